@@ -0,0 +1,275 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Offline throughput benchmark for the crossing detection hot loop.
+
+Feeds synthetic signals (sine, noise, spikes, or wrapped phase ramps like the Phase Calculator's
+output; see Test/TestSignals.h), or a recorded signal, block by block through the CrossingEngine the plugin uses, for each
+combination of signal, threshold type, voting span, buffer size and channel count. For each
+combination, prints the average time per sample, the number of events detected per second of
+processing time, and the worst-case time to process one block of all channels.
+
+Usage: CrossingBenchmark [--quick] [--seconds <s>] [--signal sine|noise|spikes|phase|file] [--file <path>]
+    --file    raw little-endian float32 samples (e.g. one channel exported from a recording),
+              normalized to zero mean and unit variance; each benchmarked channel reads it at a
+              different offset.
+*/
+
+#include "../Source/CrossingEngine.h"
+#include "../Test/TestSignals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace TestSignals;
+
+    // the synthetic signals, then the recording passed with --file
+    const int SIGNAL_FILE = NUM_SIGNAL_TYPES;
+    const int NUM_BENCHMARK_SIGNALS = NUM_SIGNAL_TYPES + 1;
+
+    const char* signalName(int signal)
+    {
+        return signal == SIGNAL_FILE ? "file" : signalNames[signal];
+    }
+
+    enum ThresholdType { THRESH_CONSTANT, THRESH_CHANNEL, THRESH_RANDOM, NUM_THRESH_TYPES };
+    const char* const thresholdNames[] = { "constant", "channel", "random" };
+
+    // past and future voting spans (0 = block kernel path)
+    const int votingSpans[] = { 0, 2, 10 };
+    const int NUM_VOTING_SPANS = sizeof(votingSpans) / sizeof(votingSpans[0]);
+
+    // Only counts crossings; anything more would measure the sink rather than the detector.
+    class CountingSink : public CrossingEngine::EventSink
+    {
+    public:
+        CountingSink() : numEvents(0) {}
+
+        void handleCrossing(const CrossingEngine::Crossing&) override
+        {
+            ++numEvents;
+        }
+
+        long long numEvents;
+    };
+
+    struct CaseResult
+    {
+        double nsPerSample;
+        double eventsPerSecond;
+        double worstBlockUs;
+        long long numEvents;
+    };
+
+    CaseResult runCase(const std::vector<std::vector<float>>& inputs, const std::vector<float>& threshChan,
+        ThresholdType threshType, int votingSpan, int bufferSize, int numChannels)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        CrossingEngine::Settings settings;
+        settings.posOn = true;
+        settings.negOn = true;
+        settings.pastSpan = votingSpan;
+        settings.futureSpan = votingSpan;
+        settings.randomThreshRange[0] = -0.5f;
+        settings.randomThreshRange[1] = 0.5f;
+
+        CrossingEngine engine;
+        engine.setSettings(settings);
+        engine.setNumChannels(numChannels);
+        engine.reserve(bufferSize);
+        engine.setRandomSeed(1);
+        engine.redrawRandomThresholds();
+
+        CountingSink sink;
+
+        const int numSamples = static_cast<int>(inputs[0].size());
+        const int numBlocks = numSamples / bufferSize;
+
+        double totalNs = 0, worstNs = 0;
+
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            const int start = b * bufferSize;
+            auto blockStart = Clock::now();
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const float* in = inputs[c % inputs.size()].data() + start;
+                switch (threshType)
+                {
+                case THRESH_CONSTANT:
+                    engine.processBlock(c, in, 0.0f, bufferSize, start, sink);
+                    break;
+
+                case THRESH_CHANNEL:
+                    engine.processBlock(c, in, threshChan.data() + start, bufferSize, start, sink);
+                    break;
+
+                default:
+                    engine.processBlockRandom(c, in, bufferSize, start, sink);
+                    break;
+                }
+            }
+
+            double blockNs = std::chrono::duration<double, std::nano>(Clock::now() - blockStart).count();
+            totalNs += blockNs;
+            worstNs = std::max(worstNs, blockNs);
+        }
+
+        CaseResult result;
+        result.nsPerSample = totalNs / (static_cast<double>(numBlocks) * bufferSize * numChannels);
+        result.eventsPerSecond = totalNs > 0 ? sink.numEvents / (totalNs * 1e-9) : 0;
+        result.worstBlockUs = worstNs * 1e-3;
+        result.numEvents = sink.numEvents;
+        return result;
+    }
+
+    void printUsage()
+    {
+        std::printf("Usage: CrossingBenchmark [--quick] [--seconds <s>] [--signal sine|noise|spikes|phase|file] [--file <path>]\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = 30.0;
+    bool quick = false;
+    int onlySignal = -1;
+    std::string filePath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+        {
+            quick = true;
+        }
+        else if (arg == "--seconds" && i + 1 < argc)
+        {
+            seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--signal" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            onlySignal = 0;
+            while (onlySignal < NUM_BENCHMARK_SIGNALS && name != signalName(onlySignal))
+            {
+                ++onlySignal;
+            }
+            if (onlySignal == NUM_BENCHMARK_SIGNALS)
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (arg == "--file" && i + 1 < argc)
+        {
+            filePath = argv[++i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (quick)
+    {
+        seconds = std::min(seconds, 2.0);
+    }
+
+    const int numSamples = std::max(4096, static_cast<int>(seconds * SAMPLE_RATE));
+
+    std::vector<float> recorded;
+    if (!filePath.empty() && !loadSignal(filePath, recorded))
+    {
+        std::fprintf(stderr, "Could not read samples from %s\n", filePath.c_str());
+        return 1;
+    }
+    if (onlySignal == SIGNAL_FILE && recorded.empty())
+    {
+        std::fprintf(stderr, "--signal file requires --file\n");
+        return 1;
+    }
+
+    const std::vector<int> bufferSizes = quick ? std::vector<int>{ 1024 } : std::vector<int>{ 64, 256, 1024, 4096 };
+    const std::vector<int> channelCounts = quick ? std::vector<int>{ 1, 16 } : std::vector<int>{ 1, 16, 64, 256 };
+
+    // a few distinct input channels, reused round-robin so that many-channel runs stay small in memory
+    const int numDistinctInputs = 4;
+    const std::vector<float> threshChan = makeSignal(SIGNAL_SINE, numSamples, 1000);
+
+    std::printf("%-7s %-9s %5s %7s %6s %12s %14s %16s %10s\n",
+        "signal", "thresh", "span", "buffer", "chans", "ns/sample", "events/s", "worst block (us)", "events");
+
+    for (int s = 0; s < NUM_BENCHMARK_SIGNALS; ++s)
+    {
+        if ((onlySignal >= 0 && s != onlySignal) || (s == SIGNAL_FILE && recorded.empty()))
+        {
+            continue;
+        }
+
+        std::vector<std::vector<float>> inputs;
+        for (int c = 0; c < numDistinctInputs; ++c)
+        {
+            if (s == SIGNAL_FILE)
+            {
+                inputs.push_back(excerpt(recorded, numSamples, c, numDistinctInputs));
+            }
+            else
+            {
+                inputs.push_back(makeSignal(static_cast<SignalType>(s), numSamples, 1 + c));
+            }
+        }
+
+        for (int t = 0; t < NUM_THRESH_TYPES; ++t)
+        {
+            for (int v = 0; v < NUM_VOTING_SPANS; ++v)
+            {
+                for (int bufferSize : bufferSizes)
+                {
+                    for (int numChannels : channelCounts)
+                    {
+                        CaseResult result = runCase(inputs, threshChan, static_cast<ThresholdType>(t),
+                            votingSpans[v], bufferSize, numChannels);
+
+                        std::printf("%-7s %-9s %5d %7d %6d %12.3f %14.0f %16.1f %10lld\n",
+                            signalName(s), thresholdNames[t], votingSpans[v], bufferSize, numChannels,
+                            result.nsPerSample, result.eventsPerSecond, result.worstBlockUs, result.numEvents);
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
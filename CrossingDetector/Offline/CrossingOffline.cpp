@@ -0,0 +1,806 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Offline crossing detection on recorded data, for tuning parameters without replaying recordings
+through the GUI.
+
+Reads a recording (memory-mapped, see RecordingReader) and feeds it block by block through the
+same CrossingEngine the plugin uses, converting settings from milliseconds to samples the same way.
+Any of the threshold, voting and timeout parameters may be given as comma-separated lists, in which
+case every combination is run. Combinations that only differ in constant threshold, strictness and
+timeout are evaluated together in one pass over each channel's data by a CrossingSweep (one lane
+per combination); otherwise (or with --no-sweep) each combination runs on its own CrossingEngine.
+Each such unit of work on one channel is an independent task for a pool of worker threads; the
+output doesn't depend on the number of threads, or on whether combinations were swept together.
+
+With --sample-type int16, sweeps run on the recording's raw samples against integer thresholds
+(CrossingSweepInt16), converting back to the plugin's units for output. This halves the data read
+per sample; a threshold is then effectively rounded to the recording's resolution, so events can
+differ from the float path where a sample is within one bit of the threshold (and interpolated
+points by rounding).
+
+Writes one CSV row per turning-on event, sorted by combination, then channel, then time. The
+columns after "timestamp" are the plugin's event metadata (full profile), named by their
+identifiers. The parameters and number of events of each combination are written to
+<output>.params.csv.
+
+Differences from the plugin:
+ - Only constant, channel and random thresholds are supported (not adaptive or average).
+ - Random thresholds are drawn from a single generator shared by all channels, as in the plugin,
+   so a combination with random thresholds runs as a single task. The plugin seeds its generator
+   randomly, so pass --seed to make runs repeatable (exact draws then match a plugin build seeded
+   the same way).
+ - With the buffer end mask on, results depend on the block size, which should then match the
+   GUI's buffer size.
+*/
+
+#include "CrossingSweep.h"
+#include "RecordingReader.h"
+#include "../Source/CrossingEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    enum ThresholdType { THRESH_CONSTANT, THRESH_CHANNEL, THRESH_RANDOM };
+
+    struct Options
+    {
+        Options()
+            : numBinaryChannels (0)
+            , bitVolts          (0.195f)
+            , sampleRate        (0)
+            , startTs           (0)
+            , blockSize         (1024)
+            , numThreads        (0)
+            , outputPath        ("events.csv")
+            , thresholdType     (THRESH_CONSTANT)
+            , thresholdChannel  (-1)
+            , seed              (0)
+            , useSeed           (false)
+            , bufferEndMaskMs   (-1)
+            , useSweep          (true)
+            , useInt16          (false)
+        {
+            randomRange[0] = -180.0f;
+            randomRange[1] = 180.0f;
+        }
+
+        std::vector<std::string> continuousPaths;
+        std::string binaryPath;
+        int numBinaryChannels;
+        float bitVolts;
+        double sampleRate;
+        int64_t startTs;
+
+        std::vector<int> channels; // monitored channels (all if empty)
+        int blockSize;
+        int numThreads;
+        std::string outputPath;
+
+        ThresholdType thresholdType;
+        int thresholdChannel;
+        float randomRange[2];
+        unsigned int seed;
+        bool useSeed;
+
+        // swept parameters
+        std::vector<float> thresholds;
+        std::vector<int> pastSpans;
+        std::vector<int> futureSpans;
+        std::vector<float> pastStricts;
+        std::vector<float> futureStricts;
+        std::vector<int> timeoutsMs;
+
+        // other settings, in the plugin's units
+        CrossingEngine::Settings baseSettings;
+        int bufferEndMaskMs; // < 0 = off
+
+        bool useSweep;
+        bool useInt16; // sweep raw samples
+    };
+
+    // one point of the parameter sweep
+    struct Combination
+    {
+        float threshold;
+        int timeoutMs;
+        CrossingEngine::Settings settings;
+    };
+
+    struct Event
+    {
+        int channel;
+        int64_t timestamp; // of the turning-on event
+        CrossingEngine::Crossing crossing;
+    };
+
+    // Combinations firstCombination to firstCombination + numCombinations - 1 on one channel
+    struct Task
+    {
+        int firstCombination;
+        int numCombinations; // > 1 only for sweeps
+        int channel;         // -1 = all monitored channels (random thresholds)
+    };
+
+    // Collects the turning-on events the plugin would add for each crossing.
+    class CollectingSink : public CrossingEngine::EventSink
+    {
+    public:
+        /* For an engine, crossing.channel indexes channelMap and all events go to events[0].
+         * For a sweep, crossing.channel is the lane, whose events go to events[lane] (on sweepChannel).
+         */
+        CollectingSink(std::vector<std::vector<Event>>& e, const int* map, int chan)
+            : events(e), channelMap(map), sweepChannel(chan)
+        {}
+
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override
+        {
+            Event event;
+            event.channel = channelMap != nullptr ? channelMap[crossing.channel] : sweepChannel;
+            // as in CrossingDetector::handleCrossing, crossings in a previous block are put at the start of this one
+            event.timestamp = crossing.crossingPoint - crossing.offset + std::max(crossing.offset, 0);
+            event.crossing = crossing;
+            events[channelMap != nullptr ? 0 : crossing.channel].push_back(event);
+        }
+
+    private:
+        std::vector<std::vector<Event>>& events;
+        const int* channelMap;
+        const int sweepChannel;
+    };
+
+    /*************** argument parsing ***************/
+
+    template <typename T>
+    bool parseList(const std::string& text, std::vector<T>& values)
+    {
+        values.clear();
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            std::stringstream itemStream(item);
+            T value;
+            if (!(itemStream >> value))
+            {
+                return false;
+            }
+            values.push_back(value);
+        }
+        return !values.empty();
+    }
+
+    void printUsage()
+    {
+        std::printf(
+            "Usage: CrossingOffline (--continuous <file.continuous>... | --binary <continuous.dat> --num-channels <n>)\n"
+            "                       [options]\n"
+            "Input:\n"
+            "  --continuous <files>      Open Ephys format, one file per channel\n"
+            "  --binary <file>           binary format (interleaved int16)\n"
+            "  --num-channels <n>        number of channels in the binary file\n"
+            "  --bit-volts <v>           binary format scale (default 0.195)\n"
+            "  --sample-rate <hz>        binary format sample rate (required for ms settings)\n"
+            "  --start-ts <ts>           binary format timestamp of the first sample (default 0)\n"
+            "  --channels <list>         channels to monitor (default all)\n"
+            "  --block-size <n>          samples per block, as the GUI's buffer size (default 1024)\n"
+            "Processing:\n"
+            "  --threads <n>             worker threads (default: number of cores)\n"
+            "  --output <file>           events CSV (default events.csv)\n"
+            "  --no-sweep                run each combination separately instead of sweeping\n"
+            "  --sample-type float|int16 sample type for sweeps (default float)\n"
+            "Detection (lists are swept):\n"
+            "  --direction rising|falling|both   (default rising)\n"
+            "  --threshold <list>        constant threshold (default 0)\n"
+            "  --threshold-channel <k>   use recorded channel k as the threshold\n"
+            "  --random-threshold <lo>,<hi>  draw a random threshold after each crossing\n"
+            "  --seed <s>                seed for random thresholds\n"
+            "  --past-span <list>        --future-span <list>\n"
+            "  --past-strict <list>      --future-strict <list>\n"
+            "  --timeout-ms <list>       (default 1000)\n"
+            "  --early-fire\n"
+            "  --jump-limit <v>          --jump-limit-sleep <samples>\n"
+            "  --buffer-end-mask-ms <ms>\n"
+            "  --interp none|linear|cubic\n");
+    }
+
+    // Returns false (after printing the problem) if the arguments are invalid.
+    bool parseArgs(int argc, char* argv[], Options& opts)
+    {
+        opts.thresholds.assign(1, 0.0f);
+        opts.pastSpans.assign(1, 0);
+        opts.futureSpans.assign(1, 0);
+        opts.pastStricts.assign(1, 1.0f);
+        opts.futureStricts.assign(1, 1.0f);
+        opts.timeoutsMs.assign(1, 1000);
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            bool ok = true;
+
+            if (arg == "--continuous")
+            {
+                while (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0)
+                {
+                    opts.continuousPaths.push_back(argv[++i]);
+                }
+                ok = !opts.continuousPaths.empty();
+            }
+            else if (arg == "--early-fire")
+            {
+                opts.baseSettings.earlyFire = true;
+            }
+            else if (arg == "--no-sweep")
+            {
+                opts.useSweep = false;
+            }
+            else if (!hasValue)
+            {
+                ok = false;
+            }
+            else
+            {
+                const std::string value = argv[++i];
+                std::vector<float> pair;
+
+                if (arg == "--binary")                  { opts.binaryPath = value; }
+                else if (arg == "--num-channels")       { opts.numBinaryChannels = std::atoi(value.c_str()); }
+                else if (arg == "--bit-volts")          { opts.bitVolts = static_cast<float>(std::atof(value.c_str())); }
+                else if (arg == "--sample-rate")        { opts.sampleRate = std::atof(value.c_str()); }
+                else if (arg == "--start-ts")           { opts.startTs = std::atoll(value.c_str()); }
+                else if (arg == "--channels")           { ok = parseList(value, opts.channels); }
+                else if (arg == "--block-size")         { opts.blockSize = std::atoi(value.c_str()); ok = opts.blockSize > 0; }
+                else if (arg == "--threads")            { opts.numThreads = std::atoi(value.c_str()); }
+                else if (arg == "--output")             { opts.outputPath = value; }
+                else if (arg == "--threshold")          { ok = parseList(value, opts.thresholds); }
+                else if (arg == "--past-span")          { ok = parseList(value, opts.pastSpans); }
+                else if (arg == "--future-span")        { ok = parseList(value, opts.futureSpans); }
+                else if (arg == "--past-strict")        { ok = parseList(value, opts.pastStricts); }
+                else if (arg == "--future-strict")      { ok = parseList(value, opts.futureStricts); }
+                else if (arg == "--timeout-ms")         { ok = parseList(value, opts.timeoutsMs); }
+                else if (arg == "--jump-limit")
+                {
+                    opts.baseSettings.useJumpLimit = true;
+                    opts.baseSettings.jumpLimit = static_cast<float>(std::atof(value.c_str()));
+                }
+                else if (arg == "--jump-limit-sleep")   { opts.baseSettings.jumpLimitSleep = static_cast<float>(std::atof(value.c_str())); }
+                else if (arg == "--buffer-end-mask-ms") { opts.bufferEndMaskMs = std::atoi(value.c_str()); }
+                else if (arg == "--seed")
+                {
+                    opts.seed = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+                    opts.useSeed = true;
+                }
+                else if (arg == "--threshold-channel")
+                {
+                    opts.thresholdType = THRESH_CHANNEL;
+                    opts.thresholdChannel = std::atoi(value.c_str());
+                }
+                else if (arg == "--random-threshold")
+                {
+                    ok = parseList(value, pair) && pair.size() == 2;
+                    if (ok)
+                    {
+                        opts.thresholdType = THRESH_RANDOM;
+                        opts.randomRange[0] = std::min(pair[0], pair[1]);
+                        opts.randomRange[1] = std::max(pair[0], pair[1]);
+                    }
+                }
+                else if (arg == "--sample-type")
+                {
+                    opts.useInt16 = value == "int16";
+                    ok = opts.useInt16 || value == "float";
+                }
+                else if (arg == "--direction")
+                {
+                    opts.baseSettings.posOn = value == "rising" || value == "both";
+                    opts.baseSettings.negOn = value == "falling" || value == "both";
+                    ok = opts.baseSettings.posOn || opts.baseSettings.negOn;
+                }
+                else if (arg == "--interp")
+                {
+                    if (value == "none")        { opts.baseSettings.interpolation = CrossingEngine::INTERP_NONE; }
+                    else if (value == "linear") { opts.baseSettings.interpolation = CrossingEngine::INTERP_LINEAR; }
+                    else if (value == "cubic")  { opts.baseSettings.interpolation = CrossingEngine::INTERP_CUBIC; }
+                    else                        { ok = false; }
+                }
+                else
+                {
+                    ok = false;
+                }
+            }
+
+            if (!ok)
+            {
+                std::fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+                return false;
+            }
+        }
+
+        if (opts.continuousPaths.empty() == opts.binaryPath.empty())
+        {
+            std::fprintf(stderr, "Give either --continuous or --binary\n");
+            return false;
+        }
+
+        return true;
+    }
+
+    /*************** detection ***************/
+
+    /* Same conversions as CrossingDetector::updateSampleRateDependentValues. Combinations with
+     * the same voting spans are consecutive, so that they can be swept together.
+     */
+    std::vector<Combination> makeCombinations(const Options& opts, float sampleRate)
+    {
+        CrossingEngine::Settings base = opts.baseSettings;
+        base.randomThreshRange[0] = opts.randomRange[0];
+        base.randomThreshRange[1] = opts.randomRange[1];
+        base.useBufferEndMask = opts.bufferEndMaskMs >= 0;
+        base.bufferEndMaskSamp = base.useBufferEndMask
+            ? int(std::ceil(opts.bufferEndMaskMs * sampleRate / 1000.0f)) : 0;
+
+        // the constant threshold is only swept if it's used
+        const std::vector<float> thresholds = opts.thresholdType == THRESH_CONSTANT
+            ? opts.thresholds : std::vector<float>(1, 0.0f);
+
+        std::vector<Combination> combinations;
+        for (int pastSpan : opts.pastSpans)
+        for (int futureSpan : opts.futureSpans)
+        for (float threshold : thresholds)
+        for (float pastStrict : opts.pastStricts)
+        for (float futureStrict : opts.futureStricts)
+        for (int timeoutMs : opts.timeoutsMs)
+        {
+            Combination combination;
+            combination.threshold = threshold;
+            combination.timeoutMs = timeoutMs;
+            combination.settings = base;
+            combination.settings.pastSpan = pastSpan;
+            combination.settings.futureSpan = futureSpan;
+            combination.settings.pastStrict = pastStrict;
+            combination.settings.futureStrict = futureStrict;
+            combination.settings.timeoutSamp = int(std::floor(timeoutMs * sampleRate / 1000.0f));
+            combinations.push_back(combination);
+        }
+
+        return combinations;
+    }
+
+    // Whether combinations with the same voting spans can be evaluated as lanes of a CrossingSweep.
+    bool canSweep(const Options& opts, const Combination& combination)
+    {
+        return opts.useSweep && opts.thresholdType == THRESH_CONSTANT && CrossingSweep::supports(combination.settings);
+    }
+
+    // Runs one combination on the given channels, processing them in order within each block as process() does.
+    void runEngineTask(const RecordingReader& reader, const Options& opts, const Combination& combination,
+        const std::vector<int>& channels, std::vector<std::vector<Event>>& events)
+    {
+        const int numChannels = static_cast<int>(channels.size());
+        const int blockSize = opts.blockSize;
+
+        CrossingEngine engine;
+        engine.setSettings(combination.settings);
+        engine.setNumChannels(numChannels);
+        engine.reserve(blockSize);
+        if (opts.thresholdType == THRESH_RANDOM)
+        {
+            if (opts.useSeed)
+            {
+                engine.setRandomSeed(opts.seed);
+            }
+            engine.redrawRandomThresholds();
+        }
+
+        CollectingSink sink(events, channels.data(), -1);
+
+        std::vector<float> input(blockSize);
+        std::vector<float> threshold(opts.thresholdType == THRESH_CHANNEL ? blockSize : 0);
+
+        const int64_t numSamples = reader.getNumSamples();
+        for (int64_t start = 0; start < numSamples; start += blockSize)
+        {
+            const int n = static_cast<int>(std::min<int64_t>(blockSize, numSamples - start));
+            const int64_t startTs = reader.getStartTimestamp() + start;
+
+            if (opts.thresholdType == THRESH_CHANNEL)
+            {
+                reader.readSamples(opts.thresholdChannel, start, n, threshold.data());
+            }
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                reader.readSamples(channels[c], start, n, input.data());
+
+                switch (opts.thresholdType)
+                {
+                case THRESH_CONSTANT:
+                    engine.processBlock(c, input.data(), combination.threshold, n, startTs, sink);
+                    break;
+
+                case THRESH_CHANNEL:
+                    engine.processBlock(c, input.data(), threshold.data(), n, startTs, sink);
+                    break;
+
+                case THRESH_RANDOM:
+                    engine.processBlockRandom(c, input.data(), n, startTs, sink);
+                    break;
+                }
+            }
+        }
+
+        // within a task, events are in time order per channel
+        std::stable_sort(events[0].begin(), events[0].end(), [](const Event& a, const Event& b)
+        {
+            return a.channel < b.channel;
+        });
+    }
+
+    // Scales crossings found by a sweep on raw samples back to the plugin's units.
+    class RawScalingSink : public CrossingEngine::EventSink
+    {
+    public:
+        RawScalingSink(CrossingEngine::EventSink& d, float bv, const Combination* c)
+            : dest(d), bitVolts(bv), combinations(c)
+        {}
+
+        void handleCrossing(const CrossingEngine::Crossing& rawCrossing) override
+        {
+            CrossingEngine::Crossing crossing = rawCrossing;
+            crossing.level = rawCrossing.level * bitVolts; // as in RecordingReader::readSamples
+            crossing.threshold = combinations[rawCrossing.channel].threshold;
+            dest.handleCrossing(crossing);
+        }
+
+    private:
+        CrossingEngine::EventSink& dest;
+        const float bitVolts;
+        const Combination* const combinations;
+    };
+
+    void readBlock(const RecordingReader& reader, int channel, int64_t start, int n, float* dest)
+    {
+        reader.readSamples(channel, start, n, dest);
+    }
+
+    void readBlock(const RecordingReader& reader, int channel, int64_t start, int n, int16_t* dest)
+    {
+        reader.readRawSamples(channel, start, n, dest);
+    }
+
+    template <typename Sample>
+    void runSweep(const RecordingReader& reader, const Options& opts, const Combination* combinations,
+        const std::vector<CrossingSweep::Lane>& lanes, int channel, CrossingEngine::EventSink& sink)
+    {
+        BasicCrossingSweep<Sample> sweep(combinations[0].settings, lanes);
+        sweep.reserve(opts.blockSize);
+
+        std::vector<Sample> input(opts.blockSize);
+
+        const int64_t numSamples = reader.getNumSamples();
+        for (int64_t start = 0; start < numSamples; start += opts.blockSize)
+        {
+            const int n = static_cast<int>(std::min<int64_t>(opts.blockSize, numSamples - start));
+            readBlock(reader, channel, start, n, input.data());
+            sweep.processBlock(input.data(), n, reader.getStartTimestamp() + start, sink);
+        }
+    }
+
+    // Runs a group of swept combinations on one channel, reading each block once for all of them.
+    void runSweepTask(const RecordingReader& reader, const Options& opts, const Combination* combinations,
+        int numCombinations, int channel, std::vector<std::vector<Event>>& events)
+    {
+        // raw thresholds are in units of bitVolts
+        const float thresholdScale = opts.useInt16 ? 1.0f / reader.getBitVolts(channel) : 1.0f;
+
+        std::vector<CrossingSweep::Lane> lanes;
+        for (int i = 0; i < numCombinations; ++i)
+        {
+            CrossingSweep::Lane lane;
+            lane.posOn = combinations[i].settings.posOn;
+            lane.negOn = combinations[i].settings.negOn;
+            lane.threshold = combinations[i].threshold * thresholdScale;
+            lane.pastSpan = combinations[i].settings.pastSpan;
+            lane.futureSpan = combinations[i].settings.futureSpan;
+            lane.pastStrict = combinations[i].settings.pastStrict;
+            lane.futureStrict = combinations[i].settings.futureStrict;
+            lane.timeoutSamp = combinations[i].settings.timeoutSamp;
+            lanes.push_back(lane);
+        }
+
+        CollectingSink sink(events, nullptr, channel);
+        if (opts.useInt16)
+        {
+            RawScalingSink rawSink(sink, reader.getBitVolts(channel), combinations);
+            runSweep<int16_t>(reader, opts, combinations, lanes, channel, rawSink);
+        }
+        else
+        {
+            runSweep<float>(reader, opts, combinations, lanes, channel, sink);
+        }
+    }
+
+    // Divides the combinations into tasks, grouped by first combination and then ordered by channel.
+    std::vector<Task> makeTasks(const Options& opts, const std::vector<Combination>& combinations)
+    {
+        std::vector<Task> tasks;
+        const int numCombinations = static_cast<int>(combinations.size());
+
+        for (int first = 0, count = 1; first < numCombinations; first += count)
+        {
+            const Combination& firstCombination = combinations[first];
+            count = 1;
+            if (canSweep(opts, firstCombination))
+            {
+                while (first + count < numCombinations &&
+                    combinations[first + count].settings.pastSpan == firstCombination.settings.pastSpan &&
+                    combinations[first + count].settings.futureSpan == firstCombination.settings.futureSpan)
+                {
+                    ++count;
+                }
+            }
+
+            if (opts.thresholdType == THRESH_RANDOM)
+            {
+                Task task = { first, count, -1 };
+                tasks.push_back(task);
+            }
+            else
+            {
+                for (int c : opts.channels)
+                {
+                    Task task = { first, count, c };
+                    tasks.push_back(task);
+                }
+            }
+        }
+
+        return tasks;
+    }
+
+    /*************** output ***************/
+
+    void writeEventHeader(FILE* file, bool interpolated)
+    {
+        std::fprintf(file, "combination,timestamp,crossing.point,crossing.level,crossing.threshold,"
+            "crossing.direction,crossing.threshold.learningrate,%scrossing.latency,crossing.source.channel\n",
+            interpolated ? "crossing.point.interpolated," : "");
+    }
+
+    void writeEvents(FILE* file, int combination, const std::vector<Event>& events, bool interpolated)
+    {
+        for (const Event& event : events)
+        {
+            const CrossingEngine::Crossing& c = event.crossing;
+
+            // %.9g round-trips floats; %.17g round-trips doubles
+            std::fprintf(file, "%d,%lld,%lld,%.9g,%.9g,%d,0,", combination,
+                static_cast<long long>(event.timestamp), static_cast<long long>(c.crossingPoint),
+                c.level, c.threshold, c.rising ? 1 : 0);
+
+            if (interpolated)
+            {
+                std::fprintf(file, "%.17g,", c.interpolatedPoint);
+            }
+
+            std::fprintf(file, "%d,%d\n", c.decisionOffset - c.offset, event.channel);
+        }
+    }
+
+    bool writeParams(const std::string& path, const std::vector<Combination>& combinations,
+        const std::vector<long long>& numEvents, const Options& opts)
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            return false;
+        }
+
+        std::fprintf(file, "combination,threshold,pastSpan,futureSpan,pastStrict,futureStrict,timeoutMs,events\n");
+        for (size_t i = 0; i < combinations.size(); ++i)
+        {
+            const Combination& combination = combinations[i];
+            char threshold[32];
+            if (opts.thresholdType == THRESH_CONSTANT)
+            {
+                std::snprintf(threshold, sizeof(threshold), "%.9g", combination.threshold);
+            }
+            else
+            {
+                std::snprintf(threshold, sizeof(threshold), "%s", opts.thresholdType == THRESH_CHANNEL ? "channel" : "random");
+            }
+
+            std::fprintf(file, "%d,%s,%d,%d,%g,%g,%d,%lld\n", static_cast<int>(i), threshold,
+                combination.settings.pastSpan, combination.settings.futureSpan,
+                combination.settings.pastStrict, combination.settings.futureStrict, combination.timeoutMs,
+                numEvents[i]);
+        }
+
+        return std::fclose(file) == 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (argc < 2 || !parseArgs(argc, argv, opts))
+    {
+        printUsage();
+        return 1;
+    }
+
+    RecordingReader reader;
+    std::string error;
+    bool opened = opts.binaryPath.empty()
+        ? reader.openContinuous(opts.continuousPaths, error)
+        : reader.openBinary(opts.binaryPath, opts.numBinaryChannels, opts.bitVolts, opts.sampleRate, opts.startTs, error);
+
+    if (!opened)
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    if (reader.getSampleRate() <= 0)
+    {
+        std::fprintf(stderr, "Unknown sample rate; pass --sample-rate\n");
+        return 1;
+    }
+
+    if (opts.channels.empty())
+    {
+        for (int c = 0; c < reader.getNumChannels(); ++c)
+        {
+            opts.channels.push_back(c);
+        }
+    }
+
+    for (int c : opts.channels)
+    {
+        if (c < 0 || c >= reader.getNumChannels())
+        {
+            std::fprintf(stderr, "Channel %d is out of range (the recording has %d)\n", c, reader.getNumChannels());
+            return 1;
+        }
+    }
+
+    if (opts.thresholdType == THRESH_CHANNEL &&
+        (opts.thresholdChannel < 0 || opts.thresholdChannel >= reader.getNumChannels()))
+    {
+        std::fprintf(stderr, "Threshold channel %d is out of range\n", opts.thresholdChannel);
+        return 1;
+    }
+
+    // the plugin gets its sample rate as a float
+    const std::vector<Combination> combinations = makeCombinations(opts, static_cast<float>(reader.getSampleRate()));
+
+    const std::vector<Task> tasks = makeTasks(opts, combinations);
+
+    FILE* out = std::fopen(opts.outputPath.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "Could not write output to %s\n", opts.outputPath.c_str());
+        return 1;
+    }
+
+    const bool interpolated = opts.baseSettings.interpolation != CrossingEngine::INTERP_NONE;
+    writeEventHeader(out, interpolated);
+
+    // Workers take the next task in order; the main thread writes results in combination, then
+    // channel order as they finish, so that output is deterministic and finished results don't accumulate.
+    typedef std::vector<std::vector<Event>> TaskResult; // events of each combination of a task
+    std::vector<std::unique_ptr<TaskResult>> results(tasks.size());
+    std::mutex resultMutex;
+    std::condition_variable resultReady;
+    std::atomic<size_t> nextTask(0);
+
+    int numThreads = opts.numThreads > 0 ? opts.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    numThreads = std::max(1, std::min(numThreads, static_cast<int>(tasks.size())));
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            for (size_t i = nextTask++; i < tasks.size(); i = nextTask++)
+            {
+                const Task& task = tasks[i];
+                std::unique_ptr<TaskResult> events(new TaskResult(task.numCombinations));
+
+                if (canSweep(opts, combinations[task.firstCombination]))
+                {
+                    runSweepTask(reader, opts, &combinations[task.firstCombination], task.numCombinations,
+                        task.channel, *events);
+                }
+                else
+                {
+                    const std::vector<int> channels = task.channel >= 0 ? std::vector<int>(1, task.channel) : opts.channels;
+                    runEngineTask(reader, opts, combinations[task.firstCombination], channels, *events);
+                }
+
+                std::lock_guard<std::mutex> lock(resultMutex);
+                results[i] = std::move(events);
+                resultReady.notify_one();
+            }
+        }));
+    }
+
+    std::vector<long long> numEvents(combinations.size(), 0);
+    long long totalEvents = 0;
+
+    for (size_t groupStart = 0, groupEnd; groupStart < tasks.size(); groupStart = groupEnd)
+    {
+        // tasks for the same combinations (one per channel)
+        for (groupEnd = groupStart + 1; groupEnd < tasks.size() &&
+            tasks[groupEnd].firstCombination == tasks[groupStart].firstCombination; ++groupEnd) {}
+
+        std::vector<std::unique_ptr<TaskResult>> group;
+        for (size_t i = groupStart; i < groupEnd; ++i)
+        {
+            std::unique_lock<std::mutex> lock(resultMutex);
+            resultReady.wait(lock, [&]() { return results[i] != nullptr; });
+            group.push_back(std::move(results[i]));
+        }
+
+        for (int k = 0; k < tasks[groupStart].numCombinations; ++k)
+        {
+            const int combination = tasks[groupStart].firstCombination + k;
+            for (const std::unique_ptr<TaskResult>& taskResult : group)
+            {
+                writeEvents(out, combination, (*taskResult)[k], interpolated);
+                numEvents[combination] += static_cast<long long>((*taskResult)[k].size());
+            }
+            totalEvents += numEvents[combination];
+        }
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (std::fclose(out) != 0 || !writeParams(opts.outputPath + ".params.csv", combinations, numEvents, opts))
+    {
+        std::fprintf(stderr, "Error writing %s\n", opts.outputPath.c_str());
+        return 1;
+    }
+
+    std::printf("%lld events from %d combination(s) x %d channel(s) written to %s\n", totalEvents,
+        static_cast<int>(combinations.size()), static_cast<int>(opts.channels.size()), opts.outputPath.c_str());
+    return 0;
+}
@@ -0,0 +1,367 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "RecordingReader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*************** MappedFile ***************/
+
+MappedFile::MappedFile()
+    : data      (nullptr)
+    , size      (0)
+#ifdef _WIN32
+    , fileHandle    (INVALID_HANDLE_VALUE)
+    , mappingHandle (nullptr)
+#endif
+{}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    data = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // data is mostly read front to back, one block at a time
+    madvise(mapped, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data = static_cast<const unsigned char*>(mapped);
+    size = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(data), size);
+    }
+#endif
+
+    data = nullptr;
+    size = 0;
+}
+
+const unsigned char* MappedFile::getData() const
+{
+    return data;
+}
+
+size_t MappedFile::getSize() const
+{
+    return size;
+}
+
+/*************** RecordingReader ***************/
+
+RecordingReader::RecordingReader()
+    : format            (FORMAT_NONE)
+    , numChannels       (0)
+    , numSamples        (0)
+    , sampleRate        (0)
+    , startTimestamp    (0)
+{}
+
+bool RecordingReader::openContinuous(const std::vector<std::string>& paths, std::string& error)
+{
+    format = FORMAT_NONE;
+    files.clear();
+    bitVolts.clear();
+
+    if (paths.empty())
+    {
+        error = "No .continuous files given";
+        return false;
+    }
+
+    numSamples = INT64_MAX;
+    for (size_t c = 0; c < paths.size(); ++c)
+    {
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if (!file->open(paths[c]) || file->getSize() < CONTINUOUS_HEADER_BYTES + CONTINUOUS_RECORD_BYTES)
+        {
+            error = "Could not map " + paths[c] + " (missing or too short)";
+            return false;
+        }
+
+        std::string header(reinterpret_cast<const char*>(file->getData()), CONTINUOUS_HEADER_BYTES);
+        std::string value;
+
+        if (!getHeaderValue(header, "bitVolts", value))
+        {
+            error = paths[c] + " does not have an Open Ephys .continuous header";
+            return false;
+        }
+        bitVolts.push_back(static_cast<float>(std::atof(value.c_str())));
+
+        if (getHeaderValue(header, "sampleRate", value))
+        {
+            double rate = std::atof(value.c_str());
+            if (c > 0 && rate != sampleRate)
+            {
+                error = paths[c] + " has a different sample rate than " + paths[0];
+                return false;
+            }
+            sampleRate = rate;
+        }
+
+        // truncate to the shortest file (the last record may be incomplete if recording was interrupted)
+        int64_t numRecords = static_cast<int64_t>((file->getSize() - CONTINUOUS_HEADER_BYTES) / CONTINUOUS_RECORD_BYTES);
+        numSamples = std::min(numSamples, numRecords * CONTINUOUS_RECORD_SAMPLES);
+
+        if (c == 0)
+        {
+            // first record timestamp, little-endian
+            int64_t ts;
+            std::copy(file->getData() + CONTINUOUS_HEADER_BYTES,
+                file->getData() + CONTINUOUS_HEADER_BYTES + sizeof(ts), reinterpret_cast<unsigned char*>(&ts));
+            startTimestamp = ts;
+        }
+
+        files.push_back(std::move(file));
+    }
+
+    numChannels = static_cast<int>(paths.size());
+    format = FORMAT_CONTINUOUS;
+    return true;
+}
+
+bool RecordingReader::openBinary(const std::string& path, int nChannels, float bv, double rate,
+    int64_t startTs, std::string& error)
+{
+    format = FORMAT_NONE;
+    files.clear();
+    bitVolts.clear();
+
+    if (nChannels <= 0)
+    {
+        error = "The number of channels of a binary recording must be given";
+        return false;
+    }
+
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path))
+    {
+        error = "Could not map " + path;
+        return false;
+    }
+
+    numChannels = nChannels;
+    numSamples = static_cast<int64_t>(file->getSize() / (sizeof(int16_t) * nChannels));
+    sampleRate = rate;
+    startTimestamp = startTs;
+    bitVolts.assign(nChannels, bv);
+    files.push_back(std::move(file));
+
+    format = FORMAT_BINARY;
+    return true;
+}
+
+int RecordingReader::getNumChannels() const
+{
+    return numChannels;
+}
+
+int64_t RecordingReader::getNumSamples() const
+{
+    return numSamples;
+}
+
+double RecordingReader::getSampleRate() const
+{
+    return sampleRate;
+}
+
+int64_t RecordingReader::getStartTimestamp() const
+{
+    return startTimestamp;
+}
+
+template <typename Store>
+void RecordingReader::decodeSamples(int chan, int64_t start, int count, Store store) const
+{
+    assert(chan >= 0 && chan < numChannels);
+    assert(start >= 0 && start + count <= numSamples);
+
+    if (format == FORMAT_CONTINUOUS)
+    {
+        const unsigned char* base = files[chan]->getData() + CONTINUOUS_HEADER_BYTES;
+
+        int64_t record = start / CONTINUOUS_RECORD_SAMPLES;
+        int indInRecord = static_cast<int>(start % CONTINUOUS_RECORD_SAMPLES);
+
+        for (int i = 0; i < count; ++record, indInRecord = 0)
+        {
+            const unsigned char* samples = base + record * CONTINUOUS_RECORD_BYTES + 12;
+            int n = std::min(count - i, CONTINUOUS_RECORD_SAMPLES - indInRecord);
+
+            for (int k = indInRecord; k < indInRecord + n; ++k, ++i)
+            {
+                // big-endian
+                int16_t raw = static_cast<int16_t>((samples[2 * k] << 8) | samples[2 * k + 1]);
+                store(i, raw);
+            }
+        }
+    }
+    else if (format == FORMAT_BINARY)
+    {
+        const unsigned char* base = files[0]->getData();
+        const size_t frameBytes = sizeof(int16_t) * numChannels;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const unsigned char* sample = base + (start + i) * frameBytes + sizeof(int16_t) * chan;
+            // little-endian
+            int16_t raw = static_cast<int16_t>(sample[0] | (sample[1] << 8));
+            store(i, raw);
+        }
+    }
+}
+
+void RecordingReader::readSamples(int chan, int64_t start, int count, float* dest) const
+{
+    const float bv = bitVolts[chan];
+    decodeSamples(chan, start, count, [dest, bv](int i, int16_t raw) { dest[i] = raw * bv; });
+}
+
+void RecordingReader::readRawSamples(int chan, int64_t start, int count, int16_t* dest) const
+{
+    decodeSamples(chan, start, count, [dest](int i, int16_t raw) { dest[i] = raw; });
+}
+
+float RecordingReader::getBitVolts(int chan) const
+{
+    assert(chan >= 0 && chan < numChannels);
+    return bitVolts[chan];
+}
+
+bool RecordingReader::getHeaderValue(const std::string& header, const std::string& key, std::string& value)
+{
+    size_t keyPos = header.find("header." + key);
+    if (keyPos == std::string::npos)
+    {
+        return false;
+    }
+
+    size_t eqPos = header.find('=', keyPos);
+    size_t endPos = header.find(';', keyPos);
+    if (eqPos == std::string::npos || endPos == std::string::npos || endPos < eqPos)
+    {
+        return false;
+    }
+
+    value = header.substr(eqPos + 1, endPos - eqPos - 1);
+
+    // strip spaces and quotes
+    value.erase(std::remove_if(value.begin(), value.end(), [](char ch)
+    {
+        return ch == ' ' || ch == '\'' || ch == '"';
+    }), value.end());
+
+    return !value.empty();
+}
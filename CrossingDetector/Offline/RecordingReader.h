@@ -0,0 +1,127 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RECORDING_READER_H_INCLUDED
+#define RECORDING_READER_H_INCLUDED
+
+/*
+Read-only access to continuous data recorded by the Open Ephys GUI, for offline processing.
+
+Supports the two formats written by the 0.4 Record Node:
+ - "Open Ephys" format: one .continuous file per channel, made up of a 1024-byte text header
+   followed by records of 1024 big-endian int16 samples, each preceded by its timestamp.
+ - Binary format: a continuous.dat file with interleaved little-endian int16 samples.
+
+Files are memory-mapped, and samples are converted to floats (int16 * bitVolts, as the GUI does
+when the data reaches a processor's buffer) only for the range requested. The raw int16 samples
+can also be read directly. After opening, the
+reader may be used from several threads at once.
+*/
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Maps the given file, unmapping any previous one. Returns false on failure.
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* getData() const;
+    size_t getSize() const;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    const unsigned char* data;
+    size_t size;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+class RecordingReader
+{
+public:
+    RecordingReader();
+
+    /** Opens a set of .continuous files, one per channel, recorded together.
+     *  Returns false and sets error on failure.
+     */
+    bool openContinuous(const std::vector<std::string>& paths, std::string& error);
+
+    /** Opens a binary-format continuous.dat file. bitVolts applies to all channels. The
+     *  binary format doesn't store the sample rate or timestamps in the data file, so they
+     *  must be supplied (see the structure.oebin and timestamps.npy files of the recording).
+     */
+    bool openBinary(const std::string& path, int numChannels, float bitVolts, double sampleRate,
+        int64_t startTimestamp, std::string& error);
+
+    int getNumChannels() const;
+    int64_t getNumSamples() const;   // per channel
+    double getSampleRate() const;    // 0 if unknown
+    int64_t getStartTimestamp() const;
+
+    /** Converts numSamples samples of a channel, starting at sample index start, into dest. */
+    void readSamples(int chan, int64_t start, int numSamples, float* dest) const;
+
+    /** Copies numSamples raw samples of a channel (in units of getBitVolts(chan)) into dest. */
+    void readRawSamples(int chan, int64_t start, int numSamples, int16_t* dest) const;
+
+    float getBitVolts(int chan) const;
+
+private:
+    enum Format { FORMAT_NONE, FORMAT_CONTINUOUS, FORMAT_BINARY };
+
+    static const int CONTINUOUS_HEADER_BYTES = 1024;
+    static const int CONTINUOUS_RECORD_SAMPLES = 1024;
+    // timestamp (8) + number of samples (2) + recording number (2) + samples + record marker (10)
+    static const int CONTINUOUS_RECORD_BYTES = 8 + 2 + 2 + 2 * CONTINUOUS_RECORD_SAMPLES + 10;
+
+    // Finds "header.<key> = <value>;" in a .continuous header and returns the value as a string.
+    static bool getHeaderValue(const std::string& header, const std::string& key, std::string& value);
+
+    // Calls store(i, raw) for each of the requested samples of a channel.
+    template <typename Store>
+    void decodeSamples(int chan, int64_t start, int numSamples, Store store) const;
+
+    Format format;
+    std::vector<std::unique_ptr<MappedFile>> files; // one per channel (continuous) or one in total (binary)
+    std::vector<float> bitVolts;                     // per channel
+    int numChannels;
+    int64_t numSamples;
+    double sampleRate;
+    int64_t startTimestamp;
+};
+
+#endif // RECORDING_READER_H_INCLUDED
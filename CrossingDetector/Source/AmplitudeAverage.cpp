@@ -0,0 +1,274 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AmplitudeAverage.h"
+#include "CrossingKernels.h" // for SIMD selection
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+    // out[i] = multiplier * sqrt(meanSquares[i])
+    void scaledSqrt(const double* meanSquares, int n, float multiplier, float* out)
+    {
+        int i = 0;
+#if CROSSING_KERNELS_AVX
+        const __m256 mult = _mm256_set1_ps(multiplier);
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(meanSquares + i));
+            __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(meanSquares + i + 4));
+            __m256 ms = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(mult, _mm256_sqrt_ps(ms)));
+        }
+#elif CROSSING_KERNELS_SSE2
+        const __m128 mult = _mm_set1_ps(multiplier);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(meanSquares + i));
+            __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(meanSquares + i + 2));
+            __m128 ms = _mm_movelh_ps(lo, hi);
+            _mm_storeu_ps(out + i, _mm_mul_ps(mult, _mm_sqrt_ps(ms)));
+        }
+#elif CROSSING_KERNELS_NEON
+        const float32x4_t mult = vdupq_n_f32(multiplier);
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x2_t lo = vcvt_f32_f64(vld1q_f64(meanSquares + i));
+            float32x2_t hi = vcvt_f32_f64(vld1q_f64(meanSquares + i + 2));
+            vst1q_f32(out + i, vmulq_f32(mult, vsqrtq_f32(vcombine_f32(lo, hi))));
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            out[i] = multiplier * std::sqrt(static_cast<float>(meanSquares[i]));
+        }
+    }
+}
+
+AmplitudeAverage::AmplitudeAverage()
+    : window        (WINDOW_EXPONENTIAL)
+    , needsInit     (true)
+    , newSampWeight (1.0)
+    , meanSquare    (0.0)
+    , boxcarLength  (1)
+    , ringPos       (0)
+    , numFilled     (0)
+    , squareSum     (0.0)
+{}
+
+void AmplitudeAverage::configure(Window newWindow, double lengthSamples)
+{
+    window = newWindow;
+    lengthSamples = std::max(1.0, lengthSamples);
+    newSampWeight = 1.0 / lengthSamples;
+
+    if (window == WINDOW_BOXCAR)
+    {
+        int newLength = static_cast<int>(std::ceil(lengthSamples));
+        if (newLength != boxcarLength || squares.empty())
+        {
+            boxcarLength = newLength;
+            squares.assign(boxcarLength, 0.0);
+            ringPos = 0;
+            numFilled = 0;
+            squareSum = 0.0;
+        }
+    }
+    else
+    {
+        // the boxcar history isn't kept up to date while it's not in use
+        std::vector<double>().swap(squares);
+    }
+}
+
+AmplitudeAverage::Window AmplitudeAverage::getWindow() const
+{
+    return window;
+}
+
+void AmplitudeAverage::reserve(int maxBlockLength)
+{
+    if (blockMeanSquares.size() < static_cast<size_t>(maxBlockLength))
+    {
+        blockMeanSquares.resize(maxBlockLength);
+    }
+}
+
+void AmplitudeAverage::restart()
+{
+    needsInit = true;
+    meanSquare = 0.0;
+    std::fill(squares.begin(), squares.end(), 0.0);
+    ringPos = 0;
+    numFilled = 0;
+    squareSum = 0.0;
+}
+
+void AmplitudeAverage::process(const float* input, int numSamples, float multiplier, float* rmsOut)
+{
+    if (numSamples <= 0)
+    {
+        return;
+    }
+
+    reserve(numSamples);
+    double* const ms = blockMeanSquares.data();
+
+    if (window == WINDOW_BOXCAR)
+    {
+        processBoxcar(input, numSamples, ms);
+    }
+    else
+    {
+        processExponential(input, numSamples, ms);
+    }
+
+    if (rmsOut != nullptr)
+    {
+        scaledSqrt(ms, numSamples, multiplier, rmsOut);
+    }
+}
+
+double AmplitudeAverage::getMeanSquare() const
+{
+    if (window == WINDOW_BOXCAR)
+    {
+        return numFilled > 0 ? squareSum / numFilled : 0.0;
+    }
+    return meanSquare;
+}
+
+void AmplitudeAverage::processExponential(const float* input, int n, double* ms)
+{
+    if (needsInit)
+    {
+        meanSquare = static_cast<double>(input[0]) * input[0];
+        needsInit = false;
+    }
+
+    const double w = newSampWeight;
+    const double a = 1.0 - w;
+
+    /* Each new sample depends on the previous one, which limits a plain loop to one sample per
+     * floating-point latency. Instead, the block is split into NUM_CHAINS segments whose
+     * recurrences start from 0 and run interleaved; then, since the true value at index k of
+     * segment s is its local value plus a^(k+1) times the true value at the end of segment s-1,
+     * all segments are corrected in a second interleaved pass.
+     */
+    const int NUM_CHAINS = 4;
+    const int segLength = n / NUM_CHAINS;
+
+    if (segLength < 16)
+    {
+        double y = meanSquare;
+        for (int i = 0; i < n; ++i)
+        {
+            y = a * y + w * (static_cast<double>(input[i]) * input[i]);
+            ms[i] = y;
+        }
+        meanSquare = y;
+        return;
+    }
+
+    // local recurrences (the last segment also takes the remainder)
+    double y[NUM_CHAINS] = {};
+    for (int k = 0; k < segLength; ++k)
+    {
+        for (int s = 0; s < NUM_CHAINS; ++s)
+        {
+            const int i = s * segLength + k;
+            y[s] = a * y[s] + w * (static_cast<double>(input[i]) * input[i]);
+            ms[i] = y[s];
+        }
+    }
+
+    double& yLast = y[NUM_CHAINS - 1];
+    for (int i = NUM_CHAINS * segLength; i < n; ++i)
+    {
+        yLast = a * yLast + w * (static_cast<double>(input[i]) * input[i]);
+        ms[i] = yLast;
+    }
+
+    // true values just before each segment
+    const double decayOverSegment = std::pow(a, segLength);
+    double start[NUM_CHAINS];
+    start[0] = meanSquare;
+    for (int s = 1; s < NUM_CHAINS; ++s)
+    {
+        start[s] = ms[s * segLength - 1] + decayOverSegment * start[s - 1];
+    }
+
+    // corrections
+    double decay = 1.0; // a^(k+1)
+    for (int k = 0; k < segLength; ++k)
+    {
+        decay *= a;
+        for (int s = 0; s < NUM_CHAINS; ++s)
+        {
+            ms[s * segLength + k] += decay * start[s];
+        }
+    }
+
+    const double lastStart = start[NUM_CHAINS - 1];
+    for (int i = NUM_CHAINS * segLength; i < n; ++i)
+    {
+        decay *= a;
+        ms[i] += decay * lastStart;
+    }
+
+    meanSquare = ms[n - 1];
+}
+
+void AmplitudeAverage::processBoxcar(const float* input, int n, double* ms)
+{
+    if (squares.empty())
+    {
+        // not configured as a boxcar
+        configure(WINDOW_BOXCAR, boxcarLength);
+    }
+    needsInit = false;
+
+    for (int i = 0; i < n; ++i)
+    {
+        const double square = static_cast<double>(input[i]) * input[i];
+        squareSum += square - squares[ringPos];
+        squares[ringPos] = square;
+
+        if (numFilled < boxcarLength)
+        {
+            ++numFilled;
+        }
+
+        if (++ringPos == boxcarLength)
+        {
+            // once per window, recompute the sum to discard accumulated rounding error
+            ringPos = 0;
+            squareSum = std::accumulate(squares.begin(), squares.end(), 0.0);
+        }
+
+        ms[i] = squareSum / numFilled;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef AMPLITUDE_AVERAGE_H_INCLUDED
+#define AMPLITUDE_AVERAGE_H_INCLUDED
+
+/*
+Running RMS amplitude of one channel, for thresholds that are a multiple of the signal's RMS.
+
+Two windows are available:
+ - Exponential: first-order exponential smoothing of the squared amplitude, with a time constant
+   of the given length. The recurrence is evaluated a block at a time as several independent
+   chains that are then joined in closed form, in double precision so that long time constants
+   (small weights for each new sample) don't drift.
+ - Boxcar: mean of the squared amplitude over the last `length` samples, kept in a ring buffer
+   with a running sum (O(1) per sample, with the sum recomputed once per window to cancel
+   rounding error). The squares are kept in double precision as well.
+
+The square root is taken in a separate vectorized pass, and only if the RMS is requested.
+
+Does not depend on JUCE.
+*/
+
+#include <vector>
+
+class AmplitudeAverage
+{
+public:
+    enum Window { WINDOW_EXPONENTIAL, WINDOW_BOXCAR };
+
+    AmplitudeAverage();
+
+    /** Sets the window type and length in samples (time constant for exponential, width for
+     *  boxcar). Allocates the boxcar history if its length changes.
+     */
+    void configure(Window window, double lengthSamples);
+
+    Window getWindow() const;
+
+    /** Ensures that blocks of up to maxBlockLength samples can be processed without allocating. */
+    void reserve(int maxBlockLength);
+
+    /** Forgets the history; the average restarts from the first sample of the next block. */
+    void restart();
+
+    /** Updates the average with the next block of input. If rmsOut is not null, fills it with
+     *  multiplier * the RMS amplitude up to and including each sample.
+     */
+    void process(const float* input, int numSamples, float multiplier, float* rmsOut);
+
+    /** Current mean squared amplitude. */
+    double getMeanSquare() const;
+
+private:
+    // Fills meanSquares with the exponential average after each sample.
+    void processExponential(const float* input, int numSamples, double* meanSquares);
+
+    // Fills meanSquares with the boxcar average after each sample.
+    void processBoxcar(const float* input, int numSamples, double* meanSquares);
+
+    Window window;
+    bool needsInit;
+
+    // exponential
+    double newSampWeight;
+    double meanSquare;
+
+    // boxcar
+    std::vector<double> squares; // ring buffer of the last boxcarLength squared samples
+    int boxcarLength;
+    int ringPos;
+    int numFilled;
+    double squareSum;
+
+    std::vector<double> blockMeanSquares; // scratch
+};
+
+#endif // AMPLITUDE_AVERAGE_H_INCLUDED
@@ -0,0 +1,209 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AmplitudePercentile.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int AmplitudePercentile::MAX_POINTS;
+const int AmplitudePercentile::BINS_PER_OCTAVE;
+const int AmplitudePercentile::MIN_EXPONENT;
+const int AmplitudePercentile::MAX_EXPONENT;
+
+namespace
+{
+    // bin 0 holds amplitudes below 2^MIN_EXPONENT; bin b > 0 starts at 2^(MIN_EXPONENT + (b - 1) / BINS_PER_OCTAVE)
+    const int NUM_BINS = (AmplitudePercentile::MAX_EXPONENT - AmplitudePercentile::MIN_EXPONENT)
+        * AmplitudePercentile::BINS_PER_OCTAVE + 1;
+
+    double binLowerEdge(int bin)
+    {
+        return std::exp2(AmplitudePercentile::MIN_EXPONENT
+            + static_cast<double>(bin - 1) / AmplitudePercentile::BINS_PER_OCTAVE);
+    }
+}
+
+AmplitudePercentile::AmplitudePercentile()
+    : percentile     (50.0)
+    , windowPoints   (1)
+    , decimation     (1)
+    , untilNextPoint (0)
+    , points         (MAX_POINTS)
+    , ringPos        (0)
+    , numPoints      (0)
+    , histogram      (NUM_BINS)
+    , percentileBin  (0)
+    , countBelow     (0)
+    , estimate       (0.0f)
+{}
+
+void AmplitudePercentile::configure(double newPercentile, double windowSamples)
+{
+    percentile = std::min(100.0, std::max(0.0, newPercentile));
+
+    windowSamples = std::max(1.0, windowSamples);
+    const int newDecimation = static_cast<int>(std::ceil(windowSamples / MAX_POINTS));
+    const int newWindowPoints = std::min(MAX_POINTS,
+        std::max(1, static_cast<int>(std::round(windowSamples / newDecimation))));
+
+    if (newDecimation != decimation || newWindowPoints != windowPoints)
+    {
+        decimation = newDecimation;
+        windowPoints = newWindowPoints;
+        restart();
+    }
+    else
+    {
+        updateEstimate();
+    }
+}
+
+void AmplitudePercentile::restart()
+{
+    std::fill(histogram.begin(), histogram.end(), 0);
+    untilNextPoint = 0;
+    ringPos = 0;
+    numPoints = 0;
+    percentileBin = 0;
+    countBelow = 0;
+    estimate = 0.0f;
+}
+
+void AmplitudePercentile::process(const float* input, int numSamples, float multiplier, float* thresholdOut)
+{
+    int i = 0;
+    while (i < numSamples)
+    {
+        // samples up to the next point keep the current estimate
+        const int segmentEnd = std::min(numSamples, i + untilNextPoint);
+        if (thresholdOut != nullptr)
+        {
+            std::fill(thresholdOut + i, thresholdOut + segmentEnd, multiplier * estimate);
+        }
+        untilNextPoint -= segmentEnd - i;
+        i = segmentEnd;
+
+        if (i == numSamples)
+        {
+            break;
+        }
+
+        addPoint(std::fabs(input[i]));
+        if (thresholdOut != nullptr)
+        {
+            thresholdOut[i] = multiplier * estimate;
+        }
+        ++i;
+        untilNextPoint = decimation - 1;
+    }
+}
+
+float AmplitudePercentile::getEstimate() const
+{
+    return estimate;
+}
+
+int AmplitudePercentile::getDecimation() const
+{
+    return decimation;
+}
+
+int AmplitudePercentile::binOf(float value)
+{
+    // (also catches NaN)
+    if (!(value >= std::ldexp(1.0f, MIN_EXPONENT)))
+    {
+        return 0;
+    }
+
+    const int bin = 1 + static_cast<int>(std::floor((std::log2(value) - MIN_EXPONENT) * BINS_PER_OCTAVE));
+    return std::min(bin, NUM_BINS - 1);
+}
+
+void AmplitudePercentile::addPoint(float value)
+{
+    if (numPoints == windowPoints)
+    {
+        // remove the oldest point
+        const int oldBin = points[ringPos];
+        --histogram[oldBin];
+        if (oldBin < percentileBin)
+        {
+            --countBelow;
+        }
+    }
+    else
+    {
+        ++numPoints;
+    }
+
+    const int bin = binOf(value);
+    points[ringPos] = static_cast<uint16_t>(bin);
+    ++histogram[bin];
+    if (bin < percentileBin)
+    {
+        ++countBelow;
+    }
+
+    if (++ringPos == windowPoints)
+    {
+        ringPos = 0;
+    }
+
+    updateEstimate();
+}
+
+void AmplitudePercentile::updateEstimate()
+{
+    if (numPoints == 0)
+    {
+        estimate = 0.0f;
+        return;
+    }
+
+    // 0-based rank of the target point
+    const int target = static_cast<int>(std::floor(percentile / 100 * (numPoints - 1) + 0.5));
+
+    while (countBelow > target)
+    {
+        --percentileBin;
+        countBelow -= histogram[percentileBin];
+    }
+
+    while (countBelow + histogram[percentileBin] <= target)
+    {
+        countBelow += histogram[percentileBin];
+        ++percentileBin;
+    }
+
+    if (percentileBin == 0)
+    {
+        estimate = 0.0f;
+        return;
+    }
+
+    // assume the points in the bin are evenly spread on a log scale
+    const double fraction = (target - countBelow + 0.5) / histogram[percentileBin];
+    estimate = static_cast<float>(binLowerEdge(percentileBin) * std::exp2(fraction / BINS_PER_OCTAVE));
+}
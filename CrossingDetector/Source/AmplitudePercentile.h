@@ -0,0 +1,100 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef AMPLITUDE_PERCENTILE_H_INCLUDED
+#define AMPLITUDE_PERCENTILE_H_INCLUDED
+
+/*
+Running percentile of one channel's absolute amplitude over a sliding window, for robust noise
+thresholds. With the 50th percentile, this is the median absolute deviation of a signal whose
+median is 0 (such as a band-passed spike channel); the noise standard deviation is then about
+MAD / 0.6745.
+
+The window is decimated to at most MAX_POINTS samples, each of which is placed into a
+logarithmically spaced histogram bin (BINS_PER_OCTAVE bins per factor of 2, so the estimate is
+accurate to about 1%). Adding a sample and removing the one that falls out of the window only
+update two bin counts, and the bin containing the percentile is tracked incrementally, so no
+sorting is done. The estimate is updated once per decimated sample.
+
+All memory is allocated on construction. Does not depend on JUCE.
+*/
+
+#include <cstdint>
+#include <vector>
+
+class AmplitudePercentile
+{
+public:
+    static const int MAX_POINTS = 8192;
+    static const int BINS_PER_OCTAVE = 64;
+    static const int MIN_EXPONENT = -24; // smallest distinguishable amplitude is 2^MIN_EXPONENT
+    static const int MAX_EXPONENT = 24;  // amplitudes of 2^MAX_EXPONENT or more share the top bin
+
+    AmplitudePercentile();
+
+    /** Sets the percentile (0 to 100) and window length in samples. Restarts if the window's
+     *  decimation changes.
+     */
+    void configure(double percentile, double windowSamples);
+
+    /** Forgets the history. Until the next sample is added, the estimate is 0. */
+    void restart();
+
+    /** Updates the window with the next block of input. If thresholdOut is not null, fills it
+     *  with multiplier * the estimate as of each sample.
+     */
+    void process(const float* input, int numSamples, float multiplier, float* thresholdOut);
+
+    /** Current estimate of the percentile of the absolute amplitude. */
+    float getEstimate() const;
+
+    /** Every how many input samples one is added to the window */
+    int getDecimation() const;
+
+private:
+    static int binOf(float value);
+
+    // Adds the decimated sample to the window (removing the oldest one if full)
+    void addPoint(float value);
+
+    // Moves percentileBin and countBelow so that the target rank is in percentileBin,
+    // and updates the estimate.
+    void updateEstimate();
+
+    double percentile;
+    int windowPoints;
+    int decimation;
+    int untilNextPoint; // input samples to skip before the next one is added
+
+    std::vector<uint16_t> points; // ring buffer of bin indices
+    int ringPos;
+    int numPoints;
+
+    std::vector<int> histogram;
+    int percentileBin;
+    int countBelow; // number of points in bins below percentileBin
+
+    float estimate;
+};
+
+#endif // AMPLITUDE_PERCENTILE_H_INCLUDED
@@ -24,17 +24,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "CrossingDetector.h"
 #include "CrossingDetectorEditor.h"
 
+#include <algorithm> // for sort
 #include <cmath> // for ceil, floor
+#include <cstring> // for memcpy
+#include <limits> // for numeric_limits
+
+namespace
+{
+    // size of the part of a serialized event before its data (see BinaryEvent::serialize):
+    // base type, event type, source node ID, subprocessor index, source index, timestamp
+    const int EVENT_HEADER_SIZE = 16;
+
+    // (the data of a message isn't necessarily aligned)
+    template <typename T>
+    float readAsFloat(const juce::uint8* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return static_cast<float>(value);
+    }
+}
 
 CrossingDetector::CrossingDetector()
     : GenericProcessor      ("Crossing Detector")
     , thresholdType         (CONSTANT)
     , wantTattleThreshold   (false)
+    , measureLatency        (false)
     , constantThresh        (0.0f)
     , averageDecaySeconds   (5.0f)
-    , averageNewSampWeight  (0.0f)
-    , averageNeedsInit      (true)
-    , runningSquaredAverage (0.0f)
+    , averageWindow         (AVERAGE_EXPONENTIAL)
+    , percentileRank        (50.0f)
+    , percentileSeconds     (10.0f)
     , indicatorChan         (-1)
     , indicatorTarget       (180.0f)
     , useIndicatorRange     (true)
@@ -45,35 +65,56 @@ CrossingDetector::CrossingDetector()
     , useAdaptThreshRange   (true)
     , currLearningRate      (startLearningRate)
     , currLRDivisor         (1.0)
+    , adaptiveStartLR       (startLearningRate)
+    , adaptiveThreshVaries  (false)
+    , adaptiveBlockLength   (0)
+    , adaptiveFilledTo      (0)
     , indicatorChanName     ("")
     , thresholdChannel      (-1)
     , inputChannel          (-1)
     , validSubProcFullID    (0)
     , eventChannel          (0)
+    , useMultiChannel       (false)
+    , useMultiRule          (false)
+    , numWorkerThreads      (0)
+    , pinWorkerThreads      (false)
+    , maxBlockLength        (DEFAULT_MAX_BLOCK_LENGTH)
+    , currentBuffer         (nullptr)
+    , metaDataProfile       (METADATA_FULL)
+    , logCrossings          (false)
+    , eventLogPath          ("crossings.bin")
+    , useTTLLines           (false)
+    , useRateLimit          (false)
+    , rateLimit             (1000.0f)
+    , rateLimitBurst        (100)
+    , rateLimitPerSample    (0.0)
+    , useCoalescing         (false)
+    , coalesceSamples       (30)
+    , crossingInterpolation (INTERP_NONE)
+    , activeDetectorVariant (VARIANT_INACTIVE)
+    , parameterFifo         (PARAMETER_FIFO_SIZE)
+    , nextEventMetaDataSet  (0)
     , posOn                 (true)
     , negOn                 (false)
     , eventDuration         (5)
+    , eventDurationSamp     (0)
     , timeout               (1000)
+    , timeoutSamp           (0)
     , useBufferEndMask      (false)
     , bufferEndMaskMs       (3)
+    , bufferEndMaskSamp     (0)
     , pastStrict            (1.0f)
     , pastSpan              (0)
     , futureStrict          (1.0f)
     , futureSpan            (0)
+    , maxVotingSpan         (200)
+    , useEarlyFire          (false)
     , useJumpLimit          (false)
     , jumpLimit             (5.0f)
     , jumpLimitSleep        (0)
-    , jumpLimitElapsed      (jumpLimitSleep)
-    , sampToReenable        (pastSpan + futureSpan + 1)
-    , pastSamplesAbove      (0)
-    , futureSamplesAbove    (0)
-    , inputHistory          (pastSpan + futureSpan + 2)
-    , thresholdHistory      (pastSpan + futureSpan + 2)
+    , decimationFactor      (1)
+    , useMinMaxDecimation   (false)
     , eventChannelPtr       (nullptr)
-    , turnoffEvent          (nullptr)
-#if TATTLE_ON_NEW_CHANNEL
-    , tattleChannelPtr      (nullptr)
-#endif
 {
     setProcessorType(PROCESSOR_TYPE_FILTER);
 
@@ -84,6 +125,16 @@ CrossingDetector::CrossingDetector()
     randomThreshRange[0] = -180.0f;
     randomThreshRange[1] = 180.0f;
     thresholdVal = constantThresh;
+    displayedThreshold = constantThresh;
+    displayedThreshChannel = -1;
+    multiChanInputs.add(0);
+    detectionRules.add(getDefaultRule());
+    ttlLines.add(0);
+    threadContexts.add(new ThreadContext());
+
+    parameterChanges.resize(PARAMETER_FIFO_SIZE);
+    indicatorValues.ensureStorageAllocated(MAX_INDICATOR_BATCH);
+    indicatorPositions.ensureStorageAllocated(MAX_INDICATOR_BATCH);
 
     // make the event-related metadata descriptors
     eventMetaDataDescriptors.add(new MetaDataDescriptor(MetaDataDescriptor::INT64, 1, "Crossing Point",
@@ -96,6 +147,18 @@ CrossingDetector::CrossingDetector()
         "Direction of crossing: 1 = rising, 0 = falling", "crossing.direction"));
     eventMetaDataDescriptors.add(new MetaDataDescriptor(MetaDataDescriptor::DOUBLE, 1, "Learning rate",
         "If using adaptive threshold, current threshold learning rate", "crossing.threshold.learningrate"));
+    eventMetaDataDescriptors.add(new MetaDataDescriptor(MetaDataDescriptor::DOUBLE, 1, "Interpolated crossing point",
+        "Estimated sub-sample time when threshold was crossed", "crossing.point.interpolated"));
+    eventMetaDataDescriptors.add(new MetaDataDescriptor(MetaDataDescriptor::INT32, 1, "Decision latency",
+        "Samples from crossing point to the sample at which the crossing was confirmed", "crossing.latency"));
+    eventMetaDataDescriptors.add(new MetaDataDescriptor(MetaDataDescriptor::UINT32, 1, "Crossing count",
+        "Number of crossings merged into this event (final on the turning-off event)", "crossing.count"));
+
+    // only added to the event channel in multi-channel mode
+    sourceChanMetaDataDescriptor = new MetaDataDescriptor(MetaDataDescriptor::UINT16, 1, "Source channel",
+        "Index of the monitored data channel that crossed the threshold", "crossing.source.channel");
+
+    updateEngineSettings();
 }
 
 CrossingDetector::~CrossingDetector() {}
@@ -108,8 +171,10 @@ AudioProcessorEditor* CrossingDetector::createEditor()
 
 void CrossingDetector::createEventChannels()
 {
+    updateActiveInputs();
+
     // add detection event channel
-    const DataChannel* in = getDataChannel(inputChannel);
+    const DataChannel* in = getDataChannel(activeInputs.isEmpty() ? -1 : activeInputs[0]);
 
     if (!in)
     {
@@ -117,8 +182,20 @@ void CrossingDetector::createEventChannels()
         return;
     }
 
+    // in multi-channel mode, each channel gets its own line, starting at eventChannel;
+    // with multiple rules, each rule has its own line
+    int numLines = monitorsMultipleChannels() ? jmax(8, eventChannel + activeInputs.size()) : 8;
+    if (useMultiRule)
+    {
+        for (const DetectionRule& rule : detectionRules)
+        {
+            numLines = jmax(numLines, rule.eventLine + 1);
+        }
+    }
+    ttlData.resize((numLines + 7) / 8);
+
     float sampleRate = in->getSampleRate();
-    EventChannel* chan = new EventChannel(EventChannel::TTL, 8, 1, sampleRate, this);
+    EventChannel* chan = new EventChannel(EventChannel::TTL, numLines, 1, sampleRate, this);
     chan->setName("Crossing detector output");
     chan->setDescription("Triggers whenever the input signal crosses a voltage threshold.");
     chan->setIdentifier("crossing.event");
@@ -136,228 +213,482 @@ void CrossingDetector::createEventChannels()
     chan->addMetaData(sourceChanDesc, sourceChanVal);
 
     // event-related metadata!
-    for (auto desc : eventMetaDataDescriptors)
+    for (int field = 0; field < NUM_EVENT_METADATA_FIELDS; ++field)
+    {
+        if (includesEventMetaData(static_cast<EventMetaDataField>(field)))
+        {
+            chan->addEventMetaData(eventMetaDataDescriptors[field]);
+        }
+    }
+
+    if (monitorsMultipleChannels())
     {
-        chan->addEventMetaData(desc);
+        chan->addEventMetaData(sourceChanMetaDataDescriptor);
     }
 
     eventChannelPtr = eventChannelArray.add(chan);
 }
 
-#if TATTLE_ON_NEW_CHANNEL
-// FIXME - This doesn't work properly. It detects but we don't get output.
-// Implementation was cribbed from the "Phase Calculator" plugin.
 void CrossingDetector::updateSettings()
 {
-    // NOTE - The "createDataChannels()" method is only called for sources. We aren't a source.
-    // So, we have to do the equivalent here, and manually adjust "settings.numOutputs".
-
-    // Force sanity.
-    tattleChannelPtr = nullptr;
-
-    // Add a tattle channel if and only if we want tattling.
+    // createDataChannels() is only called for sources, so the threshold channels are added here
+    // (after createEventChannels has updated the activeInputs). Each is a copy of its input
+    // channel, so it has the same source subprocessor and therefore the same timestamps and
+    // buffer lengths downstream.
+    tattleChannels.clearQuick();
     if (wantTattleThreshold)
     {
-        tattleChannelPtr = new DataChannel(DataChannel::HEADSTAGE_CHANNEL, getSampleRate(), this);
-        tattleChannelPtr->setName("Threshold");
-        dataChannelArray.add(tattleChannelPtr);
+        for (int chan : activeInputs)
+        {
+            const DataChannel* in = getDataChannel(chan);
+            DataChannel* out = new DataChannel(*in);
+            out->setName(in->getName() + " threshold");
+            out->setDescription("Threshold of the crossing detector monitoring " + in->getName());
+            out->setIdentifier("crossing.threshold");
+
+            tattleChannels.add(dataChannelArray.size());
+            dataChannelArray.add(out);
+        }
     }
 
-    // Manually update the channel count.
     settings.numOutputs = dataChannelArray.size();
 }
-#endif
 
 void CrossingDetector::process(AudioSampleBuffer& continuousBuffer)
 {
-    if (inputChannel < 0 || inputChannel >= continuousBuffer.getNumChannels() || !eventChannelPtr)
+    if (activeInputs.isEmpty() || !eventChannelPtr)
     {
         jassertfalse;
         return;
     }
 
-    int nSamples = getNumSamples(inputChannel);
-    const float* const rp = continuousBuffer.getReadPointer(inputChannel);
-    juce::int64 startTs = getTimestamp(inputChannel);
+    processStartTime = std::chrono::steady_clock::now();
+    maxBlockLength = jmax(maxBlockLength, getNumSamples(activeInputs[0]));
 
-    // turn off event from previous buffer if necessary
-    int turnoffOffset = turnoffEvent ? jmax(0, int(turnoffEvent->getTimestamp() - startTs)) : -1;
-    if (turnoffOffset >= 0 && turnoffOffset < nSamples)
-    {
-        addEvent(eventChannelPtr, turnoffEvent, turnoffOffset);
-        turnoffEvent = nullptr;
-    }
-
-    const ThresholdType currThreshType = thresholdType;
+    // apply changes from the editor
+    applyPendingParameterChanges();
 
     // adapt threshold if necessary
-    if (currThreshType == ADAPTIVE && indicatorChan > -1)
+    adaptiveThreshVaries = false;
+    if (thresholdType == ADAPTIVE && indicatorChan > -1)
     {
+        beginAdaptiveBlock(getNumSamples(activeInputs[0]));
         checkForEvents();
+        endAdaptiveBlock();
     }
 
-    // store threshold for each sample of current buffer
-    if (currThresholds.size() < nSamples)
+    // (gotten here, since getWritePointer isn't safe to call from several threads at once)
+    thresholdOutputs.clearQuick();
+    for (int chan : tattleChannels)
     {
-        currThresholds.resize(nSamples);
+        thresholdOutputs.add(chan < continuousBuffer.getNumChannels()
+            ? continuousBuffer.getWritePointer(chan) : nullptr);
     }
-    float* const pThresh = currThresholds.getRawDataPointer();
-    const float* const rpThreshChan = currThreshType == CHANNEL
-        ? continuousBuffer.getReadPointer(thresholdChannel)
-        : nullptr;
 
-    // define lambdas to access history values more easily
-    auto inputAt = [=](int index)
+    if (shouldUseWorkerPool())
     {
-        return index < 0 ? inputHistory[index] : rp[index];
-    };
-
-    auto thresholdAt = [&, this](int index)
+        currentBuffer = &continuousBuffer;
+        workerPool.run(*this, (activeInputs.size() + CHANNELS_PER_TASK - 1) / CHANNELS_PER_TASK);
+        handleStagedCrossings();
+    }
+    else if (activeInputs.size() > 1 || ruleSweep != nullptr)
     {
-        return index < 0 ? thresholdHistory[index] : pThresh[index];
-    };
+        // The rate limit, merging and releasing of turn-offs when the queue is full depend on the
+        // order crossings arrive in, and rules may share a line, so handle them in time order, as
+        // on the worker pool, rather than channel by channel (or rule by rule).
+        for (int c = 0; c < activeInputs.size(); ++c)
+        {
+            processChannel(c, continuousBuffer, *threadContexts[0], *threadContexts[0]);
+        }
+        handleStagedCrossings();
+    }
+    else
+    {
+        for (int c = 0; c < activeInputs.size(); ++c)
+        {
+            processChannel(c, continuousBuffer, *threadContexts[0], *this);
+        }
+    }
 
-    // Initialize the running average if we need to.
-    if (averageNeedsInit)
+    // add turning-off events that fall within this buffer, including ones scheduled just now
+    releaseTurnoffs(getTimestamp(activeInputs[0]), getNumSamples(activeInputs[0]));
+
+#if CROSSING_DETECTOR_STATS
+    const int nSamples = getNumSamples(activeInputs[0]);
+    const auto blockNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - processStartTime).count();
+    processStats.recordBlock(nSamples, static_cast<uint64_t>(blockNs), 1e9 * nSamples / getSampleRate());
+    // (in multiple rule mode, the rules are all evaluated by the sweep)
+    processStats.setDetectionCounters(ruleSweep != nullptr ? ruleSweep->getCounters() : engine.getCounters());
+#endif
+}
+
+void CrossingDetector::processChannel(int chanInd, AudioSampleBuffer& continuousBuffer,
+    ThreadContext& context, CrossingEngine::EventSink& crossingSink)
+{
+    const int inChan = activeInputs[chanInd];
+    if (inChan >= continuousBuffer.getNumChannels())
     {
-        averageNeedsInit = false;
-        runningSquaredAverage = inputAt(0) * inputAt(0);
+        jassertfalse;
+        return;
     }
 
-    // loop over current buffer and add events for newly detected crossings
-    for (int i = 0; i < nSamples; ++i)
+    int nSamples = getNumSamples(inChan);
+    juce::int64 startTs = getTimestamp(inChan);
+
+    const ThresholdType currThreshType = thresholdType;
+    const float* const rp = continuousBuffer.getReadPointer(inChan);
+
+    // If outputting the threshold, it is written straight to its output channel (see updateSettings).
+    float* const wpThresh = thresholdOutputs[chanInd];
+
+    // Update the running average and percentile whether or not we're using them.
+    // The threshold output channel, if any, doubles as the storage for the threshold they compute.
+    float* pAverageThresh = nullptr;
+    if (currThreshType == AVERAGE || currThreshType == PERCENTILE)
+    {
+        if (wpThresh != nullptr)
+        {
+            pAverageThresh = wpThresh;
+        }
+        else
+        {
+            if (context.averageThresholds.size() < nSamples)
+            {
+                context.averageThresholds.resize(nSamples);
+            }
+            pAverageThresh = context.averageThresholds.getRawDataPointer();
+        }
+    }
+    updateRunningAverage(chanInd, rp, currThreshType == AVERAGE ? pAverageThresh : nullptr, nSamples);
+    updateRunningPercentile(chanInd, rp, currThreshType == PERCENTILE ? pAverageThresh : nullptr, nSamples);
+
+    // Per-sample threshold from elsewhere: the threshold channel, or the adaptive threshold if it
+    // changed during this buffer (see applyIndicatorEvents).
+    const float* const pSampleThresh = currThreshType == CHANNEL ? continuousBuffer.getReadPointer(thresholdChannel)
+        : currThreshType == ADAPTIVE && adaptiveThreshVaries ? adaptiveThresholds.getRawDataPointer() : nullptr;
+    const float* pChannelThresh = pSampleThresh;
+
+    // If decimating, the engine only sees the chosen samples, and its crossings are mapped back
+    // to the full-rate buffer before reaching the crossingSink.
+    Decimator& decimator = *decimators[chanInd];
+    Decimator::MappingSink mappingSink(decimator, startTs, crossingSink);
+    const bool decimate = decimationFactor > 1;
+
+    const float* detInput = rp;
+    int detSamples = nSamples;
+    juce::int64 detStartTs = startTs;
+    CrossingEngine::EventSink& sink = decimate ? static_cast<CrossingEngine::EventSink&>(mappingSink) : crossingSink;
+
+    if (decimate)
     {
-        // state to keep constant during each iteration
-        bool currPosOn = posOn;
-        bool currNegOn = negOn;
+        detSamples = decimator.selectSamples(nSamples, startTs, rp);
+        detStartTs = decimator.getDecimatedStart();
+
+        if (context.decimatedInput.size() < detSamples)
+        {
+            context.decimatedInput.resize(detSamples);
+            context.decimatedThresholds.resize(detSamples);
+        }
+        decimator.gather(rp, context.decimatedInput.getRawDataPointer());
+        detInput = context.decimatedInput.getRawDataPointer();
 
-        // Update the running average whether or not we're using it.
-        // Bog standard first-order exponential smoothing of the squared amplitude.
-        runningSquaredAverage *= (1.0 - averageNewSampWeight);
-        runningSquaredAverage += averageNewSampWeight * inputAt(i) * inputAt(i);
+        const float* pFullThresh = pChannelThresh != nullptr ? pChannelThresh : pAverageThresh;
+        if (pFullThresh != nullptr)
+        {
+            decimator.gather(pFullThresh, context.decimatedThresholds.getRawDataPointer());
+            pChannelThresh = pAverageThresh = context.decimatedThresholds.getRawDataPointer();
+        }
+    }
 
-        // get and save threshold for this sample
+    // detect crossings (reported to handleCrossing)
+    if (ruleSweep != nullptr)
+    {
+        // each rule has its own constant threshold
+        ruleSweep->processBlock(detInput, detSamples, detStartTs, sink);
+        activeDetectorVariant = VARIANT_MULTI_RULE;
+    }
+    else
+    {
         switch (currThreshType)
         {
         case CONSTANT:
-        case ADAPTIVE: // adaptive threshold process updates constantThresh
-            pThresh[i] = constantThresh;
+            engine.processBlock(chanInd, detInput, constantThresh, detSamples, detStartTs, sink);
             break;
 
-        case AVERAGE:
-            // Threshold is a multiplier for the RMS average.
-            pThresh[i] = constantThresh * sqrt(runningSquaredAverage);
+        case ADAPTIVE: // adaptive threshold process updates constantThresh
+            if (pChannelThresh != nullptr)
+            {
+                engine.processBlock(chanInd, detInput, pChannelThresh, detSamples, detStartTs, sink);
+            }
+            else
+            {
+                engine.processBlock(chanInd, detInput, constantThresh, detSamples, detStartTs, sink);
+            }
             break;
 
         case RANDOM:
-            pThresh[i] = currRandomThresh;
+            engine.processBlockRandom(chanInd, detInput, detSamples, detStartTs, sink);
             break;
 
         case CHANNEL:
-            pThresh[i] = rpThreshChan[i];
+            engine.processBlock(chanInd, detInput, pChannelThresh, detSamples, detStartTs, sink);
+            break;
+
+        case AVERAGE:
+        case PERCENTILE:
+            engine.processBlock(chanInd, detInput, pAverageThresh, detSamples, detStartTs, sink);
             break;
+
+        default:
+            jassertfalse;
+            return;
         }
 
-        int indCross = i - futureSpan;
+        if (chanInd == 0)
+        {
+            activeDetectorVariant = engine.getLastVariant(0);
+        }
+    }
 
-        // update pastSamplesA`bove and futureSamplesAbove
-        if (pastSpan > 0)
+    // Output the threshold values, if desired. Average and percentile thresholds are already there.
+    if (wpThresh != nullptr && ruleSweep != nullptr)
+    {
+        // (the first rule's)
+        FloatVectorOperations::fill(wpThresh, detectionRules[0].threshold, nSamples);
+    }
+    else if (wpThresh != nullptr)
+    {
+        switch (currThreshType)
         {
-            int indLeaving = indCross - 2 - pastSpan;
-            if (inputAt(indLeaving) > thresholdAt(indLeaving))
+        case CONSTANT:
+        case ADAPTIVE:
+        case CHANNEL:
+            if (pSampleThresh != nullptr)
             {
-                pastSamplesAbove--;
+                FloatVectorOperations::copy(wpThresh, pSampleThresh, nSamples);
             }
-
-            int indEntering = indCross - 2;
-            if (inputAt(indEntering) > thresholdAt(indEntering))
+            else
             {
-                pastSamplesAbove++;
+                FloatVectorOperations::fill(wpThresh, constantThresh, nSamples);
             }
-        }
+            break;
 
-        if (futureSpan > 0)
-        {
-            int indLeaving = indCross;
-            if (inputAt(indLeaving) > thresholdAt(indLeaving))
+        case RANDOM:
+            // redrawn during the block, so only the engine knows
+            if (decimate)
             {
-                futureSamplesAbove--;
+                decimator.expand(engine.getLastThresholds(chanInd), wpThresh);
             }
-
-            int indEntering = indCross + futureSpan; // (== i)
-            if (inputAt(indEntering) > thresholdAt(indEntering))
+            else
             {
-                futureSamplesAbove++;
+                FloatVectorOperations::copy(wpThresh, engine.getLastThresholds(chanInd), nSamples);
             }
-        }
+            break;
 
-        if (indCross < sampToReenable ||
-            (useBufferEndMask && nSamples - indCross > bufferEndMaskSamp))
-        {
-            // can't trigger an event now
-            continue;
+        default:
+            break;
         }
+    }
 
-        float preVal = inputAt(indCross - 1);
-        float preThresh = thresholdAt(indCross - 1);
-        float postVal = inputAt(indCross);
-        float postThresh = thresholdAt(indCross);
+    if (decimate)
+    {
+        decimator.commit();
+    }
+}
 
+void CrossingDetector::updateRunningAverage(int chanInd, const float* rp, float* pThresh, int nSamples)
+{
+    // Threshold is a multiplier for the RMS average.
+    runningAverages[chanInd]->process(rp, nSamples, constantThresh, pThresh);
+}
 
+void CrossingDetector::updateRunningPercentile(int chanInd, const float* rp, float* pThresh, int nSamples)
+{
+    // Threshold is a multiplier for the percentile of the absolute value.
+    runningPercentiles[chanInd]->process(rp, nSamples, constantThresh, pThresh);
+}
 
-        // check whether to trigger an event
-        if (currPosOn && shouldTrigger(true, preVal, postVal, preThresh, postThresh) ||
-            currNegOn && shouldTrigger(false, preVal, postVal, preThresh, postThresh))
-        {
-            // add event
-            triggerEvent(startTs, indCross, nSamples, postThresh, postVal);
-            
-            // update sampToReenable
-            sampToReenable = indCross + 1 + timeoutSamp;
+void CrossingDetector::updateEngineSettings()
+{
+    // the engine counts evaluated samples
+    const double sampPerEval = getSamplesPerEvaluation();
+
+    CrossingEngine::Settings engineSettings;
+    engineSettings.posOn = posOn;
+    engineSettings.negOn = negOn;
+    engineSettings.timeoutSamp = int(std::floor(timeoutSamp / sampPerEval));
+    engineSettings.pastSpan = pastSpan;
+    engineSettings.futureSpan = futureSpan;
+    engineSettings.pastStrict = pastStrict;
+    engineSettings.futureStrict = futureStrict;
+    engineSettings.earlyFire = useEarlyFire;
+    engineSettings.useJumpLimit = useJumpLimit;
+    engineSettings.jumpLimit = jumpLimit;
+    engineSettings.jumpLimitSleep = static_cast<float>(jumpLimitSleep / sampPerEval);
+    engineSettings.useBufferEndMask = useBufferEndMask;
+    engineSettings.bufferEndMaskSamp = int(std::ceil(bufferEndMaskSamp / sampPerEval));
+    engineSettings.interpolation = static_cast<CrossingEngine::Interpolation>(crossingInterpolation);
+    engineSettings.randomThreshRange[0] = randomThreshRange[0];
+    engineSettings.randomThreshRange[1] = randomThreshRange[1];
+
+    engine.setSettings(engineSettings);
+
+    if (ruleSweep != nullptr)
+    {
+        ruleSweep->setSettings(getRuleSweepSettings());
+    }
+}
+
+String CrossingDetector::getDetectorVariantDescription(int variant)
+{
+    if (variant == VARIANT_MULTI_RULE)
+    {
+        return "Multiple rules (one pass for all rules)";
+    }
 
-            // if using random thresholds, set a new threshold
-            if (currThreshType == RANDOM)
+    return String(CrossingEngine::getVariantDescription(variant));
+}
+
+int CrossingDetector::getActiveDetectorVariant() const
+{
+    return activeDetectorVariant.get();
+}
+
+// all new values should be validated before this function is called!
+void CrossingDetector::setParameter(int parameterIndex, float newValue)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        // process() may be running, so let it apply the change at the start of the next buffer.
+        // Going through overflowChanges keeps the order of changes if the FIFO ever fills up;
+        // an older value of the same parameter that is still waiting is superseded.
+        for (int i = overflowChanges.size(); --i >= 0;)
+        {
+            if (overflowChanges.getReference(i).index == parameterIndex)
             {
-                currRandomThresh = nextRandomThresh();
-                thresholdVal = currRandomThresh;
+                overflowChanges.remove(i);
             }
         }
+
+        ParameterChange change;
+        change.index = parameterIndex;
+        change.value = newValue;
+        overflowChanges.add(change);
+        flushParameterChanges();
+        return;
     }
 
-    // update inputHistory and thresholdHistory
-    inputHistory.enqueueArray(rp, nSamples);
-    thresholdHistory.enqueueArray(pThresh, nSamples);
+    applyParameter(parameterIndex, newValue);
+    updateThresholdDisplay();
+
+    // Side effects on the editor and signal chain (these parameters can't change during acquisition)
+    switch (parameterIndex)
+    {
+    case INPUT_CHAN:
+        // make sure available threshold channels take into account new input channel
+        static_cast<CrossingDetectorEditor*>(getEditor())->updateChannelThreshBox();
+
+        // update signal chain, since the event channel metadata has to get updated.
+        //CoreServices::updateSignalChain(editor);
+        break;
+
+    case WANT_TATTLE_THRESH:
+        // Force a signal chain update, since the number of output channels may have changed.
+        CoreServices::updateSignalChain(editor);
+        break;
 
-    // shift sampToReenable so it is relative to the next buffer
-    sampToReenable = jmax(0, sampToReenable - nSamples);
+    case MULTI_CHAN_ON:
+    case MULTI_RULE_ON:
+        // number of event lines may have changed
+        CoreServices::updateSignalChain(editor);
+        break;
 
+    case EVENT_CHAN:
+        if (monitorsMultipleChannels())
+        {
+            // the channels' lines start at the event channel, so there may need to be more lines
+            CoreServices::updateSignalChain(editor);
+        }
+        break;
 
-    // Tattle the threshold values, if desired.
+    case METADATA_PROFILE:
+    case CROSSING_INTERP:
+    case USE_COALESCING:
+        // event channel metadata has changed
+        CoreServices::updateSignalChain(editor);
+        break;
+    }
+}
 
-    int tattleChannelNum = -1;
-    if (wantTattleThreshold)
+void CrossingDetector::applyPendingParameterChanges()
+{
+    int numReady = parameterFifo.getNumReady();
+    if (numReady == 0)
     {
-#if TATTLE_ON_NEW_CHANNEL
-        if (tattleChannelPtr != nullptr)
-            tattleChannelNum = dataChannelArray.indexOf(tattleChannelPtr);
-#else
-        tattleChannelNum = inputChannel;
-#endif
+        return;
     }
 
-    if (tattleChannelNum >= 0)
+    int start1, size1, start2, size2;
+    parameterFifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+    for (int i = start1; i < start1 + size1; ++i)
     {
-        float *wpThresh = continuousBuffer.getWritePointer(tattleChannelNum);
-        if (wpThresh != nullptr)
+        applyParameter(parameterChanges[i].index, parameterChanges[i].value);
+    }
+
+    for (int i = start2; i < start2 + size2; ++i)
+    {
+        applyParameter(parameterChanges[i].index, parameterChanges[i].value);
+    }
+
+    parameterFifo.finishedRead(size1 + size2);
+}
+
+void CrossingDetector::flushParameterChanges()
+{
+    const int numToWrite = jmin(overflowChanges.size(), parameterFifo.getFreeSpace());
+    if (numToWrite > 0)
+    {
+        int start1, size1, start2, size2;
+        parameterFifo.prepareToWrite(numToWrite, start1, size1, start2, size2);
+
+        for (int i = 0; i < size1; ++i)
+        {
+            parameterChanges.set(start1 + i, overflowChanges[i]);
+        }
+
+        for (int i = 0; i < size2; ++i)
         {
-            for (int i = 0; i < nSamples; ++i)
-                wpThresh[i] = pThresh[i];
+            parameterChanges.set(start2 + i, overflowChanges[size1 + i]);
         }
+
+        parameterFifo.finishedWrite(size1 + size2);
+        overflowChanges.removeRange(0, size1 + size2);
     }
+
 }
 
-// all new values should be validated before this function is called!
-void CrossingDetector::setParameter(int parameterIndex, float newValue)
+void CrossingDetector::updateThresholdDisplay()
+{
+    const int chan = displayedThreshChannel.get();
+    if (chan >= 0)
+    {
+        thresholdVal = toChannelThreshString(chan);
+    }
+    else
+    {
+        thresholdVal = displayedThreshold.get();
+    }
+}
+
+void CrossingDetector::timerCallback()
+{
+    flushParameterChanges();
+    updateThresholdDisplay();
+}
+
+void CrossingDetector::applyParameter(int parameterIndex, float newValue)
 {
     switch (parameterIndex)
     {
@@ -367,35 +698,39 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
         switch (thresholdType)
         {
         case CONSTANT:
-            thresholdVal = constantThresh;
+            displayedThreshold = constantThresh;
             break;
 
         case ADAPTIVE:
-            thresholdVal = constantThresh;
+            displayedThreshold = constantThresh;
             restartAdaptiveThreshold();
             break;
 
         case AVERAGE:
-            thresholdVal = constantThresh;
-            // We don't need to reinitialize the average; keep the old value.
+        case PERCENTILE:
+            displayedThreshold = constantThresh;
+            // We don't need to reinitialize the average or percentile; keep the old value.
             break;
 
         case RANDOM:
-            // get new random threshold
-            currRandomThresh = nextRandomThresh();
-            thresholdVal = currRandomThresh;
+            // get new random thresholds
+            redrawRandomThresholds();
             break;
 
         case CHANNEL:
             jassert(isCompatibleWithInput(thresholdChannel));
-            thresholdVal = toChannelThreshString(thresholdChannel);
             break;
         }
 
+        displayedThreshChannel = thresholdType == CHANNEL ? thresholdChannel : -1;
         break;
 
     case CONST_THRESH:
         constantThresh = newValue;
+        if (thresholdType != RANDOM && thresholdType != CHANNEL)
+        {
+            displayedThreshold = constantThresh;
+        }
         break;
 
     case INDICATOR_CHAN:
@@ -462,20 +797,12 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
 
     case MIN_RAND_THRESH:
         randomThreshRange[0] = newValue;
-        currRandomThresh = nextRandomThresh();
-        if (thresholdType == RANDOM)
-        {
-            thresholdVal = currRandomThresh;
-        }
+        redrawRandomThresholds();
         break;
 
     case MAX_RAND_THRESH:
         randomThreshRange[1] = newValue;
-        currRandomThresh = nextRandomThresh();
-        if (thresholdType == RANDOM)
-        {
-            thresholdVal = currRandomThresh;
-        }
+        redrawRandomThresholds();
         break;
 
     case THRESH_CHAN:
@@ -483,19 +810,14 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
         thresholdChannel = static_cast<int>(newValue);
         if (thresholdType == CHANNEL)
         {
-            thresholdVal = toChannelThreshString(thresholdChannel);
+            displayedThreshChannel = thresholdChannel;
         }
         break;
 
     case INPUT_CHAN:
         inputChannel = static_cast<int>(newValue);
         validSubProcFullID = getSubProcFullID(inputChannel);
-   
-        // make sure available threshold channels take into account new input channel
-        static_cast<CrossingDetectorEditor*>(getEditor())->updateChannelThreshBox();
-
-        // update signal chain, since the event channel metadata has to get updated.
-        //CoreServices::updateSignalChain(editor);
+        updateActiveInputs();
         break;
 
     case EVENT_CHAN:
@@ -521,17 +843,8 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
         break;
 
     case PAST_SPAN:
-        pastSpan = static_cast<int>(newValue);
-        sampToReenable = pastSpan + futureSpan + 1;
-
-        inputHistory.reset();
-        inputHistory.resize(pastSpan + futureSpan + 2);
-        thresholdHistory.reset();
-        thresholdHistory.resize(pastSpan + futureSpan + 2);
-
-        // counters must reflect current contents of inputHistory and thresholdHistory
-        pastSamplesAbove = 0;
-        futureSamplesAbove = 0;
+        pastSpan = static_cast<int>(newValue); // engine resizes voting histories
+        resizeDecimatorHistories();
         break;
 
     case PAST_STRICT:
@@ -539,23 +852,18 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
         break;
 
     case FUTURE_SPAN:
-        futureSpan = static_cast<int>(newValue);
-        sampToReenable = pastSpan + futureSpan + 1;
-
-        inputHistory.reset();
-        inputHistory.resize(pastSpan + futureSpan + 2);
-        thresholdHistory.reset();
-        thresholdHistory.resize(pastSpan + futureSpan + 2);
-
-        // counters must reflect current contents of inputHistory and thresholdHistory
-        pastSamplesAbove = 0;
-        futureSamplesAbove = 0;
+        futureSpan = static_cast<int>(newValue); // engine resizes voting histories
+        resizeDecimatorHistories();
         break;
 
     case FUTURE_STRICT:
         futureStrict = newValue;
         break;
 
+    case EARLY_FIRE:
+        useEarlyFire = static_cast<bool>(newValue);
+        break;
+
     case USE_JUMP_LIMIT:
         useJumpLimit = static_cast<bool>(newValue);
         break;
@@ -580,81 +888,350 @@ void CrossingDetector::setParameter(int parameterIndex, float newValue)
     case AVERAGE_DECAY_TIME:
         averageDecaySeconds = newValue;
         updateSampleRateDependentValues();
-        // We don't need to reinitialize the average; keep the old value.
+        // An exponential average keeps its old value; a boxcar restarts if its length changed.
         break;
 
     case WANT_TATTLE_THRESH:
         wantTattleThreshold = newValue ? true : false;
-#if TATTLE_ON_NEW_CHANNEL
-        // Force a signal chain update, since the number of output channels may have changed.
-        CoreServices::updateSignalChain(editor);
-#endif
         break;
-    }
-}
 
-bool CrossingDetector::enable()
-{
-    jumpLimitElapsed = jumpLimitSleep;
-    updateSampleRateDependentValues();
-    restartAdaptiveThreshold();
-    averageNeedsInit = true;
-    return isEnabled;
-}
+    case MEASURE_LATENCY:
+        measureLatency = newValue ? true : false;
+        if (measureLatency)
+        {
+            // (on the processing thread if acquiring, so doesn't race with recording)
+            latencyStats.reset();
+        }
+        break;
 
-bool CrossingDetector::disable()
-{
-    // set this to pastSpan so that we don't trigger on old data when we start again.
-    sampToReenable = pastSpan + futureSpan + 1;    
-    // cancel any pending turning-off
-    turnoffEvent = nullptr;
-    return true;
-}
+    case MULTI_CHAN_ON:
+        useMultiChannel = newValue ? true : false;
+        break;
 
-float CrossingDetector::getSampleRate(int subProcessorIdx) const
-{
-    float sampleRate = getDefaultSampleRate();
+    case MULTI_RULE_ON:
+        useMultiRule = newValue ? true : false;
+        break;
 
-    const DataChannel* refChan = getDataChannel(inputChannel);
-    if (refChan == nullptr)
-        refChan = getDataChannel(0);
-    if (refChan != nullptr)
-        sampleRate = refChan->getSampleRate();
+    case NUM_WORKER_THREADS:
+        numWorkerThreads = jmax(0, static_cast<int>(newValue));
+        break;
 
-    return sampleRate;
-}
+    case PIN_WORKER_THREADS:
+        pinWorkerThreads = newValue ? true : false;
+        break;
 
-// ----- private functions ------
+    case MAX_VOTING_SPAN:
+        maxVotingSpan = jmax(0, static_cast<int>(newValue));
+        resizeDecimatorHistories();
+        break;
 
-void CrossingDetector::handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition)
-{
-    jassert(indicatorChan > -1);
-    const EventChannel* adaptChanInfo = getEventChannel(indicatorChan);
-    jassert(isValidIndicatorChan(adaptChanInfo));
-    if (eventInfo == adaptChanInfo && thresholdType == ADAPTIVE && !adaptThreshPaused)
-    {
-        // get error of received event
-        BinaryEventPtr binaryEvent = BinaryEvent::deserializeFromMessage(event, eventInfo);
-        if (binaryEvent == nullptr)
-        {
-            return;
-        }
-        float eventValue = floatFromBinaryEvent(binaryEvent);
-        float eventErr = errorFromTarget(eventValue);
+    case LOG_CROSSINGS:
+        logCrossings = newValue ? true : false;
+        break;
 
-        // update state
-        currLRDivisor += decayRate;
-        double currDecayingLR = currLearningRate - currMinLearningRate;
-        currLearningRate = currDecayingLR / currLRDivisor + currMinLearningRate;
+    case TTL_LINES_ONLY:
+        useTTLLines = newValue ? true : false;
+        break;
 
-        // update threshold
-        constantThresh -= currLearningRate * eventErr;
-        if (useAdaptThreshRange)
-        {
+    case USE_RATE_LIMIT:
+        useRateLimit = newValue ? true : false;
+        rateLimiter.fill(); // start with a full bucket
+        break;
+
+    case RATE_LIMIT:
+        rateLimit = newValue;
+        updateSampleRateDependentValues();
+        break;
+
+    case RATE_LIMIT_BURST:
+        rateLimitBurst = jmax(1, static_cast<int>(newValue));
+        rateLimiter.setLimit(rateLimitPerSample, rateLimitBurst);
+        break;
+
+    case USE_COALESCING:
+        useCoalescing = newValue ? true : false;
+        break;
+
+    case COALESCE_WINDOW:
+        coalesceSamples = jmax(0, static_cast<int>(newValue));
+        break;
+
+    case RESTART_ADAPTATION:
+        restartAdaptiveThreshold();
+        break;
+
+    case METADATA_PROFILE:
+        metaDataProfile = static_cast<MetaDataProfile>(static_cast<int>(newValue));
+        break;
+
+    case CROSSING_INTERP:
+        crossingInterpolation = static_cast<CrossingInterpolation>(static_cast<int>(newValue));
+        break;
+
+    case AVERAGE_WINDOW:
+        averageWindow = static_cast<AverageWindow>(static_cast<int>(newValue));
+        configureRunningAverages();
+        break;
+
+    case PERCENTILE_RANK:
+        percentileRank = newValue;
+        configureRunningPercentiles();
+        break;
+
+    case DECIMATION:
+        decimationFactor = jmax(1, static_cast<int>(newValue));
+        configureDecimators();
+        break;
+
+    case DECIMATION_MIN_MAX:
+        useMinMaxDecimation = static_cast<bool>(newValue);
+        configureDecimators();
+        break;
+
+    case PERCENTILE_WINDOW:
+        percentileSeconds = newValue;
+        updateSampleRateDependentValues();
+        // The window restarts if its decimation changed.
+        break;
+    }
+
+    updateEngineSettings();
+}
+
+bool CrossingDetector::enable()
+{
+    updateSampleRateDependentValues();
+    updateEngineSettings();
+    engine.setMaxVotingSpan(maxVotingSpan);
+    resetChannelStates();
+    createRuleSweep();
+
+    // Events are serialized as soon as they are added, so one metadata set is normally enough.
+    allocateEventMetaDataPool(2);
+
+    // Crossings are handled in time order, so each line has at most one turn-off pending at or
+    // after the current crossing (see handleCrossing); the rest of the capacity holds earlier ones
+    // that haven't been added yet.
+    pendingTurnoffs.setCapacity(2 * (ruleSweep != nullptr ? detectionRules.size() : activeInputs.size()) + 16);
+
+    restartAdaptiveThreshold();
+    indicatorValues.clearQuick();
+    indicatorPositions.clearQuick();
+
+    // Worker threads, if any, process groups of channels alongside the processing thread.
+    uint32 affinityMask = 0;
+    if (pinWorkerThreads)
+    {
+        for (int core : workerCores)
+        {
+            if (core < 32)
+            {
+                affinityMask |= uint32(1) << core;
+            }
+        }
+    }
+    workerPool.start(numWorkerThreads, affinityMask);
+
+    while (threadContexts.size() <= numWorkerThreads)
+    {
+        threadContexts.add(new ThreadContext());
+    }
+    threadContexts.removeLast(threadContexts.size() - (numWorkerThreads + 1));
+    reserveBlockStorage(jmax(maxBlockLength, getBlockSize()));
+
+    // If the log can't be opened, every crossing still gets its TTL event.
+    if (logCrossings)
+    {
+        eventLog.open(getEventLogFile(), getSampleRate());
+    }
+    const bool limitTTLLines = eventLog.isOpen() && useTTLLines;
+    ttlLineOn.clearQuick();
+    ttlLineOn.insertMultiple(0, !limitTTLLines, 8 * ttlData.size());
+    if (limitTTLLines)
+    {
+        for (int line : ttlLines)
+        {
+            if (line < ttlLineOn.size())
+            {
+                ttlLineOn.set(line, true);
+            }
+        }
+    }
+
+    // (timestamps start at or after 0, so the bucket starts full)
+    rateLimiter.reset(0);
+    lastCrossingTs.clearQuick();
+    lastCrossingTs.insertMultiple(0, std::numeric_limits<juce::int64>::min() / 2, ttlLineOn.size());
+    numCoalesced = 0;
+    numRateLimited = 0;
+
+    engine.resetCounters();
+    if (ruleSweep != nullptr)
+    {
+        ruleSweep->resetCounters();
+    }
+    latencyStats.reset();
+#if CROSSING_DETECTOR_STATS
+    processStats.reset();
+#endif
+
+    // Initialize the running averages from the first buffer.
+    for (AmplitudeAverage* average : runningAverages)
+    {
+        average->restart();
+    }
+    for (AmplitudePercentile* percentile : runningPercentiles)
+    {
+        percentile->restart();
+    }
+
+    // Parameter changes that don't fit in the FIFO and the threshold label are handled on the
+    // message thread while acquiring.
+    overflowChanges.clearQuick();
+    startTimer(MESSAGE_TIMER_MS);
+
+    return isEnabled;
+}
+
+bool CrossingDetector::disable()
+{
+    // process() is done, so apply any changes it didn't get to
+    applyPendingParameterChanges();
+
+    stopTimer();
+    for (const ParameterChange& change : overflowChanges)
+    {
+        applyParameter(change.index, change.value);
+    }
+    overflowChanges.clearQuick();
+    updateThresholdDisplay();
+
+    workerPool.stop();
+    eventLog.close();
+
+    // cancel any timeouts, pending early firing candidates and pending turning-off
+    engine.reset();
+    pendingTurnoffs.clear();
+    activeDetectorVariant = VARIANT_INACTIVE;
+    return true;
+}
+
+float CrossingDetector::getSampleRate(int subProcessorIdx) const
+{
+    float sampleRate = getDefaultSampleRate();
+
+    const DataChannel* refChan = getDataChannel(inputChannel);
+    if (refChan == nullptr)
+        refChan = getDataChannel(0);
+    if (refChan != nullptr)
+        sampleRate = refChan->getSampleRate();
+
+    return sampleRate;
+}
+
+// ----- private functions ------
+
+void CrossingDetector::handleEvent(const EventChannel* eventInfo, const MidiMessage& event, int samplePosition)
+{
+    jassert(indicatorChan > -1);
+    const EventChannel* adaptChanInfo = getEventChannel(indicatorChan);
+    jassert(isValidIndicatorChan(adaptChanInfo));
+    if (eventInfo == adaptChanInfo && thresholdType == ADAPTIVE && !adaptThreshPaused)
+    {
+        float eventValue;
+        if (!readIndicatorValue(event, eventInfo, &eventValue))
+        {
+            return;
+        }
+
+        if (indicatorValues.size() >= MAX_INDICATOR_BATCH)
+        {
+            // don't allocate; apply what we have so far
+            applyIndicatorEvents();
+        }
+        indicatorValues.add(eventValue);
+        indicatorPositions.add(samplePosition);
+    }
+}
+
+void CrossingDetector::beginAdaptiveBlock(int numSamples)
+{
+    if (adaptiveThresholds.size() < numSamples)
+    {
+        adaptiveThresholds.resize(numSamples);
+        adaptiveLearningRates.resize(numSamples);
+    }
+    adaptiveBlockLength = numSamples;
+    adaptiveFilledTo = 0;
+    adaptiveStartLR = currLearningRate;
+}
+
+void CrossingDetector::endAdaptiveBlock()
+{
+    applyIndicatorEvents();
+
+    if (adaptiveThreshVaries)
+    {
+        // the rest of the buffer has the threshold after the last event
+        FloatVectorOperations::fill(adaptiveThresholds.getRawDataPointer() + adaptiveFilledTo,
+            constantThresh, adaptiveBlockLength - adaptiveFilledTo);
+        FloatVectorOperations::fill(adaptiveLearningRates.getRawDataPointer() + adaptiveFilledTo,
+            currLearningRate, adaptiveBlockLength - adaptiveFilledTo);
+        displayedThreshold = constantThresh;
+    }
+}
+
+void CrossingDetector::applyIndicatorEvents()
+{
+    const int numEvents = indicatorValues.size();
+    if (numEvents == 0)
+    {
+        return;
+    }
+
+    // convert the indicator values to errors in place
+    float* const errors = indicatorValues.getRawDataPointer();
+    for (int k = 0; k < numEvents; ++k)
+    {
+        errors[k] = errorFromTarget(errors[k]);
+    }
+
+    /* Each event's learning rate is MLR + DLR_k, where the decaying part DLR_k = DLR_{k-1} / divisor_k
+     * (see currLearningRate). Once DLR_k reaches 0, the divisor no longer matters and is advanced
+     * in closed form.
+     */
+    float* const thresholds = adaptiveThresholds.getRawDataPointer();
+    double* const learningRates = adaptiveLearningRates.getRawDataPointer();
+    double decayingLR = currLearningRate - currMinLearningRate;
+    int numDecayed = 0; // events that applied to the divisor
+    for (int k = 0; k < numEvents; ++k)
+    {
+        // samples before the event keep the threshold from before it
+        const int position = jlimit(adaptiveFilledTo, adaptiveBlockLength, indicatorPositions[k]);
+        FloatVectorOperations::fill(thresholds + adaptiveFilledTo, constantThresh, position - adaptiveFilledTo);
+        FloatVectorOperations::fill(learningRates + adaptiveFilledTo, currMinLearningRate + decayingLR,
+            position - adaptiveFilledTo);
+        adaptiveFilledTo = position;
+
+        if (decayingLR != 0)
+        {
+            currLRDivisor += decayRate;
+            decayingLR /= currLRDivisor;
+            ++numDecayed;
+        }
+
+        constantThresh = static_cast<float>(constantThresh - (currMinLearningRate + decayingLR) * errors[k]);
+        if (useAdaptThreshRange)
+        {
             constantThresh = toThresholdInRange(constantThresh);
         }
-        thresholdVal = constantThresh;
     }
+    currLRDivisor += (numEvents - numDecayed) * decayRate;
+    currLearningRate = decayingLR + currMinLearningRate;
+
+    adaptiveThreshVaries = true;
+    indicatorValues.clearQuick();
+    indicatorPositions.clearQuick();
 }
 
 void CrossingDetector::restartAdaptiveThreshold()
@@ -719,35 +1296,33 @@ float CrossingDetector::toThresholdInRange(float x) const
     return toEquivalentInRange(x, adaptThreshRange);
 }
 
-float CrossingDetector::floatFromBinaryEvent(BinaryEventPtr& eventPtr)
-{
-    jassert(eventPtr != nullptr);
-    const void *ptr = eventPtr->getBinaryDataPointer();
-    switch (eventPtr->getBinaryType())
-    {
-    case EventChannel::INT8_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::int8*>(ptr)));
-    case EventChannel::UINT8_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::uint8*>(ptr)));
-    case EventChannel::INT16_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::int16*>(ptr)));
-    case EventChannel::UINT16_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::uint16*>(ptr)));
-    case EventChannel::INT32_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::int32*>(ptr)));
-    case EventChannel::UINT32_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::uint32*>(ptr)));
-    case EventChannel::INT64_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::int64*>(ptr)));
-    case EventChannel::UINT64_ARRAY:
-        return static_cast<float>(*(static_cast<const juce::uint64*>(ptr)));
-    case EventChannel::FLOAT_ARRAY:
-        return *(static_cast<const float*>(ptr));
-    case EventChannel::DOUBLE_ARRAY:
-        return static_cast<float>(*(static_cast<const double*>(ptr)));
+bool CrossingDetector::readIndicatorValue(const MidiMessage& event, const EventChannel* eventInfo, float* value)
+{
+    const juce::uint8* const raw = event.getRawData();
+    const EventChannel::EventChannelTypes type = eventInfo->getChannelType();
+    if (event.getRawDataSize() < EVENT_HEADER_SIZE + static_cast<int>(eventInfo->getDataSize()) ||
+        raw[1] != static_cast<juce::uint8>(type))
+    {
+        jassertfalse;
+        return false;
+    }
+
+    const juce::uint8* const data = raw + EVENT_HEADER_SIZE;
+    switch (type)
+    {
+    case EventChannel::INT8_ARRAY:   *value = readAsFloat<juce::int8>(data);   return true;
+    case EventChannel::UINT8_ARRAY:  *value = readAsFloat<juce::uint8>(data);  return true;
+    case EventChannel::INT16_ARRAY:  *value = readAsFloat<juce::int16>(data);  return true;
+    case EventChannel::UINT16_ARRAY: *value = readAsFloat<juce::uint16>(data); return true;
+    case EventChannel::INT32_ARRAY:  *value = readAsFloat<juce::int32>(data);  return true;
+    case EventChannel::UINT32_ARRAY: *value = readAsFloat<juce::uint32>(data); return true;
+    case EventChannel::INT64_ARRAY:  *value = readAsFloat<juce::int64>(data);  return true;
+    case EventChannel::UINT64_ARRAY: *value = readAsFloat<juce::uint64>(data); return true;
+    case EventChannel::FLOAT_ARRAY:  *value = readAsFloat<float>(data);        return true;
+    case EventChannel::DOUBLE_ARRAY: *value = readAsFloat<double>(data);       return true;
     default:
         jassertfalse;
-        return 0;
+        return false;
     }
 }
 
@@ -759,10 +1334,16 @@ bool CrossingDetector::isValidIndicatorChan(const EventChannel* eventInfo)
     return isBinary && isNonempty;
 }
 
-float CrossingDetector::nextRandomThresh()
+void CrossingDetector::redrawRandomThresholds()
 {
-    float range = randomThreshRange[1] - randomThreshRange[0];
-    return randomThreshRange[0] + range * rng.nextFloat();
+    // make sure the engine has the current range
+    updateEngineSettings();
+    engine.redrawRandomThresholds();
+
+    if (thresholdType == RANDOM && engine.getNumChannels() > 0)
+    {
+        displayedThreshold = engine.getRandomThreshold(0);
+    }
 }
 
 juce::uint32 CrossingDetector::getSubProcFullID(int chanNum) const
@@ -790,97 +1371,658 @@ String CrossingDetector::toChannelThreshString(int chanNum)
     return "<chan " + String(chanNum + 1) + ">";
 }
 
-bool CrossingDetector::shouldTrigger(bool direction, float preVal, float postVal,
-    float preThresh, float postThresh)
+void CrossingDetector::setMultiChannelInputs(const Array<int>& chans)
 {
-    jassert(pastSamplesAbove >= 0 && futureSamplesAbove >= 0);
-    // check jumpLimit
-    if (useJumpLimit && abs(postVal - preVal) >= jumpLimit)
+    multiChanInputs = chans;
+    if (monitorsMultipleChannels())
     {
-        jumpLimitElapsed = 0;
-        return false;
+        // number of event lines may have changed
+        CoreServices::updateSignalChain(editor);
+    }
+}
+
+void CrossingDetector::updateActiveInputs()
+{
+    activeInputs.clearQuick();
+
+    if (!monitorsMultipleChannels())
+    {
+        if (inputChannel >= 0 && inputChannel < getNumInputs())
+        {
+            activeInputs.add(inputChannel);
+        }
+    }
+    else
+    {
+        // all monitored channels must share a source subprocessor, so that timestamps and
+        // buffer lengths agree with those of the event channel.
+        for (int chan : multiChanInputs)
+        {
+            if (chan >= 0 && chan < getNumInputs() && getSubProcFullID(chan) == validSubProcFullID)
+            {
+                activeInputs.addIfNotAlreadyThere(chan);
+            }
+        }
+    }
+
+    resetChannelStates();
+}
+
+void CrossingDetector::ThreadContext::handleCrossing(const CrossingEngine::Crossing& crossing)
+{
+    crossings.add(crossing);
+}
+
+void CrossingDetector::setWorkerCores(const Array<int>& cores)
+{
+    workerCores = cores;
+}
+
+void CrossingDetector::setEventLogPath(const String& path)
+{
+    eventLogPath = path;
+}
+
+void CrossingDetector::setTTLLines(const Array<int>& lines)
+{
+    ttlLines = lines;
+}
+
+File CrossingDetector::getEventLogFile() const
+{
+    // (an absolute path replaces the directory)
+    File file = File::getSpecialLocation(File::userDocumentsDirectory).getChildFile(eventLogPath);
+    return file.exists() ? file.getNonexistentSibling() : file;
+}
+
+bool CrossingDetector::shouldUseWorkerPool() const
+{
+    // Random thresholds are all drawn from one generator, in order, so those channels aren't
+    // processed in parallel (see CrossingEngine).
+    return workerPool.getNumWorkers() > 0 && activeInputs.size() >= MIN_POOL_CHANNELS &&
+        thresholdType != RANDOM && ruleSweep == nullptr;
+}
+
+void CrossingDetector::runTask(int task, int threadIndex)
+{
+    ThreadContext& context = *threadContexts[threadIndex];
+
+    const int last = jmin((task + 1) * CHANNELS_PER_TASK, activeInputs.size());
+    for (int c = task * CHANNELS_PER_TASK; c < last; ++c)
+    {
+        processChannel(c, *currentBuffer, context, context);
+    }
+}
+
+void CrossingDetector::handleStagedCrossings()
+{
+    stagedCrossings.clearQuick();
+    for (ThreadContext* context : threadContexts)
+    {
+        stagedCrossings.addArray(context->crossings);
+        context->crossings.clearQuick();
+    }
+
+    // The activeInputs share their buffer, so order by the sample of the turning-on event, then by
+    // channel, or by rule in multiple rule mode (each one's crossings are already in order).
+    std::sort(stagedCrossings.begin(), stagedCrossings.end(), CrossingEngine::isEarlier);
+
+    for (const CrossingEngine::Crossing& crossing : stagedCrossings)
+    {
+        handleCrossing(crossing);
+    }
+}
+
+bool CrossingDetector::monitorsMultipleChannels() const
+{
+    return useMultiChannel && !useMultiRule;
+}
+
+CrossingDetector::DetectionRule CrossingDetector::getDefaultRule() const
+{
+    DetectionRule rule;
+    rule.posOn = posOn;
+    rule.negOn = negOn;
+    rule.threshold = constantThresh;
+    rule.pastSpan = pastSpan;
+    rule.futureSpan = futureSpan;
+    rule.pastStrict = pastStrict;
+    rule.futureStrict = futureStrict;
+    rule.timeout = timeout;
+    rule.eventLine = eventChannel;
+    return rule;
+}
+
+void CrossingDetector::setDetectionRules(const Array<DetectionRule>& rules)
+{
+    detectionRules = rules;
+    configureDecimators();
+    if (useMultiRule)
+    {
+        // number of event lines may have changed
+        CoreServices::updateSignalChain(editor);
+    }
+}
+
+bool CrossingDetector::parseDetectionRules(const String& text, const DetectionRule& defaults,
+    Array<DetectionRule>* out)
+{
+    StringArray ruleTexts;
+    ruleTexts.addTokens(text, ";", "");
+    ruleTexts.trim();
+    ruleTexts.removeEmptyStrings();
+
+    Array<DetectionRule> rules;
+    for (const String& ruleText : ruleTexts)
+    {
+        DetectionRule rule = defaults;
+
+        StringArray settings;
+        settings.addTokens(ruleText, " \t", "");
+        settings.removeEmptyStrings();
+
+        for (const String& setting : settings)
+        {
+            const String key = setting.upToFirstOccurrenceOf("=", false, false).toLowerCase();
+            const String value = setting.fromFirstOccurrenceOf("=", false, false);
+            const bool isInt = value.isNotEmpty() && value.containsOnly("0123456789");
+            const bool isFloat = value.isNotEmpty() && value.containsOnly("0123456789.-+eE");
+
+            if (key == "dir" && (value == "rising" || value == "falling" || value == "both"))
+            {
+                rule.posOn = value != "falling";
+                rule.negOn = value != "rising";
+            }
+            else if (key == "thresh" && isFloat)
+            {
+                rule.threshold = value.getFloatValue();
+            }
+            else if (key == "past" && isInt)
+            {
+                rule.pastSpan = value.getIntValue();
+            }
+            else if (key == "pstrict" && isFloat && value.getFloatValue() >= 0 && value.getFloatValue() <= 100)
+            {
+                rule.pastStrict = value.getFloatValue() / 100;
+            }
+            else if (key == "future" && isInt)
+            {
+                rule.futureSpan = value.getIntValue();
+            }
+            else if (key == "fstrict" && isFloat && value.getFloatValue() >= 0 && value.getFloatValue() <= 100)
+            {
+                rule.futureStrict = value.getFloatValue() / 100;
+            }
+            else if (key == "timeout" && isInt)
+            {
+                rule.timeout = value.getIntValue();
+            }
+            else if (key == "line" && isInt && value.getIntValue() >= 1)
+            {
+                rule.eventLine = value.getIntValue() - 1;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        rules.add(rule);
     }
 
-    if (jumpLimitElapsed <= jumpLimitSleep)
+    if (rules.isEmpty())
     {
-        jumpLimitElapsed++;
         return false;
     }
 
-    // number of samples required before and after crossing threshold
-    int pastSamplesNeeded = pastSpan ? static_cast<int>(ceil(pastSpan * pastStrict)) : 0;
-    int futureSamplesNeeded = futureSpan ? static_cast<int>(ceil(futureSpan * futureStrict)) : 0;
-    
-    // four conditions for the event
-    bool preSat = direction != (preVal > preThresh);
-    bool postSat = direction == (postVal > postThresh);
-    bool pastSat = (direction ? pastSpan - pastSamplesAbove : pastSamplesAbove) >= pastSamplesNeeded;
-    bool futureSat = (direction ? futureSamplesAbove : futureSpan - futureSamplesAbove) >= futureSamplesNeeded;
-    
-    return preSat && postSat && pastSat && futureSat;
+    *out = rules;
+    return true;
 }
 
-void CrossingDetector::triggerEvent(juce::int64 bufferTs, int crossingOffset,
-    int bufferLength, float threshold, float crossingLevel)
+String CrossingDetector::detectionRulesToString(const Array<DetectionRule>& rules)
 {
-    // Construct metadata array
-    // The order has to match the order the descriptors are stored in createEventChannels.
-    MetaDataValueArray mdArray;
+    String result;
+    for (const DetectionRule& rule : rules)
+    {
+        if (result.isNotEmpty())
+        {
+            result += "; ";
+        }
 
-    int mdInd = 0;
-    MetaDataValue* crossingPointVal = new MetaDataValue(*eventMetaDataDescriptors[mdInd++]);
-    crossingPointVal->setValue(bufferTs + crossingOffset);
-    mdArray.add(crossingPointVal);
+        result += "dir=" + String(rule.posOn && rule.negOn ? "both" : rule.negOn ? "falling" : "rising");
+        result += " thresh=" + String(rule.threshold);
+        result += " past=" + String(rule.pastSpan) + " pstrict=" + String(100 * rule.pastStrict);
+        result += " future=" + String(rule.futureSpan) + " fstrict=" + String(100 * rule.futureStrict);
+        result += " timeout=" + String(rule.timeout) + " line=" + String(rule.eventLine + 1);
+    }
+    return result;
+}
 
-    MetaDataValue* crossingLevelVal = new MetaDataValue(*eventMetaDataDescriptors[mdInd++]);
-    crossingLevelVal->setValue(crossingLevel);
-    mdArray.add(crossingLevelVal);
+void CrossingDetector::createRuleSweep()
+{
+    if (!useMultiRule || activeInputs.isEmpty())
+    {
+        ruleSweep = nullptr;
+        return;
+    }
 
-    MetaDataValue* threshVal = new MetaDataValue(*eventMetaDataDescriptors[mdInd++]);
-    threshVal->setValue(threshold);
-    mdArray.add(threshVal);
+    // as in updateEngineSettings, the sweep counts evaluated samples
+    const double sampPerEval = getSamplesPerEvaluation();
+    const float sampleRate = getSampleRate();
 
-    MetaDataValue* directionVal = new MetaDataValue(*eventMetaDataDescriptors[mdInd++]);
-    directionVal->setValue(static_cast<juce::uint8>(crossingLevel > threshold));
-    mdArray.add(directionVal);
+    std::vector<CrossingSweep::Lane> lanes;
+    for (const DetectionRule& rule : detectionRules)
+    {
+        CrossingSweep::Lane lane;
+        lane.posOn = rule.posOn;
+        lane.negOn = rule.negOn;
+        lane.threshold = rule.threshold;
+        lane.pastSpan = rule.pastSpan;
+        lane.futureSpan = rule.futureSpan;
+        lane.pastStrict = rule.pastStrict;
+        lane.futureStrict = rule.futureStrict;
+        // (converted as in updateSampleRateDependentValues)
+        const int timeoutFullRate = int(std::floor(rule.timeout * sampleRate / 1000.0f));
+        lane.timeoutSamp = int(std::floor(timeoutFullRate / sampPerEval));
+        lanes.push_back(lane);
+    }
+
+    ruleSweep = new CrossingSweep(getRuleSweepSettings(), lanes);
+}
+
+CrossingEngine::Settings CrossingDetector::getRuleSweepSettings() const
+{
+    CrossingEngine::Settings sweepSettings = engine.getSettings();
+    sweepSettings.useJumpLimit = false;
+    sweepSettings.earlyFire = false;
+    return sweepSettings;
+}
+
+void CrossingDetector::resetChannelStates()
+{
+    int numChans = activeInputs.size();
 
-    MetaDataValue* learningRateVal = new MetaDataValue(*eventMetaDataDescriptors[mdInd++]);
-    learningRateVal->setValue(thresholdType == ADAPTIVE ? currLearningRate : 0);
-    mdArray.add(learningRateVal);
+    // (keeps existing random thresholds)
+    engine.setNumChannels(numChans);
 
-    // Create events
-    int currEventChan = eventChannel;
-    juce::uint8 ttlDataOn = 1 << currEventChan;
+    runningAverages.clear();
+    for (int c = 0; c < numChans; ++c)
+    {
+        runningAverages.add(new AmplitudeAverage());
+    }
+    configureRunningAverages();
+
+    runningPercentiles.clear();
+    for (int c = 0; c < numChans; ++c)
+    {
+        runningPercentiles.add(new AmplitudePercentile());
+    }
+    configureRunningPercentiles();
+
+    decimators.clear();
+    for (int c = 0; c < numChans; ++c)
+    {
+        decimators.add(new Decimator());
+    }
+    configureDecimators();
+
+    pendingTurnoffs.clear();
+}
+
+void CrossingDetector::reserveBlockStorage(int maxLength)
+{
+    // (after setMaxVotingSpan, since the engine's masks also cover the voting history)
+    engine.reserve(maxLength);
+    if (ruleSweep != nullptr)
+    {
+        ruleSweep->reserve(maxLength);
+    }
+
+    for (Decimator* decimator : decimators)
+    {
+        decimator->reserve(maxLength);
+    }
+    for (AmplitudeAverage* average : runningAverages)
+    {
+        average->reserve(maxLength);
+    }
+
+    // (processChannel and beginAdaptiveBlock resize these within the storage reserved here)
+    for (ThreadContext* context : threadContexts)
+    {
+        context->averageThresholds.ensureStorageAllocated(maxLength);
+        context->decimatedInput.ensureStorageAllocated(maxLength);
+        context->decimatedThresholds.ensureStorageAllocated(maxLength);
+    }
+    adaptiveThresholds.ensureStorageAllocated(maxLength);
+    adaptiveLearningRates.ensureStorageAllocated(maxLength);
+
+    // Room for the crossings of a buffer in one direction with no timeout (one every other sample)
+    // on each channel, or each rule. The calling thread's context stages all of them when the pool
+    // isn't used; otherwise each thread handles about an equal share of the tasks (and its staging
+    // only grows if it takes more).
+    const int crossingsPerChannel = maxLength / 2 + 1;
+    const int numStaged = ruleSweep != nullptr ? detectionRules.size() : activeInputs.size();
+    const int numTasks = (activeInputs.size() + CHANNELS_PER_TASK - 1) / CHANNELS_PER_TASK;
+    const int tasksPerThread = (numTasks + threadContexts.size() - 1) / jmax(1, threadContexts.size());
+    for (int t = 0; t < threadContexts.size(); ++t)
+    {
+        const int numChannels = t == 0 ? numStaged : jmin(tasksPerThread * CHANNELS_PER_TASK, numStaged);
+        threadContexts[t]->crossings.ensureStorageAllocated(crossingsPerChannel * numChannels);
+    }
+    stagedCrossings.ensureStorageAllocated(crossingsPerChannel * numStaged);
+}
+
+void CrossingDetector::handleCrossing(const CrossingEngine::Crossing& engineCrossing)
+{
+    // in multiple rule mode, the sweep reports the rule index as the channel
+    const int chanInd = engineCrossing.channel;
+    const int inputInd = ruleSweep != nullptr ? 0 : chanInd;
+    const int crossingOffset = engineCrossing.offset;
+    const juce::int64 bufferTs = engineCrossing.crossingPoint - crossingOffset;
+
+    CrossingInfo crossing;
+    crossing.crossingPoint = engineCrossing.crossingPoint;
+    crossing.crossingLevel = engineCrossing.level;
+    crossing.threshold = engineCrossing.threshold;
+    crossing.learningRate = 0;
+    if (thresholdType == ADAPTIVE && ruleSweep == nullptr)
+    {
+        // the learning rate behind the threshold the crossing was tested against (crossings
+        // confirmed late can be in the previous buffer, which ended with this one's starting rate)
+        crossing.learningRate = !adaptiveThreshVaries ? currLearningRate
+            : crossingOffset < 0 ? adaptiveStartLR : adaptiveLearningRates[crossingOffset];
+    }
+    crossing.sourceChannel = static_cast<juce::uint16>(activeInputs[inputInd]);
+    crossing.interpCrossingPoint = engineCrossing.interpolatedPoint;
+    crossing.decisionLatency = engineCrossing.decisionOffset - crossingOffset;
+    crossing.count = 1;
+
+    if (thresholdType == RANDOM && ruleSweep == nullptr && chanInd == 0)
+    {
+        // the engine has drawn the next threshold
+        displayedThreshold = engine.getRandomThreshold(0);
+    }
+
+    int currEventChan = ruleSweep != nullptr ? detectionRules[chanInd].eventLine
+        : monitorsMultipleChannels() ? eventChannel + chanInd : eventChannel;
+
+    // Add turning-on event
     int sampleNumOn = std::max(crossingOffset, 0);
     juce::int64 eventTsOn = bufferTs + sampleNumOn;
-    TTLEventPtr eventOn = TTLEvent::createTTLEvent(eventChannelPtr, eventTsOn,
-        &ttlDataOn, sizeof(juce::uint8), mdArray, currEventChan);
-    addEvent(eventChannelPtr, eventOn, sampleNumOn);
-
-    juce::uint8 ttlDataOff = 0;
-    int sampleNumOff = sampleNumOn + eventDurationSamp;
-    juce::int64 eventTsOff = bufferTs + sampleNumOff;
-    TTLEventPtr eventOff = TTLEvent::createTTLEvent(eventChannelPtr, eventTsOff,
-        &ttlDataOff, sizeof(juce::uint8), mdArray, currEventChan);
-
-    // Add or schedule turning-off event
-    // We don't care whether there are other turning-offs scheduled to occur either in
-    // this buffer or later. The abilities to change event duration during acquisition and for
-    // events to be longer than the timeout period create a lot of possibilities and edge cases,
-    // but overwriting turnoffEvent unconditionally guarantees that this and all previously
-    // turned-on events will be turned off by this "turning-off" if they're not already off.
-    if (sampleNumOff <= bufferLength)
-    {
-        // add event now
-        addEvent(eventChannelPtr, eventOff, sampleNumOff);
+
+    if (eventLog.isOpen())
+    {
+        CrossingEventLog::Record record = {};
+        record.timestamp = crossing.crossingPoint;
+        record.level = crossing.crossingLevel;
+        record.threshold = crossing.threshold;
+        record.channel = crossing.sourceChannel;
+        record.line = static_cast<juce::uint16>(currEventChan);
+        record.rising = static_cast<juce::uint8>(crossing.crossingLevel > crossing.threshold);
+        eventLog.append(record);
     }
-    else
+
+    if (currEventChan >= ttlLineOn.size())
+    {
+        // the event channel doesn't have this line (so the signal chain is out of date)
+        jassertfalse;
+        return;
+    }
+
+    if (!ttlLineOn[currEventChan])
+    {
+        // logged only
+        return;
+    }
+
+    // Under a flood of crossings (e.g. noise with no timeout), merge them into pulses and/or
+    // limit the event rate, to keep the event pipeline from falling behind.
+    if (useCoalescing && coalesceCrossing(crossing, currEventChan, eventTsOn))
+    {
+        ++numCoalesced;
+        return;
+    }
+
+    if (useRateLimit && !rateLimiter.take(eventTsOn))
+    {
+        ++numRateLimited;
+        return;
+    }
+    lastCrossingTs.set(currEventChan, crossing.crossingPoint);
+
+    if (measureLatency)
+    {
+        // samples until the event leaves with this buffer, and time spent in process() so far
+        const juce::int64 bufferEndTs = bufferTs + getNumSamples(activeInputs[inputInd]);
+        const auto elapsed = std::chrono::steady_clock::now() - processStartTime;
+        latencyStats.record(bufferEndTs - engineCrossing.crossingPoint, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    addTTLEvent(crossing, currEventChan, true, eventTsOn, sampleNumOn);
+
+    // Schedule turning-off event
+    // If this line is still on from a previous event (i.e. the event duration is longer than the
+    // timeout), that event's turning-off would cut this one short, so it is superseded and the
+    // two pulses merge. Turn-offs that come before this event, or are on other lines, are kept.
+    pendingTurnoffs.removeIf([=](const PendingTurnoff& turnoff)
+    {
+        return turnoff.line == currEventChan && turnoff.timestamp >= eventTsOn;
+    });
+
+    if (pendingTurnoffs.isFull())
+    {
+        // Make room by adding the ones before this event. Later ones may still be superseded by
+        // crossings that haven't been handled yet (on other lines, since crossings arrive in time order).
+        releaseTurnoffs(bufferTs, static_cast<int>(eventTsOn - bufferTs));
+    }
+
+    PendingTurnoff turnoff;
+    turnoff.timestamp = eventTsOn + eventDurationSamp;
+    turnoff.line = currEventChan;
+    turnoff.crossing = crossing;
+
+    if (!pendingTurnoffs.push(turnoff))
     {
-        // save for later
-        turnoffEvent = eventOff;
+        // Should be impossible, since there is at most one turn-off per line in the future.
+        jassertfalse;
     }
 }
 
+bool CrossingDetector::coalesceCrossing(const CrossingInfo& crossing, int line, juce::int64 eventTs)
+{
+    if (crossing.crossingPoint - lastCrossingTs[line] > coalesceSamples)
+    {
+        return false;
+    }
+
+    // The line is on if its latest turn-off hasn't been added yet (there is at most one at or after eventTs).
+    PendingTurnoff merged;
+    bool isOn = false;
+    pendingTurnoffs.removeIf([&](const PendingTurnoff& turnoff)
+    {
+        if (turnoff.line == line && turnoff.timestamp >= eventTs)
+        {
+            merged = turnoff;
+            isOn = true;
+            return true;
+        }
+        return false;
+    });
+
+    if (!isOn)
+    {
+        return false;
+    }
+
+    merged.timestamp = jmax(merged.timestamp, eventTs + eventDurationSamp);
+    merged.crossing.count += crossing.count;
+    pendingTurnoffs.push(merged); // (the removed element made room)
+    lastCrossingTs.set(line, crossing.crossingPoint);
+    return true;
+}
+
+void CrossingDetector::addTTLEvent(const CrossingInfo& crossing, int line, bool state,
+    juce::int64 timestamp, int sampleNum)
+{
+    // Fill in metadata values
+    // The order matches the order the descriptors are stored in createEventChannels.
+    // Events must provide every metadata field declared by their channel, so the turning-off event
+    // carries the same values as the turning-on event (or nothing, under METADATA_NONE).
+    MetaDataValueArray& mdArray = getFreeEventMetaData();
+
+    int mdInd = 0;
+    if (includesEventMetaData(MD_CROSSING_POINT))
+    {
+        mdArray[mdInd++]->setValue(crossing.crossingPoint);
+    }
+
+    if (includesEventMetaData(MD_CROSSING_LEVEL))
+    {
+        mdArray[mdInd++]->setValue(crossing.crossingLevel);
+    }
+
+    if (includesEventMetaData(MD_THRESHOLD))
+    {
+        mdArray[mdInd++]->setValue(crossing.threshold);
+    }
+
+    if (includesEventMetaData(MD_DIRECTION))
+    {
+        mdArray[mdInd++]->setValue(static_cast<juce::uint8>(crossing.crossingLevel > crossing.threshold));
+    }
+
+    if (includesEventMetaData(MD_LEARNING_RATE))
+    {
+        mdArray[mdInd++]->setValue(crossing.learningRate);
+    }
+
+    if (includesEventMetaData(MD_INTERP_CROSSING_POINT))
+    {
+        mdArray[mdInd++]->setValue(crossing.interpCrossingPoint);
+    }
+
+    if (includesEventMetaData(MD_DECISION_LATENCY))
+    {
+        mdArray[mdInd++]->setValue(static_cast<juce::int32>(crossing.decisionLatency));
+    }
+
+    if (includesEventMetaData(MD_CROSSING_COUNT))
+    {
+        mdArray[mdInd++]->setValue(crossing.count);
+    }
+
+    if (monitorsMultipleChannels())
+    {
+        mdArray[mdInd++]->setValue(crossing.sourceChannel);
+    }
+
+    // Create event
+    juce::uint8* const pTtlData = ttlData.getRawDataPointer();
+    ttlData.fill(0);
+    if (state)
+    {
+        pTtlData[line / 8] = 1 << (line % 8);
+    }
+
+    TTLEventPtr event = TTLEvent::createTTLEvent(eventChannelPtr, timestamp,
+        pTtlData, ttlData.size(), mdArray, line);
+    addEvent(eventChannelPtr, event, sampleNum);
+}
+
+void CrossingDetector::releaseTurnoffs(juce::int64 bufferTs, int bufferLength)
+{
+    const juce::int64 bufferEndTs = bufferTs + bufferLength;
+    while (!pendingTurnoffs.isEmpty() && pendingTurnoffs.top().timestamp < bufferEndTs)
+    {
+        const PendingTurnoff& turnoff = pendingTurnoffs.top();
+        int sampleNum = static_cast<int>(jmax(juce::int64(0), turnoff.timestamp - bufferTs));
+        addTTLEvent(turnoff.crossing, turnoff.line, false, turnoff.timestamp, sampleNum);
+        pendingTurnoffs.pop();
+    }
+}
+
+bool CrossingDetector::includesEventMetaData(EventMetaDataField field) const
+{
+    if (field == MD_INTERP_CROSSING_POINT)
+    {
+        return crossingInterpolation != INTERP_NONE && metaDataProfile != METADATA_NONE;
+    }
+
+    if (field == MD_CROSSING_COUNT)
+    {
+        return useCoalescing && metaDataProfile != METADATA_NONE;
+    }
+
+    switch (metaDataProfile)
+    {
+    case METADATA_FULL:
+        return true;
+
+    case METADATA_MINIMAL:
+        return field == MD_CROSSING_POINT || field == MD_DIRECTION;
+
+    default:
+        return false;
+    }
+}
+
+MetaDataValueArray* CrossingDetector::createEventMetaDataSet() const
+{
+    auto mdArray = new MetaDataValueArray();
+
+    for (int field = 0; field < NUM_EVENT_METADATA_FIELDS; ++field)
+    {
+        if (includesEventMetaData(static_cast<EventMetaDataField>(field)))
+        {
+            mdArray->add(new MetaDataValue(*eventMetaDataDescriptors[field]));
+        }
+    }
+
+    if (monitorsMultipleChannels())
+    {
+        mdArray->add(new MetaDataValue(*sourceChanMetaDataDescriptor));
+    }
+
+    return mdArray;
+}
+
+void CrossingDetector::allocateEventMetaDataPool(int numSets)
+{
+    eventMetaDataPool.clear();
+    eventMetaDataPool.ensureStorageAllocated(numSets);
+    for (int i = 0; i < numSets; ++i)
+    {
+        eventMetaDataPool.add(createEventMetaDataSet());
+    }
+    nextEventMetaDataSet = 0;
+}
+
+MetaDataValueArray& CrossingDetector::getFreeEventMetaData()
+{
+    // Values in a set are always shared together, so checking the first one is enough.
+    auto isFree = [](const MetaDataValueArray* mdArray)
+    {
+        return mdArray->size() == 0 || mdArray->getUnchecked(0)->getReferenceCount() == 1;
+    };
+
+    const int numSets = eventMetaDataPool.size();
+    for (int i = 0; i < numSets; ++i)
+    {
+        int setInd = (nextEventMetaDataSet + i) % numSets;
+        if (isFree(eventMetaDataPool[setInd]))
+        {
+            nextEventMetaDataSet = (setInd + 1) % numSets;
+            return *eventMetaDataPool[setInd];
+        }
+    }
+
+    // all in use (or pool not allocated yet) - grow the pool
+    nextEventMetaDataSet = 0;
+    return *eventMetaDataPool.add(createEventMetaDataSet());
+}
+
 void CrossingDetector::updateSampleRateDependentValues()
 {
     float sampleRate = getSampleRate();
@@ -888,8 +2030,80 @@ void CrossingDetector::updateSampleRateDependentValues()
     eventDurationSamp = int(std::ceil(eventDuration * sampleRate / 1000.0f));
     timeoutSamp = int(std::floor(timeout * sampleRate / 1000.0f));
     bufferEndMaskSamp = int(std::ceil(bufferEndMaskMs * sampleRate / 1000.0f));
+    rateLimitPerSample = rateLimit / sampleRate;
+    rateLimiter.setLimit(rateLimitPerSample, rateLimitBurst);
 
     if (averageDecaySeconds < 0.1)
         averageDecaySeconds = 0.1;
-    averageNewSampWeight = 1.0 / (averageDecaySeconds * sampleRate);
+    configureRunningAverages();
+
+    if (percentileSeconds < 0.1)
+        percentileSeconds = 0.1;
+    configureRunningPercentiles();
+}
+
+void CrossingDetector::configureRunningAverages()
+{
+    const double lengthSamples = averageDecaySeconds * getSampleRate();
+    const auto window = static_cast<AmplitudeAverage::Window>(averageWindow);
+
+    for (AmplitudeAverage* average : runningAverages)
+    {
+        average->configure(window, lengthSamples);
+    }
+}
+
+void CrossingDetector::configureRunningPercentiles()
+{
+    const double windowSamples = percentileSeconds * getSampleRate();
+
+    for (AmplitudePercentile* percentile : runningPercentiles)
+    {
+        percentile->configure(percentileRank, windowSamples);
+    }
+}
+
+Decimator::Mode CrossingDetector::getDecimationMode() const
+{
+    return useMinMaxDecimation ? Decimator::MIN_MAX : Decimator::SUBSAMPLE;
+}
+
+double CrossingDetector::getSamplesPerEvaluation() const
+{
+    return Decimator::getSamplesPerOutput(decimationFactor, getDecimationMode());
+}
+
+void CrossingDetector::configureDecimators()
+{
+    const int historyLength = getVotingHistoryLength();
+
+    for (Decimator* decimator : decimators)
+    {
+        decimator->configure(decimationFactor, getDecimationMode());
+        // far enough back to map crossings the engine (or sweep) reports in earlier blocks
+        decimator->setHistoryLength(historyLength);
+    }
+}
+
+void CrossingDetector::resizeDecimatorHistories()
+{
+    const int historyLength = getVotingHistoryLength();
+    for (Decimator* decimator : decimators)
+    {
+        decimator->resizeHistory(historyLength);
+    }
+}
+
+int CrossingDetector::getVotingHistoryLength() const
+{
+    // as in CrossingEngine::setMaxVotingSpan
+    int historyLength = jmax(pastSpan + futureSpan, maxVotingSpan) + 2;
+    if (useMultiRule)
+    {
+        for (const DetectionRule& rule : detectionRules)
+        {
+            historyLength = jmax(historyLength, rule.pastSpan + rule.futureSpan + 2);
+        }
+    }
+    return historyLength;
 }
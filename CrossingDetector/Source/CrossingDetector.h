@@ -24,11 +24,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef CROSSING_DETECTOR_H_INCLUDED
 #define CROSSING_DETECTOR_H_INCLUDED
 
-// FIXME - Debugging switch
-#define TATTLE_ON_NEW_CHANNEL 0
-
 #include <ProcessorHeaders.h>
-#include "CircularArray.h"
+#include "AmplitudeAverage.h"
+#include "AmplitudePercentile.h"
+#include "CrossingEngine.h"
+#include "CrossingEventLog.h"
+#include "EventRateLimiter.h"
+#include "CrossingSweep.h"
+#include "Decimator.h"
+#include "LatencyStats.h"
+#include "PendingEventQueue.h"
+#include "ProcessStats.h"
+#include "WorkerPool.h"
+
+#include <chrono> // for steady_clock
 
 /*
  * The crossing detector plugin is designed to read in one continuous channel c, and generate events on one events channel
@@ -38,14 +47,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *  - the duration of the generated event
  *  - the minimum time to wait between events ("timeout")
  *  - whether to use a constant threshold, draw one randomly from a range for each event, or read thresholds from an input channel
+ *  - or to scale the threshold by a running estimate of the input's amplitude (RMS or a percentile of the absolute value)
  *
  * All ontinuous signals pass through unchanged, so multiple CrossingDetectors can be
- * chained together in order to operate on more than one channel.
+ * chained together in order to operate on more than one channel. Alternatively, in multi-channel
+ * mode a single instance monitors a set of channels from the same source as the input channel,
+ * keeping separate detection state for each one and firing on one TTL line per channel.
+ * In multiple rule mode, a single instance instead applies several rules (each with its own
+ * directions, constant threshold, voting, timeout and TTL line) to the input channel, in one pass
+ * over the data rather than one instance per rule.
+ *
+ * Detection itself is done by a CrossingEngine; this processor computes the thresholds,
+ * feeds it each buffer and turns the crossings it reports into TTL events. With many channels,
+ * groups of them can be processed in parallel by a pool of worker threads.
+ *
+ * Crossings can also be logged as compact binary records to a file of their own (see
+ * CrossingEventLog), bypassing the event pipeline; TTL events can then be limited to the
+ * lines that need them.
  *
- * @see GenericProcessor
+ * @see GenericProcessor, CrossingEngine
  */
 
-class CrossingDetector : public GenericProcessor
+class CrossingDetector : public GenericProcessor, private CrossingEngine::EventSink,
+    private WorkerPool::Job, private Timer
 {
     friend class CrossingDetectorEditor;
 
@@ -57,15 +81,8 @@ public:
     AudioProcessorEditor* createEditor() override;
 
     void createEventChannels() override;
-#if TATTLE_ON_NEW_CHANNEL
-    // We have to manually add channels in updateSettings().
-    // createDataChannels() is only called for sources.
+    // Adds the threshold output channels, if wanted.
     void updateSettings() override;
-    // FIXME - Add Phase Calculator's kludge for new channels.
-    // Other methods that PC overrides have reasonable default implementations.
-// NOTE - This doesn't help; still no output.
-//    bool isGeneratesTimestamps() const override { return true; }
-#endif
 
     void process(AudioSampleBuffer& continuousBuffer) override;
 
@@ -77,7 +94,39 @@ public:
     float getSampleRate(int subProcessorIdx = 0) const override;
 
 private:
-    enum ThresholdType { CONSTANT, RANDOM, CHANNEL, ADAPTIVE, AVERAGE };
+    enum ThresholdType { CONSTANT, RANDOM, CHANNEL, ADAPTIVE, AVERAGE, PERCENTILE };
+
+    // Which of the per-event metadata fields are attached to each event
+    //  - FULL:    all EventMetaDataFields
+    //  - MINIMAL: crossing point and direction only
+    //  - NONE:    no per-event metadata
+    // (In multi-channel mode, the source channel is always included. If interpolation is on,
+    // the interpolated crossing point is included in FULL and MINIMAL, as is the crossing count
+    // if coalescing.)
+    enum MetaDataProfile { METADATA_FULL, METADATA_MINIMAL, METADATA_NONE };
+
+    // How to estimate the sub-sample crossing time (MD_INTERP_CROSSING_POINT is only included if not NONE).
+    // Same order as CrossingEngine::Interpolation.
+    enum CrossingInterpolation { INTERP_NONE, INTERP_LINEAR, INTERP_CUBIC };
+
+    // Window of the running RMS for AVERAGE thresholds. Same order as AmplitudeAverage::Window.
+    //  - EXPONENTIAL: exponentially weighted, with time constant averageDecaySeconds
+    //  - BOXCAR:      unweighted over the last averageDecaySeconds
+    enum AverageWindow { AVERAGE_EXPONENTIAL, AVERAGE_BOXCAR };
+
+    // Order of the descriptors in eventMetaDataDescriptors
+    enum EventMetaDataField
+    {
+        MD_CROSSING_POINT,
+        MD_CROSSING_LEVEL,
+        MD_THRESHOLD,
+        MD_DIRECTION,
+        MD_LEARNING_RATE,
+        MD_INTERP_CROSSING_POINT,
+        MD_DECISION_LATENCY,
+        MD_CROSSING_COUNT,
+        NUM_EVENT_METADATA_FIELDS
+    };
 
     enum Parameter
     {
@@ -114,19 +163,69 @@ private:
         USE_BUF_END_MASK,
         BUF_END_MASK,
         AVERAGE_DECAY_TIME,
-        WANT_TATTLE_THRESH
+        WANT_TATTLE_THRESH,
+        MULTI_CHAN_ON,
+        METADATA_PROFILE,
+        CROSSING_INTERP,
+        EARLY_FIRE,
+        AVERAGE_WINDOW,
+        PERCENTILE_RANK,
+        PERCENTILE_WINDOW,
+        DECIMATION,
+        DECIMATION_MIN_MAX,
+        MEASURE_LATENCY,
+        MULTI_RULE_ON,
+        NUM_WORKER_THREADS,
+        PIN_WORKER_THREADS,
+        MAX_VOTING_SPAN,
+        LOG_CROSSINGS,
+        TTL_LINES_ONLY,
+        USE_RATE_LIMIT,
+        RATE_LIMIT,
+        RATE_LIMIT_BURST,
+        USE_COALESCING,
+        COALESCE_WINDOW,
+        RESTART_ADAPTATION // (value ignored)
+    };
+
+    // One rule of multiple rule mode (times in milliseconds, line 0-based)
+    struct DetectionRule
+    {
+        bool posOn;
+        bool negOn;
+        float threshold;
+        int pastSpan;
+        int futureSpan;
+        float pastStrict;
+        float futureStrict;
+        int timeout;
+        int eventLine;
     };
 
     // ---------------------------- PRIVATE FUNCTIONS ----------------------
 
     /*********** adaptive threshold *************/
 
-    /* Use events created by the phase calculator to adapt threshold, if the threshold
-     * mode is adaptive.
+    /* Collects the values of events created by the phase calculator to adapt the threshold,
+     * if the threshold mode is adaptive (applied by applyIndicatorEvents).
      */
     void handleEvent(const EventChannel* eventInfo, const MidiMessage& event,
         int samplePosition = 0) override;
 
+    /* The adaptive threshold changes at the sample position of each indicator event. Around
+     * checkForEvents, beginAdaptiveBlock and endAdaptiveBlock fill adaptiveThresholds (and
+     * adaptiveLearningRates) with the threshold (and learning rate) of each sample of the buffer
+     * if any events arrived (setting adaptiveThreshVaries); otherwise, the whole buffer uses
+     * constantThresh (and currLearningRate).
+     */
+    void beginAdaptiveBlock(int numSamples);
+    void endAdaptiveBlock();
+
+    /* Updates the threshold and learning rate from the indicator events collected so far, filling
+     * adaptiveThresholds and adaptiveLearningRates up to the last one's position, and clears them.
+     */
+    void applyIndicatorEvents();
+
     // Restart the learning rate decaying process (updating start and min learning rates to match UI)
     void restartAdaptiveThreshold();
 
@@ -148,19 +247,20 @@ private:
     // toEquivalentInRange with range = thresholdRange
     float toThresholdInRange(float x) const;
 
-    /* Convert the first element of a binary event to a float, regardless of the type
-     * (assumes eventPtr is not null)
+    /* Converts the first element of a binary event on the given channel to a float, regardless
+     * of the type, reading it directly from the serialized event (without allocating).
+     * Returns false if the event is malformed.
      */
-    static float floatFromBinaryEvent(BinaryEventPtr& eventPtr);
+    static bool readIndicatorValue(const MidiMessage& event, const EventChannel* eventInfo, float* value);
 
     // Returns whether the given event chan can be used to train an adaptive threshold.
     static bool isValidIndicatorChan(const EventChannel* eventInfo);
 
     /********** random threshold ***********/
 
-    // Select a new random threshold using minThresh, maxThresh, and rng.
-    float nextRandomThresh();
- 
+    // Draws new random thresholds for all channels (after the range or threshold type changes).
+    void redrawRandomThresholds();
+
     /********** channel threshold ***********/
 
     // Retrieves the full source subprocessor ID of the given channel.
@@ -175,42 +275,252 @@ private:
     // Returns a string to display in the threshold box when using a threshold channel
     static String toChannelThreshString(int chanNum);
 
+    /********** multi-channel mode ***********/
+
+    // Sets the channels to monitor in multi-channel mode (takes effect on the next signal chain update).
+    void setMultiChannelInputs(const Array<int>& chans);
+
+    /* Recalculates activeInputs from the current mode and settings: the input channel in single-channel
+     * mode, or the valid channels of multiChanInputs (same source subprocessor as the input channel)
+     * in multi-channel mode.
+     */
+    void updateActiveInputs();
+
+    // Allocates and resets the per-channel detection state for the current activeInputs.
+    void resetChannelStates();
+
+    /* Reserves the storage of the engine, rule sweep, decimators, running averages and thread
+     * contexts for buffers of up to maxLength samples, so that process() doesn't allocate.
+     */
+    void reserveBlockStorage(int maxLength);
+
+    // Whether each of several channels is being monitored (multi-channel mode is off while using multiple rules).
+    bool monitorsMultipleChannels() const;
+
+    /********** multiple rule mode ***********/
+
+    // A rule with the current main settings (used as the defaults for fields a rule doesn't give).
+    DetectionRule getDefaultRule() const;
+
+    // Sets the rules used in multiple rule mode (takes effect on the next signal chain update).
+    void setDetectionRules(const Array<DetectionRule>& rules);
+
+    /* Parses a list of rules separated by semicolons, each a list of key=value settings
+     * (e.g. "dir=rising thresh=50 line=1; dir=falling thresh=-50 line=2"). Keys: dir (rising,
+     * falling or both), thresh, past, pstrict, future, fstrict (in %), timeout (ms) and line
+     * (1-based); settings a rule doesn't give are taken from defaults.
+     * Returns false (and leaves *out unchanged) if the text is not a valid nonempty list.
+     */
+    static bool parseDetectionRules(const String& text, const DetectionRule& defaults,
+        Array<DetectionRule>* out);
+
+    // Inverse of parseDetectionRules (with every setting given)
+    static String detectionRulesToString(const Array<DetectionRule>& rules);
+
+    // Recreates ruleSweep from the detectionRules and current settings, if using multiple rules.
+    void createRuleSweep();
+
+    /* The engine settings that the rules share (buffer end mask, interpolation). Jump limit
+     * and early firing aren't supported by CrossingSweep, so are off.
+     */
+    CrossingEngine::Settings getRuleSweepSettings() const;
+
+    /********** parallel processing ***********/
+
+    /* Scratch space for processChannel on one thread. On a worker thread, crossings are also
+     * collected here, to be handled on the processing thread once every channel is done.
+     */
+    struct ThreadContext : public CrossingEngine::EventSink
+    {
+        // Stages the crossing.
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override;
+
+        // (preallocated, see reserveBlockStorage)
+        Array<CrossingEngine::Crossing> crossings;
+
+        // AVERAGE or PERCENTILE threshold of the current buffer
+        Array<float> averageThresholds;
+
+        // decimated input and threshold of the current buffer
+        Array<float> decimatedInput;
+        Array<float> decimatedThresholds;
+    };
+
+    // Sets the cores that the worker threads may run on, if pinned (takes effect when acquisition starts).
+    void setWorkerCores(const Array<int>& cores);
+
+    // Whether to process the activeInputs of the current buffer on the worker pool, rather than in order.
+    bool shouldUseWorkerPool() const;
+
+    // Processes the task-th group of CHANNELS_PER_TASK activeInputs of currentBuffer.
+    void runTask(int task, int threadIndex) override;
+
+    // Passes the crossings collected by each thread to handleCrossing, in the order of their events.
+    void handleStagedCrossings();
+
+    // Runs detection on one of the activeInputs (by index into activeInputs), using the given
+    // thread's scratch space and reporting crossings to the given sink.
+    void processChannel(int chanInd, AudioSampleBuffer& continuousBuffer, ThreadContext& context,
+        CrossingEngine::EventSink& sink);
+
+    /* Updates the channel's running average with the current buffer, and if pThresh is not
+     * null, fills it with the AVERAGE threshold of each sample.
+     */
+    void updateRunningAverage(int chanInd, const float* rp, float* pThresh, int nSamples);
+
+    /* Same as updateRunningAverage, for the channel's running percentile and the
+     * PERCENTILE threshold.
+     */
+    void updateRunningPercentile(int chanInd, const float* rp, float* pThresh, int nSamples);
+
+    // Copies the detection parameters to the engine.
+    void updateEngineSettings();
+
+    /********* detector variants **********/
+
+    static const int VARIANT_INACTIVE = CrossingEngine::VARIANT_INACTIVE;
+    static const int VARIANT_MULTI_RULE = -3; // all rules by ruleSweep
+
+    // Human-readable summary of a detector variant, for the visualizer.
+    static String getDetectorVariantDescription(int variant);
+
+    // Variant used for the first channel of the latest buffer (or VARIANT_INACTIVE).
+    int getActiveDetectorVariant() const;
+
     /*********  triggering ************/
 
-    /* Whether there should be a trigger in the given direction (true = rising, float = falling),
-     * given the current pastCounter and futureCounter and the passed values and thresholds
-     * surrounding the point where a crossing may be.
+    /* Adds the "turning-on" event for a crossing reported by the engine and schedules
+     * the "turning-off" event.
+     */
+    void handleCrossing(const CrossingEngine::Crossing& engineCrossing) override;
+
+    // Values describing a detected crossing, used to fill in event metadata
+    struct CrossingInfo
+    {
+        juce::int64 crossingPoint;
+        float crossingLevel;
+        float threshold;
+        double learningRate;
+        juce::uint16 sourceChannel;
+        double interpCrossingPoint;
+        int decisionLatency; // samples from crossingPoint to the sample at which it was confirmed
+        juce::uint32 count;  // crossings merged into the event (see coalesceCrossing)
+    };
+
+    // A turning-off event waiting to be added (see PendingEventQueue)
+    struct PendingTurnoff
+    {
+        juce::int64 timestamp;
+        int line;
+        CrossingInfo crossing;
+    };
+
+    // Sets the file crossings are logged to (takes effect when acquisition starts).
+    void setEventLogPath(const String& path);
+
+    // Sets the lines on which to add TTL events while logging crossings, if limited (takes effect when acquisition starts).
+    void setTTLLines(const Array<int>& lines);
+
+    /* The file to log to in the coming acquisition: eventLogPath, relative to the documents
+     * directory, with a number added to the name if the file already exists.
      */
-    bool shouldTrigger(bool direction, float preVal, float postVal, float preThresh, float postThresh);
-
-    /* Add "turning-on" and "turning-off" event for a crossing.
-     *  - bufferTs:       Timestamp of start of current buffer
-     *  - crossingOffset: Difference betweeen time of actual crossing and bufferTs
-     *  - bufferLength:   Number of samples in current buffer
-     *  - threshold:      Threshold at the time of the crossing
-     *  - crossingLevel:  Level of signal at the first sample after the crossing
+    File getEventLogFile() const;
+
+    /* If the given line is still on from an event whose last crossing was at most coalesceSamples
+     * before this one, extends that event's pulse and adds to the count its turning-off event
+     * carries, and returns true. Otherwise returns false (and a new event should be added).
      */
-    void triggerEvent(juce::int64 bufferTs, int crossingOffset, int bufferLength,
-        float threshold, float crossingLevel);
+    bool coalesceCrossing(const CrossingInfo& crossing, int line, juce::int64 eventTs);
+
+    // Adds a turning-on (state = true) or turning-off event for a crossing on the given line.
+    void addTTLEvent(const CrossingInfo& crossing, int line, bool state, juce::int64 timestamp, int sampleNum);
 
+    // Adds all pending turning-off events with timestamps before the end of the given buffer, in order.
+    void releaseTurnoffs(juce::int64 bufferTs, int bufferLength);
+
+    /* Event metadata values are kept in a pool of preallocated sets (matching the descriptors added
+     * in createEventChannels) and updated in place, rather than allocated for each event. A set can
+     * be reused once no event (e.g. a scheduled turn-off) holds a reference to its values anymore.
+     */
+
+    // Whether the given field is included in events under the current metadata profile.
+    bool includesEventMetaData(EventMetaDataField field) const;
+
+    // Creates a set of metadata values for the current event channel's descriptors.
+    MetaDataValueArray* createEventMetaDataSet() const;
+
+    // Replaces the pool with numSets new metadata sets.
+    void allocateEventMetaDataPool(int numSets);
+
+    // Returns an unused set from the pool (only allocating if all sets are in use).
+    MetaDataValueArray& getFreeEventMetaData();
+
+
+    /********* parameter updates **********/
+
+    // Sets a parameter immediately. During acquisition, only called from process() (on the processing thread).
+    void applyParameter(int parameterIndex, float newValue);
+
+    // Applies changes queued by setParameter during acquisition, in order.
+    void applyPendingParameterChanges();
+
+    /* Message thread: moves changes waiting in overflowChanges into the FIFO as far as it has room.
+     * During acquisition, the timer retries until they all fit.
+     */
+    void flushParameterChanges();
+
+    // Message thread: copies displayedThreshold or displayedThreshChannel into thresholdVal.
+    void updateThresholdDisplay();
+
+    // Runs during acquisition, to flush parameter changes and update the threshold label.
+    void timerCallback() override;
 
     /********* misc **********/
     
     // Converts parameters specified in ms to samples, and updates the corresponding member variables.
     void updateSampleRateDependentValues();
 
+    // Applies averageWindow and averageDecaySeconds to each of the runningAverages.
+    // Only allocates if a boxcar window's length changes.
+    void configureRunningAverages();
+
+    // Applies percentileRank and percentileSeconds to each of the runningPercentiles.
+    void configureRunningPercentiles();
+
+    // Applies decimationFactor, useMinMaxDecimation and the (longest) voting spans to each of the decimators.
+    void configureDecimators();
+
+    Decimator::Mode getDecimationMode() const;
+
+    // Full-rate samples per sample the engine evaluates, as the decimators count them
+    // (for converting times in samples to the engine's units).
+    double getSamplesPerEvaluation() const;
+
+    // Resizes the decimators' histories for changed voting spans, without resetting them.
+    void resizeDecimatorHistories();
+
+    // History the engine keeps for the voting spans, in (decimated) samples
+    int getVotingHistoryLength() const;
+
     // ------ PARAMETERS ------------
 
     ThresholdType thresholdType;
 
     bool wantTattleThreshold;
 
+    // whether to record the latency of each event (see LatencyStats)
+    bool measureLatency;
+
     // if using constant threshold:
     float constantThresh;
 
     // if using multiple-of-average threshold:
     float averageDecaySeconds;
-    float averageNewSampWeight;
+    AverageWindow averageWindow;
+
+    // if using multiple-of-percentile threshold:
+    float percentileRank; // 0 to 100
+    float percentileSeconds; // window length
 
     // if using adaptive threshold:
     int indicatorChan; // index of the monitored event channel
@@ -226,13 +536,50 @@ private:
 
     // if using random thresholds:
     float randomThreshRange[2];
-    float currRandomThresh;
 
     // if using channel threshold:
     int thresholdChannel;
 
     int inputChannel;
     int eventChannel;
+
+    // multi-channel mode
+    bool useMultiChannel;
+
+    // worker threads helping the processing thread (0 = none), and if pinWorkerThreads,
+    // the (0-based) cores they may run on
+    int numWorkerThreads;
+    bool pinWorkerThreads;
+    Array<int> workerCores;
+
+    // multiple rule mode
+    bool useMultiRule;
+    Array<DetectionRule> detectionRules;
+
+    MetaDataProfile metaDataProfile;
+
+    // whether to write a record of each crossing to eventLogPath (see CrossingEventLog), and if so,
+    // whether to only add TTL events on the (0-based) ttlLines
+    bool logCrossings;
+    String eventLogPath;
+    bool useTTLLines;
+    Array<int> ttlLines;
+
+    // if useRateLimit, at most rateLimit events per second are added, in bursts of up to
+    // rateLimitBurst (a token bucket refilled over sample time); other crossings are dropped
+    bool useRateLimit;
+    float rateLimit;
+    int rateLimitBurst;
+    double rateLimitPerSample;
+
+    // if useCoalescing, crossings within coalesceSamples of the previous one on their line are
+    // merged into its event while the line is still on (see coalesceCrossing)
+    bool useCoalescing;
+    int coalesceSamples;
+
+    CrossingInterpolation crossingInterpolation;
+    Array<int> multiChanInputs; // requested channels (may include unavailable ones)
+
     bool posOn;
     bool negOn;
 
@@ -253,40 +600,137 @@ private:
     int pastSpan;
     int futureSpan;
 
+    /* Largest pastSpan + futureSpan allowed during acquisition. The engine keeps this much history
+     * from the start, so that the spans can be changed while running without reallocating or
+     * waiting for new samples.
+     */
+    int maxVotingSpan;
+
     // fraction of spans required to be above / below threshold
     float pastStrict;
     float futureStrict;
 
+    // whether to fire as soon as the future vote is guaranteed to pass (see updateEarlyCandidate)
+    bool useEarlyFire;
+
     // maximum absolute difference between x[k] and x[k-1] to trigger an event on x[k]
     bool useJumpLimit;
     float jumpLimit;
     float jumpLimitSleep;
-    int jumpLimitElapsed;
+
+    /* If decimationFactor > 1, crossings are only evaluated on every decimationFactor-th sample,
+     * or on the minimum and maximum of each group of decimationFactor samples if useMinMaxDecimation.
+     * Voting spans then count evaluated samples; times are still converted from ms at the full rate.
+     */
+    int decimationFactor;
+    bool useMinMaxDecimation;
 
     // ------ INTERNALS -----------
 
-    // the next time at which the detector should be reenabled after a timeout period, measured in
-    // samples past the start of the current processing buffer. Less than -numNext if there is no scheduled reenable (i.e. the detector is enabled).
-    int sampToReenable;
+    // channels actually being monitored; per-channel state below is indexed by position in this array
+    Array<int> activeInputs;
+
+    // detection state of each of the activeInputs
+    CrossingEngine engine;
+
+    // detection state of each rule in multiple rule mode (null otherwise); crossings are reported
+    // with the rule index as their channel
+    ScopedPointer<CrossingSweep> ruleSweep;
+
+    // running RMS of each of the activeInputs
+    OwnedArray<AmplitudeAverage> runningAverages;
+
+    // running percentile of the absolute value of each of the activeInputs
+    OwnedArray<AmplitudePercentile> runningPercentiles;
+
+#if CROSSING_DETECTOR_STATS
+    // processing time and detection counters since acquisition started, for the status display
+    ProcessStats processStats;
+#endif
+
+    // when the current call to process() started
+    std::chrono::steady_clock::time_point processStartTime;
+
+    // latency of each event since acquisition started (or measureLatency was turned on)
+    LatencyStats latencyStats;
+
+    // open during acquisition if logging crossings
+    CrossingEventLog eventLog;
+
+    // whether TTL events are added on each line in the current acquisition
+    Array<bool> ttlLineOn;
+
+    // token bucket of the rate limit (see useRateLimit)
+    EventRateLimiter rateLimiter;
 
-     // counters for delay keeping track of voting samples
-    int pastSamplesAbove;
-    int futureSamplesAbove;
+    // latest crossing point of an event (or crossing merged into one) on each line
+    Array<juce::int64> lastCrossingTs;
 
-    // arrays to implement past/future voting
-    CircularArray<float> inputHistory;
-    CircularArray<float> thresholdHistory;
+    // crossings merged into an earlier event and dropped by the rate limiter since acquisition started
+    Atomic<juce::int64> numCoalesced;
+    Atomic<juce::int64> numRateLimited;
 
-    Array<float> currThresholds;
+    // samples to evaluate for each of the activeInputs, if decimating
+    OwnedArray<Decimator> decimators;
 
-    bool averageNeedsInit;
-    float runningSquaredAverage;
+    // Buffers are at most the audio device's block size, which may not be set yet when
+    // acquisition starts, so storage is reserved for at least the longest buffer seen so far and
+    // DEFAULT_MAX_BLOCK_LENGTH (longer buffers still work, but allocate the first time).
+    static const int DEFAULT_MAX_BLOCK_LENGTH = 1024;
+    int maxBlockLength;
+
+    // The pool is used with at least MIN_POOL_CHANNELS activeInputs, in tasks of CHANNELS_PER_TASK
+    // (smaller counts are faster to process in order than to hand off).
+    static const int CHANNELS_PER_TASK = 8;
+    static const int MIN_POOL_CHANNELS = 32;
+    WorkerPool workerPool;
+
+    // for the processing thread (index 0) and each worker
+    OwnedArray<ThreadContext> threadContexts;
+
+    // crossings staged by all threads in the current buffer, in order (preallocated, see reserveBlockStorage)
+    Array<CrossingEngine::Crossing> stagedCrossings;
+
+    // buffer being processed on the worker pool
+    AudioSampleBuffer* currentBuffer;
+
+    // write pointers of the tattleChannels for the current buffer (gotten on the processing thread)
+    Array<float*> thresholdOutputs;
+
+    Atomic<int> activeDetectorVariant;
+
+    // Parameter changes from the message thread during acquisition. setParameter writes
+    // and process() reads, so no locking is needed.
+    struct ParameterChange
+    {
+        int index;
+        float value;
+    };
+
+    static const int PARAMETER_FIFO_SIZE = 256;
+    AbstractFifo parameterFifo;
+    Array<ParameterChange> parameterChanges;
+
+    // Changes that didn't fit in the FIFO, with only the latest value of each parameter kept
+    // (message thread only).
+    Array<ParameterChange> overflowChanges;
+    static const int MESSAGE_TIMER_MS = 50;
 
     EventChannel* eventChannelPtr;
     MetaDataDescriptorArray eventMetaDataDescriptors;
-    TTLEventPtr turnoffEvent; // holds a turnoff event that must be added in a later buffer
+    ReferenceCountedObjectPtr<MetaDataDescriptor> sourceChanMetaDataDescriptor; // per-event source channel (multi-channel mode only)
+    PendingEventQueue<PendingTurnoff> pendingTurnoffs; // turning-off events that must be added in a later buffer
+    Array<juce::uint8> ttlData; // scratch TTL word, sized for the event channel's lines
+
+    OwnedArray<MetaDataValueArray> eventMetaDataPool;
+    int nextEventMetaDataSet;
 
-    Value thresholdVal; // underlying value of the threshold label
+    Value thresholdVal; // underlying value of the threshold label (message thread only)
+
+    // What the threshold label should show, set wherever the threshold changes (also on the
+    // processing thread) and copied into thresholdVal by updateThresholdDisplay.
+    Atomic<float> displayedThreshold;
+    Atomic<int> displayedThreshChannel; // -1 unless the threshold type is CHANNEL
 
     /* If using adaptive threshold, learning rate evolves by this formula (LR = learning rate, MLR = min learning rate):
      * LR_{t} = (LR_{t-1} - MLR) / divisor_{t} + MLR
@@ -296,17 +740,29 @@ private:
     double currLearningRate;
     double currMinLearningRate;
     double currLRDivisor;  // what the LR was last divided by
+
+    // values and sample positions of the indicator events received so far in the current buffer (preallocated)
+    static const int MAX_INDICATOR_BATCH = 1024;
+    Array<float> indicatorValues;
+    Array<int> indicatorPositions;
+
+    // adaptive threshold of each sample of the current buffer, if adaptiveThreshVaries
+    Array<float> adaptiveThresholds;
+    // learning rate in effect at each of those samples (for the crossing metadata)
+    Array<double> adaptiveLearningRates;
+    double adaptiveStartLR; // learning rate at the start of the current buffer
+    bool adaptiveThreshVaries;
+    int adaptiveBlockLength;
+    int adaptiveFilledTo; // samples of adaptiveThresholds filled in so far
     
     String indicatorChanName; // save so that we can try to find a matching channel when updating
 
-    Random rng; // for random thresholds
-
     // full subprocessor ID of input channel (or 0 if none selected)
     juce::uint32 validSubProcFullID;
 
-#if TATTLE_ON_NEW_CHANNEL
-    DataChannel *tattleChannelPtr;
-#endif
+    // index of the output channel carrying the threshold of each of the activeInputs
+    // (empty if not outputting thresholds)
+    Array<int> tattleChannels;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CrossingDetector);
 };
@@ -128,13 +128,156 @@ CrossingDetectorEditor::CrossingDetectorEditor(GenericProcessor* parentNode, boo
 
     Font subtitleFont(16, Font::bold);
 
+    /* ~~~~~~~~ Input channels ~~~~~~~~ */
+
+    inputGroupSet = new VerticalGroupSet("Input controls");
+    optionsPanel->addAndMakeVisible(inputGroupSet, 0);
+
+    xPos = LEFT_EDGE;
+    yPos += 45;
+
+    inputTitle = new Label("InputTitle", "Input channels");
+    inputTitle->setBounds(bounds = { xPos, yPos, 200, 50 });
+    inputTitle->setFont(subtitleFont);
+    optionsPanel->addAndMakeVisible(inputTitle);
+    opBounds = opBounds.getUnion(bounds);
+
+    /* --------- Multi-channel mode --------- */
+
+    xPos += TAB_WIDTH;
+    yPos += 45;
+
+    static const String multiChanTT =
+        "Detect crossings on each of the listed channels (e.g. \"1-16, 33\") with a single instance. "
+        "Only channels from the same source as the input channel are used. The first listed channel "
+        "fires on the output event channel, the second on the next one, and so on.";
+
+    multiChanButton = new ToggleButton("Monitor multiple channels:");
+    multiChanButton->setBounds(bounds = { xPos, yPos, 200, C_TEXT_HT });
+    multiChanButton->setToggleState(processor->useMultiChannel, dontSendNotification);
+    multiChanButton->setTooltip(multiChanTT);
+    multiChanButton->addListener(this);
+    optionsPanel->addAndMakeVisible(multiChanButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    multiChanEditable = createEditable("MultiChanE", channelListToString(processor->multiChanInputs),
+        multiChanTT, bounds = { xPos + 200, yPos, 150, C_TEXT_HT });
+    multiChanEditable->setEnabled(processor->useMultiChannel);
+    optionsPanel->addAndMakeVisible(multiChanEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    inputGroupSet->addGroup({ multiChanButton, multiChanEditable });
+
+    /* --------- Multiple rule mode --------- */
+
+    yPos += 40;
+
+    static const String multiRuleTT =
+        "Apply several rules to the input channel in one pass, instead of using one instance per rule. "
+        "Rules are separated by semicolons, each a list of settings such as "
+        "\"dir=rising thresh=50 timeout=1000 line=1; dir=falling thresh=-50 line=2\". "
+        "Settings: dir (rising, falling or both), thresh, past and future (voting spans), pstrict and "
+        "fstrict (in %), timeout (ms) and line (event channel); any not given are taken from the "
+        "current settings. Thresholds are constant; the threshold type, jump limit, early firing and "
+        "multi-channel mode are not used.";
+
+    multiRuleButton = new ToggleButton("Apply multiple rules:");
+    multiRuleButton->setBounds(bounds = { xPos, yPos, 200, C_TEXT_HT });
+    multiRuleButton->setToggleState(processor->useMultiRule, dontSendNotification);
+    multiRuleButton->setTooltip(multiRuleTT);
+    multiRuleButton->addListener(this);
+    optionsPanel->addAndMakeVisible(multiRuleButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    multiRuleEditable = createEditable("MultiRuleE",
+        CrossingDetector::detectionRulesToString(processor->detectionRules), multiRuleTT,
+        bounds = { xPos + 200, yPos, 400, C_TEXT_HT });
+    multiRuleEditable->setEnabled(processor->useMultiRule);
+    optionsPanel->addAndMakeVisible(multiRuleEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    inputGroupSet->addGroup({ multiRuleButton, multiRuleEditable });
+
+    /* --------- Decimation --------- */
+
+    yPos += 40;
+
+    static const String decimationTT =
+        "Only evaluate crossings on every nth sample, to save processing time on slowly changing signals. "
+        "Event times are still reported at the full sample rate. Sample voting spans count evaluated samples.";
+
+    decimationLabel = new Label("DecimationL", "Evaluate every");
+    decimationLabel->setBounds(bounds = { xPos, yPos, 100, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(decimationLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    decimationEditable = createEditable("DecimationE", String(processor->decimationFactor),
+        decimationTT, bounds = { xPos + 100, yPos, 40, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(decimationEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    decimationUnitLabel = new Label("DecimationU", "samples");
+    decimationUnitLabel->setBounds(bounds = { xPos + 145, yPos, 60, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(decimationUnitLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    decimationMinMaxButton = new ToggleButton("using the min and max of each group");
+    decimationMinMaxButton->setBounds(bounds = { xPos + 210, yPos, 250, C_TEXT_HT });
+    decimationMinMaxButton->setToggleState(processor->useMinMaxDecimation, dontSendNotification);
+    decimationMinMaxButton->setTooltip("Instead of every nth sample, evaluate the smallest and largest sample "
+        "of each group of n, so that brief excursions across the threshold are not missed.");
+    decimationMinMaxButton->setEnabled(processor->decimationFactor > 1);
+    decimationMinMaxButton->addListener(this);
+    optionsPanel->addAndMakeVisible(decimationMinMaxButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    inputGroupSet->addGroup({ decimationLabel, decimationEditable, decimationUnitLabel, decimationMinMaxButton });
+
+    /* --------- Worker threads --------- */
+
+    yPos += 40;
+
+    static const String workerThreadsTT =
+        "Number of extra threads that process groups of channels in parallel with the acquisition thread, "
+        "when monitoring many channels (0 = process all channels on the acquisition thread).";
+
+    workerThreadsLabel = new Label("WorkerThreadsL", "Worker threads:");
+    workerThreadsLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(workerThreadsLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    workerThreadsEditable = createEditable("WorkerThreadsE", String(processor->numWorkerThreads),
+        workerThreadsTT, bounds = { xPos + 110, yPos, 40, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(workerThreadsEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    static const String workerCoresTT =
+        "Only run the worker threads on the listed cores (numbered from 0, e.g. \"2-7\"), "
+        "for instance to keep them off the core of the acquisition thread.";
+
+    pinWorkersButton = new ToggleButton("on cores:");
+    pinWorkersButton->setBounds(bounds = { xPos + 155, yPos, 85, C_TEXT_HT });
+    pinWorkersButton->setToggleState(processor->pinWorkerThreads, dontSendNotification);
+    pinWorkersButton->setTooltip(workerCoresTT);
+    pinWorkersButton->addListener(this);
+    optionsPanel->addAndMakeVisible(pinWorkersButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    workerCoresEditable = createEditable("WorkerCoresE", channelListToString(processor->workerCores, 0),
+        workerCoresTT, bounds = { xPos + 240, yPos, 100, C_TEXT_HT });
+    workerCoresEditable->setEnabled(processor->pinWorkerThreads);
+    optionsPanel->addAndMakeVisible(workerCoresEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    inputGroupSet->addGroup({ workerThreadsLabel, workerThreadsEditable, pinWorkersButton, workerCoresEditable });
+
     /* ~~~~~~~~ Threshold type ~~~~~~~~ */
 
     thresholdGroupSet = new VerticalGroupSet("Threshold controls");
     optionsPanel->addAndMakeVisible(thresholdGroupSet, 0);
 
     xPos = LEFT_EDGE;
-    yPos += 45;
+    yPos += 40;
 
     thresholdTitle = new Label("ThresholdTitle", "Threshold type");
     thresholdTitle->setBounds(bounds = { xPos, yPos, 200, 50 });
@@ -186,10 +329,71 @@ CrossingDetectorEditor::CrossingDetectorEditor(GenericProcessor* parentNode, boo
     optionsPanel->addAndMakeVisible(averageTimeLabel);
     opBounds = opBounds.getUnion(bounds);
 
+    averageWindowBox = new ComboBox("averageWindowBox");
+    averageWindowBox->addItem("exponential", CrossingDetector::AVERAGE_EXPONENTIAL + 1);
+    averageWindowBox->addItem("boxcar", CrossingDetector::AVERAGE_BOXCAR + 1);
+    averageWindowBox->setSelectedId(processor->averageWindow + 1, dontSendNotification);
+    averageWindowBox->setBounds(bounds = { xPos + 320, yPos, 110, C_TEXT_HT });
+    averageWindowBox->setTooltip("Exponential: recent samples are weighted more, with this time constant. "
+        "Boxcar: all samples within this window are weighted equally (uses memory proportional to its length, "
+        "so the length can't be changed during acquisition).");
+    averageWindowBox->setEnabled(averageThreshButton->getToggleState());
+    averageWindowBox->addListener(this);
+    optionsPanel->addAndMakeVisible(averageWindowBox);
+    opBounds = opBounds.getUnion(bounds);
+
     thresholdGroupSet->addGroup({
         averageThreshButton,
         averageTimeLabel,
-        averageTimeEditable
+        averageTimeEditable,
+        averageWindowBox
+    });
+
+    /* -------- Multiple of percentile threshold --------- */
+
+    yPos += 40;
+
+    percentileThreshButton = new ToggleButton("Multiple of |input| percentile");
+    percentileThreshButton->setLookAndFeel(&rbLookAndFeel);
+    percentileThreshButton->setRadioGroupId(threshRadioId, dontSendNotification);
+    percentileThreshButton->setBounds(bounds = { xPos, yPos, 200, C_TEXT_HT });
+    percentileThreshButton->setToggleState(processor->thresholdType == CrossingDetector::PERCENTILE,
+        dontSendNotification);
+    percentileThreshButton->setTooltip("Use a percentile of the absolute amplitude over a sliding window, multiplied by "
+        "a constant (set on the main editor panel in the signal chain). For a signal with zero median, such as a band-passed "
+        "spike channel, the 50th percentile is the median absolute deviation (MAD); e.g. a threshold of -4.5 gives -4.5 * MAD.");
+    percentileThreshButton->addListener(this);
+    optionsPanel->addAndMakeVisible(percentileThreshButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    percentileRankEditable = createEditable("PctRankE", String(processor->percentileRank),
+        "Percentile (0-100)", bounds = { xPos + 210, yPos, 40, C_TEXT_HT });
+    percentileRankEditable->setEnabled(percentileThreshButton->getToggleState());
+    optionsPanel->addAndMakeVisible(percentileRankEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    percentileOverLabel = new Label("PctOverL", "% over");
+    percentileOverLabel->setBounds(bounds = { xPos + 255, yPos, 50, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(percentileOverLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    percentileTimeEditable = createEditable("PctTimeE", String(processor->percentileSeconds),
+        "Length of the sliding window", bounds = { xPos + 310, yPos, 50, C_TEXT_HT });
+    percentileTimeEditable->setEnabled(percentileThreshButton->getToggleState());
+    optionsPanel->addAndMakeVisible(percentileTimeEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    percentileTimeLabel = new Label("PctTimeL", "seconds");
+    percentileTimeLabel->setBounds(bounds = { xPos + 370, yPos, 50, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(percentileTimeLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    thresholdGroupSet->addGroup({
+        percentileThreshButton,
+        percentileRankEditable,
+        percentileOverLabel,
+        percentileTimeEditable,
+        percentileTimeLabel
     });
 
     /* --------- Adaptive threshold -------- */
@@ -599,11 +803,50 @@ CrossingDetectorEditor::CrossingDetectorEditor(GenericProcessor* parentNode, boo
     optionsPanel->addAndMakeVisible(votingFooter);
     opBounds = opBounds.getUnion(bounds);
 
+    xPos = LEFT_EDGE + 2 * TAB_WIDTH;
+    yPos += 30;
+
+    earlyFireButton = new ToggleButton("Fire as soon as the future vote is certain to pass");
+    earlyFireButton->setBounds(bounds = { xPos, yPos, 340, C_TEXT_HT });
+    earlyFireButton->setToggleState(processor->useEarlyFire, dontSendNotification);
+    earlyFireButton->setTooltip("Instead of waiting for all of the samples after X[k], trigger as soon as "
+        "enough of them are on the correct side of the threshold. This reduces latency when the future "
+        "span extends past the end of the buffer. The number of samples from the crossing to the decision "
+        "is recorded in the \"Decision latency\" metadata field (full metadata profile).");
+    earlyFireButton->addListener(this);
+    optionsPanel->addAndMakeVisible(earlyFireButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    xPos = LEFT_EDGE + 2 * TAB_WIDTH;
+    yPos += 30;
+
+    static const String maxSpanTT =
+        "Largest total of the past and future spans that can be set during acquisition. History for "
+        "this many samples is kept from the start, so changing the spans while running takes effect "
+        "immediately, without reallocating or waiting for new samples to vote on.";
+
+    maxSpanLabel = new Label("MaxSpanL", "Allow spans totaling up to");
+    maxSpanLabel->setBounds(bounds = { xPos, yPos, 180, C_TEXT_HT });
+    maxSpanLabel->setTooltip(maxSpanTT);
+    optionsPanel->addAndMakeVisible(maxSpanLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    maxSpanEditable = createEditable("MaxSpanE", String(processor->maxVotingSpan), maxSpanTT,
+        bounds = { xPos += 180, yPos, 45, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(maxSpanEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    maxSpanUnitLabel = new Label("MaxSpanUnitL", "samples during acquisition");
+    maxSpanUnitLabel->setBounds(bounds = { xPos += 50, yPos, 180, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(maxSpanUnitLabel);
+    opBounds = opBounds.getUnion(bounds);
+
     criteriaGroupSet->addGroup({
         votingHeader,
         pastStrictLabel,   pastPctEditable,   pastPctLabel,   pastSpanEditable,   pastSpanLabel,
         futureStrictLabel, futurePctEditable, futurePctLabel, futureSpanEditable, futureSpanLabel,
-        votingFooter
+        votingFooter,      earlyFireButton,
+        maxSpanLabel,      maxSpanEditable,   maxSpanUnitLabel
     });
 
 
@@ -676,39 +919,325 @@ CrossingDetectorEditor::CrossingDetectorEditor(GenericProcessor* parentNode, boo
 
     outputGroupSet->addGroup({ durationLabel, durationEditable, durationUnit });
 
+    /* ------------------ Event rate limit --------------- */
+
+    xPos = LEFT_EDGE + TAB_WIDTH;
+    yPos += 45;
+
+    static const String rateLimitTT = "Add at most this many events per second (on average), with bursts "
+        "of up to the given number of events; further crossings are dropped, to protect the rest of the "
+        "signal chain from a noisy channel. Counted in sample time, across all lines.";
+
+    rateLimitButton = new ToggleButton("Limit to");
+    rateLimitButton->setBounds(bounds = { xPos, yPos, 75, C_TEXT_HT });
+    rateLimitButton->setToggleState(processor->useRateLimit, dontSendNotification);
+    rateLimitButton->setTooltip(rateLimitTT);
+    rateLimitButton->addListener(this);
+    optionsPanel->addAndMakeVisible(rateLimitButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    rateLimitEditable = createEditable("RateLimitE", String(processor->rateLimit), rateLimitTT,
+        bounds = { xPos += 80, yPos, 50, C_TEXT_HT });
+    rateLimitEditable->setEnabled(processor->useRateLimit);
+    optionsPanel->addAndMakeVisible(rateLimitEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    rateLimitBurstLabel = new Label("RateLimitBurstL", "events/s, bursts of");
+    rateLimitBurstLabel->setBounds(bounds = { xPos += 55, yPos, 125, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(rateLimitBurstLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    rateLimitBurstEditable = createEditable("RateLimitBurstE", String(processor->rateLimitBurst),
+        rateLimitTT, bounds = { xPos += 130, yPos, 40, C_TEXT_HT });
+    rateLimitBurstEditable->setEnabled(processor->useRateLimit);
+    optionsPanel->addAndMakeVisible(rateLimitBurstEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    xPos = LEFT_EDGE + TAB_WIDTH;
+    yPos += 30;
+
+    static const String coalesceTT = "While a line is on, merge each crossing within this many samples of "
+        "the previous one into the same event, extending its pulse instead of adding another event. "
+        "Events then carry a \"Crossing count\" field (final on the turning-off event). "
+        "The window can be changed during acquisition, but not whether to merge.";
+
+    coalesceButton = new ToggleButton("Merge crossings within");
+    coalesceButton->setBounds(bounds = { xPos, yPos, 165, C_TEXT_HT });
+    coalesceButton->setToggleState(processor->useCoalescing, dontSendNotification);
+    coalesceButton->setTooltip(coalesceTT);
+    coalesceButton->addListener(this);
+    optionsPanel->addAndMakeVisible(coalesceButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    coalesceEditable = createEditable("CoalesceE", String(processor->coalesceSamples), coalesceTT,
+        bounds = { xPos += 170, yPos, 40, C_TEXT_HT });
+    coalesceEditable->setEnabled(processor->useCoalescing);
+    optionsPanel->addAndMakeVisible(coalesceEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    coalesceUnitLabel = new Label("CoalesceUnitL", "samples into one event");
+    coalesceUnitLabel->setBounds(bounds = { xPos += 45, yPos, 150, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(coalesceUnitLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    outputGroupSet->addGroup({ rateLimitButton, rateLimitEditable, rateLimitBurstLabel, rateLimitBurstEditable,
+        coalesceButton, coalesceEditable, coalesceUnitLabel });
+
+    /* ------------------ Metadata profile --------------- */
+
+    xPos = LEFT_EDGE + TAB_WIDTH;
+    yPos += 45;
+
+    metaDataLabel = new Label("MetaDataL", "Event metadata:");
+    metaDataLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(metaDataLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    metaDataBox = new ComboBox("metaDataBox");
+    metaDataBox->addItem("Full", CrossingDetector::METADATA_FULL + 1);
+    metaDataBox->addItem("Minimal (crossing point, direction)", CrossingDetector::METADATA_MINIMAL + 1);
+    metaDataBox->addItem("None", CrossingDetector::METADATA_NONE + 1);
+    metaDataBox->setSelectedId(processor->metaDataProfile + 1, dontSendNotification);
+    metaDataBox->setBounds(bounds = { xPos + 115, yPos, 240, C_TEXT_HT });
+    metaDataBox->setTooltip("Which metadata fields each event carries. \"Full\" adds crossing point, "
+        "crossing level, threshold, direction, learning rate and decision latency. Less metadata means smaller event files "
+        "and less work per event at high event rates. Turning-off events carry the same fields as "
+        "turning-on events.");
+    metaDataBox->addListener(this);
+    optionsPanel->addAndMakeVisible(metaDataBox);
+    opBounds = opBounds.getUnion(bounds);
+
+    yPos += 30;
+
+    interpLabel = new Label("InterpL", "Crossing time:");
+    interpLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    optionsPanel->addAndMakeVisible(interpLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    interpBox = new ComboBox("interpBox");
+    interpBox->addItem("Sample after crossing", CrossingDetector::INTERP_NONE + 1);
+    interpBox->addItem("Linear interpolation", CrossingDetector::INTERP_LINEAR + 1);
+    interpBox->addItem("Cubic interpolation", CrossingDetector::INTERP_CUBIC + 1);
+    interpBox->setSelectedId(processor->crossingInterpolation + 1, dontSendNotification);
+    interpBox->setBounds(bounds = { xPos + 115, yPos, 240, C_TEXT_HT });
+    interpBox->setTooltip("If interpolation is selected, events also carry an estimate of the "
+        "fractional sample time at which the threshold was crossed (\"crossing.point.interpolated\"). "
+        "Cubic interpolation also uses the two samples before the crossing pair, so it needs no samples "
+        "after the crossing. Not included with the \"None\" metadata profile.");
+    interpBox->addListener(this);
+    optionsPanel->addAndMakeVisible(interpBox);
+    opBounds = opBounds.getUnion(bounds);
+
+    outputGroupSet->addGroup({ metaDataLabel, metaDataBox, interpLabel, interpBox });
+
     /* ------------------ Tattle channels --------------- */
 
     xPos = LEFT_EDGE + TAB_WIDTH;
     yPos += 45;
 
-    // NOTE - In a perfect world, we'd create a new channel for the threshold, but that's misbehaving. Overwrite the input instead.
-#if TATTLE_ON_NEW_CHANNEL
     tattleThreshButton = new ToggleButton("Output threshold value on a new channel.");
-#else
-    tattleThreshButton = new ToggleButton("Output threshold value (replacing input).");
-#endif
     tattleThreshButton->setBounds(bounds = { xPos, yPos, 270, C_TEXT_HT });
     tattleThreshButton->setToggleState(processor->wantTattleThreshold, dontSendNotification);
     tattleThreshButton->addListener(this);
-#if TATTLE_ON_NEW_CHANNEL
-    tattleThreshButton->setTooltip("Create a new channel and use it to record the running threshold value for debugging purposes.");
-#else
-    tattleThreshButton->setTooltip("Replace the input channel's data with the running threshold value for debugging purposes.");
-#endif
+    tattleThreshButton->setTooltip("Add an output channel for each monitored channel, carrying the threshold "
+        "it is compared against at each sample (for debugging, or to record alongside the data). "
+        "Can't be changed during acquisition.");
     optionsPanel->addAndMakeVisible(tattleThreshButton);
     opBounds = opBounds.getUnion(bounds);
 
     outputGroupSet->addGroup({ tattleThreshButton });
 
+    /* ------------------ Latency measurement --------------- */
+
+    yPos += 30;
+
+    latencyButton = new ToggleButton("Measure event latency");
+    latencyButton->setBounds(bounds = { xPos, yPos, 270, C_TEXT_HT });
+    latencyButton->setToggleState(processor->measureLatency, dontSendNotification);
+    latencyButton->addListener(this);
+    latencyButton->setTooltip("Record how long each event takes to leave the plugin: the number of samples "
+        "from the crossing point to the end of the buffer in which the event is added (which depends on "
+        "the buffer size, future span and buffer end mask), and the time spent processing the buffer "
+        "before the event is added. Percentiles are shown in the status section and saved with the settings.");
+    optionsPanel->addAndMakeVisible(latencyButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    outputGroupSet->addGroup({ latencyButton });
+
+    /* ------------------ Crossing log --------------- */
+
+    yPos += 40;
+
+    static const String eventLogTT =
+        "Write a 24-byte record of each crossing (timestamp, source channel, TTL line, crossing level, "
+        "threshold and direction) to this file, directly rather than through the Record Node. Relative paths "
+        "are in the documents directory; if the file exists, a number is added to the new one's name.";
+
+    eventLogButton = new ToggleButton("Log crossings to file:");
+    eventLogButton->setBounds(bounds = { xPos, yPos, 160, C_TEXT_HT });
+    eventLogButton->setToggleState(processor->logCrossings, dontSendNotification);
+    eventLogButton->setTooltip(eventLogTT);
+    eventLogButton->addListener(this);
+    optionsPanel->addAndMakeVisible(eventLogButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    eventLogEditable = createEditable("EventLogE", processor->eventLogPath, eventLogTT,
+        bounds = { xPos + 165, yPos, 200, C_TEXT_HT });
+    eventLogEditable->setEnabled(processor->logCrossings);
+    optionsPanel->addAndMakeVisible(eventLogEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    yPos += 30;
+
+    static const String ttlLinesTT =
+        "While logging crossings, only add TTL events on the listed lines (e.g. the ones that drive "
+        "hardware outputs). Crossings on other lines are only logged.";
+
+    ttlLinesButton = new ToggleButton("TTL events only on lines:");
+    ttlLinesButton->setBounds(bounds = { xPos, yPos, 160, C_TEXT_HT });
+    ttlLinesButton->setToggleState(processor->useTTLLines, dontSendNotification);
+    ttlLinesButton->setEnabled(processor->logCrossings);
+    ttlLinesButton->setTooltip(ttlLinesTT);
+    ttlLinesButton->addListener(this);
+    optionsPanel->addAndMakeVisible(ttlLinesButton);
+    opBounds = opBounds.getUnion(bounds);
+
+    ttlLinesEditable = createEditable("TTLLinesE", channelListToString(processor->ttlLines), ttlLinesTT,
+        bounds = { xPos + 165, yPos, 100, C_TEXT_HT });
+    ttlLinesEditable->setEnabled(processor->logCrossings && processor->useTTLLines);
+    optionsPanel->addAndMakeVisible(ttlLinesEditable);
+    opBounds = opBounds.getUnion(bounds);
+
+    outputGroupSet->addGroup({ eventLogButton, eventLogEditable, ttlLinesButton, ttlLinesEditable });
+
+    /* ~~~~~~~~~~~~~~~ Status section ~~~~~~~~~~~~ */
+
+    statusGroupSet = new VerticalGroupSet("Status displays");
+    optionsPanel->addAndMakeVisible(statusGroupSet, 0);
+
+    xPos = LEFT_EDGE;
+    yPos += 40;
+
+    statusTitle = new Label("statusTitle", "Status");
+    statusTitle->setBounds(bounds = { xPos, yPos, 150, 50 });
+    statusTitle->setFont(subtitleFont);
+    optionsPanel->addAndMakeVisible(statusTitle);
+    opBounds = opBounds.getUnion(bounds);
+
+    /* ------------------ Detector variant --------------- */
+
+    xPos = LEFT_EDGE + TAB_WIDTH;
+    yPos += 45;
+
+    variantLabel = new Label("VariantL", "Active detector:");
+    variantLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    variantLabel->setTooltip("Which compiled detection loop is processing the (first) input channel. "
+        "This depends on the current settings and is updated during acquisition.");
+    optionsPanel->addAndMakeVisible(variantLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    variantValue = new Label("VariantV",
+        CrossingDetector::getDetectorVariantDescription(CrossingDetector::VARIANT_INACTIVE));
+    variantValue->setBounds(bounds = { xPos + 115, yPos, 250, 6 * C_TEXT_HT });
+    variantValue->setJustificationType(Justification::topLeft);
+    optionsPanel->addAndMakeVisible(variantValue);
+    opBounds = opBounds.getUnion(bounds);
+
+    statusGroupSet->addGroup({ variantLabel, variantValue });
+    yPos += 5 * C_TEXT_HT;
+
+    /* ------------------ Event latency --------------- */
+
+    yPos += 40;
+
+    latencyLabel = new Label("LatencyL", "Event latency:");
+    latencyLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    latencyLabel->setTooltip("Percentiles of the latency of each event since acquisition started "
+        "(or measurement was turned on). Enable with \"Measure event latency\" under Output.");
+    optionsPanel->addAndMakeVisible(latencyLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    latencyValue = new Label("LatencyV", "");
+    latencyValue->setBounds(bounds = { xPos + 115, yPos, 400, 4 * C_TEXT_HT });
+    latencyValue->setJustificationType(Justification::topLeft);
+    optionsPanel->addAndMakeVisible(latencyValue);
+    opBounds = opBounds.getUnion(bounds);
+
+    statusGroupSet->addGroup({ latencyLabel, latencyValue });
+    yPos += 3 * C_TEXT_HT;
+
+    /* ------------------ Event limits --------------- */
+
+    yPos += 40;
+
+    eventLimitLabel = new Label("EventLimitL", "Event limits:");
+    eventLimitLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    eventLimitLabel->setTooltip("Crossings merged into an earlier event and dropped by the rate limit "
+        "since acquisition started (see \"Limit to\" and \"Merge crossings within\" under Output).");
+    optionsPanel->addAndMakeVisible(eventLimitLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    eventLimitValue = new Label("EventLimitV", "");
+    eventLimitValue->setBounds(bounds = { xPos + 115, yPos, 400, C_TEXT_HT });
+    eventLimitValue->setJustificationType(Justification::topLeft);
+    optionsPanel->addAndMakeVisible(eventLimitValue);
+    opBounds = opBounds.getUnion(bounds);
+
+    statusGroupSet->addGroup({ eventLimitLabel, eventLimitValue });
+
+    /* ------------------ Crossing log --------------- */
+
+    yPos += 40;
+
+    eventLogLabel = new Label("EventLogL", "Crossing log:");
+    eventLogLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    eventLogLabel->setTooltip("File the crossings of the current (or last) acquisition are logged to, and "
+        "how many records have been written. Records are dropped if the disk falls too far behind.");
+    optionsPanel->addAndMakeVisible(eventLogLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    eventLogValue = new Label("EventLogV", "");
+    eventLogValue->setBounds(bounds = { xPos + 115, yPos, 400, 2 * C_TEXT_HT });
+    eventLogValue->setJustificationType(Justification::topLeft);
+    optionsPanel->addAndMakeVisible(eventLogValue);
+    opBounds = opBounds.getUnion(bounds);
+
+    statusGroupSet->addGroup({ eventLogLabel, eventLogValue });
+    yPos += C_TEXT_HT;
+
+#if CROSSING_DETECTOR_STATS
+    /* ------------------ Processing statistics --------------- */
+
+    yPos += 40;
+
+    statsLabel = new Label("StatsL", "Processing:");
+    statsLabel->setBounds(bounds = { xPos, yPos, 110, C_TEXT_HT });
+    statsLabel->setTooltip("Processing time per buffer and what happened to each threshold crossing "
+        "since acquisition started. Times include all monitored channels.");
+    optionsPanel->addAndMakeVisible(statsLabel);
+    opBounds = opBounds.getUnion(bounds);
+
+    statsValue = new Label("StatsV", "");
+    statsValue->setBounds(bounds = { xPos + 115, yPos, 400, 14 * C_TEXT_HT });
+    statsValue->setJustificationType(Justification::topLeft);
+    optionsPanel->addAndMakeVisible(statsValue);
+    opBounds = opBounds.getUnion(bounds);
+
+    statusGroupSet->addGroup({ statsLabel, statsValue });
+    yPos += 13 * C_TEXT_HT;
+#endif
+
 
     // some extra padding
     opBounds.setBottom(opBounds.getBottom() + 10);
     opBounds.setRight(opBounds.getRight() + 10);
 
     optionsPanel->setBounds(opBounds);
+    inputGroupSet->setBounds(opBounds);
     thresholdGroupSet->setBounds(opBounds);
     criteriaGroupSet->setBounds(opBounds);
     outputGroupSet->setBounds(opBounds);
+    statusGroupSet->setBounds(opBounds);
 }
 
 CrossingDetectorEditor::~CrossingDetectorEditor() {}
@@ -728,6 +1257,24 @@ void CrossingDetectorEditor::comboBoxChanged(ComboBox* comboBoxThatHasChanged)
             static_cast<float>(outputBox->getSelectedId() - 1));
     }
 
+    else if (comboBoxThatHasChanged == metaDataBox)
+    {
+        processor->setParameter(CrossingDetector::METADATA_PROFILE,
+            static_cast<float>(metaDataBox->getSelectedId() - 1));
+    }
+
+    else if (comboBoxThatHasChanged == interpBox)
+    {
+        processor->setParameter(CrossingDetector::CROSSING_INTERP,
+            static_cast<float>(interpBox->getSelectedId() - 1));
+    }
+
+    else if (comboBoxThatHasChanged == averageWindowBox)
+    {
+        processor->setParameter(CrossingDetector::AVERAGE_WINDOW,
+            static_cast<float>(averageWindowBox->getSelectedId() - 1));
+    }
+
     else if (comboBoxThatHasChanged == indicatorChanBox)
     {
         processor->setParameter(CrossingDetector::INDICATOR_CHAN,
@@ -844,6 +1391,7 @@ void CrossingDetectorEditor::labelTextChanged(Label* labelThatHasChanged)
         case CrossingDetector::CONSTANT:
         case CrossingDetector::ADAPTIVE:
         case CrossingDetector::AVERAGE:
+        case CrossingDetector::PERCENTILE:
             isok = updateFloatLabel(labelThatHasChanged, -FLT_MAX, FLT_MAX,
                 processor->constantThresh, &newVal);
             break;
@@ -866,6 +1414,126 @@ void CrossingDetectorEditor::labelTextChanged(Label* labelThatHasChanged)
             processor->setParameter(CrossingDetector::CONST_THRESH, newVal);
     }
 
+    // Multi-channel editable label
+    else if (labelThatHasChanged == multiChanEditable)
+    {
+        Array<int> chans;
+        if (parseChannelList(labelThatHasChanged->getText(), &chans))
+        {
+            labelThatHasChanged->setText(channelListToString(chans), dontSendNotification);
+            processor->setMultiChannelInputs(chans);
+        }
+        else
+        {
+            labelThatHasChanged->setText(channelListToString(processor->multiChanInputs), dontSendNotification);
+        }
+    }
+
+    // Multiple rule editable label
+    else if (labelThatHasChanged == multiRuleEditable)
+    {
+        Array<CrossingDetector::DetectionRule> rules;
+        if (CrossingDetector::parseDetectionRules(labelThatHasChanged->getText(),
+            processor->getDefaultRule(), &rules))
+        {
+            labelThatHasChanged->setText(CrossingDetector::detectionRulesToString(rules), dontSendNotification);
+            processor->setDetectionRules(rules);
+        }
+        else
+        {
+            labelThatHasChanged->setText(CrossingDetector::detectionRulesToString(processor->detectionRules),
+                dontSendNotification);
+        }
+    }
+
+    // Decimation editable label
+    else if (labelThatHasChanged == decimationEditable)
+    {
+        int newVal;
+        if (updateIntLabel(labelThatHasChanged, 1, 10000, processor->decimationFactor, &newVal))
+        {
+            decimationMinMaxButton->setEnabled(newVal > 1);
+            processor->setParameter(CrossingDetector::DECIMATION, static_cast<float>(newVal));
+        }
+    }
+
+    // Worker thread editable labels
+    else if (labelThatHasChanged == workerThreadsEditable)
+    {
+        int newVal;
+        if (updateIntLabel(labelThatHasChanged, 0, 64, processor->numWorkerThreads, &newVal))
+        {
+            processor->setParameter(CrossingDetector::NUM_WORKER_THREADS, static_cast<float>(newVal));
+        }
+    }
+    else if (labelThatHasChanged == workerCoresEditable)
+    {
+        Array<int> cores;
+        if (parseChannelList(labelThatHasChanged->getText(), &cores, 0))
+        {
+            labelThatHasChanged->setText(channelListToString(cores, 0), dontSendNotification);
+            processor->setWorkerCores(cores);
+        }
+        else
+        {
+            labelThatHasChanged->setText(channelListToString(processor->workerCores, 0), dontSendNotification);
+        }
+    }
+
+    // Event limit editable labels
+    else if (labelThatHasChanged == rateLimitEditable)
+    {
+        float newVal;
+        if (updateFloatLabel(labelThatHasChanged, 0.001f, 1e6f, processor->rateLimit, &newVal))
+        {
+            processor->setParameter(CrossingDetector::RATE_LIMIT, newVal);
+        }
+    }
+    else if (labelThatHasChanged == rateLimitBurstEditable)
+    {
+        int newVal;
+        if (updateIntLabel(labelThatHasChanged, 1, 1000000, processor->rateLimitBurst, &newVal))
+        {
+            processor->setParameter(CrossingDetector::RATE_LIMIT_BURST, static_cast<float>(newVal));
+        }
+    }
+    else if (labelThatHasChanged == coalesceEditable)
+    {
+        int newVal;
+        if (updateIntLabel(labelThatHasChanged, 0, INT_MAX, processor->coalesceSamples, &newVal))
+        {
+            processor->setParameter(CrossingDetector::COALESCE_WINDOW, static_cast<float>(newVal));
+        }
+    }
+
+    // Crossing log editable labels
+    else if (labelThatHasChanged == eventLogEditable)
+    {
+        String path = labelThatHasChanged->getText().trim();
+        if (path.isNotEmpty())
+        {
+            labelThatHasChanged->setText(path, dontSendNotification);
+            processor->setEventLogPath(path);
+        }
+        else
+        {
+            labelThatHasChanged->setText(processor->eventLogPath, dontSendNotification);
+        }
+    }
+    else if (labelThatHasChanged == ttlLinesEditable)
+    {
+        Array<int> lines;
+        if (parseChannelList(labelThatHasChanged->getText(), &lines))
+        {
+            labelThatHasChanged->setText(channelListToString(lines), dontSendNotification);
+            processor->setTTLLines(lines);
+        }
+        else
+        {
+            labelThatHasChanged->setText(channelListToString(processor->ttlLines), dontSendNotification);
+        }
+    }
+
     // Sample voting editable labels
     else if (labelThatHasChanged == pastPctEditable)
     {
@@ -878,7 +1546,7 @@ void CrossingDetectorEditor::labelTextChanged(Label* labelThatHasChanged)
     else if (labelThatHasChanged == pastSpanEditable)
     {
         int newVal;
-        if (updateIntLabel(labelThatHasChanged, 0, INT_MAX, processor->pastSpan, &newVal))
+        if (updateIntLabel(labelThatHasChanged, 0, getMaxSpan(processor->futureSpan), processor->pastSpan, &newVal))
         {
             processor->setParameter(CrossingDetector::PAST_SPAN, static_cast<float>(newVal));
         }
@@ -894,11 +1562,19 @@ void CrossingDetectorEditor::labelTextChanged(Label* labelThatHasChanged)
     else if (labelThatHasChanged == futureSpanEditable)
     {
         int newVal;
-        if (updateIntLabel(labelThatHasChanged, 0, INT_MAX, processor->futureSpan, &newVal))
+        if (updateIntLabel(labelThatHasChanged, 0, getMaxSpan(processor->pastSpan), processor->futureSpan, &newVal))
         {
             processor->setParameter(CrossingDetector::FUTURE_SPAN, static_cast<float>(newVal));
         }
     }
+    else if (labelThatHasChanged == maxSpanEditable)
+    {
+        int newVal;
+        if (updateIntLabel(labelThatHasChanged, 0, INT_MAX, processor->maxVotingSpan, &newVal))
+        {
+            processor->setParameter(CrossingDetector::MAX_VOTING_SPAN, static_cast<float>(newVal));
+        }
+    }
 
     // Average threshold editable labels
     else if (labelThatHasChanged == averageTimeEditable)
@@ -916,6 +1592,24 @@ void CrossingDetectorEditor::labelTextChanged(Label* labelThatHasChanged)
         }
     }
 
+    // Percentile threshold editable labels
+    else if (labelThatHasChanged == percentileRankEditable)
+    {
+        float newVal;
+        if (updateFloatLabel(labelThatHasChanged, 0, 100, processor->percentileRank, &newVal))
+        {
+            processor->setParameter(CrossingDetector::PERCENTILE_RANK, newVal);
+        }
+    }
+    else if (labelThatHasChanged == percentileTimeEditable)
+    {
+        float newVal;
+        if (updateFloatLabel(labelThatHasChanged, 0.1f, 600, processor->percentileSeconds, &newVal))
+        {
+            processor->setParameter(CrossingDetector::PERCENTILE_WINDOW, newVal);
+        }
+    }
+
     // Random threshold editable labels
     else if (labelThatHasChanged == minThreshEditable)
     {
@@ -1043,6 +1737,68 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
         processor->setParameter(CrossingDetector::NEG_ON, static_cast<float>(button->getToggleState()));
     }
 
+    // Buttons for multi-channel mode
+    else if (button == multiChanButton)
+    {
+        bool multiOn = button->getToggleState();
+        multiChanEditable->setEnabled(multiOn);
+        processor->setParameter(CrossingDetector::MULTI_CHAN_ON, static_cast<float>(multiOn));
+    }
+
+    // Buttons for multiple rule mode
+    else if (button == multiRuleButton)
+    {
+        bool multiOn = button->getToggleState();
+        multiRuleEditable->setEnabled(multiOn);
+        processor->setParameter(CrossingDetector::MULTI_RULE_ON, static_cast<float>(multiOn));
+    }
+
+    // Worker threads
+    else if (button == pinWorkersButton)
+    {
+        bool pinOn = button->getToggleState();
+        workerCoresEditable->setEnabled(pinOn);
+        processor->setParameter(CrossingDetector::PIN_WORKER_THREADS, static_cast<float>(pinOn));
+    }
+
+    // Event limits
+    else if (button == rateLimitButton)
+    {
+        bool limitOn = button->getToggleState();
+        rateLimitEditable->setEnabled(limitOn);
+        rateLimitBurstEditable->setEnabled(limitOn);
+        processor->setParameter(CrossingDetector::USE_RATE_LIMIT, static_cast<float>(limitOn));
+    }
+    else if (button == coalesceButton)
+    {
+        bool coalesceOn = button->getToggleState();
+        coalesceEditable->setEnabled(coalesceOn);
+        processor->setParameter(CrossingDetector::USE_COALESCING, static_cast<float>(coalesceOn));
+    }
+
+    // Crossing log
+    else if (button == eventLogButton)
+    {
+        bool logOn = button->getToggleState();
+        eventLogEditable->setEnabled(logOn);
+        ttlLinesButton->setEnabled(logOn);
+        ttlLinesEditable->setEnabled(logOn && ttlLinesButton->getToggleState());
+        processor->setParameter(CrossingDetector::LOG_CROSSINGS, static_cast<float>(logOn));
+    }
+    else if (button == ttlLinesButton)
+    {
+        bool linesOn = button->getToggleState();
+        ttlLinesEditable->setEnabled(linesOn);
+        processor->setParameter(CrossingDetector::TTL_LINES_ONLY, static_cast<float>(linesOn));
+    }
+
+    // Decimation
+    else if (button == decimationMinMaxButton)
+    {
+        processor->setParameter(CrossingDetector::DECIMATION_MIN_MAX,
+            static_cast<float>(button->getToggleState()));
+    }
+
     // Buttons for adaptive threshold
     else if (button == indicatorRangeButton)
     {
@@ -1066,7 +1822,7 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
     }
     else if (button == restartButton)
     {
-        processor->restartAdaptiveThreshold();
+        processor->setParameter(CrossingDetector::RESTART_ADAPTATION, 1.0f);
     }
     else if (button == pauseButton)
     {
@@ -1101,6 +1857,11 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
         limitSleepEditable->setEnabled(limitOn);
         processor->setParameter(CrossingDetector::USE_JUMP_LIMIT, static_cast<float>(limitOn));
     }
+    else if (button == earlyFireButton)
+    {
+        processor->setParameter(CrossingDetector::EARLY_FIRE,
+            static_cast<float>(button->getToggleState()));
+    }
     else if (button == bufferMaskButton)
     {
         bool bufMaskOn = button->getToggleState();
@@ -1114,6 +1875,11 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
         bool wantTattle = button->getToggleState();
         processor->setParameter(CrossingDetector::WANT_TATTLE_THRESH, static_cast<float>(wantTattle));
     }
+    else if (button == latencyButton)
+    {
+        processor->setParameter(CrossingDetector::MEASURE_LATENCY,
+            static_cast<float>(button->getToggleState()));
+    }
 
     // Threshold radio buttons
     else if (button == constantThreshButton)
@@ -1129,7 +1895,9 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
     else if (button == averageThreshButton)
     {
         bool on = button->getToggleState();
-        averageTimeEditable->setEnabled(on);
+        bool acquiring = CoreServices::getAcquisitionStatus();
+        averageTimeEditable->setEnabled(on && !(acquiring && isBoxcarAverage()));
+        averageWindowBox->setEnabled(on && !acquiring);
         if (on)
         {
             thresholdEditable->setEnabled(true);
@@ -1137,6 +1905,18 @@ void CrossingDetectorEditor::buttonEvent(Button* button)
                 static_cast<float>(CrossingDetector::AVERAGE));
         }
     }
+    else if (button == percentileThreshButton)
+    {
+        bool on = button->getToggleState();
+        percentileRankEditable->setEnabled(on);
+        percentileTimeEditable->setEnabled(on);
+        if (on)
+        {
+            thresholdEditable->setEnabled(true);
+            processor->setParameter(CrossingDetector::THRESH_TYPE,
+                static_cast<float>(CrossingDetector::PERCENTILE));
+        }
+    }
     else if (button == adaptiveThreshButton)
     {
         bool on = button->getToggleState();
@@ -1314,7 +2094,38 @@ void CrossingDetectorEditor::updateChannelThreshBox()
 
 void CrossingDetectorEditor::startAcquisition()
 {
+    auto processor = static_cast<CrossingDetector*>(getProcessor());
+
     inputBox->setEnabled(false);
+    if (processor->monitorsMultipleChannels())
+    {
+        // the number of lines depends on the first one
+        outputBox->setEnabled(false);
+    }
+    multiChanButton->setEnabled(false);
+    multiChanEditable->setEnabled(false);
+    multiRuleButton->setEnabled(false);
+    multiRuleEditable->setEnabled(false);
+    decimationEditable->setEnabled(false);
+    decimationMinMaxButton->setEnabled(false);
+    workerThreadsEditable->setEnabled(false);
+    pinWorkersButton->setEnabled(false);
+    workerCoresEditable->setEnabled(false);
+    maxSpanEditable->setEnabled(false);
+    metaDataBox->setEnabled(false);
+    interpBox->setEnabled(false);
+    tattleThreshButton->setEnabled(false);
+    coalesceButton->setEnabled(false);
+    eventLogButton->setEnabled(false);
+    eventLogEditable->setEnabled(false);
+    ttlLinesButton->setEnabled(false);
+    ttlLinesEditable->setEnabled(false);
+    averageWindowBox->setEnabled(false);
+    if (isBoxcarAverage())
+    {
+        // changing the length would reallocate the window during acquisition
+        averageTimeEditable->setEnabled(false);
+    }
     pastSpanEditable->getText(false);
     futureSpanEditable->getText(false);
 }
@@ -1322,8 +2133,124 @@ void CrossingDetectorEditor::startAcquisition()
 void CrossingDetectorEditor::stopAcquisition()
 {
     inputBox->setEnabled(true);
+    outputBox->setEnabled(true);
+    multiChanButton->setEnabled(true);
+    multiChanEditable->setEnabled(multiChanButton->getToggleState());
+    multiRuleButton->setEnabled(true);
+    multiRuleEditable->setEnabled(multiRuleButton->getToggleState());
+    decimationEditable->setEnabled(true);
+    decimationMinMaxButton->setEnabled(decimationEditable->getText().getIntValue() > 1);
+    workerThreadsEditable->setEnabled(true);
+    pinWorkersButton->setEnabled(true);
+    workerCoresEditable->setEnabled(pinWorkersButton->getToggleState());
+    maxSpanEditable->setEnabled(true);
+    metaDataBox->setEnabled(true);
+    interpBox->setEnabled(true);
+    tattleThreshButton->setEnabled(true);
+    coalesceButton->setEnabled(true);
+    eventLogButton->setEnabled(true);
+    eventLogEditable->setEnabled(eventLogButton->getToggleState());
+    ttlLinesButton->setEnabled(eventLogButton->getToggleState());
+    ttlLinesEditable->setEnabled(eventLogButton->getToggleState() && ttlLinesButton->getToggleState());
+    averageWindowBox->setEnabled(averageThreshButton->getToggleState());
+    averageTimeEditable->setEnabled(averageThreshButton->getToggleState());
     pastSpanEditable->getText(true);
     futureSpanEditable->getText(true);
+    updateStatus();
+}
+
+void CrossingDetectorEditor::updateStatus()
+{
+    auto processor = static_cast<CrossingDetector*>(getProcessor());
+
+    variantValue->setText(CrossingDetector::getDetectorVariantDescription(
+        processor->getActiveDetectorVariant()), dontSendNotification);
+
+    latencyValue->setText(getLatencyDescription(), dontSendNotification);
+
+    eventLimitValue->setText("Merged: " + String(processor->numCoalesced.get())
+        + " crossings; dropped by rate limit: " + String(processor->numRateLimited.get()),
+        dontSendNotification);
+
+    eventLogValue->setText(getEventLogDescription(), dontSendNotification);
+
+#if CROSSING_DETECTOR_STATS
+    const ProcessStats::Snapshot stats = processor->processStats.getSnapshot();
+    const CrossingEngine::Counters& det = stats.detection;
+
+    String text = "Buffers: " + String(static_cast<int64>(stats.blocks))
+        + " (" + String(static_cast<int64>(stats.samples)) + " samples)\n";
+    text += "Mean / max time: "
+        + String(stats.blocks > 0 ? stats.totalBlockNs / 1000.0 / stats.blocks : 0.0, 1) + " / "
+        + String(stats.maxBlockNs / 1000.0, 1) + " us; max load "
+        + String(100 * stats.maxLoad, 2) + "% of real time\n";
+
+    text += "Time histogram (us):";
+    for (int b = 0; b < ProcessStats::NUM_TIME_BINS; ++b)
+    {
+        if (stats.timeBins[b] > 0)
+        {
+            text += (b == 0 ? String(" <1: ")
+                : b == ProcessStats::NUM_TIME_BINS - 1 ? " >=" + String(1 << (b - 1)) + ": "
+                : " <" + String(1 << b) + ": ")
+                + String(static_cast<int64>(stats.timeBins[b]));
+        }
+    }
+    text += "\n";
+
+    text += "Crossings: " + String(static_cast<int64>(det.candidates))
+        + "; events: " + String(static_cast<int64>(det.reported)) + "\n";
+    text += "Suppressed by timeout: " + String(static_cast<int64>(det.timeout))
+        + ", jump limit: " + String(static_cast<int64>(det.jumpLimit))
+        + ", buffer end mask: " + String(static_cast<int64>(det.bufferEndMask))
+        + ", voting: " + String(static_cast<int64>(det.voting));
+
+    statsValue->setText(text, dontSendNotification);
+#endif
+}
+
+String CrossingDetectorEditor::getLatencyDescription() const
+{
+    auto processor = static_cast<CrossingDetector*>(getProcessor());
+
+    const LatencyStats::Summary samples = processor->latencyStats.getSampleLatency();
+    if (samples.count == 0)
+    {
+        return processor->measureLatency ? "No events yet" : "Not measured";
+    }
+
+    const LatencyStats::Summary time = processor->latencyStats.getTimeLatency();
+    const double msPerSample = 1000.0 / processor->getSampleRate();
+
+    String text = "Events: " + String(static_cast<int64>(samples.count)) + "\n";
+    text += "Crossing to end of buffer: p50 " + String(samples.p50, 1)
+        + ", p99 " + String(samples.p99, 1)
+        + ", max " + String(static_cast<int64>(samples.max)) + " samples ("
+        + String(samples.p50 * msPerSample, 2) + " / " + String(samples.p99 * msPerSample, 2)
+        + " / " + String(samples.max * msPerSample, 2) + " ms)\n";
+    text += "Processing before event: p50 " + String(time.p50 / 1000, 1)
+        + ", p99 " + String(time.p99 / 1000, 1)
+        + ", max " + String(time.max / 1000.0, 1) + " us";
+    return text;
+}
+
+String CrossingDetectorEditor::getEventLogDescription() const
+{
+    auto processor = static_cast<CrossingDetector*>(getProcessor());
+    const CrossingEventLog& log = processor->eventLog;
+
+    if (log.getFile() == File())
+    {
+        return processor->logCrossings ? "Not started" : "Off";
+    }
+
+    if (!log.isOpen() && CoreServices::getAcquisitionStatus())
+    {
+        return "Could not write " + log.getFile().getFullPathName();
+    }
+
+    return log.getFile().getFullPathName() + "\n"
+        + String(log.getNumWritten()) + " records written, " + String(log.getNumDropped()) + " dropped";
 }
 
 Visualizer* CrossingDetectorEditor::createNewCanvas()
@@ -1349,6 +2276,15 @@ void CrossingDetectorEditor::saveCustomParameters(XmlElement* xml)
     // channels
     paramValues->setAttribute("inputChanId", inputBox->getSelectedId());
     paramValues->setAttribute("outputChanId", outputBox->getSelectedId());
+    paramValues->setAttribute("bMultiChannel", multiChanButton->getToggleState());
+    paramValues->setAttribute("multiChannels", multiChanEditable->getText());
+    paramValues->setAttribute("bMultiRule", multiRuleButton->getToggleState());
+    paramValues->setAttribute("rules", multiRuleEditable->getText());
+    paramValues->setAttribute("decimationFactor", decimationEditable->getText());
+    paramValues->setAttribute("bDecimationMinMax", decimationMinMaxButton->getToggleState());
+    paramValues->setAttribute("numWorkerThreads", workerThreadsEditable->getText());
+    paramValues->setAttribute("bPinWorkers", pinWorkersButton->getToggleState());
+    paramValues->setAttribute("workerCores", workerCoresEditable->getText());
 
     // rising/falling
     paramValues->setAttribute("bRising", risingButton->getToggleState());
@@ -1358,6 +2294,9 @@ void CrossingDetectorEditor::saveCustomParameters(XmlElement* xml)
     paramValues->setAttribute("thresholdType", processor->thresholdType);
     paramValues->setAttribute("threshold", processor->constantThresh);
     paramValues->setAttribute("averageDecaySeconds", averageTimeEditable->getText());
+    paramValues->setAttribute("averageWindow", averageWindowBox->getSelectedId() - 1);
+    paramValues->setAttribute("percentileRank", percentileRankEditable->getText());
+    paramValues->setAttribute("percentileSeconds", percentileTimeEditable->getText());
     paramValues->setAttribute("indicatorChanName", processor->indicatorChanName);
     paramValues->setAttribute("indicatorTarget", targetEditable->getText());
     paramValues->setAttribute("useIndicatorRange", indicatorRangeButton->getToggleState());
@@ -1378,6 +2317,8 @@ void CrossingDetectorEditor::saveCustomParameters(XmlElement* xml)
     paramValues->setAttribute("pastSpanExclusive", pastSpanEditable->getText());
     paramValues->setAttribute("futurePctExclusive", futurePctEditable->getText());
     paramValues->setAttribute("futureSpanExclusive", futureSpanEditable->getText());
+    paramValues->setAttribute("bEarlyFire", earlyFireButton->getToggleState());
+    paramValues->setAttribute("maxVotingSpan", maxSpanEditable->getText());
 
     // jump limit
     paramValues->setAttribute("bJumpLimit", limitButton->getToggleState());
@@ -1390,10 +2331,40 @@ void CrossingDetectorEditor::saveCustomParameters(XmlElement* xml)
 
     // timing
     paramValues->setAttribute("durationMS", durationEditable->getText());
+    paramValues->setAttribute("bRateLimit", rateLimitButton->getToggleState());
+    paramValues->setAttribute("rateLimit", rateLimitEditable->getText());
+    paramValues->setAttribute("rateLimitBurst", rateLimitBurstEditable->getText());
+    paramValues->setAttribute("bCoalesce", coalesceButton->getToggleState());
+    paramValues->setAttribute("coalesceSamples", coalesceEditable->getText());
     paramValues->setAttribute("timeoutMS", timeoutEditable->getText());
 
+    // metadata
+    paramValues->setAttribute("metaDataProfile", metaDataBox->getSelectedId() - 1);
+    paramValues->setAttribute("crossingInterp", interpBox->getSelectedId() - 1);
+
     // debug tattles
     paramValues->setAttribute("bTattleThresh", tattleThreshButton->getToggleState());
+    paramValues->setAttribute("bMeasureLatency", latencyButton->getToggleState());
+    paramValues->setAttribute("bLogCrossings", eventLogButton->getToggleState());
+    paramValues->setAttribute("eventLogPath", eventLogEditable->getText());
+    paramValues->setAttribute("bTTLLinesOnly", ttlLinesButton->getToggleState());
+    paramValues->setAttribute("ttlLines", ttlLinesEditable->getText());
+
+    // latency measured so far (for reference only; not loaded)
+    const LatencyStats::Summary sampleLatency = processor->latencyStats.getSampleLatency();
+    if (sampleLatency.count > 0)
+    {
+        const LatencyStats::Summary timeLatency = processor->latencyStats.getTimeLatency();
+        XmlElement* latencyValues = xml->createNewChildElement("LATENCY");
+        latencyValues->setAttribute("events", static_cast<int>(sampleLatency.count));
+        latencyValues->setAttribute("sampleRate", processor->getSampleRate());
+        latencyValues->setAttribute("samplesP50", sampleLatency.p50);
+        latencyValues->setAttribute("samplesP99", sampleLatency.p99);
+        latencyValues->setAttribute("samplesMax", static_cast<int>(sampleLatency.max));
+        latencyValues->setAttribute("processUsP50", timeLatency.p50 / 1000);
+        latencyValues->setAttribute("processUsP99", timeLatency.p99 / 1000);
+        latencyValues->setAttribute("processUsMax", timeLatency.max / 1000.0);
+    }
 }
 
 void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
@@ -1411,6 +2382,15 @@ void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
 			inputBox->setSelectedId(inputChanId, sendNotificationSync);
 		}
         outputBox->setSelectedId(xmlNode->getIntAttribute("outputChanId", outputBox->getSelectedId()), sendNotificationSync);
+        multiChanEditable->setText(xmlNode->getStringAttribute("multiChannels", multiChanEditable->getText()), sendNotificationSync);
+        multiChanButton->setToggleState(xmlNode->getBoolAttribute("bMultiChannel", multiChanButton->getToggleState()), sendNotificationSync);
+        multiRuleEditable->setText(xmlNode->getStringAttribute("rules", multiRuleEditable->getText()), sendNotificationSync);
+        multiRuleButton->setToggleState(xmlNode->getBoolAttribute("bMultiRule", multiRuleButton->getToggleState()), sendNotificationSync);
+        decimationEditable->setText(xmlNode->getStringAttribute("decimationFactor", decimationEditable->getText()), sendNotificationSync);
+        decimationMinMaxButton->setToggleState(xmlNode->getBoolAttribute("bDecimationMinMax", decimationMinMaxButton->getToggleState()), sendNotificationSync);
+        workerThreadsEditable->setText(xmlNode->getStringAttribute("numWorkerThreads", workerThreadsEditable->getText()), sendNotificationSync);
+        workerCoresEditable->setText(xmlNode->getStringAttribute("workerCores", workerCoresEditable->getText()), sendNotificationSync);
+        pinWorkersButton->setToggleState(xmlNode->getBoolAttribute("bPinWorkers", pinWorkersButton->getToggleState()), sendNotificationSync);
 
         // rising/falling
         risingButton->setToggleState(xmlNode->getBoolAttribute("bRising", risingButton->getToggleState()), sendNotificationSync);
@@ -1433,6 +2413,15 @@ void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
         minThreshEditable->setText(xmlNode->getStringAttribute("minThresh", minThreshEditable->getText()), sendNotificationSync);
         maxThreshEditable->setText(xmlNode->getStringAttribute("maxThresh", maxThreshEditable->getText()), sendNotificationSync);
         averageTimeEditable->setText(xmlNode->getStringAttribute("averageDecaySeconds", averageTimeEditable->getText()), sendNotificationSync);
+
+        int averageWindowId = xmlNode->getIntAttribute("averageWindow", averageWindowBox->getSelectedId() - 1) + 1;
+        if (averageWindowBox->indexOfItemId(averageWindowId) >= 0)
+        {
+            averageWindowBox->setSelectedId(averageWindowId, sendNotificationSync);
+        }
+
+        percentileRankEditable->setText(xmlNode->getStringAttribute("percentileRank", percentileRankEditable->getText()), sendNotificationSync);
+        percentileTimeEditable->setText(xmlNode->getStringAttribute("percentileSeconds", percentileTimeEditable->getText()), sendNotificationSync);
 		
 		int thresholdChanId = xmlNode->getIntAttribute("thresholdChanId", channelThreshBox->getSelectedId());
 		if (channelThreshBox->indexOfItemId(thresholdChanId) >= 0) // guard against different # of channels
@@ -1461,6 +2450,10 @@ void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
             averageThreshButton->setToggleState(true, sendNotificationSync);
             break;
 
+        case CrossingDetector::PERCENTILE:
+            percentileThreshButton->setToggleState(true, sendNotificationSync);
+            break;
+
         case CrossingDetector::ADAPTIVE:
             adaptiveThreshButton->setToggleState(true, sendNotificationSync);
             break;
@@ -1479,6 +2472,8 @@ void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
         pastSpanEditable->setText(xmlNode->getStringAttribute("pastSpanExclusive", pastSpanEditable->getText()), sendNotificationSync);
         futurePctEditable->setText(xmlNode->getStringAttribute("futurePctExclusive", futurePctEditable->getText()), sendNotificationSync);
         futureSpanEditable->setText(xmlNode->getStringAttribute("futureSpanExclusive", futureSpanEditable->getText()), sendNotificationSync);
+        earlyFireButton->setToggleState(xmlNode->getBoolAttribute("bEarlyFire", earlyFireButton->getToggleState()), sendNotificationSync);
+        maxSpanEditable->setText(xmlNode->getStringAttribute("maxVotingSpan", maxSpanEditable->getText()), sendNotificationSync);
 
         // jump limit
         limitButton->setToggleState(xmlNode->getBoolAttribute("bJumpLimit", limitButton->getToggleState()), sendNotificationSync);
@@ -1493,8 +2488,35 @@ void CrossingDetectorEditor::loadCustomParameters(XmlElement* xml)
         durationEditable->setText(xmlNode->getStringAttribute("durationMS", durationEditable->getText()), sendNotificationSync);
         timeoutEditable->setText(xmlNode->getStringAttribute("timeoutMS", timeoutEditable->getText()), sendNotificationSync);
 
+        // event limits
+        rateLimitEditable->setText(xmlNode->getStringAttribute("rateLimit", rateLimitEditable->getText()), sendNotificationSync);
+        rateLimitBurstEditable->setText(xmlNode->getStringAttribute("rateLimitBurst", rateLimitBurstEditable->getText()), sendNotificationSync);
+        rateLimitButton->setToggleState(xmlNode->getBoolAttribute("bRateLimit", rateLimitButton->getToggleState()), sendNotificationSync);
+        coalesceEditable->setText(xmlNode->getStringAttribute("coalesceSamples", coalesceEditable->getText()), sendNotificationSync);
+        coalesceButton->setToggleState(xmlNode->getBoolAttribute("bCoalesce", coalesceButton->getToggleState()), sendNotificationSync);
+
+        // metadata
+        int metaDataId = xmlNode->getIntAttribute("metaDataProfile", metaDataBox->getSelectedId() - 1) + 1;
+        if (metaDataBox->indexOfItemId(metaDataId) >= 0)
+        {
+            metaDataBox->setSelectedId(metaDataId, sendNotificationSync);
+        }
+
+        int interpId = xmlNode->getIntAttribute("crossingInterp", interpBox->getSelectedId() - 1) + 1;
+        if (interpBox->indexOfItemId(interpId) >= 0)
+        {
+            interpBox->setSelectedId(interpId, sendNotificationSync);
+        }
+
         // debug tattles
         tattleThreshButton->setToggleState(xmlNode->getBoolAttribute("bTattleThresh", tattleThreshButton->getToggleState()), sendNotificationSync);
+        latencyButton->setToggleState(xmlNode->getBoolAttribute("bMeasureLatency", latencyButton->getToggleState()), sendNotificationSync);
+
+        // crossing log
+        eventLogEditable->setText(xmlNode->getStringAttribute("eventLogPath", eventLogEditable->getText()), sendNotificationSync);
+        eventLogButton->setToggleState(xmlNode->getBoolAttribute("bLogCrossings", eventLogButton->getToggleState()), sendNotificationSync);
+        ttlLinesEditable->setText(xmlNode->getStringAttribute("ttlLines", ttlLinesEditable->getText()), sendNotificationSync);
+        ttlLinesButton->setToggleState(xmlNode->getBoolAttribute("bTTLLinesOnly", ttlLinesButton->getToggleState()), sendNotificationSync);
 
         // backwards compatibility
         // old duration/timeout in samples, convert to ms.
@@ -1685,6 +2707,98 @@ bool CrossingDetectorEditor::updateFloatLabel(Label* label, float min, float max
     return true;
 }
 
+bool CrossingDetectorEditor::parseChannelList(const String& text, Array<int>* out, int firstNumber)
+{
+    if (text.trim().isEmpty() || !text.containsOnly("0123456789-, "))
+    {
+        return false;
+    }
+
+    StringArray tokens;
+    tokens.addTokens(text, ",", "");
+    tokens.trim();
+    tokens.removeEmptyStrings();
+
+    Array<int> chans;
+    for (const String& token : tokens)
+    {
+        int first, last;
+        if (token.containsChar('-'))
+        {
+            first = token.upToFirstOccurrenceOf("-", false, false).getIntValue();
+            last = token.fromFirstOccurrenceOf("-", false, false).getIntValue();
+        }
+        else
+        {
+            first = last = token.getIntValue();
+        }
+
+        if (first < firstNumber || last < first)
+        {
+            return false;
+        }
+
+        for (int chan = first; chan <= last; ++chan)
+        {
+            chans.addIfNotAlreadyThere(chan - firstNumber);
+        }
+    }
+
+    if (chans.isEmpty())
+    {
+        return false;
+    }
+
+    chans.sort();
+    *out = chans;
+    return true;
+}
+
+String CrossingDetectorEditor::channelListToString(const Array<int>& chans, int firstNumber)
+{
+    String result;
+    int i = 0;
+    while (i < chans.size())
+    {
+        // find end of run of consecutive channels
+        int j = i;
+        while (j + 1 < chans.size() && chans[j + 1] == chans[j] + 1)
+        {
+            ++j;
+        }
+
+        if (result.isNotEmpty())
+        {
+            result += ", ";
+        }
+
+        result += String(chans[i] + firstNumber);
+        if (j > i)
+        {
+            result += "-" + String(chans[j] + firstNumber);
+        }
+        i = j + 1;
+    }
+    return result;
+}
+
+bool CrossingDetectorEditor::isBoxcarAverage() const
+{
+    return averageWindowBox->getSelectedId() == CrossingDetector::AVERAGE_BOXCAR + 1;
+}
+
+int CrossingDetectorEditor::getMaxSpan(int otherSpan) const
+{
+    if (!CoreServices::getAcquisitionStatus())
+    {
+        return INT_MAX;
+    }
+
+    // beyond this, the engine would have to reallocate its histories while running
+    auto processor = static_cast<CrossingDetector*>(getProcessor());
+    return jmax(0, processor->maxVotingSpan - otherSpan);
+}
+
 /*************** canvas (extra settings) *******************/
 
 CrossingDetectorCanvas::CrossingDetectorCanvas(GenericProcessor* n)
@@ -1702,9 +2816,22 @@ CrossingDetectorCanvas::~CrossingDetectorCanvas() {}
 
 void CrossingDetectorCanvas::refreshState() {}
 void CrossingDetectorCanvas::update() {}
-void CrossingDetectorCanvas::refresh() {}
-void CrossingDetectorCanvas::beginAnimation() {}
-void CrossingDetectorCanvas::endAnimation() {}
+
+void CrossingDetectorCanvas::refresh()
+{
+    editor->updateStatus();
+}
+
+void CrossingDetectorCanvas::beginAnimation()
+{
+    startCallbacks();
+}
+
+void CrossingDetectorCanvas::endAnimation()
+{
+    stopCallbacks();
+}
+
 void CrossingDetectorCanvas::setParameter(int, float) {}
 void CrossingDetectorCanvas::setParameter(int, int, int, float) {}
 
@@ -36,11 +36,14 @@ Editor (in signal chain) contains:
 - Event timeout control
 
 Canvas/visualizer contains:
+- Multi-channel mode toggle and channel list
 - Threshold type selection - constant, rms average, adaptive, random, or channel (with parameters)
 - Threshold tattle enable/disable
 - Jump limiting toggle and max jump box
 - Voting settings (pre/post event span and strictness)
 - Event duration control
+- Event rate limit and coalescing of crossings
+- Crossing log file and TTL line selection
 
 @see GenericEditor
 */
@@ -104,10 +107,20 @@ public:
 
     Component* getOptionsPanel();
 
+    // Updates the read-only status displays in the options panel (called by the canvas while animating).
+    // If CROSSING_DETECTOR_STATS is on, this includes the processing statistics.
+    void updateStatus();
+
     void saveCustomParameters(XmlElement* xml) override;
     void loadCustomParameters(XmlElement* xml) override;
 
 private:
+    // Summary of the processor's latencyStats, for the status section
+    String getLatencyDescription() const;
+
+    // State of the processor's eventLog, for the status section
+    String getEventLogDescription() const;
+
     // Scope to be able to use "pi" in adaptive target range specification
     class PiScope : public Expression::Scope
     {
@@ -156,6 +169,21 @@ private:
     static bool updateFloatLabel(Label* label, float min, float max,
         float defaultValue, float* out);
 
+    /* Parses a list of 1-based channel numbers and ranges (e.g. "1-4, 7") into 0-based indices.
+     * (Numbers counting from firstNumber instead, e.g. 0 for cores.)
+     * Returns false (and leaves *out unchanged) if the text is not a valid nonempty list.
+     */
+    static bool parseChannelList(const String& text, Array<int>* out, int firstNumber = 1);
+
+    // Inverse of parseChannelList (collapses consecutive channels into ranges)
+    static String channelListToString(const Array<int>& chans, int firstNumber = 1);
+
+    // Whether the boxcar window is selected for the RMS average
+    bool isBoxcarAverage() const;
+
+    // Largest value either voting span can take given the other (limited during acquisition)
+    int getMaxSpan(int otherSpan) const;
+
     RadioButtonLookAndFeel rbLookAndFeel;
 
     // top row (channels)
@@ -180,6 +208,31 @@ private:
     ScopedPointer<Component> optionsPanel;
 
     ScopedPointer<Label> optionsPanelTitle;
+
+    /****** input section ******/
+
+    ScopedPointer<Label> inputTitle;
+    ScopedPointer<VerticalGroupSet> inputGroupSet;
+
+    // multi-channel mode
+    ScopedPointer<ToggleButton> multiChanButton;
+    ScopedPointer<Label> multiChanEditable;
+
+    // multiple rule mode
+    ScopedPointer<ToggleButton> multiRuleButton;
+    ScopedPointer<Label> multiRuleEditable;
+
+    // decimation
+    ScopedPointer<Label> decimationLabel;
+    ScopedPointer<Label> decimationEditable;
+    ScopedPointer<Label> decimationUnitLabel;
+    ScopedPointer<ToggleButton> decimationMinMaxButton;
+
+    // worker threads
+    ScopedPointer<Label> workerThreadsLabel;
+    ScopedPointer<Label> workerThreadsEditable;
+    ScopedPointer<ToggleButton> pinWorkersButton;
+    ScopedPointer<Label> workerCoresEditable;
     
     /****** threshold section ******/
 
@@ -193,6 +246,14 @@ private:
     ScopedPointer<ToggleButton> averageThreshButton;
     ScopedPointer<Label> averageTimeLabel;
     ScopedPointer<Label> averageTimeEditable;
+    ScopedPointer<ComboBox> averageWindowBox;
+
+    // multiple of percentile of absolute value
+    ScopedPointer<ToggleButton> percentileThreshButton;
+    ScopedPointer<Label> percentileRankEditable;
+    ScopedPointer<Label> percentileOverLabel;
+    ScopedPointer<Label> percentileTimeEditable;
+    ScopedPointer<Label> percentileTimeLabel;
 
     // adaptive threshold
     // row 1
@@ -264,6 +325,11 @@ private:
     ScopedPointer<Label> futureSpanEditable;
 
     ScopedPointer<Label> votingFooter;
+    ScopedPointer<ToggleButton> earlyFireButton;
+
+    ScopedPointer<Label> maxSpanLabel;
+    ScopedPointer<Label> maxSpanEditable;
+    ScopedPointer<Label> maxSpanUnitLabel;
 
     // buffer end mask
     ScopedPointer<ToggleButton> bufferMaskButton;
@@ -280,8 +346,61 @@ private:
     ScopedPointer<Label> durationEditable;
     ScopedPointer<Label> durationUnit;
 
+    // event rate limit and coalescing
+    ScopedPointer<ToggleButton> rateLimitButton;
+    ScopedPointer<Label> rateLimitEditable;
+    ScopedPointer<Label> rateLimitBurstLabel;
+    ScopedPointer<Label> rateLimitBurstEditable;
+    ScopedPointer<ToggleButton> coalesceButton;
+    ScopedPointer<Label> coalesceEditable;
+    ScopedPointer<Label> coalesceUnitLabel;
+
+    // metadata profile
+    ScopedPointer<Label> metaDataLabel;
+    ScopedPointer<ComboBox> metaDataBox;
+
+    // crossing time interpolation
+    ScopedPointer<Label> interpLabel;
+    ScopedPointer<ComboBox> interpBox;
+
     // threshold tattling
     ScopedPointer<ToggleButton> tattleThreshButton;
+
+    // latency measurement
+    ScopedPointer<ToggleButton> latencyButton;
+
+    // crossing log and TTL lines
+    ScopedPointer<ToggleButton> eventLogButton;
+    ScopedPointer<Label> eventLogEditable;
+    ScopedPointer<ToggleButton> ttlLinesButton;
+    ScopedPointer<Label> ttlLinesEditable;
+
+    /******** status section *******/
+
+    ScopedPointer<Label> statusTitle;
+    ScopedPointer<VerticalGroupSet> statusGroupSet;
+
+    // active detector variant
+    ScopedPointer<Label> variantLabel;
+    ScopedPointer<Label> variantValue;
+
+    // event latency
+    ScopedPointer<Label> latencyLabel;
+    ScopedPointer<Label> latencyValue;
+
+    // crossings merged or dropped by the event limits
+    ScopedPointer<Label> eventLimitLabel;
+    ScopedPointer<Label> eventLimitValue;
+
+    // crossing log
+    ScopedPointer<Label> eventLogLabel;
+    ScopedPointer<Label> eventLogValue;
+
+#if CROSSING_DETECTOR_STATS
+    // processing statistics
+    ScopedPointer<Label> statsLabel;
+    ScopedPointer<Label> statsValue;
+#endif
 };
 
 // Visualizer window containing additional settings
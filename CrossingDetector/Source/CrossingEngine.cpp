@@ -0,0 +1,796 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "CrossingEngine.h"
+#include "CrossingKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath> // for ceil, abs
+
+const int CrossingEngine::NUM_DETECTOR_VARIANTS;
+const int CrossingEngine::VARIANT_BLOCK_KERNEL;
+const int CrossingEngine::VARIANT_INACTIVE;
+const int CrossingEngine::NO_EARLY_CROSSING;
+
+CrossingEngine::Settings::Settings()
+    : posOn             (true)
+    , negOn             (false)
+    , timeoutSamp       (0)
+    , pastSpan          (0)
+    , futureSpan        (0)
+    , pastStrict        (1.0f)
+    , futureStrict      (1.0f)
+    , earlyFire         (false)
+    , useJumpLimit      (false)
+    , jumpLimit         (5.0f)
+    , jumpLimitSleep    (0)
+    , useBufferEndMask  (false)
+    , bufferEndMaskSamp (0)
+    , interpolation     (INTERP_NONE)
+{
+    randomThreshRange[0] = -180.0f;
+    randomThreshRange[1] = 180.0f;
+}
+
+CrossingEngine::Counters::Counters()
+    : candidates    (0)
+    , reported      (0)
+    , timeout       (0)
+    , bufferEndMask (0)
+    , jumpLimit     (0)
+    , voting        (0)
+{}
+
+CrossingEngine::CrossingEngine()
+    : pastSamplesNeeded   (0)
+    , futureSamplesNeeded (0)
+    , minHistoryLength    (0)
+    , rng                 (std::random_device()())
+{}
+
+void CrossingEngine::setSettings(const Settings& newSettings)
+{
+    const bool spansChanged = newSettings.pastSpan != settings.pastSpan ||
+        newSettings.futureSpan != settings.futureSpan;
+
+    settings = newSettings;
+    pastSamplesNeeded = getSamplesNeeded(settings.pastSpan, settings.pastStrict);
+    futureSamplesNeeded = getSamplesNeeded(settings.futureSpan, settings.futureStrict);
+
+    if (spansChanged)
+    {
+        resizeVotingHistories();
+    }
+}
+
+int CrossingEngine::getSamplesNeeded(int span, float strict)
+{
+    return span ? static_cast<int>(std::ceil(span * strict)) : 0;
+}
+
+bool CrossingEngine::isEarlier(const Crossing& a, const Crossing& b)
+{
+    const int sampleA = std::max(a.offset, 0);
+    const int sampleB = std::max(b.offset, 0);
+    if (sampleA != sampleB)
+    {
+        return sampleA < sampleB;
+    }
+    return a.channel != b.channel ? a.channel < b.channel : a.offset < b.offset;
+}
+
+const CrossingEngine::Settings& CrossingEngine::getSettings() const
+{
+    return settings;
+}
+
+void CrossingEngine::setNumChannels(int numChannels)
+{
+    const int historyLength = getHistoryLength();
+
+    sampToReenable.assign(numChannels, settings.pastSpan + settings.futureSpan + 1);
+    pastSamplesAbove.assign(numChannels, 0);
+    futureSamplesAbove.assign(numChannels, 0);
+    jumpLimitElapsed.assign(numChannels, static_cast<int>(settings.jumpLimitSleep));
+    earlyCandidates.assign(numChannels, EarlyCandidate());
+    lastVariant.assign(numChannels, VARIANT_INACTIVE);
+    inputStaging.assign(numChannels, StagingBuffer<float>(historyLength));
+    thresholdStaging.assign(numChannels, StagingBuffer<float>(historyLength));
+    crossingMasks.resize(numChannels);
+    counters.resize(numChannels); // (existing channels keep their counts)
+
+    // keep existing random thresholds
+    while (static_cast<int>(randomThresh.size()) < numChannels)
+    {
+        randomThresh.push_back(nextRandomThresh());
+    }
+    randomThresh.resize(numChannels);
+}
+
+int CrossingEngine::getNumChannels() const
+{
+    return static_cast<int>(sampToReenable.size());
+}
+
+void CrossingEngine::reserve(int maxBlockLength)
+{
+    // (with voting, the masks also cover the history)
+    size_t numWords = CrossingKernels::numMaskWords(getHistoryLength() + maxBlockLength);
+    for (int c = 0; c < getNumChannels(); ++c)
+    {
+        inputStaging[c].reserve(maxBlockLength);
+        thresholdStaging[c].reserve(maxBlockLength);
+        if (crossingMasks[c].size() < numWords)
+        {
+            crossingMasks[c].resize(numWords);
+        }
+    }
+}
+
+void CrossingEngine::setMaxVotingSpan(int maxSpan)
+{
+    minHistoryLength = std::max(0, maxSpan) + 3;
+    resizeVotingHistories();
+}
+
+int CrossingEngine::getHistoryLength() const
+{
+    // (one more sample than voting needs, for cubic interpolation)
+    return std::max(settings.pastSpan + settings.futureSpan + 3, minHistoryLength);
+}
+
+void CrossingEngine::reset()
+{
+    // set this to pastSpan so that we don't trigger on old data when we start again.
+    std::fill(sampToReenable.begin(), sampToReenable.end(), settings.pastSpan + settings.futureSpan + 1);
+    std::fill(earlyCandidates.begin(), earlyCandidates.end(), EarlyCandidate());
+    std::fill(lastVariant.begin(), lastVariant.end(), VARIANT_INACTIVE);
+}
+
+void CrossingEngine::resizeVotingHistories()
+{
+    const int pastSpan = settings.pastSpan;
+    const int futureSpan = settings.futureSpan;
+    const int historyLength = getHistoryLength();
+    const int votingLength = pastSpan + futureSpan + 2; // of the history, used for voting
+
+    for (int c = 0; c < getNumChannels(); ++c)
+    {
+        // (no change if the history was already long enough, see setMaxVotingSpan)
+        const int numKept = inputStaging[c].resizeHistory(historyLength);
+        thresholdStaging[c].resizeHistory(historyLength);
+
+        // recount the voting counters from the history, as they are after the sample before the
+        // next block: past samples -votingLength to -futureSpan - 3, future samples -futureSpan to -1
+        std::vector<uint64_t>& mask = crossingMasks[c];
+        if (mask.size() < static_cast<size_t>(CrossingKernels::numMaskWords(votingLength)))
+        {
+            mask.resize(CrossingKernels::numMaskWords(historyLength));
+        }
+        CrossingKernels::computeAboveMask(inputStaging[c].getBlock() - votingLength,
+            thresholdStaging[c].getBlock() - votingLength, votingLength, mask.data());
+
+        pastSamplesAbove[c] = CrossingKernels::countSetBits(mask.data(), 0, pastSpan);
+        futureSamplesAbove[c] = CrossingKernels::countSetBits(mask.data(), votingLength - futureSpan, votingLength);
+
+        // don't vote over samples from before the channel's history
+        sampToReenable[c] = std::max(sampToReenable[c], pastSpan + 1 - numKept);
+    }
+
+    std::fill(earlyCandidates.begin(), earlyCandidates.end(), EarlyCandidate());
+}
+
+void CrossingEngine::processBlock(int chan, const float* input, const float* threshold, int numSamples,
+    int64_t startTs, EventSink& sink)
+{
+    const float* rp;
+    float* pThresh = beginBlock(chan, input, numSamples, &rp);
+    std::copy(threshold, threshold + numSamples, pThresh);
+    detect(chan, rp, pThresh, numSamples, startTs, false, false, sink);
+}
+
+void CrossingEngine::processBlock(int chan, const float* input, float threshold, int numSamples,
+    int64_t startTs, EventSink& sink)
+{
+    const float* rp;
+    float* pThresh = beginBlock(chan, input, numSamples, &rp);
+    std::fill(pThresh, pThresh + numSamples, threshold);
+    detect(chan, rp, pThresh, numSamples, startTs, false, true, sink);
+}
+
+void CrossingEngine::processBlockRandom(int chan, const float* input, int numSamples, int64_t startTs,
+    EventSink& sink)
+{
+    const float* rp;
+    float* pThresh = beginBlock(chan, input, numSamples, &rp);
+    std::fill(pThresh, pThresh + numSamples, randomThresh[chan]); // updated by the detector after each event
+    detect(chan, rp, pThresh, numSamples, startTs, true, false, sink);
+}
+
+float* CrossingEngine::beginBlock(int chan, const float* input, int numSamples, const float** rp)
+{
+    assert(chan >= 0 && chan < getNumChannels());
+
+    // move the end of the previous block into the input and threshold histories
+    inputStaging[chan].commit();
+    thresholdStaging[chan].commit();
+
+    // stage the input after its history, and make room to store the threshold for each sample
+    // of the current block after the threshold history, so that both can be indexed directly
+    // from -(pastSpan + futureSpan + 3) to numSamples - 1.
+    *rp = inputStaging[chan].stage(input, numSamples);
+    return thresholdStaging[chan].prepare(numSamples);
+}
+
+void CrossingEngine::detect(int chan, const float* rp, float* pThresh, int numSamples, int64_t startTs,
+    bool randomThresh, bool constantOverBuffer, EventSink& sink)
+{
+    // dispatch to the detector for the current configuration
+    const int variant = getDetectorVariant(chan, randomThresh);
+    lastVariant[chan] = variant;
+
+    if (variant == VARIANT_BLOCK_KERNEL)
+    {
+        detectCrossingsFast(chan, rp, pThresh, numSamples, startTs, constantOverBuffer, sink);
+    }
+    else
+    {
+        (this->*getDetector(variant))(chan, rp, pThresh, numSamples, startTs, sink);
+    }
+
+    // shift sampToReenable so it is relative to the next block (crossings from futureSpan
+    // samples before the next block onward have yet to be checked)
+    sampToReenable[chan] = std::max(-settings.futureSpan, sampToReenable[chan] - numSamples);
+
+    // likewise for the early firing candidate (dropped if early firing is no longer in use)
+    EarlyCandidate& earlyCandidate = earlyCandidates[chan];
+    earlyCandidate.crossing -= numSamples;
+    if (variant < 0 || ((variant >> 6) & 1) == 0)
+    {
+        earlyCandidate.active = false;
+    }
+}
+
+int CrossingEngine::getDetectorVariant(int chan, bool randomThresh) const
+{
+    const bool voting = settings.pastSpan > 0 || settings.futureSpan > 0;
+    const bool jumpLimitActive = settings.useJumpLimit || jumpLimitElapsed[chan] <= settings.jumpLimitSleep;
+
+    if (!randomThresh && !voting && !jumpLimitActive)
+    {
+        return VARIANT_BLOCK_KERNEL;
+    }
+
+    const int directions = (settings.posOn ? DETECT_RISING : 0) | (settings.negOn ? DETECT_FALLING : 0);
+    const bool earlyFire = settings.earlyFire && settings.futureSpan > 0 && directions != 0;
+    return (int(earlyFire) << 6) | (directions << 4) | (int(randomThresh) << 3) | (int(voting) << 2) |
+        (int(jumpLimitActive) << 1) | int(settings.useBufferEndMask);
+}
+
+template <bool RISING, bool VOTING, bool JUMP_LIMIT>
+bool CrossingEngine::shouldTrigger(int chan, float preVal, float postVal, bool preAbove, bool postAbove)
+{
+    if (JUMP_LIMIT)
+    {
+        int& currJumpLimitElapsed = jumpLimitElapsed[chan];
+
+        // check jumpLimit
+        if (settings.useJumpLimit && std::abs(postVal - preVal) >= settings.jumpLimit)
+        {
+            currJumpLimitElapsed = 0;
+            return false;
+        }
+
+        if (currJumpLimitElapsed <= settings.jumpLimitSleep)
+        {
+            currJumpLimitElapsed++;
+            return false;
+        }
+    }
+
+    bool preSat = RISING != preAbove;
+    bool postSat = RISING == postAbove;
+    if (!VOTING)
+    {
+        return preSat && postSat;
+    }
+
+    const int currPastSamplesAbove = pastSamplesAbove[chan];
+    const int currFutureSamplesAbove = futureSamplesAbove[chan];
+    assert(currPastSamplesAbove >= 0 && currFutureSamplesAbove >= 0);
+
+    bool pastSat = (RISING ? settings.pastSpan - currPastSamplesAbove : currPastSamplesAbove) >= pastSamplesNeeded;
+    bool futureSat = (RISING ? currFutureSamplesAbove : settings.futureSpan - currFutureSamplesAbove) >= futureSamplesNeeded;
+
+    return preSat && postSat && pastSat && futureSat;
+}
+
+template <int DIRECTIONS, bool JUMP_LIMIT, typename IsAbove>
+int CrossingEngine::updateEarlyCandidate(int chan, const float* rp, int i, const IsAbove& isAbove,
+    const uint64_t* aboveMask, int maskOffset)
+{
+    EarlyCandidate& candidate = earlyCandidates[chan];
+    const bool above = isAbove(i);
+
+    if (candidate.active)
+    {
+        candidate.futureSeen++;
+        if (above == candidate.rising)
+        {
+            candidate.futureSatisfied++;
+        }
+
+        if (candidate.futureSatisfied >= futureSamplesNeeded)
+        {
+            // guaranteed to pass
+            candidate.active = false;
+            return candidate.crossing;
+        }
+
+        if (candidate.futureSeen - candidate.futureSatisfied <= settings.futureSpan - futureSamplesNeeded)
+        {
+            // still undecided
+            return NO_EARLY_CROSSING;
+        }
+
+        // can no longer pass; look for a new candidate at i
+        candidate.active = false;
+    }
+
+    // is there a crossing from i - 1 to i in an enabled direction?
+    if (above == isAbove(i - 1) ||
+        (above && !(DIRECTIONS & DETECT_RISING)) ||
+        (!above && !(DIRECTIONS & DETECT_FALLING)))
+    {
+        return NO_EARLY_CROSSING;
+    }
+
+    if (JUMP_LIMIT && (jumpLimitElapsed[chan] <= settings.jumpLimitSleep ||
+        (settings.useJumpLimit && std::abs(rp[i] - rp[i - 1]) >= settings.jumpLimit)))
+    {
+        return NO_EARLY_CROSSING;
+    }
+
+    // past vote (over the same samples as in shouldTrigger, i - 1 - pastSpan to i - 2)
+    if (pastSamplesNeeded > 0)
+    {
+        int pastAbove = 0;
+        if (aboveMask != nullptr)
+        {
+            pastAbove = CrossingKernels::countSetBits(aboveMask, i - 1 - settings.pastSpan + maskOffset,
+                i - 1 + maskOffset);
+        }
+        else
+        {
+            for (int k = i - 1 - settings.pastSpan; k <= i - 2; ++k)
+            {
+                pastAbove += int(isAbove(k));
+            }
+        }
+
+        const int pastSatisfied = above ? settings.pastSpan - pastAbove : pastAbove;
+        if (pastSatisfied < pastSamplesNeeded)
+        {
+            return NO_EARLY_CROSSING;
+        }
+    }
+
+    if (futureSamplesNeeded == 0)
+    {
+        return i;
+    }
+
+    candidate.active = true;
+    candidate.rising = above;
+    candidate.crossing = i;
+    candidate.futureSeen = 0;
+    candidate.futureSatisfied = 0;
+    return NO_EARLY_CROSSING;
+}
+
+template <bool EARLY_FIRE, int DIRECTIONS, bool RANDOM_THRESH, bool VOTING, bool JUMP_LIMIT,
+    bool BUFFER_END_MASK>
+void CrossingEngine::detectCrossings(int chan, const float* rp, float* pThresh,
+    int nSamples, int64_t startTs, EventSink& sink)
+{
+    int& currSampToReenable = sampToReenable[chan];
+    int& currPastSamplesAbove = pastSamplesAbove[chan];
+    int& currFutureSamplesAbove = futureSamplesAbove[chan];
+
+    const int currPastSpan = settings.pastSpan;
+    const int currFutureSpan = settings.futureSpan;
+
+    /* With voting, the history and block are compared against threshold once, as a bitmask with
+     * block index k at bit k + maskOffset. The votes are then counted only where there is a
+     * crossing, with popcounts of the mask, and the voting counters are brought up to date at the
+     * end of the block. Random thresholds can change within the block, so then samples are compared
+     * as they're needed and the counters are updated for each sample.
+     */
+    const bool USE_MASK = VOTING && !RANDOM_THRESH;
+    const int maskOffset = USE_MASK ? currPastSpan + currFutureSpan + 2 : 0;
+    const uint64_t* aboveMask = nullptr;
+    if (USE_MASK)
+    {
+        std::vector<uint64_t>& mask = crossingMasks[chan];
+        const size_t nWords = CrossingKernels::numMaskWords(maskOffset + nSamples);
+        if (mask.size() < nWords)
+        {
+            mask.resize(nWords);
+        }
+        CrossingKernels::computeAboveMask(rp - maskOffset, pThresh - maskOffset, maskOffset + nSamples, mask.data());
+        aboveMask = mask.data();
+    }
+
+    auto isAbove = [&](int k)
+    {
+        if (USE_MASK)
+        {
+            const unsigned int bit = static_cast<unsigned int>(k + maskOffset);
+            return ((aboveMask[bit / 64] >> (bit % 64)) & 1) != 0;
+        }
+        return rp[k] > pThresh[k];
+    };
+
+    const int firstAllowed = BUFFER_END_MASK ? nSamples - settings.bufferEndMaskSamp : 0;
+    const int currTimeoutSamp = settings.timeoutSamp;
+
+    // reports the crossing at indCross, confirmed at the current sample i
+    auto fire = [&](int indCross, int i)
+    {
+        // if using random thresholds, draw a new one (so the sink can see it)
+        if (RANDOM_THRESH)
+        {
+            randomThresh[chan] = nextRandomThresh();
+        }
+
+        reportCrossing(chan, rp, pThresh, startTs, indCross, i, sink);
+#if CROSSING_DETECTOR_STATS
+        ++counters[chan].reported;
+#endif
+
+        // update sampToReenable
+        currSampToReenable = indCross + 1 + currTimeoutSamp;
+
+        // use the new random threshold for the following samples
+        if (RANDOM_THRESH)
+        {
+            std::fill(pThresh + i + 1, pThresh + nSamples, randomThresh[chan]);
+        }
+    };
+
+    // loop over current block and report newly detected crossings
+    for (int i = 0; i < nSamples; ++i)
+    {
+        const int indCross = VOTING ? i - currFutureSpan : i;
+
+        // update pastSamplesAbove and futureSamplesAbove
+        if (VOTING && !USE_MASK)
+        {
+            if (currPastSpan > 0)
+            {
+                // entering indCross - 2, leaving indCross - 2 - pastSpan
+                currPastSamplesAbove += int(isAbove(indCross - 2)) - int(isAbove(indCross - 2 - currPastSpan));
+            }
+
+            if (currFutureSpan > 0)
+            {
+                // entering i (== indCross + futureSpan), leaving indCross
+                currFutureSamplesAbove += int(isAbove(i)) - int(isAbove(indCross));
+            }
+        }
+
+        if (EARLY_FIRE)
+        {
+            const int indEarly = updateEarlyCandidate<DIRECTIONS, JUMP_LIMIT>(chan, rp, i, isAbove,
+                aboveMask, maskOffset);
+
+            if (indEarly != NO_EARLY_CROSSING && indEarly >= currSampToReenable &&
+                !(BUFFER_END_MASK && indEarly < firstAllowed))
+            {
+                // the full-span check below will skip this crossing, since it's now in the timeout
+                fire(indEarly, i);
+                continue;
+            }
+        }
+
+#if CROSSING_DETECTOR_STATS
+        bool candidate = false;
+        if (!EARLY_FIRE && DIRECTIONS != 0)
+        {
+            const bool postAbove = isAbove(indCross);
+            candidate = postAbove != isAbove(indCross - 1) &&
+                (postAbove ? (DIRECTIONS & DETECT_RISING) : (DIRECTIONS & DETECT_FALLING)) != 0;
+            counters[chan].candidates += candidate;
+        }
+#endif
+
+        if (DIRECTIONS == 0 || indCross < currSampToReenable ||
+            (BUFFER_END_MASK && indCross < firstAllowed))
+        {
+            // can't trigger an event now
+#if CROSSING_DETECTOR_STATS
+            if (candidate)
+            {
+                ++(indCross < currSampToReenable ? counters[chan].timeout : counters[chan].bufferEndMask);
+            }
+#endif
+            continue;
+        }
+
+        float preVal = rp[indCross - 1];
+        float postVal = rp[indCross];
+        bool preAbove = isAbove(indCross - 1);
+        bool postAbove = isAbove(indCross);
+
+        // past samples indCross - 1 - pastSpan to indCross - 2, future samples indCross + 1 to i
+        if (USE_MASK && preAbove != postAbove)
+        {
+            currPastSamplesAbove = CrossingKernels::countSetBits(aboveMask,
+                indCross - 1 - currPastSpan + maskOffset, indCross - 1 + maskOffset);
+            currFutureSamplesAbove = CrossingKernels::countSetBits(aboveMask,
+                indCross + 1 + maskOffset, i + 1 + maskOffset);
+        }
+
+#if CROSSING_DETECTOR_STATS
+        // (the same condition that makes shouldTrigger fail before voting)
+        const bool jumpLimited = JUMP_LIMIT && ((settings.useJumpLimit &&
+            std::abs(postVal - preVal) >= settings.jumpLimit) || jumpLimitElapsed[chan] <= settings.jumpLimitSleep);
+#endif
+
+        // check whether to trigger an event
+        if (((DIRECTIONS & DETECT_RISING) && shouldTrigger<true, VOTING, JUMP_LIMIT>(chan,
+                preVal, postVal, preAbove, postAbove)) ||
+            ((DIRECTIONS & DETECT_FALLING) && shouldTrigger<false, VOTING, JUMP_LIMIT>(chan,
+                preVal, postVal, preAbove, postAbove)))
+        {
+            fire(indCross, i);
+        }
+#if CROSSING_DETECTOR_STATS
+        else if (candidate)
+        {
+            ++(jumpLimited ? counters[chan].jumpLimit : counters[chan].voting);
+        }
+#endif
+    }
+
+    if (USE_MASK && nSamples > 0)
+    {
+        // as after the last sample (i = nSamples - 1)
+        const int lastCross = nSamples - 1 - currFutureSpan;
+        currPastSamplesAbove = CrossingKernels::countSetBits(aboveMask,
+            lastCross - 1 - currPastSpan + maskOffset, lastCross - 1 + maskOffset);
+        currFutureSamplesAbove = CrossingKernels::countSetBits(aboveMask,
+            lastCross + 1 + maskOffset, nSamples + maskOffset);
+    }
+}
+
+// Recursively fills the detector table with each specialization of detectCrossings.
+template <int VARIANT>
+struct CrossingEngine::DetectorTable
+{
+    static void fill(DetectorFn* table)
+    {
+        table[VARIANT] = &CrossingEngine::detectCrossings<((VARIANT >> 6) & 1) != 0, (VARIANT >> 4) & 3,
+            ((VARIANT >> 3) & 1) != 0, ((VARIANT >> 2) & 1) != 0, ((VARIANT >> 1) & 1) != 0,
+            (VARIANT & 1) != 0>;
+        DetectorTable<VARIANT - 1>::fill(table);
+    }
+};
+
+template <>
+struct CrossingEngine::DetectorTable<-1>
+{
+    static void fill(DetectorFn*) {}
+};
+
+CrossingEngine::DetectorFn CrossingEngine::getDetector(int variant)
+{
+    static DetectorFn table[NUM_DETECTOR_VARIANTS];
+    static const bool tableFilled = (DetectorTable<NUM_DETECTOR_VARIANTS - 1>::fill(table), true);
+    (void)tableFilled;
+
+    assert(variant >= 0 && variant < NUM_DETECTOR_VARIANTS);
+    return table[variant];
+}
+
+std::string CrossingEngine::getVariantDescription(int variant)
+{
+    if (variant == VARIANT_INACTIVE)
+    {
+        return "Not running";
+    }
+
+    if (variant == VARIANT_BLOCK_KERNEL)
+    {
+        return "Block kernel (SIMD mask + bit scan)";
+    }
+
+    if (variant < 0 || variant >= NUM_DETECTOR_VARIANTS)
+    {
+        return "Unknown";
+    }
+
+    static const char* const directionNames[] = { "none", "rising", "falling", "rising + falling" };
+    auto yesNo = [](int bit) { return std::string(bit ? "yes" : "no"); };
+
+    return "Specialized loop #" + std::to_string(variant) +
+        "\nDirections: " + directionNames[(variant >> 4) & 3] +
+        "\nRandom threshold: " + yesNo((variant >> 3) & 1) +
+        "\nSample voting: " + yesNo((variant >> 2) & 1) +
+        "\nJump limit: " + yesNo((variant >> 1) & 1) +
+        "\nBuffer end mask: " + yesNo(variant & 1) +
+        "\nEarly firing: " + yesNo((variant >> 6) & 1);
+}
+
+void CrossingEngine::detectCrossingsFast(int chan, const float* rp, const float* pThresh,
+    int nSamples, int64_t startTs, bool constantOverBuffer, EventSink& sink)
+{
+    if (nSamples <= 0)
+    {
+        return;
+    }
+
+    std::vector<uint64_t>& crossingMask = crossingMasks[chan];
+    const size_t nWords = CrossingKernels::numMaskWords(nSamples);
+    if (crossingMask.size() < nWords)
+    {
+        crossingMask.resize(nWords);
+    }
+    uint64_t* const mask = crossingMask.data();
+
+    if (constantOverBuffer)
+    {
+        CrossingKernels::computeAboveMask(rp, pThresh[0], nSamples, mask);
+    }
+    else
+    {
+        CrossingKernels::computeAboveMask(rp, pThresh, nSamples, mask);
+    }
+
+    // the sample just before this block determines whether sample 0 is a crossing
+    bool prevAbove = rp[-1] > pThresh[-1];
+    CrossingKernels::aboveToCrossings(mask, nSamples, prevAbove, settings.posOn, settings.negOn);
+
+    int& currSampToReenable = sampToReenable[chan];
+    const int firstAllowed = settings.useBufferEndMask ? nSamples - settings.bufferEndMaskSamp : 0;
+    const int currTimeoutSamp = settings.timeoutSamp;
+
+#if CROSSING_DETECTOR_STATS
+    // every set bit is a candidate; those not reported were masked or in a timeout
+    const int numCandidates = CrossingKernels::countSetBits(mask, 0, nSamples);
+    const int numMasked = firstAllowed > 0
+        ? CrossingKernels::countSetBits(mask, 0, std::min(firstAllowed, nSamples)) : 0;
+    int numReported = 0;
+#endif
+
+    for (int ind = CrossingKernels::findNextSet(mask, nSamples, std::max(firstAllowed, currSampToReenable));
+        ind >= 0;
+        ind = CrossingKernels::findNextSet(mask, nSamples, std::max(firstAllowed, currSampToReenable)))
+    {
+        reportCrossing(chan, rp, pThresh, startTs, ind, ind, sink);
+        currSampToReenable = ind + 1 + currTimeoutSamp;
+#if CROSSING_DETECTOR_STATS
+        ++numReported;
+#endif
+    }
+
+#if CROSSING_DETECTOR_STATS
+    Counters& chanCounters = counters[chan];
+    chanCounters.candidates += numCandidates;
+    chanCounters.reported += numReported;
+    chanCounters.bufferEndMask += numMasked;
+    chanCounters.timeout += numCandidates - numMasked - numReported;
+#endif
+}
+
+void CrossingEngine::reportCrossing(int chan, const float* rp, const float* pThresh, int64_t startTs,
+    int indCross, int indDecision, EventSink& sink) const
+{
+    Crossing crossing;
+    crossing.channel = chan;
+    crossing.offset = indCross;
+    crossing.decisionOffset = indDecision;
+    crossing.crossingPoint = startTs + indCross;
+    crossing.level = rp[indCross];
+    crossing.threshold = pThresh[indCross];
+    crossing.rising = crossing.level > crossing.threshold;
+    crossing.interpolatedPoint = settings.interpolation == INTERP_NONE ? 0.0
+        : crossing.crossingPoint - 1 + getCrossingFraction(rp, pThresh, indCross);
+
+    sink.handleCrossing(crossing);
+}
+
+double CrossingEngine::getCrossingFraction(const float* rp, const float* pThresh, int indCross) const
+{
+    // (the cubic only uses samples up to indCross, so it doesn't depend on where the blocks split)
+    if (settings.interpolation == INTERP_CUBIC)
+    {
+        return CrossingKernels::interpolateCrossingCubic(distanceAt(rp, pThresh, indCross - 3),
+            distanceAt(rp, pThresh, indCross - 2), distanceAt(rp, pThresh, indCross - 1),
+            distanceAt(rp, pThresh, indCross));
+    }
+
+    return CrossingKernels::interpolateCrossingLinear(distanceAt(rp, pThresh, indCross - 1),
+        distanceAt(rp, pThresh, indCross));
+}
+
+double CrossingEngine::distanceAt(const float* rp, const float* pThresh, int index)
+{
+    return static_cast<double>(rp[index]) - pThresh[index];
+}
+
+CrossingEngine::Counters CrossingEngine::getCounters() const
+{
+    Counters total;
+    for (const Counters& chanCounters : counters)
+    {
+        total.candidates += chanCounters.candidates;
+        total.reported += chanCounters.reported;
+        total.timeout += chanCounters.timeout;
+        total.bufferEndMask += chanCounters.bufferEndMask;
+        total.jumpLimit += chanCounters.jumpLimit;
+        total.voting += chanCounters.voting;
+    }
+    return total;
+}
+
+void CrossingEngine::resetCounters()
+{
+    std::fill(counters.begin(), counters.end(), Counters());
+}
+
+const float* CrossingEngine::getLastThresholds(int chan) const
+{
+    return thresholdStaging[chan].getBlock();
+}
+
+int CrossingEngine::getLastVariant(int chan) const
+{
+    return lastVariant[chan];
+}
+
+float CrossingEngine::getRandomThreshold(int chan) const
+{
+    return randomThresh[chan];
+}
+
+void CrossingEngine::redrawRandomThresholds()
+{
+    for (float& thresh : randomThresh)
+    {
+        thresh = nextRandomThresh();
+    }
+}
+
+void CrossingEngine::setRandomSeed(unsigned int seed)
+{
+    rng.seed(seed);
+}
+
+float CrossingEngine::nextRandomThresh()
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float range = settings.randomThreshRange[1] - settings.randomThreshRange[0];
+    return settings.randomThreshRange[0] + range * unit(rng);
+}
@@ -0,0 +1,370 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CROSSING_ENGINE_H_INCLUDED
+#define CROSSING_ENGINE_H_INCLUDED
+
+/*
+Threshold crossing detection for a set of channels, independent of the Open Ephys GUI.
+
+Holds the per-channel detection state (input and threshold histories, voting counters, timeouts,
+jump limit and early firing state) and finds crossings in blocks of samples, delivering each one
+to a caller-supplied EventSink. With sample voting, each block and its history are first reduced
+to a packed above-threshold bitmask (see CrossingKernels), and votes are counted with popcounts
+only where there is a crossing, so long spans cost about the same as short ones. What happens to
+a crossing (TTL events, event duration, metadata) is up to the sink; CrossingDetector wraps an
+engine and turns crossings into TTL events, but the same logic can run offline or in other hosts.
+
+Typical use:
+    engine.setSettings(settings);
+    engine.setNumChannels(numChannels);
+    engine.reserve(maxBlockLength);
+    for each block, for each channel c:
+        engine.processBlock(c, input, threshold, n, blockStartTimestamp, sink);
+
+Blocks of different channels may be processed concurrently (e.g. by a pool of threads, each with
+its own sink), except with random thresholds, which all channels draw from one generator. Nothing
+else may be called while a block is being processed.
+
+Does not depend on JUCE.
+*/
+
+#include "StagingBuffer.h"
+
+// If nonzero (e.g. with the CROSSING_DETECTOR_STATS CMake option), detection keeps Counters of
+// candidate crossings and why they were rejected. If 0, the counting is compiled out.
+#ifndef CROSSING_DETECTOR_STATS
+#define CROSSING_DETECTOR_STATS 0
+#endif
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+class CrossingEngine
+{
+public:
+    // How to estimate the sub-sample crossing time (see CrossingKernels)
+    enum Interpolation { INTERP_NONE, INTERP_LINEAR, INTERP_CUBIC };
+
+    // Detection parameters, shared by all channels. Times are in samples.
+    struct Settings
+    {
+        Settings();
+
+        bool posOn;  // detect rising crossings
+        bool negOn;  // detect falling crossings
+
+        int timeoutSamp; // samples after a crossing when no more crossings are allowed
+
+        /* Number of *additional* past and future samples to look at at each timepoint, and the
+         * fraction of each span required to be on the correct side of the threshold. If futureSpan
+         * samples after a timepoint are not available yet, the test is delayed until they are.
+         */
+        int pastSpan;
+        int futureSpan;
+        float pastStrict;
+        float futureStrict;
+
+        // whether to fire as soon as the future vote is guaranteed to pass (see updateEarlyCandidate)
+        bool earlyFire;
+
+        // maximum absolute difference between x[k] and x[k-1] to trigger an event on x[k]
+        bool useJumpLimit;
+        float jumpLimit;
+        float jumpLimitSleep;
+
+        // if useBufferEndMask, only crossings confirmed in the last bufferEndMaskSamp samples of a block count
+        bool useBufferEndMask;
+        int bufferEndMaskSamp;
+
+        Interpolation interpolation;
+
+        // range of thresholds drawn by processBlockRandom
+        float randomThreshRange[2];
+    };
+
+    // A detected crossing, as passed to EventSink::handleCrossing
+    struct Crossing
+    {
+        int channel;
+        int offset;            // first sample after the crossing, relative to the block (< 0 if in an earlier block)
+        int decisionOffset;    // sample of the block at which the crossing was confirmed
+        int64_t crossingPoint; // timestamp of the first sample after the crossing
+        float level;           // input at the first sample after the crossing
+        float threshold;       // threshold at the first sample after the crossing
+        bool rising;
+        double interpolatedPoint; // estimated fractional timestamp of the crossing (if interpolation is on)
+    };
+
+    /* Totals over all channels since the last resetCounters() (only kept if CROSSING_DETECTOR_STATS).
+     * A candidate is a crossing of the threshold in an enabled direction; each is either reported
+     * or rejected for one of the listed reasons. With early firing, only reported crossings are counted.
+     */
+    struct Counters
+    {
+        Counters();
+
+        uint64_t candidates;
+        uint64_t reported;
+        uint64_t timeout;       // within the timeout after the previous crossing
+        uint64_t bufferEndMask; // before the last bufferEndMaskSamp samples of the block
+        uint64_t jumpLimit;     // jump too large, or within the jump limit sleep
+        uint64_t voting;        // past or future vote failed
+    };
+
+    class EventSink
+    {
+    public:
+        virtual ~EventSink() {}
+
+        // Called for each crossing, in order, from within processBlock.
+        virtual void handleCrossing(const Crossing& crossing) = 0;
+    };
+
+    /* Crossings are found by one of NUM_DETECTOR_VARIANTS specializations of detectCrossings,
+     * chosen once per block by getDetectorVariant. Variant index bits (high to low):
+     *  [6] early firing, [5:4] DetectorDirections, [3] random threshold, [2] sample voting,
+     *  [1] jump limit (or jump limit sleep not yet elapsed), [0] buffer end mask
+     * Configurations without random threshold, voting or jump limit use detectCrossingsFast instead.
+     */
+    static const int NUM_DETECTOR_VARIANTS = 128;
+    static const int VARIANT_BLOCK_KERNEL = -1;
+    static const int VARIANT_INACTIVE = -2;
+
+    CrossingEngine();
+
+    /** Changes the settings. If the voting spans change, the voting histories are resized, keeping
+     *  the most recent samples, and the voting counters are recounted from them.
+     */
+    void setSettings(const Settings& newSettings);
+
+    const Settings& getSettings() const;
+
+    /** Changes the number of channels and resets the state of each (keeping their random thresholds). */
+    void setNumChannels(int numChannels);
+
+    int getNumChannels() const;
+
+    /** Ensures that blocks of up to maxBlockLength samples can be processed without allocating. */
+    void reserve(int maxBlockLength);
+
+    /** Keeps enough history for voting spans (pastSpan + futureSpan) of up to maxSpan, so that
+     *  the spans can then change within that range without allocating or losing any samples
+     *  they need. Larger spans still work, but reallocate the histories when set.
+     */
+    void setMaxVotingSpan(int maxSpan);
+
+    /** Forgets timeouts and pending early firing candidates, so that detection restarts cleanly
+     *  (after the histories have been refilled) when the next block is processed.
+     */
+    void reset();
+
+    /** Detects crossings in the next block of a channel with a threshold for each sample. */
+    void processBlock(int chan, const float* input, const float* threshold, int numSamples,
+        int64_t startTs, EventSink& sink);
+
+    /** Detects crossings in the next block of a channel with the same threshold for each sample. */
+    void processBlock(int chan, const float* input, float threshold, int numSamples,
+        int64_t startTs, EventSink& sink);
+
+    /** Detects crossings in the next block of a channel with the channel's random threshold,
+     *  which is redrawn from settings.randomThreshRange after each crossing (getRandomThreshold
+     *  already returns the new one when the sink is called).
+     */
+    void processBlockRandom(int chan, const float* input, int numSamples, int64_t startTs, EventSink& sink);
+
+    /** Threshold of each sample of the block most recently processed on the given channel
+     *  (valid until its next block is processed).
+     */
+    const float* getLastThresholds(int chan) const;
+
+    /** The detector variant used for the block most recently processed on the given channel. */
+    int getLastVariant(int chan) const;
+
+    float getRandomThreshold(int chan) const;
+
+    /** Draws a new random threshold for each channel. */
+    void redrawRandomThresholds();
+
+    void setRandomSeed(unsigned int seed);
+
+    Counters getCounters() const;
+
+    void resetCounters();
+
+    /** Number of samples of a voting span that must be on the correct side of the threshold. */
+    static int getSamplesNeeded(int span, float strict);
+
+    /** Human-readable summary of a detector variant. */
+    static std::string getVariantDescription(int variant);
+
+    /** Orders the crossings of channels that share a block by the sample their events turn on at
+        (the start of the block for ones decided late), then by channel, then by offset. Sorting
+        them this way makes the order independent of which channel was processed first. */
+    static bool isEarlier(const Crossing& a, const Crossing& b);
+
+private:
+    enum DetectorDirections { DETECT_RISING = 1, DETECT_FALLING = 2 };
+
+    typedef void (CrossingEngine::*DetectorFn)(int chan, const float* rp, float* pThresh,
+        int nSamples, int64_t startTs, EventSink& sink);
+
+    // helper to build the table of detectCrossings specializations
+    template <int VARIANT>
+    struct DetectorTable;
+
+    static DetectorFn getDetector(int variant);
+
+    // Returns the variant to use for the given channel in the current block.
+    int getDetectorVariant(int chan, bool randomThresh) const;
+
+    // Stages the input of the next block of a channel, and returns where its thresholds go.
+    float* beginBlock(int chan, const float* input, int numSamples, const float** rp);
+
+    // Runs the detector variant for the current configuration on the staged block.
+    void detect(int chan, const float* rp, float* pThresh, int numSamples, int64_t startTs,
+        bool randomThresh, bool constantOverBuffer, EventSink& sink);
+
+    /* Detects crossings in one block of a channel, with the sample-by-sample voting, jump limit,
+     * random threshold and direction logic compiled in or out according to the template parameters.
+     * rp and pThresh must be indexable from -(pastSpan + futureSpan + 3).
+     */
+    template <bool EARLY_FIRE, int DIRECTIONS, bool RANDOM_THRESH, bool VOTING, bool JUMP_LIMIT,
+        bool BUFFER_END_MASK>
+    void detectCrossings(int chan, const float* rp, float* pThresh, int nSamples, int64_t startTs,
+        EventSink& sink);
+
+    /* Detects crossings in one block of a channel using CrossingKernels, for the case where there
+     * is no sample voting or jump limit (so each crossing only depends on two samples).
+     * pThresh holds the threshold for each sample; if constantOverBuffer, it is only read at index 0.
+     */
+    void detectCrossingsFast(int chan, const float* rp, const float* pThresh, int nSamples,
+        int64_t startTs, bool constantOverBuffer, EventSink& sink);
+
+    /* Whether there should be a trigger in the given direction (true = rising, false = falling),
+     * given the current voting counters of the given channel and the passed values surrounding
+     * the point where a crossing may be, and whether each is above its threshold.
+     */
+    template <bool RISING, bool VOTING, bool JUMP_LIMIT>
+    bool shouldTrigger(int chan, float preVal, float postVal, bool preAbove, bool postAbove);
+
+    /* Early firing: rather than waiting for all futureSpan samples after a crossing, a crossing that
+     * passes the other criteria becomes the channel's candidate, and fires as soon as enough of the
+     * following samples are on the correct side for the future vote to pass no matter what the rest
+     * are (or is dropped as soon as it can no longer pass). Crossings that occur while a candidate
+     * is pending are still checked once their full future span is available.
+     *
+     * Advances the candidate of the given channel by the newest sample i (or starts a new one if a
+     * crossing ending at i qualifies), and returns the index of the crossing to fire now, or
+     * NO_EARLY_CROSSING. isAbove(k) tells whether sample k is above threshold; if aboveMask is not
+     * null, it holds the same bits, with block index k at bit k + maskOffset.
+     */
+    template <int DIRECTIONS, bool JUMP_LIMIT, typename IsAbove>
+    int updateEarlyCandidate(int chan, const float* rp, int i, const IsAbove& isAbove,
+        const uint64_t* aboveMask, int maskOffset);
+
+    static const int NO_EARLY_CROSSING = INT32_MIN;
+
+    // Fills in a Crossing for the sample at indCross, confirmed at indDecision, and passes it to the sink.
+    void reportCrossing(int chan, const float* rp, const float* pThresh, int64_t startTs,
+        int indCross, int indDecision, EventSink& sink) const;
+
+    /* Position of the crossing just before sample indCross, as a fraction of the interval from
+     * indCross - 1 to indCross, according to the interpolation setting (the cubic also reads
+     * indCross - 3 and indCross - 2).
+     */
+    double getCrossingFraction(const float* rp, const float* pThresh, int indCross) const;
+
+    // input - threshold at the given block index
+    static double distanceAt(const float* rp, const float* pThresh, int index);
+
+    // Resizes the histories that depend on the voting spans and recounts the voting counters.
+    void resizeVotingHistories();
+
+    // Length of the input and threshold histories for the current spans.
+    int getHistoryLength() const;
+
+    float nextRandomThresh();
+
+    Settings settings;
+
+    // from the voting spans and strictness, see getSamplesNeeded
+    int pastSamplesNeeded;
+    int futureSamplesNeeded;
+
+    // see setMaxVotingSpan
+    int minHistoryLength;
+
+    /* Per-channel detection state, stored as one array per field so that the state of
+     * all channels is contiguous when they are processed in sequence.
+     */
+
+    // the next time at which the detector should be reenabled after a timeout period, measured in
+    // samples past the start of the current block. At most -futureSpan if there is no scheduled
+    // reenable (i.e. the detector is enabled).
+    std::vector<int> sampToReenable;
+
+    // counters for delay keeping track of voting samples (with the above-mask, only brought up to
+    // date at the end of each block)
+    std::vector<int> pastSamplesAbove;
+    std::vector<int> futureSamplesAbove;
+
+    std::vector<int> jumpLimitElapsed;
+
+    // crossing waiting for its future vote to be guaranteed, if using early firing
+    struct EarlyCandidate
+    {
+        EarlyCandidate() : active(false), rising(false), crossing(0), futureSeen(0), futureSatisfied(0) {}
+
+        bool active;
+        bool rising;
+        int crossing; // index relative to the current block
+        int futureSeen;
+        int futureSatisfied;
+    };
+
+    std::vector<EarlyCandidate> earlyCandidates;
+
+    // input and threshold of the current block, preceded by enough history to implement
+    // past/future voting and to look at the samples before a crossing. Each block is committed
+    // to the history when the next one is staged, so its thresholds can be read in between.
+    std::vector<StagingBuffer<float>> inputStaging;
+    std::vector<StagingBuffer<float>> thresholdStaging;
+
+    // if using random thresholds, the current threshold of each channel
+    std::vector<float> randomThresh;
+
+    std::vector<int> lastVariant;
+
+    // packed above/crossing bits of the history and current block (see CrossingKernels), for each
+    // channel so that channels can be processed concurrently
+    std::vector<std::vector<uint64_t>> crossingMasks;
+
+    std::vector<Counters> counters;
+
+    std::mt19937 rng; // for random thresholds
+};
+
+#endif // CROSSING_ENGINE_H_INCLUDED
@@ -0,0 +1,217 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "CrossingEventLog.h"
+
+#include <cstring> // memcpy
+
+static_assert(sizeof(CrossingEventLog::Record) == 24, "log records must be tightly packed");
+
+CrossingEventLog::CrossingEventLog()
+    : Thread        ("Crossing Detector event log")
+    , ring          (RING_SIZE)
+    , fifo          (RING_SIZE)
+    , fileOpen      (false)
+    , chunkStart    (0)
+    , writePosition (0)
+    , writeFailed   (false)
+{}
+
+CrossingEventLog::~CrossingEventLog()
+{
+    close();
+}
+
+bool CrossingEventLog::open(const File& f, double sampleRate)
+{
+    close();
+
+    file = f;
+    fifo.reset();
+    numWritten = 0;
+    numDropped = 0;
+    writePosition = 0;
+    writeFailed = false;
+
+    if (!file.getParentDirectory().createDirectory() || (file.exists() && !file.deleteFile())
+        || !mapChunk(0))
+    {
+        return false;
+    }
+
+    juce::uint8 header[HEADER_SIZE];
+    const juce::uint32 version = VERSION;
+    const juce::uint32 recordSize = sizeof(Record);
+    std::memcpy(header, "CROSSLOG", 8);
+    std::memcpy(header + 8, &version, sizeof(juce::uint32));
+    std::memcpy(header + 12, &recordSize, sizeof(juce::uint32));
+    std::memcpy(header + 16, &sampleRate, sizeof(double));
+    write(header, HEADER_SIZE);
+
+    fileOpen = true;
+    startThread();
+    return true;
+}
+
+void CrossingEventLog::close()
+{
+    if (!fileOpen)
+    {
+        return;
+    }
+
+    stopThread(2000);
+
+    // (append isn't called anymore, so anything left can be written here)
+    writePending();
+    fileOpen = false;
+
+    // The mapping must be released before the file can be resized.
+    chunk = nullptr;
+    FileOutputStream out(file);
+    if (out.openedOk())
+    {
+        out.setPosition(writePosition);
+        out.truncate();
+    }
+}
+
+bool CrossingEventLog::isOpen() const
+{
+    return fileOpen;
+}
+
+const File& CrossingEventLog::getFile() const
+{
+    return file;
+}
+
+void CrossingEventLog::append(const Record& record)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0)
+    {
+        ++numDropped;
+        return;
+    }
+
+    ring[start1] = record;
+    fifo.finishedWrite(1);
+}
+
+juce::int64 CrossingEventLog::getNumWritten() const
+{
+    return numWritten.get();
+}
+
+juce::int64 CrossingEventLog::getNumDropped() const
+{
+    return numDropped.get();
+}
+
+void CrossingEventLog::run()
+{
+    // The processing thread doesn't notify the writer (so that append stays cheap); the ring
+    // holds enough records to cover the polling interval at any realistic event rate.
+    while (!threadShouldExit())
+    {
+        writePending();
+        wait(5);
+    }
+}
+
+void CrossingEventLog::writePending()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+    const int numRecords = size1 + size2;
+    if (numRecords == 0)
+    {
+        return;
+    }
+
+    if (!writeFailed)
+    {
+        writeFailed = !write(ring + start1, size1 * sizeof(Record))
+            || (size2 > 0 && !write(ring + start2, size2 * sizeof(Record)));
+    }
+    fifo.finishedRead(numRecords);
+
+    if (writeFailed)
+    {
+        numDropped += numRecords;
+    }
+    else
+    {
+        numWritten += numRecords;
+    }
+}
+
+bool CrossingEventLog::write(const void* data, size_t numBytes)
+{
+    const char* src = static_cast<const char*>(data);
+    while (numBytes > 0)
+    {
+        if (writePosition >= chunkStart + CHUNK_SIZE && !mapChunk(chunkStart + CHUNK_SIZE))
+        {
+            return false;
+        }
+
+        // records may straddle two chunks
+        const size_t n = static_cast<size_t>(jmin(static_cast<juce::int64>(numBytes),
+            chunkStart + CHUNK_SIZE - writePosition));
+        std::memcpy(static_cast<char*>(chunk->getData()) + (writePosition - chunkStart), src, n);
+
+        src += n;
+        numBytes -= n;
+        writePosition += n;
+    }
+    return true;
+}
+
+bool CrossingEventLog::mapChunk(juce::int64 start)
+{
+    chunk = nullptr;
+
+    // The file has to cover the mapped range. (Its stream is closed again before mapping,
+    // since not every platform allows writing it both ways at once.)
+    {
+        FileOutputStream out(file);
+        if (!out.openedOk() || !out.setPosition(start + CHUNK_SIZE - 1) || !out.writeByte(0))
+        {
+            return false;
+        }
+    }
+
+    chunk = new MemoryMappedFile(file, Range<juce::int64>(start, start + CHUNK_SIZE),
+        MemoryMappedFile::readWrite);
+    if (chunk->getData() == nullptr || static_cast<juce::int64>(chunk->getSize()) < CHUNK_SIZE)
+    {
+        chunk = nullptr;
+        return false;
+    }
+
+    chunkStart = start;
+    return true;
+}
@@ -0,0 +1,120 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CROSSING_EVENT_LOG_H_INCLUDED
+#define CROSSING_EVENT_LOG_H_INCLUDED
+
+/*
+Binary log of detected crossings, written directly to a file rather than through the event
+pipeline. The processing thread appends fixed-size records to a single-producer, single-consumer
+ring (without locking or allocating), and a background thread moves them into the file through
+a memory mapping, one chunk of the file at a time.
+
+File layout (little-endian, as written by the host):
+  header (HEADER_SIZE bytes): "CROSSLOG", uint32 version, uint32 record size, float64 sample rate
+  then one Record per crossing, in the order they were appended.
+
+If the ring is full (the writer has fallen behind), records are dropped and counted.
+
+Used by CrossingDetector to log crossings at rates the event pipeline can't keep up with.
+*/
+
+#include <BasicJuceHeader.h>
+
+class CrossingEventLog : private Thread
+{
+public:
+    struct Record
+    {
+        juce::int64 timestamp;   // crossing point
+        float level;             // sample after the crossing
+        float threshold;
+        juce::uint16 channel;    // source channel
+        juce::uint16 line;       // TTL line of the rule or channel (also when no TTL event is added)
+        juce::uint8 rising;      // 1 if the crossing was rising, 0 if falling
+        juce::uint8 reserved[3];
+    };
+
+    static const juce::uint32 VERSION = 1;
+    static const int HEADER_SIZE = 24;
+
+    CrossingEventLog();
+    ~CrossingEventLog();
+
+    /** Creates the file (replacing any existing one), writes the header and starts the writer
+     *  thread. Returns false if the file can't be written.
+     */
+    bool open(const File& file, double sampleRate);
+
+    /** Writes the remaining records, stops the writer thread and trims the file to the records written. */
+    void close();
+
+    bool isOpen() const;
+
+    // File of the current or last session
+    const File& getFile() const;
+
+    /** Appends a record, on the processing thread only. Never blocks; if the ring is full,
+     *  the record is dropped.
+     */
+    void append(const Record& record);
+
+    // Records written to the file and dropped, in the current or last session
+    juce::int64 getNumWritten() const;
+    juce::int64 getNumDropped() const;
+
+private:
+    void run() override;
+
+    // Moves the records in the ring into the file (on the writer thread, or after it has stopped).
+    void writePending();
+
+    // Copies bytes to the file at writePosition, mapping further chunks as needed.
+    bool write(const void* data, size_t numBytes);
+
+    // Extends the file to cover the chunk starting at the given offset, and maps that chunk.
+    bool mapChunk(juce::int64 start);
+
+    // records in the ring (a power of 2), and bytes of the file mapped at a time
+    static const int RING_SIZE = 1 << 16;
+    static const juce::int64 CHUNK_SIZE = 16 << 20;
+
+    HeapBlock<Record> ring;
+    AbstractFifo fifo;
+
+    File file;
+    bool fileOpen;
+
+    // writer state
+    ScopedPointer<MemoryMappedFile> chunk;
+    juce::int64 chunkStart;
+    juce::int64 writePosition;
+    bool writeFailed;
+
+    Atomic<juce::int64> numWritten;
+    Atomic<juce::int64> numDropped;
+
+    JUCE_DECLARE_NON_COPYABLE(CrossingEventLog);
+};
+
+#endif // CROSSING_EVENT_LOG_H_INCLUDED
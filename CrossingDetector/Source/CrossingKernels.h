@@ -0,0 +1,576 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CROSSING_KERNELS_H_INCLUDED
+#define CROSSING_KERNELS_H_INCLUDED
+
+/*
+Block-wise helpers for crossing detection without per-sample branching.
+
+A block of samples is first reduced to an "above" bitmask (bit i set iff input[i] > threshold[i],
+packed LSB-first into 64-bit words) using SIMD comparisons where available (AVX, SSE2 or AArch64 NEON,
+selected at compile time). The mask can be computed from float samples or from raw int16 samples
+with integer thresholds, which moves half as many bytes per sample and compares twice as many
+samples per instruction. Sign changes are then found with word-wide shifts and XORs, and the
+caller visits the candidate crossings with a count-trailing-zeros scan, so scalar code only runs
+where a crossing actually happened.
+
+Defining CROSSING_KERNELS_SCALAR as nonzero disables the SIMD paths, so that the scalar code can
+be tested on hardware that has SIMD.
+
+Does not depend on JUCE so that it can be used (and benchmarked) outside of the plugin.
+*/
+
+#include <cstdint>
+
+#ifndef CROSSING_KERNELS_SCALAR
+#define CROSSING_KERNELS_SCALAR 0
+#endif
+
+#if CROSSING_KERNELS_SCALAR
+// (no SIMD)
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define CROSSING_KERNELS_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CROSSING_KERNELS_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CROSSING_KERNELS_NEON 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace CrossingKernels
+{
+    /** Number of 64-bit words needed to hold a mask of n samples. */
+    inline int numMaskWords(int n)
+    {
+        return (n + 63) / 64;
+    }
+
+    /** Index of the lowest set bit of a nonzero word. */
+    inline int countTrailingZeros(uint64_t word)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long ind;
+        _BitScanForward64(&ind, word);
+        return static_cast<int>(ind);
+#elif defined(_MSC_VER)
+        unsigned long ind;
+        if (_BitScanForward(&ind, static_cast<unsigned long>(word)))
+        {
+            return static_cast<int>(ind);
+        }
+        _BitScanForward(&ind, static_cast<unsigned long>(word >> 32));
+        return static_cast<int>(ind) + 32;
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    /** Number of set bits in a word. */
+    inline int popCount(uint64_t word)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        return static_cast<int>(__popcnt64(word));
+#elif defined(_MSC_VER)
+        return static_cast<int>(__popcnt(static_cast<unsigned int>(word)) +
+            __popcnt(static_cast<unsigned int>(word >> 32)));
+#else
+        return __builtin_popcountll(word);
+#endif
+    }
+
+    namespace detail
+    {
+        // Threshold access policies, so the same kernel handles a per-sample threshold
+        // array and a single constant threshold.
+        struct ArrayThresh
+        {
+            const float* p;
+            float at(int i) const { return p[i]; }
+#if CROSSING_KERNELS_AVX
+            __m256 load8(int i) const { return _mm256_loadu_ps(p + i); }
+#elif CROSSING_KERNELS_SSE2
+            __m128 load4(int i) const { return _mm_loadu_ps(p + i); }
+#elif CROSSING_KERNELS_NEON
+            float32x4_t load4(int i) const { return vld1q_f32(p + i); }
+#endif
+        };
+
+        struct ConstThresh
+        {
+            float val;
+            float at(int) const { return val; }
+#if CROSSING_KERNELS_AVX
+            __m256 load8(int) const { return _mm256_set1_ps(val); }
+#elif CROSSING_KERNELS_SSE2
+            __m128 load4(int) const { return _mm_set1_ps(val); }
+#elif CROSSING_KERNELS_NEON
+            float32x4_t load4(int) const { return vdupq_n_f32(val); }
+#endif
+        };
+
+        // Computes the above-mask bits for the 64 samples starting at input[0].
+        template <typename Thresh>
+        inline uint64_t aboveWord64(const float* input, const Thresh& thresh, int offset)
+        {
+            uint64_t word = 0;
+#if CROSSING_KERNELS_AVX
+            for (int k = 0; k < 64; k += 8)
+            {
+                __m256 cmp = _mm256_cmp_ps(_mm256_loadu_ps(input + k), thresh.load8(offset + k), _CMP_GT_OQ);
+                word |= static_cast<uint64_t>(_mm256_movemask_ps(cmp)) << k;
+            }
+#elif CROSSING_KERNELS_SSE2
+            for (int k = 0; k < 64; k += 4)
+            {
+                __m128 cmp = _mm_cmpgt_ps(_mm_loadu_ps(input + k), thresh.load4(offset + k));
+                word |= static_cast<uint64_t>(_mm_movemask_ps(cmp)) << k;
+            }
+#elif CROSSING_KERNELS_NEON
+            static const uint32_t lanesArr[4] = { 1, 2, 4, 8 };
+            const uint32x4_t lanes = vld1q_u32(lanesArr);
+            for (int k = 0; k < 64; k += 4)
+            {
+                uint32x4_t cmp = vcgtq_f32(vld1q_f32(input + k), thresh.load4(offset + k));
+                word |= static_cast<uint64_t>(vaddvq_u32(vandq_u32(cmp, lanes))) << k;
+            }
+#else
+            for (int k = 0; k < 64; ++k)
+            {
+                word |= static_cast<uint64_t>(input[k] > thresh.at(offset + k)) << k;
+            }
+#endif
+            return word;
+        }
+
+        // Computes the above-mask words for the 64 samples starting at input[0] against each of
+        // numThresh constant thresholds, loading the input only once.
+        inline void aboveWords64Multi(const float* input, const float* thresh, int numThresh,
+            uint64_t* words, int wordStride)
+        {
+#if CROSSING_KERNELS_AVX
+            __m256 in[8];
+            for (int k = 0; k < 8; ++k)
+            {
+                in[k] = _mm256_loadu_ps(input + 8 * k);
+            }
+
+            for (int t = 0; t < numThresh; ++t)
+            {
+                const __m256 th = _mm256_set1_ps(thresh[t]);
+                uint64_t word = 0;
+                for (int k = 0; k < 8; ++k)
+                {
+                    word |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_cmp_ps(in[k], th, _CMP_GT_OQ))) << (8 * k);
+                }
+                words[t * wordStride] = word;
+            }
+#elif CROSSING_KERNELS_SSE2
+            __m128 in[16];
+            for (int k = 0; k < 16; ++k)
+            {
+                in[k] = _mm_loadu_ps(input + 4 * k);
+            }
+
+            for (int t = 0; t < numThresh; ++t)
+            {
+                const __m128 th = _mm_set1_ps(thresh[t]);
+                uint64_t word = 0;
+                for (int k = 0; k < 16; ++k)
+                {
+                    word |= static_cast<uint64_t>(_mm_movemask_ps(_mm_cmpgt_ps(in[k], th))) << (4 * k);
+                }
+                words[t * wordStride] = word;
+            }
+#elif CROSSING_KERNELS_NEON
+            static const uint32_t lanesArr[4] = { 1, 2, 4, 8 };
+            const uint32x4_t lanes = vld1q_u32(lanesArr);
+            float32x4_t in[16];
+            for (int k = 0; k < 16; ++k)
+            {
+                in[k] = vld1q_f32(input + 4 * k);
+            }
+
+            for (int t = 0; t < numThresh; ++t)
+            {
+                const float32x4_t th = vdupq_n_f32(thresh[t]);
+                uint64_t word = 0;
+                for (int k = 0; k < 16; ++k)
+                {
+                    word |= static_cast<uint64_t>(vaddvq_u32(vandq_u32(vcgtq_f32(in[k], th), lanes))) << (4 * k);
+                }
+                words[t * wordStride] = word;
+            }
+#else
+            for (int t = 0; t < numThresh; ++t)
+            {
+                words[t * wordStride] = aboveWord64(input, ConstThresh{ thresh[t] }, 0);
+            }
+#endif
+        }
+
+        // The same for int16 input and thresholds (AVX without AVX2 has no 256-bit integer
+        // comparisons, so the SSE2 versions are used there too).
+        struct ArrayThreshInt16
+        {
+            const int16_t* p;
+            int16_t at(int i) const { return p[i]; }
+#if CROSSING_KERNELS_AVX || CROSSING_KERNELS_SSE2
+            __m128i load8(int i) const { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)); }
+#elif CROSSING_KERNELS_NEON
+            int16x8_t load8(int i) const { return vld1q_s16(p + i); }
+#endif
+        };
+
+        struct ConstThreshInt16
+        {
+            int16_t val;
+            int16_t at(int) const { return val; }
+#if CROSSING_KERNELS_AVX || CROSSING_KERNELS_SSE2
+            __m128i load8(int) const { return _mm_set1_epi16(val); }
+#elif CROSSING_KERNELS_NEON
+            int16x8_t load8(int) const { return vdupq_n_s16(val); }
+#endif
+        };
+
+#if CROSSING_KERNELS_AVX || CROSSING_KERNELS_SSE2
+        // Bits of 16 int16 comparison results (each 0 or -1), in order.
+        inline uint64_t movemask16(__m128i cmpLo, __m128i cmpHi)
+        {
+            return static_cast<uint64_t>(_mm_movemask_epi8(_mm_packs_epi16(cmpLo, cmpHi)));
+        }
+
+        inline __m128i loadInt16x8(const int16_t* p)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+#elif CROSSING_KERNELS_NEON
+        // Bits of 8 int16 comparison results, in order.
+        inline uint64_t movemask8(uint16x8_t cmp)
+        {
+            static const uint16_t lanesArr[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+            return static_cast<uint64_t>(vaddvq_u16(vandq_u16(cmp, vld1q_u16(lanesArr))));
+        }
+#endif
+
+        template <typename Thresh>
+        inline uint64_t aboveWord64(const int16_t* input, const Thresh& thresh, int offset)
+        {
+            uint64_t word = 0;
+#if CROSSING_KERNELS_AVX || CROSSING_KERNELS_SSE2
+            for (int k = 0; k < 64; k += 16)
+            {
+                __m128i cmpLo = _mm_cmpgt_epi16(loadInt16x8(input + k), thresh.load8(offset + k));
+                __m128i cmpHi = _mm_cmpgt_epi16(loadInt16x8(input + k + 8), thresh.load8(offset + k + 8));
+                word |= movemask16(cmpLo, cmpHi) << k;
+            }
+#elif CROSSING_KERNELS_NEON
+            for (int k = 0; k < 64; k += 8)
+            {
+                word |= movemask8(vcgtq_s16(vld1q_s16(input + k), thresh.load8(offset + k))) << k;
+            }
+#else
+            for (int k = 0; k < 64; ++k)
+            {
+                word |= static_cast<uint64_t>(input[k] > thresh.at(offset + k)) << k;
+            }
+#endif
+            return word;
+        }
+
+        inline void aboveWords64Multi(const int16_t* input, const int16_t* thresh, int numThresh,
+            uint64_t* words, int wordStride)
+        {
+#if CROSSING_KERNELS_AVX || CROSSING_KERNELS_SSE2
+            __m128i in[8];
+            for (int k = 0; k < 8; ++k)
+            {
+                in[k] = loadInt16x8(input + 8 * k);
+            }
+
+            for (int t = 0; t < numThresh; ++t)
+            {
+                const __m128i th = _mm_set1_epi16(thresh[t]);
+                uint64_t word = 0;
+                for (int k = 0; k < 8; k += 2)
+                {
+                    word |= movemask16(_mm_cmpgt_epi16(in[k], th), _mm_cmpgt_epi16(in[k + 1], th)) << (8 * k);
+                }
+                words[t * wordStride] = word;
+            }
+#elif CROSSING_KERNELS_NEON
+            int16x8_t in[8];
+            for (int k = 0; k < 8; ++k)
+            {
+                in[k] = vld1q_s16(input + 8 * k);
+            }
+
+            for (int t = 0; t < numThresh; ++t)
+            {
+                const int16x8_t th = vdupq_n_s16(thresh[t]);
+                uint64_t word = 0;
+                for (int k = 0; k < 8; ++k)
+                {
+                    word |= movemask8(vcgtq_s16(in[k], th)) << (8 * k);
+                }
+                words[t * wordStride] = word;
+            }
+#else
+            for (int t = 0; t < numThresh; ++t)
+            {
+                words[t * wordStride] = aboveWord64(input, ConstThreshInt16{ thresh[t] }, 0);
+            }
+#endif
+        }
+
+        template <typename Sample, typename Thresh>
+        inline void computeAboveMask(const Sample* input, const Thresh& thresh, int n, uint64_t* mask)
+        {
+            int nFullWords = n / 64;
+            for (int w = 0; w < nFullWords; ++w)
+            {
+                mask[w] = aboveWord64(input + w * 64, thresh, w * 64);
+            }
+
+            // remainder (unused high bits are left clear)
+            int start = nFullWords * 64;
+            if (start < n)
+            {
+                uint64_t word = 0;
+                for (int i = start; i < n; ++i)
+                {
+                    word |= static_cast<uint64_t>(input[i] > thresh.at(i)) << (i - start);
+                }
+                mask[nFullWords] = word;
+            }
+        }
+    }
+
+    /** Fills mask (numMaskWords(n) words) with bit i set iff input[i] > thresh[i]. */
+    inline void computeAboveMask(const float* input, const float* thresh, int n, uint64_t* mask)
+    {
+        detail::computeAboveMask(input, detail::ArrayThresh{ thresh }, n, mask);
+    }
+
+    /** Fills mask (numMaskWords(n) words) with bit i set iff input[i] > thresh. */
+    inline void computeAboveMask(const float* input, float thresh, int n, uint64_t* mask)
+    {
+        detail::computeAboveMask(input, detail::ConstThresh{ thresh }, n, mask);
+    }
+
+    /** Fills mask (numMaskWords(n) words) with bit i set iff input[i] > thresh[i]. */
+    inline void computeAboveMask(const int16_t* input, const int16_t* thresh, int n, uint64_t* mask)
+    {
+        detail::computeAboveMask(input, detail::ArrayThreshInt16{ thresh }, n, mask);
+    }
+
+    /** Fills mask (numMaskWords(n) words) with bit i set iff input[i] > thresh. */
+    inline void computeAboveMask(const int16_t* input, int16_t thresh, int n, uint64_t* mask)
+    {
+        detail::computeAboveMask(input, detail::ConstThreshInt16{ thresh }, n, mask);
+    }
+
+    namespace detail
+    {
+        template <typename Sample>
+        inline void computeAboveMasks(const Sample* input, const Sample* thresh, int numThresh, int n,
+            uint64_t* masks, int wordStride)
+        {
+            int nFullWords = n / 64;
+            for (int w = 0; w < nFullWords; ++w)
+            {
+                aboveWords64Multi(input + w * 64, thresh, numThresh, masks + w, wordStride);
+            }
+
+            int start = nFullWords * 64;
+            if (start < n)
+            {
+                for (int t = 0; t < numThresh; ++t)
+                {
+                    uint64_t word = 0;
+                    for (int i = start; i < n; ++i)
+                    {
+                        word |= static_cast<uint64_t>(input[i] > thresh[t]) << (i - start);
+                    }
+                    masks[t * wordStride + nFullWords] = word;
+                }
+            }
+        }
+    }
+
+    /** Computes the above-mask of the same input against each of numThresh constant thresholds in
+     *  one pass over the input. The mask for thresh[t] (numMaskWords(n) words) is written starting at
+     *  masks + t * wordStride.
+     */
+    inline void computeAboveMasks(const float* input, const float* thresh, int numThresh, int n,
+        uint64_t* masks, int wordStride)
+    {
+        detail::computeAboveMasks(input, thresh, numThresh, n, masks, wordStride);
+    }
+
+    /** The same for int16 input and thresholds. */
+    inline void computeAboveMasks(const int16_t* input, const int16_t* thresh, int numThresh, int n,
+        uint64_t* masks, int wordStride)
+    {
+        detail::computeAboveMasks(input, thresh, numThresh, n, masks, wordStride);
+    }
+
+    /** Number of set bits of a mask from bit 'from' up to but not including bit 'to'. */
+    inline int countSetBits(const uint64_t* mask, int from, int to)
+    {
+        if (to <= from)
+        {
+            return 0;
+        }
+
+        int firstWord = from / 64;
+        int lastWord = (to - 1) / 64;
+        uint64_t firstMask = ~uint64_t(0) << (from % 64);
+        uint64_t lastMask = ~uint64_t(0) >> (63 - (to - 1) % 64);
+
+        if (firstWord == lastWord)
+        {
+            return popCount(mask[firstWord] & firstMask & lastMask);
+        }
+
+        int count = popCount(mask[firstWord] & firstMask);
+        for (int w = firstWord + 1; w < lastWord; ++w)
+        {
+            count += popCount(mask[w]);
+        }
+        return count + popCount(mask[lastWord] & lastMask);
+    }
+
+    /** Converts an above-mask into a crossing mask in place: bit i is set iff sample i-1 and
+     *  sample i are on different sides of the threshold and the direction is enabled.
+     *  @param prevAbove    whether the sample before the block (index -1) was above threshold
+     *  @param rising       whether to keep below -> above crossings
+     *  @param falling      whether to keep above -> below crossings
+     *  @return whether the last sample of the block is above threshold
+     */
+    inline bool aboveToCrossings(uint64_t* mask, int n, bool prevAbove, bool rising, bool falling)
+    {
+        const uint64_t risingMask = rising ? ~uint64_t(0) : 0;
+        const uint64_t fallingMask = falling ? ~uint64_t(0) : 0;
+        uint64_t carry = prevAbove ? 1 : 0;
+
+        int nWords = numMaskWords(n);
+        for (int w = 0; w < nWords; ++w)
+        {
+            uint64_t above = mask[w];
+            uint64_t prev = (above << 1) | carry;
+            uint64_t change = above ^ prev;
+            int nValid = w < nWords - 1 ? 64 : n - w * 64;
+            uint64_t validMask = nValid == 64 ? ~uint64_t(0) : (uint64_t(1) << nValid) - 1;
+
+            carry = (above >> (nValid - 1)) & 1;
+            mask[w] = change & ((above & risingMask) | (~above & fallingMask)) & validMask;
+        }
+        return carry != 0;
+    }
+
+    /** Returns the index of the first set bit at or after 'from' in a mask of n bits, or -1 if none. */
+    inline int findNextSet(const uint64_t* mask, int n, int from)
+    {
+        if (from < 0)
+        {
+            from = 0;
+        }
+
+        int nWords = numMaskWords(n);
+        int w = from / 64;
+        if (w >= nWords)
+        {
+            return -1;
+        }
+
+        uint64_t word = mask[w] & (~uint64_t(0) << (from % 64));
+        while (word == 0)
+        {
+            if (++w >= nWords)
+            {
+                return -1;
+            }
+            word = mask[w];
+        }
+
+        int ind = w * 64 + countTrailingZeros(word);
+        return ind < n ? ind : -1;
+    }
+
+    /** Sub-sample crossing position between two samples, by linear interpolation of the
+     *  distance to threshold.
+     *  @param d0   input - threshold at the sample before the crossing
+     *  @param d1   input - threshold at the sample after the crossing
+     *  @return     crossing position in [0, 1] relative to the sample before the crossing
+     */
+    inline double interpolateCrossingLinear(double d0, double d1)
+    {
+        if (d0 == d1)
+        {
+            return 1.0;
+        }
+
+        double frac = d0 / (d0 - d1);
+        return frac < 0.0 ? 0.0 : (frac > 1.0 ? 1.0 : frac);
+    }
+
+    /** Sub-sample crossing position between the samples with distances d0 and d1, using the
+     *  cubic through four consecutive distances to threshold (dm2, dm1, d0, d1) that end at the
+     *  sample after the crossing, so that it can be computed as soon as the crossing is found.
+     *  Falls back to linear interpolation if the cubic doesn't have a well-behaved root in [0, 1].
+     *  @return     crossing position in [0, 1] relative to the sample with distance d0
+     */
+    inline double interpolateCrossingCubic(double dm2, double dm1, double d0, double d1)
+    {
+        const double linear = interpolateCrossingLinear(d0, d1);
+
+        // Lagrange polynomial through (-2, dm2), (-1, dm1), (0, d0), (1, d1)
+        const double c2 = (d1 + dm1) / 2 - d0;
+        const double c3 = (d1 - dm2) / 6 + (dm1 - d0) / 2;
+        const double c1 = (d1 - dm1) / 2 - c3;
+
+        // a few Newton steps from the linear estimate
+        double t = linear;
+        for (int iter = 0; iter < 4; ++iter)
+        {
+            double p = d0 + t * (c1 + t * (c2 + t * c3));
+            double dp = c1 + t * (2 * c2 + t * 3 * c3);
+            if (dp == 0.0)
+            {
+                return linear;
+            }
+            t -= p / dp;
+        }
+
+        return (t >= 0.0 && t <= 1.0) ? t : linear;
+    }
+}
+
+#endif // CROSSING_KERNELS_H_INCLUDED
@@ -0,0 +1,301 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "CrossingSweep.h"
+#include "CrossingKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+    int longestHistory(const std::vector<CrossingSweepLane>& lanes)
+    {
+        // as CrossingEngine::getHistoryLength
+        int length = 3;
+        for (const CrossingSweepLane& lane : lanes)
+        {
+            length = std::max(length, lane.pastSpan + lane.futureSpan + 3);
+        }
+        return length;
+    }
+
+    float toSampleThreshold(float threshold, float)
+    {
+        return threshold;
+    }
+
+    // integer input is above threshold iff it's above floor(threshold)
+    int16_t toSampleThreshold(float threshold, int16_t)
+    {
+        const float floored = std::floor(threshold);
+        return static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, floored)));
+    }
+}
+
+template <typename Sample>
+bool BasicCrossingSweep<Sample>::supports(const CrossingEngine::Settings& s)
+{
+    const bool earlyFire = s.earlyFire && s.futureSpan > 0 && (s.posOn || s.negOn);
+    return !s.useJumpLimit && !earlyFire;
+}
+
+template <typename Sample>
+BasicCrossingSweep<Sample>::BasicCrossingSweep(const CrossingEngine::Settings& sharedSettings,
+    const std::vector<Lane>& l)
+    : settings      (sharedSettings)
+    , lanes         (l)
+    , historyLength (longestHistory(l))
+    , inputStaging  (historyLength)
+    , numProcessed  (0)
+    , maskStride    (0)
+{
+    assert(supports(settings));
+
+    const bool startupCheckFails = static_cast<int>(settings.jumpLimitSleep) <= settings.jumpLimitSleep;
+    for (const Lane& lane : lanes)
+    {
+        thresholds.push_back(toSampleThreshold(lane.threshold, Sample()));
+
+        pastSamplesNeeded.push_back(CrossingEngine::getSamplesNeeded(lane.pastSpan, lane.pastStrict));
+        futureSamplesNeeded.push_back(CrossingEngine::getSamplesNeeded(lane.futureSpan, lane.futureStrict));
+
+        // as after CrossingEngine::setNumChannels
+        sampToReenable.push_back(lane.pastSpan + lane.futureSpan + 1);
+        startupCheckPending.push_back(startupCheckFails);
+    }
+}
+
+template <typename Sample>
+int BasicCrossingSweep<Sample>::getNumLanes() const
+{
+    return static_cast<int>(lanes.size());
+}
+
+template <typename Sample>
+void BasicCrossingSweep<Sample>::setSettings(const CrossingEngine::Settings& sharedSettings)
+{
+    assert(supports(sharedSettings));
+    settings = sharedSettings;
+}
+
+template <typename Sample>
+void BasicCrossingSweep<Sample>::reserve(int maxBlockLength)
+{
+    inputStaging.reserve(maxBlockLength);
+
+    const int numWords = CrossingKernels::numMaskWords(historyLength + maxBlockLength);
+    if (numWords > maskStride)
+    {
+        maskStride = numWords;
+        aboveMasks.resize(static_cast<size_t>(maskStride) * getNumLanes());
+        crossingMask.resize(maskStride);
+    }
+}
+
+template <typename Sample>
+void BasicCrossingSweep<Sample>::processBlock(const Sample* input, int numSamples, int64_t startTs,
+    CrossingEngine::EventSink& sink)
+{
+    if (numSamples <= 0)
+    {
+        return;
+    }
+
+    reserve(numSamples);
+    const Sample* rp = inputStaging.stage(input, numSamples);
+
+    // one pass over the history and block for all thresholds
+    const int numBits = historyLength + numSamples;
+    CrossingKernels::computeAboveMasks(rp - historyLength, thresholds.data(), getNumLanes(), numBits,
+        aboveMasks.data(), maskStride);
+
+    // the engine's histories start out as zeros for both input and threshold, which is never "above"
+    if (numProcessed < historyLength)
+    {
+        const int numUnset = static_cast<int>(historyLength - numProcessed);
+        for (int lane = 0; lane < getNumLanes(); ++lane)
+        {
+            uint64_t* mask = aboveMasks.data() + static_cast<size_t>(lane) * maskStride;
+            for (int j = 0; j < numUnset; ++j)
+            {
+                mask[j / 64] &= ~(uint64_t(1) << (j % 64));
+            }
+        }
+    }
+
+    for (int lane = 0; lane < getNumLanes(); ++lane)
+    {
+        processLane(lane, rp, numSamples, startTs, sink);
+    }
+
+    inputStaging.commit();
+    numProcessed += numSamples;
+}
+
+template <typename Sample>
+void BasicCrossingSweep<Sample>::processLane(int lane, const Sample* rp, int nSamples, int64_t startTs,
+    CrossingEngine::EventSink& sink)
+{
+    const uint64_t* above = aboveMasks.data() + static_cast<size_t>(lane) * maskStride;
+    const int numBits = historyLength + nSamples;
+    const int h = historyLength; // mask bit of block index 0
+
+    const Lane& laneSettings = lanes[lane];
+    const int pastSpan = laneSettings.pastSpan;
+    const int futureSpan = laneSettings.futureSpan;
+    const int pastNeeded = pastSamplesNeeded[lane];
+    const int futureNeeded = futureSamplesNeeded[lane];
+    const float threshold = laneSettings.threshold;
+
+    int& currSampToReenable = sampToReenable[lane];
+
+    // crossings that can be decided in this block (the engine checks indCross = i - futureSpan at
+    // sample i, so this includes up to futureSpan crossings from the end of the previous block)
+    const int lastCross = nSamples - futureSpan; // exclusive
+    int firstChecked = std::max(currSampToReenable, -futureSpan);
+    if (settings.useBufferEndMask)
+    {
+        firstChecked = std::max(firstChecked, nSamples - settings.bufferEndMaskSamp);
+    }
+
+    // the engine's first direction check after starting fails (rising if enabled, else falling)
+    int burnedIndex = INT32_MIN;
+    if (startupCheckPending[lane] && (laneSettings.posOn || laneSettings.negOn) && firstChecked < lastCross)
+    {
+        burnedIndex = firstChecked;
+        startupCheckPending[lane] = false;
+    }
+
+    std::copy(above, above + CrossingKernels::numMaskWords(numBits), crossingMask.begin());
+    CrossingKernels::aboveToCrossings(crossingMask.data(), numBits, false,
+        laneSettings.posOn, laneSettings.negOn);
+
+#if CROSSING_DETECTOR_STATS
+    // Every crossing that can be decided in this block is a candidate. Those before firstChecked
+    // were in the timeout (which the engine checks first) or masked.
+    const int uncheckedEnd = std::min(firstChecked, lastCross);
+    const int numUnchecked = CrossingKernels::countSetBits(crossingMask.data(), h - futureSpan, h + uncheckedEnd);
+    const int numTimedOut = CrossingKernels::countSetBits(crossingMask.data(), h - futureSpan,
+        h + std::min(currSampToReenable, uncheckedEnd));
+    counters.candidates += CrossingKernels::countSetBits(crossingMask.data(), h - futureSpan, h + lastCross);
+    counters.timeout += numTimedOut;
+    counters.bufferEndMask += numUnchecked - numTimedOut;
+#endif
+
+    for (int j = CrossingKernels::findNextSet(crossingMask.data(), numBits, firstChecked + h);
+        j >= 0 && j - h < lastCross;
+        j = CrossingKernels::findNextSet(crossingMask.data(), numBits, std::max(j + 1, currSampToReenable + h)))
+    {
+        const int indCross = j - h;
+        const bool rising = ((above[j / 64] >> (j % 64)) & 1) != 0;
+
+        if (indCross == burnedIndex && (rising || !laneSettings.posOn))
+        {
+#if CROSSING_DETECTOR_STATS
+            ++counters.jumpLimit;
+#endif
+            continue;
+        }
+
+        // past samples indCross - 1 - pastSpan to indCross - 2, future samples indCross + 1 to indCross + futureSpan
+        const int pastAbove = CrossingKernels::countSetBits(above, j - 1 - pastSpan, j - 1);
+        const int futureAbove = CrossingKernels::countSetBits(above, j + 1, j + 1 + futureSpan);
+
+        const bool pastSat = (rising ? pastSpan - pastAbove : pastAbove) >= pastNeeded;
+        const bool futureSat = (rising ? futureAbove : futureSpan - futureAbove) >= futureNeeded;
+        if (!pastSat || !futureSat)
+        {
+#if CROSSING_DETECTOR_STATS
+            // (the engine counts the rejection as the jump limit's while its first check is pending)
+            ++(indCross == burnedIndex ? counters.jumpLimit : counters.voting);
+#endif
+            continue;
+        }
+
+        // same fields as CrossingEngine::reportCrossing
+        CrossingEngine::Crossing crossing;
+        crossing.channel = lane;
+        crossing.offset = indCross;
+        crossing.decisionOffset = indCross + futureSpan;
+        crossing.crossingPoint = startTs + indCross;
+        crossing.level = static_cast<float>(rp[indCross]);
+        crossing.threshold = threshold;
+        crossing.rising = rising;
+        crossing.interpolatedPoint = 0.0;
+
+        if (settings.interpolation != CrossingEngine::INTERP_NONE)
+        {
+            double fraction;
+            if (settings.interpolation == CrossingEngine::INTERP_CUBIC)
+            {
+                fraction = CrossingKernels::interpolateCrossingCubic(distanceAt(rp, threshold, indCross - 3),
+                    distanceAt(rp, threshold, indCross - 2), distanceAt(rp, threshold, indCross - 1),
+                    distanceAt(rp, threshold, indCross));
+            }
+            else
+            {
+                fraction = CrossingKernels::interpolateCrossingLinear(distanceAt(rp, threshold, indCross - 1),
+                    distanceAt(rp, threshold, indCross));
+            }
+            crossing.interpolatedPoint = crossing.crossingPoint - 1 + fraction;
+        }
+
+        sink.handleCrossing(crossing);
+        currSampToReenable = indCross + 1 + laneSettings.timeoutSamp;
+
+#if CROSSING_DETECTOR_STATS
+        // the loop skips the candidates in the new timeout
+        ++counters.reported;
+        counters.timeout += CrossingKernels::countSetBits(crossingMask.data(), j + 1,
+            h + std::min(currSampToReenable, lastCross));
+#endif
+    }
+
+    // as in CrossingEngine::detect
+    currSampToReenable = std::max(-futureSpan, currSampToReenable - nSamples);
+}
+
+template <typename Sample>
+CrossingEngine::Counters BasicCrossingSweep<Sample>::getCounters() const
+{
+    return counters;
+}
+
+template <typename Sample>
+void BasicCrossingSweep<Sample>::resetCounters()
+{
+    counters = CrossingEngine::Counters();
+}
+
+template <typename Sample>
+double BasicCrossingSweep<Sample>::distanceAt(const Sample* rp, float threshold, int index) const
+{
+    // before the first block, the engine's threshold history is 0 rather than the threshold
+    const float thresh = numProcessed + index >= 0 ? threshold : 0.0f;
+    return static_cast<double>(rp[index]) - thresh;
+}
+
+template class BasicCrossingSweep<float>;
+template class BasicCrossingSweep<int16_t>;
@@ -0,0 +1,136 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CROSSING_SWEEP_H_INCLUDED
+#define CROSSING_SWEEP_H_INCLUDED
+
+/*
+Evaluates many constant-threshold detector settings ("lanes") on one channel in a single pass.
+
+Each lane has its own directions, threshold, voting spans and strictness, and timeout; the buffer
+end mask and interpolation are shared. For each block, the input is staged once into a history
+long enough for every lane and compared against every lane's threshold in one pass
+(CrossingKernels::computeAboveMasks), then each lane's crossings are found from its above-mask,
+with the voting counts taken as popcounts of the mask around each candidate. The results are the
+same as running a separate CrossingEngine per lane on the same blocks.
+
+Used both by the offline tool's parameter sweeps and by the plugin's multiple rule mode.
+
+The sample type may be float (CrossingSweep) or int16 (CrossingSweepInt16), for raw recorded data.
+For int16, lane thresholds are given in the same (integer) units as the input; the above-masks use
+floor(threshold), which gives the same comparisons as a float threshold against integer samples,
+while interpolation uses the threshold as given.
+
+Settings that make detection depend on more than the above-mask (jump limit, early firing) are
+not supported; see supports().
+*/
+
+#include "CrossingEngine.h"
+#include "StagingBuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+// The settings that differ between lanes (thresholds in the units of the input)
+struct CrossingSweepLane
+{
+    bool posOn;
+    bool negOn;
+    float threshold;
+    int pastSpan;
+    int futureSpan;
+    float pastStrict;
+    float futureStrict;
+    int timeoutSamp;
+};
+
+template <typename Sample>
+class BasicCrossingSweep
+{
+public:
+    typedef CrossingSweepLane Lane;
+
+    /** Whether the given (shared) engine settings can be evaluated by a sweep. */
+    static bool supports(const CrossingEngine::Settings& settings);
+
+    /** Creates a sweep over the given lanes. The lane fields of sharedSettings are ignored. */
+    BasicCrossingSweep(const CrossingEngine::Settings& sharedSettings, const std::vector<Lane>& lanes);
+
+    int getNumLanes() const;
+
+    /** Changes the shared settings (buffer end mask, interpolation) between blocks. */
+    void setSettings(const CrossingEngine::Settings& sharedSettings);
+
+    /** Ensures that blocks of up to maxBlockLength samples can be processed without allocating. */
+    void reserve(int maxBlockLength);
+
+    /** Detects crossings in the next block for every lane. Crossings are passed to the sink in
+     *  order for each lane, with Crossing::channel set to the lane index.
+     */
+    void processBlock(const Sample* input, int numSamples, int64_t startTs, CrossingEngine::EventSink& sink);
+
+    /** Totals over all lanes since the sweep was created or resetCounters() was called, counted as
+     *  CrossingEngine counts them per channel (only kept if CROSSING_DETECTOR_STATS).
+     */
+    CrossingEngine::Counters getCounters() const;
+
+    void resetCounters();
+
+private:
+    void processLane(int lane, const Sample* rp, int numSamples, int64_t startTs, CrossingEngine::EventSink& sink);
+
+    // input - threshold at a (block-relative) index, as the engine's histories hold it
+    double distanceAt(const Sample* rp, float threshold, int index) const;
+
+    CrossingEngine::Settings settings;
+    std::vector<Lane> lanes;
+    std::vector<Sample> thresholds; // compared against the input
+
+    // shared input history (the longest pastSpan + futureSpan + 3 of any lane) and current block
+    int historyLength;
+    StagingBuffer<Sample> inputStaging;
+    int64_t numProcessed; // samples before the current block
+
+    /* Above-masks of the history and current block for each lane (bit j <-> block index
+     * j - historyLength), maskStride words apart, and scratch space for the crossing mask
+     */
+    std::vector<uint64_t> aboveMasks;
+    std::vector<uint64_t> crossingMask;
+    int maskStride;
+
+    // per-lane state, as CrossingEngine keeps per channel
+    std::vector<int> sampToReenable;
+    std::vector<int> pastSamplesNeeded;
+    std::vector<int> futureSamplesNeeded;
+
+    // The engine starts with its jump limit sleep counter full, so the first direction check
+    // after starting always fails (see CrossingEngine::shouldTrigger). Set until that has happened.
+    std::vector<bool> startupCheckPending;
+
+    CrossingEngine::Counters counters;
+};
+
+typedef BasicCrossingSweep<float> CrossingSweep;
+typedef BasicCrossingSweep<int16_t> CrossingSweepInt16;
+
+#endif // CROSSING_SWEEP_H_INCLUDED
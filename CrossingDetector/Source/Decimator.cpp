@@ -0,0 +1,217 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "Decimator.h"
+
+#include <algorithm>
+
+/************** MappingSink **************/
+
+Decimator::MappingSink::MappingSink(const Decimator& d, int64_t startTs, CrossingEngine::EventSink& t)
+    : decimator     (d)
+    , blockStartTs  (startTs)
+    , target        (t)
+{}
+
+void Decimator::MappingSink::handleCrossing(const CrossingEngine::Crossing& decimatedCrossing)
+{
+    CrossingEngine::Crossing crossing = decimatedCrossing;
+
+    crossing.crossingPoint = decimator.getTimestamp(decimatedCrossing.offset);
+    crossing.offset = static_cast<int>(crossing.crossingPoint - blockStartTs);
+    crossing.decisionOffset = static_cast<int>(
+        decimator.getTimestamp(decimatedCrossing.decisionOffset) - blockStartTs);
+
+    // same fraction of the way between the full-rate samples before and after the crossing
+    // (unused if interpolation is off)
+    const double fraction = decimatedCrossing.interpolatedPoint - (decimatedCrossing.crossingPoint - 1);
+    const int64_t before = decimator.getTimestamp(decimatedCrossing.offset - 1);
+    crossing.interpolatedPoint = before + fraction * (crossing.crossingPoint - before);
+
+    target.handleCrossing(crossing);
+}
+
+/************** Decimator **************/
+
+Decimator::Decimator()
+    : factor         (1)
+    , mode           (SUBSAMPLE)
+    , phase          (0)
+    , numFullRate    (0)
+    , decimatedStart (0)
+{}
+
+void Decimator::configure(int newFactor, Mode newMode)
+{
+    factor = std::max(1, newFactor);
+    mode = newMode;
+    reset();
+}
+
+int Decimator::getFactor() const
+{
+    return factor;
+}
+
+Decimator::Mode Decimator::getMode() const
+{
+    return mode;
+}
+
+double Decimator::getSamplesPerOutput() const
+{
+    return getSamplesPerOutput(factor, mode);
+}
+
+double Decimator::getSamplesPerOutput(int factor, Mode mode)
+{
+    if (mode == MIN_MAX && factor > 1)
+    {
+        return factor / 2.0;
+    }
+    return std::max(1, factor);
+}
+
+void Decimator::setHistoryLength(int historyLength)
+{
+    timestamps.setHistoryLength(historyLength);
+    reset();
+}
+
+void Decimator::resizeHistory(int historyLength)
+{
+    timestamps.resizeHistory(historyLength);
+}
+
+void Decimator::reset()
+{
+    phase = 0;
+    numFullRate = 0;
+    decimatedStart = 0;
+    timestamps.reset();
+}
+
+void Decimator::reserve(int maxBlockLength)
+{
+    if (indices.size() < static_cast<size_t>(maxBlockLength))
+    {
+        indices.resize(maxBlockLength);
+    }
+    timestamps.reserve(maxBlockLength);
+}
+
+int Decimator::selectSamples(int numSamples, int64_t startTs, const float* input)
+{
+    reserve(numSamples);
+    numFullRate = numSamples;
+
+    int numChosen = 0;
+    if (mode == SUBSAMPLE || factor == 1)
+    {
+        int i = phase;
+        for (; i < numSamples; i += factor)
+        {
+            indices[numChosen++] = i;
+        }
+        phase = i - numSamples;
+    }
+    else
+    {
+        for (int groupStart = 0; groupStart < numSamples; groupStart += factor)
+        {
+            const int groupEnd = std::min(numSamples, groupStart + factor);
+            int minInd = groupStart;
+            int maxInd = groupStart;
+            for (int i = groupStart + 1; i < groupEnd; ++i)
+            {
+                if (input[i] < input[minInd])
+                {
+                    minInd = i;
+                }
+                else if (input[i] > input[maxInd])
+                {
+                    maxInd = i;
+                }
+            }
+
+            indices[numChosen++] = std::min(minInd, maxInd);
+            if (minInd != maxInd)
+            {
+                indices[numChosen++] = std::max(minInd, maxInd);
+            }
+        }
+    }
+
+    int64_t* ts = timestamps.prepare(numChosen);
+    for (int j = 0; j < numChosen; ++j)
+    {
+        ts[j] = startTs + indices[j];
+    }
+
+    return numChosen;
+}
+
+void Decimator::gather(const float* values, float* out) const
+{
+    const int numChosen = timestamps.getBlockLength();
+    for (int j = 0; j < numChosen; ++j)
+    {
+        out[j] = values[indices[j]];
+    }
+}
+
+void Decimator::expand(const float* decimatedValues, float* out) const
+{
+    const int numChosen = timestamps.getBlockLength();
+    if (numChosen == 0)
+    {
+        return;
+    }
+
+    // (samples before the first chosen one get its value)
+    int i = 0;
+    for (int j = 0; j < numChosen; ++j)
+    {
+        const int end = j + 1 < numChosen ? indices[j + 1] : numFullRate;
+        for (; i < end; ++i)
+        {
+            out[i] = decimatedValues[j];
+        }
+    }
+}
+
+int64_t Decimator::getDecimatedStart() const
+{
+    return decimatedStart;
+}
+
+int64_t Decimator::getTimestamp(int index) const
+{
+    return timestamps.getBlock()[index];
+}
+
+void Decimator::commit()
+{
+    decimatedStart += timestamps.getBlockLength();
+    timestamps.commit();
+}
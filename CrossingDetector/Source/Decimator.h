@@ -0,0 +1,142 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DECIMATOR_H_INCLUDED
+#define DECIMATOR_H_INCLUDED
+
+/*
+Chooses a subset of each block of one channel for a CrossingEngine to evaluate, and maps the
+crossings it finds back to full-rate timestamps.
+
+Two modes are available:
+ - SUBSAMPLE: every factor-th sample, continuing across blocks.
+ - MIN_MAX:   each block is divided into groups of factor samples, and the smallest and largest
+              sample of each group are kept (in their original order), so that brief excursions
+              across the threshold are not missed. The engine sees about 2 samples per group.
+
+The engine is given the decimated samples with a block start of getDecimatedStart(), so that its
+timeouts, voting spans, etc. count decimated samples. Crossings it reports through a MappingSink
+carry the timestamps, offsets and interpolated points of the corresponding full-rate samples.
+
+Typical use for each block:
+    int m = decimator.selectSamples(n, startTs, input);
+    decimator.gather(input, decimatedInput);
+    Decimator::MappingSink mapping(decimator, startTs, sink);
+    engine.processBlock(c, decimatedInput, threshold, m, decimator.getDecimatedStart(), mapping);
+    decimator.commit();
+
+Does not depend on JUCE.
+*/
+
+#include "CrossingEngine.h"
+#include "StagingBuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+class Decimator
+{
+public:
+    enum Mode { SUBSAMPLE, MIN_MAX };
+
+    // Forwards crossings to another sink after mapping them to full rate
+    class MappingSink : public CrossingEngine::EventSink
+    {
+    public:
+        MappingSink(const Decimator& decimator, int64_t blockStartTs, CrossingEngine::EventSink& target);
+
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override;
+
+    private:
+        const Decimator& decimator;
+        const int64_t blockStartTs;
+        CrossingEngine::EventSink& target;
+    };
+
+    /** Creates a decimator that keeps every sample. */
+    Decimator();
+
+    /** Sets the decimation factor (if less than 1, 1) and mode, and resets. */
+    void configure(int factor, Mode mode);
+
+    int getFactor() const;
+    Mode getMode() const;
+
+    /** Average number of full-rate samples per decimated sample. */
+    double getSamplesPerOutput() const;
+
+    /** Same, for a decimator configured with the given factor and mode. */
+    static double getSamplesPerOutput(int factor, Mode mode);
+
+    /** Sets how far before the current block (in decimated samples) crossings can be mapped,
+     *  and resets. Should be at least the engine's pastSpan + futureSpan + 2.
+     */
+    void setHistoryLength(int historyLength);
+
+    /** Changes how far back crossings can be mapped, without resetting (crossings in recent
+     *  blocks can still be mapped, as far back as both the old and new length allow).
+     */
+    void resizeHistory(int historyLength);
+
+    /** Starts over from the next block. */
+    void reset();
+
+    /** Ensures that blocks of up to maxBlockLength samples can be processed without allocating. */
+    void reserve(int maxBlockLength);
+
+    /** Chooses the samples of the next block to evaluate and returns how many there are. */
+    int selectSamples(int numSamples, int64_t startTs, const float* input);
+
+    /** Copies the chosen samples of a full-rate block (input, threshold, etc.) to out. */
+    void gather(const float* values, float* out) const;
+
+    /** Fills the full-rate block out from decimated values, holding each one until the next.
+     *  If no samples were chosen, out is left unchanged.
+     */
+    void expand(const float* decimatedValues, float* out) const;
+
+    /** Number of decimated samples before the current block. */
+    int64_t getDecimatedStart() const;
+
+    /** Full-rate timestamp of a decimated sample of the current block (index may be negative,
+     *  down to -historyLength).
+     */
+    int64_t getTimestamp(int index) const;
+
+    /** Finishes the current block. */
+    void commit();
+
+private:
+    int factor;
+    Mode mode;
+
+    int phase; // (SUBSAMPLE) offset of the first sample to keep in the next block
+    int numFullRate; // samples in the current block
+
+    std::vector<int> indices; // chosen samples of the current block
+    StagingBuffer<int64_t> timestamps; // timestamps of the chosen samples, with history
+
+    int64_t decimatedStart;
+};
+
+#endif // DECIMATOR_H_INCLUDED
@@ -0,0 +1,97 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EVENT_RATE_LIMITER_H_INCLUDED
+#define EVENT_RATE_LIMITER_H_INCLUDED
+
+/*
+Token bucket that limits events to an average rate, refilled in sample time, with bursts of up to
+the size of the bucket.
+
+Which events get through depends on the order they are offered in, so they should come in time
+order: the bucket isn't refilled for a timestamp before the latest one. (CrossingDetector sorts
+the crossings of its channels, or of its rules, before they reach the limiter, see
+handleStagedCrossings.)
+
+Does not depend on JUCE.
+*/
+
+#include <algorithm>
+#include <cstdint>
+
+class EventRateLimiter
+{
+public:
+    EventRateLimiter() : perSample(0), burst(1), tokens(1), tokensTs(0) {}
+
+    /** Changes the average rate (in events per sample) and the size of the bucket (at least 1),
+        keeping the tokens that fit. */
+    void setLimit(double eventsPerSample, int maxBurst)
+    {
+        perSample = eventsPerSample;
+        burst = std::max(1, maxBurst);
+        tokens = std::min(tokens, static_cast<double>(burst));
+    }
+
+    /** Fills the bucket. */
+    void fill()
+    {
+        tokens = burst;
+    }
+
+    /** Fills the bucket, as of the given timestamp. */
+    void reset(int64_t timestamp)
+    {
+        fill();
+        tokensTs = timestamp;
+    }
+
+    /** Refills the bucket up to the timestamp of an event, then takes a token for it.
+        Returns false (and takes nothing) if there are none. */
+    bool take(int64_t timestamp)
+    {
+        if (timestamp > tokensTs)
+        {
+            tokens = std::min(static_cast<double>(burst), tokens + (timestamp - tokensTs) * perSample);
+            tokensTs = timestamp;
+        }
+
+        if (tokens < 1)
+        {
+            return false;
+        }
+
+        tokens -= 1;
+        return true;
+    }
+
+private:
+    double perSample;
+    int burst;
+
+    // tokens available as of tokensTs
+    double tokens;
+    int64_t tokensTs;
+};
+
+#endif // EVENT_RATE_LIMITER_H_INCLUDED
@@ -0,0 +1,163 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LatencyStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int LatencyStats::Histogram::NUM_BINS;
+
+/************** Histogram **************/
+
+LatencyStats::Histogram::Histogram()
+{
+    reset();
+}
+
+void LatencyStats::Histogram::reset()
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    max.store(0, relaxed);
+    for (std::atomic<uint64_t>& bin : bins)
+    {
+        bin.store(0, relaxed);
+    }
+}
+
+void LatencyStats::Histogram::record(uint64_t value)
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    if (value > max.load(relaxed))
+    {
+        max.store(value, relaxed);
+    }
+
+    std::atomic<uint64_t>& bin = bins[binOf(value)];
+    bin.store(bin.load(relaxed) + 1, relaxed);
+}
+
+LatencyStats::Summary LatencyStats::Histogram::getSummary() const
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+
+    // (the count is the total of the bins, so that it is consistent with them)
+    uint64_t binCounts[NUM_BINS];
+    uint64_t total = 0;
+    for (int b = 0; b < NUM_BINS; ++b)
+    {
+        binCounts[b] = bins[b].load(relaxed);
+        total += binCounts[b];
+    }
+
+    Summary summary;
+    summary.count = total;
+    summary.max = max.load(relaxed);
+    summary.p50 = 0;
+    summary.p99 = 0;
+
+    const double percentiles[] = { 50, 99 };
+    double* const estimates[] = { &summary.p50, &summary.p99 };
+    for (int p = 0; p < 2 && total > 0; ++p)
+    {
+        // 1-based rank of the target value
+        const uint64_t target = std::max(uint64_t(1),
+            static_cast<uint64_t>(std::ceil(percentiles[p] / 100 * total)));
+
+        uint64_t cumulative = 0;
+        int bin = 0;
+        for (; bin < NUM_BINS - 1; ++bin)
+        {
+            cumulative += binCounts[bin];
+            if (cumulative >= target)
+            {
+                break;
+            }
+        }
+
+        // middle of the bin (exact for the bins below 16), but no more than the maximum
+        const double lower = binLowerEdge(bin);
+        const double width = bin + 1 < NUM_BINS ? binLowerEdge(bin + 1) - lower : 1;
+        *estimates[p] = std::min(lower + (width - 1) / 2, static_cast<double>(summary.max));
+    }
+
+    return summary;
+}
+
+int LatencyStats::Histogram::binOf(uint64_t value)
+{
+    if (value < 16)
+    {
+        return static_cast<int>(value);
+    }
+
+    int exponent = 4; // position of the highest set bit
+    while ((value >> (exponent + 1)) != 0)
+    {
+        ++exponent;
+    }
+
+    if (exponent >= 40)
+    {
+        return NUM_BINS - 1;
+    }
+
+    const int mantissa = static_cast<int>((value >> (exponent - 3)) & 7);
+    return 16 + (exponent - 4) * 8 + mantissa;
+}
+
+double LatencyStats::Histogram::binLowerEdge(int bin)
+{
+    if (bin < 16)
+    {
+        return bin;
+    }
+
+    const int exponent = 4 + (bin - 16) / 8;
+    const int mantissa = (bin - 16) % 8;
+    return std::ldexp(8.0 + mantissa, exponent - 3);
+}
+
+/************** LatencyStats **************/
+
+void LatencyStats::reset()
+{
+    samples.reset();
+    ns.reset();
+}
+
+void LatencyStats::record(int64_t latencySamples, uint64_t latencyNs)
+{
+    samples.record(static_cast<uint64_t>(std::max(int64_t(0), latencySamples)));
+    ns.record(latencyNs);
+}
+
+LatencyStats::Summary LatencyStats::getSampleLatency() const
+{
+    return samples.getSummary();
+}
+
+LatencyStats::Summary LatencyStats::getTimeLatency() const
+{
+    return ns.getSummary();
+}
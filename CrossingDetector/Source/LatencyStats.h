@@ -0,0 +1,93 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LATENCY_STATS_H_INCLUDED
+#define LATENCY_STATS_H_INCLUDED
+
+/*
+Distribution of the latency of each event, written by the processing thread and read from any
+other thread. Two latencies are recorded per event:
+ - in samples, from the crossing point to the end of the buffer in which the event is added
+   (the event can't leave the plugin before the buffer does), and
+ - in nanoseconds, from the start of process() to when the event is added.
+
+Each is kept in a histogram with exact bins below 16 and 8 bins per factor of 2 above, so
+percentiles are accurate to within 1/16 (about 6%); maxima are exact. As in ProcessStats, there is
+a single writer, so values are updated with relaxed loads and stores.
+
+Does not depend on JUCE.
+*/
+
+#include <atomic>
+#include <cstdint>
+
+class LatencyStats
+{
+public:
+    struct Summary
+    {
+        uint64_t count;
+        double p50;
+        double p99;
+        uint64_t max;
+    };
+
+    class Histogram
+    {
+    public:
+        static const int NUM_BINS = 16 + (40 - 4) * 8; // values of 2^40 or more share the top bin
+
+        Histogram();
+
+        /** Clears everything (not concurrently with the writer). */
+        void reset();
+
+        void record(uint64_t value);
+
+        Summary getSummary() const;
+
+    private:
+        static int binOf(uint64_t value);
+
+        // smallest value in the bin
+        static double binLowerEdge(int bin);
+
+        std::atomic<uint64_t> max;
+        std::atomic<uint64_t> bins[NUM_BINS];
+    };
+
+    /** Clears both histograms (not concurrently with the writer). */
+    void reset();
+
+    /** Records one event. A negative sample latency counts as 0. */
+    void record(int64_t latencySamples, uint64_t latencyNs);
+
+    Summary getSampleLatency() const;
+    Summary getTimeLatency() const;
+
+private:
+    Histogram samples;
+    Histogram ns;
+};
+
+#endif // LATENCY_STATS_H_INCLUDED
@@ -0,0 +1,133 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PENDING_EVENT_QUEUE_H_INCLUDED
+#define PENDING_EVENT_QUEUE_H_INCLUDED
+
+/*
+Fixed-capacity priority queue (binary min-heap) for events scheduled in the future,
+e.g. turning-off events that fall past the end of the current buffer.
+
+Elements are ordered by their "timestamp" member, so the earliest can be peeked at and
+removed in order. Storage is only allocated by setCapacity(); push() never allocates and
+fails if the queue is full, so this can be safely used on the processing thread.
+
+Does not depend on JUCE.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+template <typename ElementType>
+class PendingEventQueue
+{
+public:
+    PendingEventQueue() : numElements(0) {}
+
+    /** Discards all elements and changes the maximum number of elements (allocates). */
+    void setCapacity(int capacity)
+    {
+        heap.assign(std::max(0, capacity), ElementType());
+        numElements = 0;
+    }
+
+    int getCapacity() const
+    {
+        return static_cast<int>(heap.size());
+    }
+
+    int size() const
+    {
+        return numElements;
+    }
+
+    bool isEmpty() const
+    {
+        return numElements == 0;
+    }
+
+    bool isFull() const
+    {
+        return numElements >= getCapacity();
+    }
+
+    /** Removes all elements (without deallocating). */
+    void clear()
+    {
+        numElements = 0;
+    }
+
+    /** Adds an element. Returns false (and does nothing) if the queue is full. */
+    bool push(const ElementType& element)
+    {
+        if (isFull())
+        {
+            return false;
+        }
+
+        heap[numElements++] = element;
+        std::push_heap(heap.begin(), heap.begin() + numElements, later);
+        return true;
+    }
+
+    /** Returns the element with the earliest timestamp. The queue must not be empty. */
+    const ElementType& top() const
+    {
+        assert(!isEmpty());
+        return heap[0];
+    }
+
+    /** Removes the element with the earliest timestamp. The queue must not be empty. */
+    void pop()
+    {
+        assert(!isEmpty());
+        std::pop_heap(heap.begin(), heap.begin() + numElements, later);
+        --numElements;
+    }
+
+    /** Removes all elements for which pred(element) is true. Linear in size(). */
+    template <typename Predicate>
+    void removeIf(Predicate pred)
+    {
+        auto newEnd = std::remove_if(heap.begin(), heap.begin() + numElements, pred);
+        int newSize = static_cast<int>(newEnd - heap.begin());
+        if (newSize != numElements)
+        {
+            numElements = newSize;
+            std::make_heap(heap.begin(), heap.begin() + numElements, later);
+        }
+    }
+
+private:
+    // heap order: "largest" element is the one with the earliest timestamp
+    static bool later(const ElementType& a, const ElementType& b)
+    {
+        return a.timestamp > b.timestamp;
+    }
+
+    std::vector<ElementType> heap;
+    int numElements;
+};
+
+#endif // PENDING_EVENT_QUEUE_H_INCLUDED
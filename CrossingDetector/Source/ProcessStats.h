@@ -0,0 +1,167 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PROCESS_STATS_H_INCLUDED
+#define PROCESS_STATS_H_INCLUDED
+
+/*
+Statistics of a detector's processing (block times and CrossingEngine::Counters), written by the
+processing thread and read from any other thread.
+
+There is a single writer, so each value is updated with a relaxed load and store rather than
+a read-modify-write; readers may see values from slightly different blocks, but never torn ones.
+
+Does not depend on JUCE.
+*/
+
+#include "CrossingEngine.h"
+
+#include <atomic>
+#include <cstdint>
+
+class ProcessStats
+{
+public:
+    // Block times are binned by powers of 2 microseconds: bin 0 is under 1 us,
+    // bin b > 0 is [2^(b-1), 2^b) us, and the last bin also holds anything longer.
+    static const int NUM_TIME_BINS = 16;
+
+    struct Snapshot
+    {
+        uint64_t blocks;
+        uint64_t samples;
+        uint64_t totalBlockNs;
+        uint64_t maxBlockNs;
+        double maxLoad; // largest fraction of a block's real-time duration spent processing it
+        uint64_t timeBins[NUM_TIME_BINS];
+        CrossingEngine::Counters detection;
+    };
+
+    ProcessStats()
+    {
+        reset();
+    }
+
+    /** Clears everything (not concurrently with the writer). */
+    void reset()
+    {
+        const std::memory_order relaxed = std::memory_order_relaxed;
+        blocks.store(0, relaxed);
+        samples.store(0, relaxed);
+        totalBlockNs.store(0, relaxed);
+        maxBlockNs.store(0, relaxed);
+        maxLoadPpm.store(0, relaxed);
+        for (std::atomic<uint64_t>& bin : timeBins)
+        {
+            bin.store(0, relaxed);
+        }
+        setDetectionCounters(CrossingEngine::Counters());
+    }
+
+    /** Records one processed block of the given length, which took blockNs to process and is
+     *  blockDurationNs long in real time.
+     */
+    void recordBlock(int numSamples, uint64_t blockNs, double blockDurationNs)
+    {
+        add(blocks, 1);
+        add(samples, static_cast<uint64_t>(numSamples));
+        add(totalBlockNs, blockNs);
+        raise(maxBlockNs, blockNs);
+
+        if (blockDurationNs > 0)
+        {
+            raise(maxLoadPpm, static_cast<uint64_t>(1e6 * blockNs / blockDurationNs));
+        }
+
+        int bin = 0;
+        for (uint64_t us = blockNs / 1000; us > 0 && bin < NUM_TIME_BINS - 1; us >>= 1)
+        {
+            ++bin;
+        }
+        add(timeBins[bin], 1);
+    }
+
+    /** Stores the engine's (cumulative) counters. */
+    void setDetectionCounters(const CrossingEngine::Counters& counters)
+    {
+        const std::memory_order relaxed = std::memory_order_relaxed;
+        candidates.store(counters.candidates, relaxed);
+        reported.store(counters.reported, relaxed);
+        timeout.store(counters.timeout, relaxed);
+        bufferEndMask.store(counters.bufferEndMask, relaxed);
+        jumpLimit.store(counters.jumpLimit, relaxed);
+        voting.store(counters.voting, relaxed);
+    }
+
+    Snapshot getSnapshot() const
+    {
+        const std::memory_order relaxed = std::memory_order_relaxed;
+        Snapshot s;
+        s.blocks = blocks.load(relaxed);
+        s.samples = samples.load(relaxed);
+        s.totalBlockNs = totalBlockNs.load(relaxed);
+        s.maxBlockNs = maxBlockNs.load(relaxed);
+        s.maxLoad = maxLoadPpm.load(relaxed) / 1e6;
+        for (int b = 0; b < NUM_TIME_BINS; ++b)
+        {
+            s.timeBins[b] = timeBins[b].load(relaxed);
+        }
+        s.detection.candidates = candidates.load(relaxed);
+        s.detection.reported = reported.load(relaxed);
+        s.detection.timeout = timeout.load(relaxed);
+        s.detection.bufferEndMask = bufferEndMask.load(relaxed);
+        s.detection.jumpLimit = jumpLimit.load(relaxed);
+        s.detection.voting = voting.load(relaxed);
+        return s;
+    }
+
+private:
+    static void add(std::atomic<uint64_t>& value, uint64_t x)
+    {
+        value.store(value.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+    }
+
+    static void raise(std::atomic<uint64_t>& value, uint64_t x)
+    {
+        if (x > value.load(std::memory_order_relaxed))
+        {
+            value.store(x, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint64_t> blocks;
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> totalBlockNs;
+    std::atomic<uint64_t> maxBlockNs;
+    std::atomic<uint64_t> maxLoadPpm;
+    std::atomic<uint64_t> timeBins[NUM_TIME_BINS];
+
+    std::atomic<uint64_t> candidates;
+    std::atomic<uint64_t> reported;
+    std::atomic<uint64_t> timeout;
+    std::atomic<uint64_t> bufferEndMask;
+    std::atomic<uint64_t> jumpLimit;
+    std::atomic<uint64_t> voting;
+};
+
+#endif // PROCESS_STATS_H_INCLUDED
@@ -0,0 +1,189 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STAGING_BUFFER_H_INCLUDED
+#define STAGING_BUFFER_H_INCLUDED
+
+/*
+Linear "history + current block" buffer for processing that looks back a fixed number of
+samples past the start of each block.
+
+The last historyLength values of previous blocks are kept directly in front of the current
+block in one contiguous allocation, so the block pointer can be indexed from -historyLength
+to blockSize - 1 with no modular arithmetic. After processing a block, commit() slides its
+tail into the history region with a single memmove.
+
+Typical use for each block:
+    const float* p = buffer.stage(input, n);  // or: float* p = buffer.prepare(n); then fill p[0..n)
+    ... read p[-historyLength] through p[n - 1] ...
+    buffer.commit();
+
+Only for trivially copyable element types. Does not depend on JUCE.
+@see CircularArray
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+template <typename ElementType>
+class StagingBuffer
+{
+    static_assert(std::is_trivially_copyable<ElementType>::value,
+        "StagingBuffer elements are copied with memcpy");
+
+public:
+    /** Creates a staging buffer with the given history length, filled with default values.
+        @param historyLength    number of past elements available before each block (if negative, 0)
+    */
+    explicit StagingBuffer(int historyLength = 0)
+        : histLength(std::max(0, historyLength))
+        , blockLength(0)
+        , storage(histLength)
+    {}
+
+    /** Returns the number of past elements available before each block. */
+    int getHistoryLength() const
+    {
+        return histLength;
+    }
+
+    /** Changes the history length and resets the history to default values. */
+    void setHistoryLength(int historyLength)
+    {
+        histLength = std::max(0, historyLength);
+        blockLength = 0;
+        if (storage.size() < static_cast<size_t>(histLength))
+        {
+            storage.resize(histLength);
+        }
+        reset();
+    }
+
+    /** Changes the history length, keeping the most recent elements of the history and current
+        block (which becomes part of the history, as after commit()). If there are fewer than
+        historyLength of them, the oldest elements are default values.
+        @return the number of elements kept
+    */
+    int resizeHistory(int historyLength)
+    {
+        const int newLength = std::max(0, historyLength);
+        if (storage.size() < static_cast<size_t>(newLength))
+        {
+            storage.resize(newLength);
+        }
+
+        const int total = histLength + blockLength;
+        const int kept = std::min(newLength, total);
+        if (kept > 0)
+        {
+            std::memmove(storage.data() + newLength - kept, storage.data() + total - kept,
+                kept * sizeof(ElementType));
+        }
+        std::fill(storage.begin(), storage.begin() + (newLength - kept), ElementType());
+
+        histLength = newLength;
+        blockLength = 0;
+        return kept;
+    }
+
+    /** Resets each element of the history to the default value (without changing its length). */
+    void reset()
+    {
+        std::fill(storage.begin(), storage.begin() + histLength, ElementType());
+    }
+
+    /** Ensures that blocks of up to maxBlockLength elements can be staged without allocating. */
+    void reserve(int maxBlockLength)
+    {
+        size_t required = static_cast<size_t>(histLength) + std::max(0, maxBlockLength);
+        if (storage.size() < required)
+        {
+            storage.resize(required);
+        }
+    }
+
+    /** Makes room for a block of the given length after the history and returns a pointer
+        to its first element, to be filled in by the caller. Previous block contents are undefined.
+    */
+    ElementType* prepare(int numElements)
+    {
+        assert(numElements >= 0);
+        reserve(numElements);
+        blockLength = numElements;
+        return getBlock();
+    }
+
+    /** Copies a block of elements to just after the history and returns a pointer to its
+        first element (i.e. to the copy of values[0]).
+    */
+    ElementType* stage(const ElementType* values, int numElements)
+    {
+        ElementType* block = prepare(numElements);
+        if (numElements > 0)
+        {
+            std::memcpy(block, values, numElements * sizeof(ElementType));
+        }
+        return block;
+    }
+
+    /** Pointer to the first element of the current block. Valid indices are
+        [-getHistoryLength(), getBlockLength()).
+    */
+    ElementType* getBlock()
+    {
+        return storage.data() + histLength;
+    }
+
+    const ElementType* getBlock() const
+    {
+        return storage.data() + histLength;
+    }
+
+    /** Returns the length of the block most recently staged or prepared. */
+    int getBlockLength() const
+    {
+        return blockLength;
+    }
+
+    /** Moves the last getHistoryLength() elements of history + current block into the
+        history, so that they precede the next block.
+    */
+    void commit()
+    {
+        if (blockLength > 0 && histLength > 0)
+        {
+            std::memmove(storage.data(), storage.data() + blockLength, histLength * sizeof(ElementType));
+        }
+        blockLength = 0;
+    }
+
+private:
+    int histLength;
+    int blockLength;
+    std::vector<ElementType> storage;
+};
+
+#endif // STAGING_BUFFER_H_INCLUDED
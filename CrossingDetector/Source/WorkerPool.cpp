@@ -0,0 +1,152 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "WorkerPool.h"
+
+/************** Worker **************/
+
+WorkerPool::Worker::Worker(WorkerPool& p, int i)
+    : Thread ("Crossing Detector worker " + String(i))
+    , pool   (p)
+    , index  (i)
+{}
+
+void WorkerPool::Worker::run()
+{
+    while (!threadShouldExit())
+    {
+        // notified by WorkerPool::run, or by stopThread
+        wait(-1);
+        if (threadShouldExit())
+        {
+            break;
+        }
+
+        pool.runTasks(index);
+    }
+}
+
+/************** WorkerPool **************/
+
+WorkerPool::WorkerPool()
+    : job (nullptr)
+{}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::start(int numWorkers, uint32 affinityMask)
+{
+    stop();
+
+    for (int i = 1; i <= numWorkers; ++i)
+    {
+        Worker* worker = workers.add(new Worker(*this, i));
+        if (affinityMask != 0)
+        {
+            worker->setAffinityMask(affinityMask); // applied when the thread starts
+        }
+        worker->startThread(9); // just below realtime
+    }
+}
+
+void WorkerPool::stop()
+{
+    for (Worker* worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->notify();
+    }
+
+    for (Worker* worker : workers)
+    {
+        worker->stopThread(1000);
+    }
+    workers.clear();
+}
+
+int WorkerPool::getNumWorkers() const
+{
+    return workers.size();
+}
+
+void WorkerPool::run(Job& newJob, int numTasks)
+{
+    if (numTasks <= 0)
+    {
+        return;
+    }
+
+    // (the job is set up before taskState makes its tasks claimable)
+    job = &newJob;
+    numUnfinished = numTasks;
+    taskState = int64(numTasks) << 32;
+
+    for (Worker* worker : workers)
+    {
+        worker->notify();
+    }
+
+    runTasks(0);
+
+    // Every task has been claimed, so only wait for the ones still running. Workers that haven't
+    // woken up yet find nothing left to claim. (A signal left over from the previous job just goes
+    // around the loop again.)
+    while (numUnfinished.get() > 0)
+    {
+        tasksDone.wait(-1);
+    }
+}
+
+void WorkerPool::runTasks(int threadIndex)
+{
+    for (int task = claimTask(); task >= 0; task = claimTask())
+    {
+        job->runTask(task, threadIndex);
+
+        if (--numUnfinished == 0)
+        {
+            tasksDone.signal();
+        }
+    }
+}
+
+int WorkerPool::claimTask()
+{
+    for (;;)
+    {
+        const int64 state = taskState.get();
+        const int next = static_cast<int>(state & 0xffffffff);
+        if (next >= static_cast<int>(state >> 32))
+        {
+            return -1;
+        }
+
+        if (taskState.compareAndSetBool(state + 1, state))
+        {
+            return next;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+/*
+Worker threads that, together with the calling thread, run the tasks of a job in parallel.
+Tasks are taken in order from a shared counter, so a thread that finishes its tasks early takes
+over ones the others haven't started yet. Between jobs, the workers sleep on their thread events.
+A job is done when its tasks are, so a worker that is slow to wake up doesn't hold it up.
+
+Used by CrossingDetector to process groups of channels in parallel within each buffer.
+*/
+
+#include <BasicJuceHeader.h>
+
+class WorkerPool
+{
+public:
+    class Job
+    {
+    public:
+        virtual ~Job() {}
+
+        // Runs one task. threadIndex is 0 on the thread that called run(), or 1 to getNumWorkers().
+        virtual void runTask(int task, int threadIndex) = 0;
+    };
+
+    WorkerPool();
+    ~WorkerPool();
+
+    /** Starts numWorkers worker threads (after stopping any running ones). If affinityMask is
+     *  nonzero, the workers only run on the cores whose bits are set.
+     */
+    void start(int numWorkers, uint32 affinityMask);
+
+    /** Stops and deletes the worker threads. */
+    void stop();
+
+    int getNumWorkers() const;
+
+    /** Runs each task of the job once, on the calling thread and the workers, and returns
+     *  when all are done. Must not be called from more than one thread.
+     */
+    void run(Job& job, int numTasks);
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        Worker(WorkerPool& pool, int index);
+        void run() override;
+
+    private:
+        WorkerPool& pool;
+        const int index;
+    };
+
+    // Runs tasks of the current job until there are none left.
+    void runTasks(int threadIndex);
+
+    // Returns the index of the next task of the current job, or -1 if all have been claimed.
+    int claimTask();
+
+    OwnedArray<Worker> workers;
+
+    // current job (written before its tasks can be claimed)
+    Job* job;
+
+    /* Number of tasks of the current job in the high 32 bits, and the next task to claim in the
+     * low 32 bits. Keeping both in one word means a worker that wakes up late, as the next job is
+     * being set up, can't claim a task until the whole job is ready.
+     */
+    Atomic<int64> taskState;
+
+    Atomic<int> numUnfinished;
+    WaitableEvent tasksDone; // signalled when numUnfinished reaches 0
+
+    JUCE_DECLARE_NON_COPYABLE(WorkerPool);
+};
+
+#endif // WORKER_POOL_H_INCLUDED
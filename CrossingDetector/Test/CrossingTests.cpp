@@ -0,0 +1,1991 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+Regression tests for the JUCE-free detection code.
+
+Synthetic signals (or a recorded signal) are fed through the CrossingEngine the plugin uses in
+blocks of 1, 3, 64 and 1024 samples and of random lengths (including empty blocks), so that
+crossings, voting spans, timeouts and early firing candidates are split across block boundaries.
+For each combination of detector settings and threshold type, the crossings found must be exactly
+those of a reference model that applies the detection rules sample by sample to the whole signal
+(as Test/simulate_cd.m used to). The same is checked for:
+  - the engine processing its channels on several threads at once,
+  - CrossingSweep and CrossingSweepInt16, each lane against the model, and the TTL events of all
+    lanes on one line (as rules sharing a line in the plugin's multiple rule mode),
+  - TTL events, with the crossings of all channels in time order and turn-offs scheduled on a
+    PendingEventQueue of the same capacity as CrossingDetector's,
+  - the rate limit, fed the crossings of all channels in time order as CrossingDetector does,
+  - the engine evaluating the samples a Decimator chooses (subsampled and min/max), against the
+    model applied to the decimated signal, with its crossings mapped back to full-rate timestamps.
+The CrossingKernels functions are checked against brute-force versions, AmplitudeAverage's
+exponential and boxcar RMS against a naive double-precision average, and AmplitudePercentile's
+estimate against a sorted copy of its window (to within its histogram's bin resolution).
+The signals are shared with the benchmark (TestSignals.h).
+
+Since every path is checked against the same model, the scalar, SIMD, specialized and threaded
+paths all produce identical event streams. CMakeLists.txt builds these tests once with the
+default SIMD kernels and once with the scalar ones; the scalar build also keeps the detection
+counters (CROSSING_DETECTOR_STATS), and checks each sweep's against those of an engine per lane.
+The time per sample of each run is printed alongside its results (the model itself isn't timed).
+The exit code is nonzero if any check fails.
+
+Usage: CrossingTests [--seconds <s>] [--file <path>]
+    --seconds length of each test signal (default 1 s at 30 kHz)
+    --file    raw little-endian float32 samples to test on instead of the synthetic signals
+              (normalized to zero mean and unit variance; each channel reads it at a different offset)
+*/
+
+#include "../Source/AmplitudeAverage.h"
+#include "../Source/AmplitudePercentile.h"
+#include "../Source/CrossingEngine.h"
+#include "../Source/CrossingKernels.h"
+#include "../Source/CrossingSweep.h"
+#include "../Source/Decimator.h"
+#include "../Source/EventRateLimiter.h"
+#include "../Source/PendingEventQueue.h"
+#include "TestSignals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    using namespace TestSignals;
+
+    // timestamp of the first sample (nonzero, so that block-relative offsets can't pass for timestamps)
+    const int64_t START_TS = 1000000;
+
+    const int NUM_CHANNELS = 4;
+
+    enum ThresholdType { THRESH_CONSTANT, THRESH_CHANNEL, THRESH_RANDOM, NUM_THRESH_TYPES };
+    const char* const thresholdNames[] = { "constant", "channel", "random" };
+
+    int numFailures = 0;
+
+    bool check(bool ok, const std::string& what)
+    {
+        if (!ok)
+        {
+            ++numFailures;
+            std::printf("FAILED: %s\n", what.c_str());
+        }
+        return ok;
+    }
+
+    double nsPerSample(Clock::duration elapsed, double numSamples)
+    {
+        return numSamples > 0 ? std::chrono::duration<double, std::nano>(elapsed).count() / numSamples : 0;
+    }
+
+    // Input and thresholds of each channel
+    struct TestData
+    {
+        int numSamples;
+        std::vector<std::vector<float>> input;
+        std::vector<float> constantThresh;
+        std::vector<std::vector<float>> channelThresh; // one per sample
+    };
+
+    TestData makeTestData(int numSamples, const std::vector<float>& recorded)
+    {
+        static const float constantThresh[NUM_CHANNELS] = { 0.25f, 0.5f, -0.3f, 0.1f };
+
+        TestData data;
+        data.numSamples = numSamples;
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+        {
+            if (recorded.empty())
+            {
+                data.input.push_back(makeSignal(static_cast<SignalType>(c % NUM_SIGNAL_TYPES), numSamples, 1 + c));
+            }
+            else
+            {
+                data.input.push_back(excerpt(recorded, numSamples, c, NUM_CHANNELS));
+            }
+
+            // a slowly varying threshold, like an adaptive one
+            data.constantThresh.push_back(constantThresh[c]);
+            std::vector<float> thresh(numSamples);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                thresh[i] = constantThresh[c] + 0.3f * static_cast<float>(std::sin(2 * PI * i / 4000.0 + c));
+            }
+            data.channelThresh.push_back(thresh);
+        }
+        return data;
+    }
+
+    /* -------- Block schedules -------- */
+
+    // How a signal is divided into blocks, with the block containing each sample
+    struct Blocks
+    {
+        std::string name;
+        std::vector<int> lengths;
+        std::vector<int64_t> startOf; // sample index
+        std::vector<int64_t> endOf;   // exclusive
+        int maxLength;
+    };
+
+    Blocks makeBlocks(const std::string& name, const std::vector<int>& lengths, int numSamples)
+    {
+        Blocks blocks;
+        blocks.name = name;
+        blocks.maxLength = 0;
+        blocks.startOf.resize(numSamples);
+        blocks.endOf.resize(numSamples);
+
+        int start = 0;
+        for (int length : lengths)
+        {
+            length = std::min(length, numSamples - start);
+            blocks.lengths.push_back(length);
+            blocks.maxLength = std::max(blocks.maxLength, length);
+            for (int i = start; i < start + length; ++i)
+            {
+                blocks.startOf[i] = start;
+                blocks.endOf[i] = start + length;
+            }
+            start += length;
+        }
+        return blocks;
+    }
+
+    std::vector<Blocks> makeSchedules(int numSamples)
+    {
+        std::vector<Blocks> schedules;
+        for (int length : { 1, 3, 64, 1024 })
+        {
+            std::vector<int> lengths((numSamples + length - 1) / length, length);
+            schedules.push_back(makeBlocks(std::to_string(length), lengths, numSamples));
+        }
+
+        // random lengths, including some empty blocks
+        std::mt19937 rng(12345);
+        std::uniform_int_distribution<int> lengthDist(0, 300);
+        std::vector<int> lengths = { 0 };
+        for (int total = 0; total < numSamples; total += lengths.back())
+        {
+            lengths.push_back(lengths.size() % 50 == 0 ? 0 : lengthDist(rng));
+        }
+        schedules.push_back(makeBlocks("random", lengths, numSamples));
+        return schedules;
+    }
+
+    /* -------- Events -------- */
+
+    // A crossing, with its decision time made absolute so that streams can be compared across block sizes
+    struct Event
+    {
+        int64_t crossingPoint;
+        int64_t decisionPoint;
+        float level;
+        float threshold;
+        bool rising;
+        double interpolatedPoint;
+    };
+
+    bool operator==(const Event& a, const Event& b)
+    {
+        return a.crossingPoint == b.crossingPoint && a.decisionPoint == b.decisionPoint &&
+            a.level == b.level && a.threshold == b.threshold && a.rising == b.rising &&
+            a.interpolatedPoint == b.interpolatedPoint;
+    }
+
+    std::string describe(const Event& e)
+    {
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "{ %s at %lld, decided at %lld, level %.9g, threshold %.9g, interpolated %.17g }",
+            e.rising ? "rising" : "falling", static_cast<long long>(e.crossingPoint),
+            static_cast<long long>(e.decisionPoint), e.level, e.threshold, e.interpolatedPoint);
+        return buf;
+    }
+
+#if CROSSING_DETECTOR_STATS
+    bool operator==(const CrossingEngine::Counters& a, const CrossingEngine::Counters& b)
+    {
+        return a.candidates == b.candidates && a.reported == b.reported && a.timeout == b.timeout &&
+            a.bufferEndMask == b.bufferEndMask && a.jumpLimit == b.jumpLimit && a.voting == b.voting;
+    }
+
+    std::string describe(const CrossingEngine::Counters& c)
+    {
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "{ %llu candidates, %llu reported, %llu timeout, %llu masked, %llu jump limit, %llu voting }",
+            static_cast<unsigned long long>(c.candidates), static_cast<unsigned long long>(c.reported),
+            static_cast<unsigned long long>(c.timeout), static_cast<unsigned long long>(c.bufferEndMask),
+            static_cast<unsigned long long>(c.jumpLimit), static_cast<unsigned long long>(c.voting));
+        return buf;
+    }
+#endif
+
+    typedef std::vector<std::vector<Event>> EventStreams; // per channel (or lane)
+
+    // Collects the crossings of each channel
+    class RecordingSink : public CrossingEngine::EventSink
+    {
+    public:
+        explicit RecordingSink(int numChannels) : streams(numChannels) {}
+
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override
+        {
+            Event e;
+            e.crossingPoint = crossing.crossingPoint;
+            e.decisionPoint = crossing.crossingPoint - crossing.offset + crossing.decisionOffset;
+            e.level = crossing.level;
+            e.threshold = crossing.threshold;
+            e.rising = crossing.rising;
+            e.interpolatedPoint = crossing.interpolatedPoint;
+            streams[crossing.channel].push_back(e);
+        }
+
+        EventStreams streams;
+    };
+
+    // Checks that the streams are identical, and reports the first difference otherwise.
+    bool compareStreams(const EventStreams& expected, const EventStreams& actual, const std::string& what)
+    {
+        if (!check(expected.size() == actual.size(), what + ": wrong number of channels"))
+        {
+            return false;
+        }
+
+        for (size_t c = 0; c < expected.size(); ++c)
+        {
+            const std::vector<Event>& exp = expected[c];
+            const std::vector<Event>& act = actual[c];
+            for (size_t k = 0; k < std::max(exp.size(), act.size()); ++k)
+            {
+                if (k >= exp.size() || k >= act.size() || !(exp[k] == act[k]))
+                {
+                    check(false, what + ", channel " + std::to_string(c) + ", event " + std::to_string(k) +
+                        " of " + std::to_string(exp.size()) + ": expected " +
+                        (k < exp.size() ? describe(exp[k]) : "none") + ", got " +
+                        (k < act.size() ? describe(act[k]) : "none"));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t countEvents(const EventStreams& streams)
+    {
+        size_t total = 0;
+        for (const std::vector<Event>& stream : streams)
+        {
+            total += stream.size();
+        }
+        return total;
+    }
+
+    /* -------- Reference model -------- */
+
+    /* The detection rules applied sample by sample to the whole signal of one channel, with
+     * each vote counted from scratch. The blocks only matter where the engine depends on them by
+     * design: the buffer end mask. If thresh is null, thresholds are drawn from rng as by processBlockRandom.
+     */
+    std::vector<Event> detectReference(const std::vector<float>& x, const float* thresh,
+        const CrossingEngine::Settings& s, const Blocks& blocks, std::mt19937* rng)
+    {
+        const int64_t n = static_cast<int64_t>(x.size());
+        const int pastSpan = s.pastSpan;
+        const int futureSpan = s.futureSpan;
+
+        // samples of each span that must be on the correct side
+        auto samplesNeeded = [](int span, float strict)
+        {
+            return span > 0 ? static_cast<int>(std::ceil(span * strict)) : 0;
+        };
+        const int pastNeeded = samplesNeeded(pastSpan, s.pastStrict);
+        const int futureNeeded = samplesNeeded(futureSpan, s.futureStrict);
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto drawThresh = [&]()
+        {
+            return s.randomThreshRange[0] + (s.randomThreshRange[1] - s.randomThreshRange[0]) * unit(*rng);
+        };
+
+        // threshold of each sample as the detector saw it
+        std::vector<float> t(n);
+        float randomThresh = 0;
+        if (thresh != nullptr)
+        {
+            std::copy(thresh, thresh + n, t.begin());
+        }
+        else
+        {
+            randomThresh = drawThresh();
+        }
+
+        // before the signal, the input and threshold are both 0
+        auto input = [&](int64_t k) { return k >= 0 ? x[k] : 0.0f; };
+        auto above = [&](int64_t k) { return k >= 0 && x[k] > t[k]; };
+        auto distance = [&](int64_t k) { return k >= 0 ? static_cast<double>(x[k]) - t[k] : 0.0; };
+        auto countAbove = [&](int64_t from, int64_t to)
+        {
+            int count = 0;
+            for (int64_t k = from; k <= to; ++k)
+            {
+                count += int(above(k));
+            }
+            return count;
+        };
+
+        // no crossings until the votes only cover samples of the signal
+        int64_t reenable = pastSpan + futureSpan + 1;
+
+        // The jump limit sleep is counted in checks of a direction (not samples), and starts out
+        // unelapsed, so the first check always fails.
+        int jumpLimitElapsed = static_cast<int>(s.jumpLimitSleep);
+
+        // whether to trigger on the crossing just before sample k
+        auto shouldTrigger = [&](bool rising, int64_t k)
+        {
+            if (s.useJumpLimit && std::abs(input(k) - input(k - 1)) >= s.jumpLimit)
+            {
+                jumpLimitElapsed = 0;
+                return false;
+            }
+
+            if (jumpLimitElapsed <= s.jumpLimitSleep)
+            {
+                ++jumpLimitElapsed;
+                return false;
+            }
+
+            if (above(k - 1) == rising || above(k) != rising)
+            {
+                return false;
+            }
+
+            // past samples k - 1 - pastSpan to k - 2, future samples k + 1 to k + futureSpan
+            const int pastAbove = countAbove(k - 1 - pastSpan, k - 2);
+            const int futureAbove = countAbove(k + 1, k + futureSpan);
+            return (rising ? pastSpan - pastAbove : pastAbove) >= pastNeeded &&
+                (rising ? futureAbove : futureSpan - futureAbove) >= futureNeeded;
+        };
+
+        // early firing: a crossing that passes all but the future vote waits for the samples after it
+        const bool earlyFire = s.earlyFire && futureSpan > 0 && (s.posOn || s.negOn);
+        const int64_t NO_CROSSING = -1;
+        bool candidateActive = false;
+        bool candidateRising = false;
+        int64_t candidate = 0;
+        int futureSeen = 0, futureSatisfied = 0;
+
+        // advances the candidate by sample i, and returns the crossing to fire now if any
+        auto updateCandidate = [&](int64_t i)
+        {
+            const bool a = above(i);
+            if (candidateActive)
+            {
+                ++futureSeen;
+                futureSatisfied += int(a == candidateRising);
+                if (futureSatisfied >= futureNeeded)
+                {
+                    candidateActive = false;
+                    return candidate;
+                }
+
+                if (futureSeen - futureSatisfied <= futureSpan - futureNeeded)
+                {
+                    return NO_CROSSING;
+                }
+                candidateActive = false;
+            }
+
+            if (a == above(i - 1) || !(a ? s.posOn : s.negOn))
+            {
+                return NO_CROSSING;
+            }
+
+            if (jumpLimitElapsed <= s.jumpLimitSleep ||
+                (s.useJumpLimit && std::abs(input(i) - input(i - 1)) >= s.jumpLimit))
+            {
+                return NO_CROSSING;
+            }
+
+            const int pastAbove = countAbove(i - 1 - pastSpan, i - 2);
+            if ((a ? pastSpan - pastAbove : pastAbove) < pastNeeded)
+            {
+                return NO_CROSSING;
+            }
+
+            if (futureNeeded == 0)
+            {
+                return i;
+            }
+
+            candidateActive = true;
+            candidateRising = a;
+            candidate = i;
+            futureSeen = 0;
+            futureSatisfied = 0;
+            return NO_CROSSING;
+        };
+
+        std::vector<Event> events;
+
+        // reports the crossing just before sample k, confirmed at sample i
+        auto fire = [&](int64_t k, int64_t i)
+        {
+            Event e;
+            e.crossingPoint = START_TS + k;
+            e.decisionPoint = START_TS + i;
+            e.level = x[k];
+            e.threshold = t[k];
+            e.rising = e.level > e.threshold;
+            e.interpolatedPoint = 0.0;
+
+            if (s.interpolation != CrossingEngine::INTERP_NONE)
+            {
+                // the cubic ends at sample k, so it never waits for later samples
+                double fraction;
+                if (s.interpolation == CrossingEngine::INTERP_CUBIC)
+                {
+                    fraction = CrossingKernels::interpolateCrossingCubic(distance(k - 3), distance(k - 2),
+                        distance(k - 1), distance(k));
+                }
+                else
+                {
+                    fraction = CrossingKernels::interpolateCrossingLinear(distance(k - 1), distance(k));
+                }
+                e.interpolatedPoint = e.crossingPoint - 1 + fraction;
+            }
+
+            events.push_back(e);
+            reenable = k + 1 + s.timeoutSamp;
+
+            if (thresh == nullptr)
+            {
+                randomThresh = drawThresh();
+            }
+        };
+
+        for (int64_t i = 0; i < n; ++i)
+        {
+            if (thresh == nullptr)
+            {
+                t[i] = randomThresh;
+            }
+
+            // only crossings in the last bufferEndMaskSamp samples of the block they're confirmed in count
+            const int64_t firstAllowed = s.useBufferEndMask ? blocks.endOf[i] - s.bufferEndMaskSamp
+                : std::numeric_limits<int64_t>::min();
+
+            if (earlyFire)
+            {
+                const int64_t early = updateCandidate(i);
+                if (early != NO_CROSSING && early >= reenable && early >= firstAllowed)
+                {
+                    fire(early, i);
+                    continue;
+                }
+            }
+
+            // the crossing whose future span ends at i
+            const int64_t k = i - futureSpan;
+            if (!(s.posOn || s.negOn) || k < reenable || k < firstAllowed)
+            {
+                continue;
+            }
+
+            if ((s.posOn && shouldTrigger(true, k)) || (s.negOn && shouldTrigger(false, k)))
+            {
+                fire(k, i);
+            }
+        }
+
+        return events;
+    }
+
+    /* -------- Engine runs -------- */
+
+    // Processes channels [firstChan, endChan) of the test data through the engine in the given blocks.
+    void runEngine(CrossingEngine& engine, const TestData& data, ThresholdType threshType,
+        const Blocks& blocks, int firstChan, int endChan, CrossingEngine::EventSink& sink,
+        std::vector<bool>* variantsUsed = nullptr)
+    {
+        int start = 0;
+        for (int length : blocks.lengths)
+        {
+            for (int c = firstChan; c < endChan; ++c)
+            {
+                const float* in = data.input[c].data() + start;
+                switch (threshType)
+                {
+                case THRESH_CONSTANT:
+                    engine.processBlock(c, in, data.constantThresh[c], length, START_TS + start, sink);
+                    break;
+
+                case THRESH_CHANNEL:
+                    engine.processBlock(c, in, data.channelThresh[c].data() + start, length, START_TS + start, sink);
+                    break;
+
+                default:
+                    engine.processBlockRandom(c, in, length, START_TS + start, sink);
+                    break;
+                }
+
+                if (variantsUsed != nullptr)
+                {
+                    (*variantsUsed)[engine.getLastVariant(c) - CrossingEngine::VARIANT_INACTIVE] = true;
+                }
+            }
+            start += length;
+        }
+    }
+
+    // A named configuration of the detector
+    struct TestCase
+    {
+        std::string name;
+        CrossingEngine::Settings settings;
+    };
+
+    std::vector<TestCase> makeTestCases()
+    {
+        std::vector<TestCase> cases;
+        auto add = [&](const std::string& name, const CrossingEngine::Settings& settings)
+        {
+            TestCase testCase;
+            testCase.name = name;
+            testCase.settings = settings;
+            testCase.settings.randomThreshRange[0] = -0.8f;
+            testCase.settings.randomThreshRange[1] = 0.8f;
+            cases.push_back(testCase);
+        };
+
+        CrossingEngine::Settings s;
+        add("rising", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.timeoutSamp = 10;
+        add("both, timeout 10", s);
+
+        s = CrossingEngine::Settings();
+        s.posOn = false;
+        s.negOn = true;
+        s.useBufferEndMask = true;
+        s.bufferEndMaskSamp = 40;
+        add("falling, end mask 40", s);
+
+        s = CrossingEngine::Settings();
+        s.pastSpan = 3;
+        s.futureSpan = 3;
+        add("votes 3/3", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.pastSpan = 10;
+        s.pastStrict = 0.7f;
+        s.futureSpan = 4;
+        s.futureStrict = 0.5f;
+        s.timeoutSamp = 5;
+        add("both, votes 10/4 partial", s);
+
+        s = CrossingEngine::Settings();
+        s.futureSpan = 20;
+        s.futureStrict = 0.8f;
+        s.timeoutSamp = 30;
+        add("future 20, timeout 30", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.useJumpLimit = true;
+        s.jumpLimit = 1.5f;
+        s.jumpLimitSleep = 3;
+        add("both, jump limit", s);
+
+        s = CrossingEngine::Settings();
+        s.jumpLimitSleep = 5;
+        s.pastSpan = 2;
+        add("jump sleep only, past 2", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.pastSpan = 2;
+        s.futureSpan = 6;
+        s.futureStrict = 0.5f;
+        s.interpolation = CrossingEngine::INTERP_LINEAR;
+        add("linear interp, votes 2/6", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.interpolation = CrossingEngine::INTERP_CUBIC;
+        add("cubic interp", s);
+
+        s = CrossingEngine::Settings();
+        s.pastSpan = 2;
+        s.futureSpan = 6;
+        s.interpolation = CrossingEngine::INTERP_CUBIC;
+        s.useBufferEndMask = true;
+        s.bufferEndMaskSamp = 100;
+        add("cubic, votes 2/6, end mask 100", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.pastSpan = 4;
+        s.futureSpan = 8;
+        s.futureStrict = 0.75f;
+        s.earlyFire = true;
+        add("early fire, votes 4/8", s);
+
+        s = CrossingEngine::Settings();
+        s.negOn = true;
+        s.futureSpan = 12;
+        s.futureStrict = 0.6f;
+        s.earlyFire = true;
+        s.timeoutSamp = 20;
+        s.useJumpLimit = true;
+        s.jumpLimit = 1.5f;
+        s.useBufferEndMask = true;
+        s.bufferEndMaskSamp = 200;
+        add("early fire, jump limit, end mask", s);
+
+        s = CrossingEngine::Settings();
+        s.posOn = false;
+        s.negOn = true;
+        s.pastSpan = 5;
+        s.futureSpan = 5;
+        s.futureStrict = 0.0f;
+        s.earlyFire = true;
+        add("early fire, no future votes needed", s);
+
+        return cases;
+    }
+
+    // Expected streams of all channels, for one threshold type and block schedule
+    EventStreams referenceStreams(const TestData& data, const CrossingEngine::Settings& settings,
+        ThresholdType threshType, const Blocks& blocks)
+    {
+        EventStreams streams;
+        std::vector<float> constant(data.numSamples);
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+        {
+            // (with random thresholds, each channel has its own engine with c + 1 channels, which
+            // draws the first thresholds of channels 0 to c - 1 before that of channel c)
+            std::mt19937 rng(100 + c);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            for (int k = 0; k < c; ++k)
+            {
+                unit(rng);
+            }
+
+            std::fill(constant.begin(), constant.end(), data.constantThresh[c]);
+            const float* thresh = threshType == THRESH_CONSTANT ? constant.data()
+                : threshType == THRESH_CHANNEL ? data.channelThresh[c].data() : nullptr;
+            streams.push_back(detectReference(data.input[c], thresh, settings, blocks, &rng));
+        }
+        return streams;
+    }
+
+    /* -------- TTL events -------- */
+
+    // Collects the crossings of a block, like CrossingDetector::ThreadContext
+    class StagingSink : public CrossingEngine::EventSink
+    {
+    public:
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override
+        {
+            crossings.push_back(crossing);
+        }
+
+        std::vector<CrossingEngine::Crossing> crossings;
+    };
+
+    // A TTL line changing state
+    struct Transition
+    {
+        int line;
+        int64_t timestamp;
+        bool on;
+    };
+
+    bool operator<(const Transition& a, const Transition& b)
+    {
+        return a.line != b.line ? a.line < b.line
+            : a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.on < b.on;
+    }
+
+    bool operator==(const Transition& a, const Transition& b)
+    {
+        return a.line == b.line && a.timestamp == b.timestamp && a.on == b.on;
+    }
+
+    /* Turns crossings into TTL events on the line of each channel, with turn-offs scheduled as in
+     * CrossingDetector::handleCrossing (on a queue of the same capacity, releasing the ones before
+     * the current event when it is full) and added at the end of each block as in releaseTurnoffs.
+     * As in CrossingDetector, the crossings of a block must be passed in CrossingEngine::isEarlier order.
+     */
+    class TTLSink : public CrossingEngine::EventSink
+    {
+    public:
+        TTLSink(int duration, int numLines)
+            : eventDuration(duration)
+        {
+            turnoffs.setCapacity(2 * numLines + 16);
+        }
+
+        void handleCrossing(const CrossingEngine::Crossing& crossing) override
+        {
+            // crossings confirmed in a later block turn on at the start of that block
+            const int64_t bufferTs = crossing.crossingPoint - crossing.offset;
+            const int64_t onTs = bufferTs + std::max(crossing.offset, 0);
+            transitions.push_back({ crossing.channel, onTs, true });
+
+            // a pulse that is still on is extended rather than cut short
+            const int line = crossing.channel;
+            turnoffs.removeIf([=](const Turnoff& turnoff)
+            {
+                return turnoff.line == line && turnoff.timestamp >= onTs;
+            });
+
+            if (turnoffs.isFull())
+            {
+                release(onTs);
+            }
+
+            Turnoff turnoff = { onTs + eventDuration, line };
+            check(turnoffs.push(turnoff), "turn-off queue has room");
+        }
+
+        void endBlock(int64_t bufferTs, int numSamples)
+        {
+            release(bufferTs + numSamples);
+        }
+
+        std::vector<Transition> transitions;
+
+    private:
+        struct Turnoff
+        {
+            int64_t timestamp;
+            int line;
+        };
+
+        // adds the turn-offs before endTs
+        void release(int64_t endTs)
+        {
+            while (!turnoffs.isEmpty() && turnoffs.top().timestamp < endTs)
+            {
+                transitions.push_back({ turnoffs.top().line, turnoffs.top().timestamp, false });
+                turnoffs.pop();
+            }
+        }
+
+        const int eventDuration;
+        PendingEventQueue<Turnoff> turnoffs;
+    };
+
+    // crossings confirmed in a later block turn on at the start of that block
+    int64_t onTime(const Event& e, const Blocks& blocks)
+    {
+        return std::max(e.crossingPoint, START_TS + blocks.startOf[e.decisionPoint - START_TS]);
+    }
+
+    // The TTL events the expected crossings should produce (with each stream on its own line)
+    std::vector<Transition> referenceTransitions(const EventStreams& streams, const Blocks& blocks,
+        int eventDuration, int numSamples)
+    {
+        std::vector<Transition> transitions;
+        for (size_t c = 0; c < streams.size(); ++c)
+        {
+            const std::vector<Event>& events = streams[c];
+            const int line = static_cast<int>(c);
+
+            for (size_t k = 0; k < events.size(); ++k)
+            {
+                const int64_t onTs = onTime(events[k], blocks);
+                const int64_t offTs = onTs + eventDuration;
+                transitions.push_back({ line, onTs, true });
+
+                // if the next event comes before this one is over, the two pulses merge
+                const bool merged = k + 1 < events.size() && onTime(events[k + 1], blocks) <= offTs;
+                if (!merged && offTs < START_TS + numSamples)
+                {
+                    transitions.push_back({ line, offTs, false });
+                }
+            }
+        }
+        std::sort(transitions.begin(), transitions.end());
+        return transitions;
+    }
+
+    // Checks that the transitions are identical (once sorted), and reports the first difference otherwise.
+    void compareTransitions(const std::vector<Transition>& expected, std::vector<Transition> actual,
+        const std::string& what)
+    {
+        std::sort(actual.begin(), actual.end());
+        if (actual != expected)
+        {
+            size_t k = 0;
+            while (k < actual.size() && k < expected.size() && actual[k] == expected[k])
+            {
+                ++k;
+            }
+            auto describeTransition = [](const std::vector<Transition>& v, size_t k)
+            {
+                return k < v.size() ? std::string(v[k].on ? "on" : "off") + " at " +
+                    std::to_string(v[k].timestamp) + " on line " + std::to_string(v[k].line) : std::string("none");
+            };
+            check(false, what + ", transition " + std::to_string(k) + ": expected " +
+                describeTransition(expected, k) + ", got " + describeTransition(actual, k));
+        }
+    }
+
+    void testTTLEvents(const TestData& data, const TestCase& testCase, const Blocks& blocks,
+        const EventStreams& expected)
+    {
+        for (int duration : { 15, 400 })
+        {
+            CrossingEngine engine;
+            engine.setSettings(testCase.settings);
+            engine.setNumChannels(NUM_CHANNELS);
+            engine.reserve(blocks.maxLength);
+
+            StagingSink staging;
+            TTLSink sink(duration, NUM_CHANNELS);
+            int start = 0;
+            for (int length : blocks.lengths)
+            {
+                for (int c = 0; c < NUM_CHANNELS; ++c)
+                {
+                    engine.processBlock(c, data.input[c].data() + start, data.constantThresh[c], length,
+                        START_TS + start, staging);
+                }
+
+                std::sort(staging.crossings.begin(), staging.crossings.end(), CrossingEngine::isEarlier);
+                for (const CrossingEngine::Crossing& crossing : staging.crossings)
+                {
+                    sink.handleCrossing(crossing);
+                }
+                staging.crossings.clear();
+
+                sink.endBlock(START_TS + start, length);
+                start += length;
+            }
+
+            compareTransitions(referenceTransitions(expected, blocks, duration, data.numSamples),
+                sink.transitions, testCase.name + ", TTL events with duration " + std::to_string(duration) +
+                ", blocks " + blocks.name);
+        }
+    }
+
+    /* -------- Rate limit -------- */
+
+    // A crossing that got past the rate limit
+    struct Passed
+    {
+        int channel;
+        int64_t crossingPoint;
+    };
+
+    bool operator==(const Passed& a, const Passed& b)
+    {
+        return a.channel == b.channel && a.crossingPoint == b.crossingPoint;
+    }
+
+    // The crossings a token bucket lets through when all channels' events are offered in the time they turn on
+    std::vector<Passed> referenceRateLimited(const EventStreams& streams, const Blocks& blocks,
+        double perSample, int burst)
+    {
+        struct Onset
+        {
+            int64_t onTs;
+            Passed crossing;
+        };
+
+        std::vector<Onset> onsets;
+        for (size_t c = 0; c < streams.size(); ++c)
+        {
+            for (const Event& e : streams[c])
+            {
+                onsets.push_back({ onTime(e, blocks), { static_cast<int>(c), e.crossingPoint } });
+            }
+        }
+        std::sort(onsets.begin(), onsets.end(), [](const Onset& a, const Onset& b)
+        {
+            return a.onTs != b.onTs ? a.onTs < b.onTs
+                : a.crossing.channel != b.crossing.channel ? a.crossing.channel < b.crossing.channel
+                : a.crossing.crossingPoint < b.crossing.crossingPoint;
+        });
+
+        std::vector<Passed> passed;
+        double tokens = burst;
+        int64_t lastTs = START_TS;
+        for (const Onset& onset : onsets)
+        {
+            tokens = std::min(static_cast<double>(burst), tokens + (onset.onTs - lastTs) * perSample);
+            lastTs = onset.onTs;
+            if (tokens >= 1)
+            {
+                tokens -= 1;
+                passed.push_back(onset.crossing);
+            }
+        }
+        return passed;
+    }
+
+    /* Feeds the crossings of all channels through an EventRateLimiter as CrossingDetector does, sorting
+     * each block's crossings with CrossingEngine::isEarlier. The channels are processed forward and
+     * backward, since on the worker pool the order they finish in varies; either way, the same crossings
+     * must get through as in the model.
+     */
+    void testRateLimit(const TestData& data, const TestCase& testCase, const Blocks& blocks,
+        const EventStreams& expected)
+    {
+        // a fraction of the noise channel's rate, with small and large bursts
+        const double perSample = 500.0 / SAMPLE_RATE;
+        for (int burst : { 1, 20 })
+        {
+            const std::vector<Passed> expectedPassed = referenceRateLimited(expected, blocks, perSample, burst);
+
+            for (bool backward : { false, true })
+            {
+                CrossingEngine engine;
+                engine.setSettings(testCase.settings);
+                engine.setNumChannels(NUM_CHANNELS);
+                engine.reserve(blocks.maxLength);
+
+                EventRateLimiter limiter;
+                limiter.setLimit(perSample, burst);
+                limiter.reset(START_TS);
+
+                StagingSink sink;
+                std::vector<Passed> passed;
+                int start = 0;
+                for (int length : blocks.lengths)
+                {
+                    for (int k = 0; k < NUM_CHANNELS; ++k)
+                    {
+                        const int c = backward ? NUM_CHANNELS - 1 - k : k;
+                        engine.processBlock(c, data.input[c].data() + start, data.constantThresh[c], length,
+                            START_TS + start, sink);
+                    }
+
+                    std::sort(sink.crossings.begin(), sink.crossings.end(), CrossingEngine::isEarlier);
+                    for (const CrossingEngine::Crossing& crossing : sink.crossings)
+                    {
+                        if (limiter.take(START_TS + start + std::max(crossing.offset, 0)))
+                        {
+                            passed.push_back({ crossing.channel, crossing.crossingPoint });
+                        }
+                    }
+                    sink.crossings.clear();
+                    start += length;
+                }
+
+                if (passed != expectedPassed)
+                {
+                    size_t k = 0;
+                    while (k < passed.size() && k < expectedPassed.size() && passed[k] == expectedPassed[k])
+                    {
+                        ++k;
+                    }
+                    auto describePassed = [](const std::vector<Passed>& v, size_t k)
+                    {
+                        return k < v.size() ? "channel " + std::to_string(v[k].channel) + " at " +
+                            std::to_string(v[k].crossingPoint) : std::string("none");
+                    };
+                    check(false, testCase.name + ", rate limit with bursts of " + std::to_string(burst) +
+                        (backward ? ", channels backward" : "") + ", blocks " + blocks.name + ", crossing " +
+                        std::to_string(k) + ": expected " + describePassed(expectedPassed, k) + ", got " +
+                        describePassed(passed, k));
+                }
+            }
+        }
+    }
+
+    /* -------- Sweeps -------- */
+
+    CrossingSweepLane toLane(const CrossingEngine::Settings& s, float threshold)
+    {
+        CrossingSweepLane lane;
+        lane.posOn = s.posOn;
+        lane.negOn = s.negOn;
+        lane.threshold = threshold;
+        lane.pastSpan = s.pastSpan;
+        lane.futureSpan = s.futureSpan;
+        lane.pastStrict = s.pastStrict;
+        lane.futureStrict = s.futureStrict;
+        lane.timeoutSamp = s.timeoutSamp;
+        return lane;
+    }
+
+    /* Runs a sweep with every lane on the same TTL line, as rules that share a line in the plugin's
+     * multiple rule mode: each block's crossings are sorted with CrossingEngine::isEarlier before
+     * they become events, so an earlier crossing of a later lane can't supersede the turn-off of a
+     * later one. The events must be those of all lanes' expected crossings merged in time order.
+     */
+    template <typename Sample>
+    void testLanesOnOneLine(const CrossingEngine::Settings& settings, const std::vector<CrossingSweepLane>& lanes,
+        const std::vector<Sample>& input, const Blocks& blocks, const EventStreams& expected, const std::string& name)
+    {
+        const int duration = 40;
+
+        BasicCrossingSweep<Sample> sweep(settings, lanes);
+        sweep.reserve(blocks.maxLength);
+        StagingSink staging;
+        TTLSink sink(duration, 1);
+
+        int start = 0;
+        for (int length : blocks.lengths)
+        {
+            sweep.processBlock(input.data() + start, length, START_TS + start, staging);
+
+            std::sort(staging.crossings.begin(), staging.crossings.end(), CrossingEngine::isEarlier);
+            for (CrossingEngine::Crossing crossing : staging.crossings)
+            {
+                crossing.channel = 0; // (the line)
+                sink.handleCrossing(crossing);
+            }
+            staging.crossings.clear();
+
+            sink.endBlock(START_TS + start, length);
+            start += length;
+        }
+
+        EventStreams merged(1);
+        for (const std::vector<Event>& stream : expected)
+        {
+            merged[0].insert(merged[0].end(), stream.begin(), stream.end());
+        }
+        std::stable_sort(merged[0].begin(), merged[0].end(), [&](const Event& a, const Event& b)
+        {
+            return onTime(a, blocks) < onTime(b, blocks);
+        });
+
+        compareTransitions(referenceTransitions(merged, blocks, duration, start), sink.transitions,
+            name + ", lanes on one line, blocks " + blocks.name);
+    }
+
+    /* Runs a sweep over lanes that vary the test case's settings on one channel, and checks each
+     * lane against the model. input holds the samples the sweep is given, and asFloat the same
+     * values as floats, for the model. Returns the time per sample and lane of each schedule.
+     */
+    template <typename Sample>
+    std::vector<double> testSweep(const TestCase& testCase, const std::vector<Sample>& input,
+        const std::vector<float>& asFloat, float threshold, float thresholdStep,
+        const std::vector<Blocks>& schedules, const std::string& name)
+    {
+        std::vector<CrossingEngine::Settings> laneSettings(3, testCase.settings);
+        std::vector<float> laneThresholds = { threshold, threshold + 3 * thresholdStep, threshold - 2 * thresholdStep };
+
+        laneSettings[1].posOn = true;
+        laneSettings[1].negOn = true;
+
+        laneSettings[2].pastSpan += 3;
+        laneSettings[2].futureSpan += 1;
+        laneSettings[2].pastStrict = 0.6f;
+        laneSettings[2].futureStrict = 0.6f;
+        laneSettings[2].timeoutSamp += 5;
+
+        std::vector<CrossingSweepLane> lanes;
+        for (size_t l = 0; l < laneSettings.size(); ++l)
+        {
+            lanes.push_back(toLane(laneSettings[l], laneThresholds[l]));
+        }
+
+        std::vector<double> timing;
+        for (const Blocks& blocks : schedules)
+        {
+            EventStreams expected;
+            std::vector<float> thresh(asFloat.size());
+            for (size_t l = 0; l < lanes.size(); ++l)
+            {
+                std::fill(thresh.begin(), thresh.end(), laneThresholds[l]);
+                expected.push_back(detectReference(asFloat, thresh.data(), laneSettings[l], blocks, nullptr));
+            }
+
+            BasicCrossingSweep<Sample> sweep(testCase.settings, lanes);
+            sweep.reserve(blocks.maxLength);
+            RecordingSink sink(static_cast<int>(lanes.size()));
+
+            const Clock::time_point startTime = Clock::now();
+            int start = 0;
+            for (int length : blocks.lengths)
+            {
+                sweep.processBlock(input.data() + start, length, START_TS + start, sink);
+                start += length;
+            }
+            timing.push_back(nsPerSample(Clock::now() - startTime, static_cast<double>(start) * lanes.size()));
+
+            const std::string what = testCase.name + ", " + name;
+            compareStreams(expected, sink.streams, what + ", blocks " + blocks.name);
+            testLanesOnOneLine(testCase.settings, lanes, input, blocks, expected, what);
+
+#if CROSSING_DETECTOR_STATS
+            // the sweep's counters, against the totals of an engine per lane
+            CrossingEngine::Counters engineTotals;
+            for (size_t l = 0; l < lanes.size(); ++l)
+            {
+                CrossingEngine engine;
+                engine.setSettings(laneSettings[l]);
+                engine.setNumChannels(1);
+                engine.reserve(blocks.maxLength);
+                RecordingSink laneSink(1);
+                start = 0;
+                for (int length : blocks.lengths)
+                {
+                    engine.processBlock(0, asFloat.data() + start, laneThresholds[l], length, START_TS + start, laneSink);
+                    start += length;
+                }
+
+                const CrossingEngine::Counters counters = engine.getCounters();
+                engineTotals.candidates += counters.candidates;
+                engineTotals.reported += counters.reported;
+                engineTotals.timeout += counters.timeout;
+                engineTotals.bufferEndMask += counters.bufferEndMask;
+                engineTotals.jumpLimit += counters.jumpLimit;
+                engineTotals.voting += counters.voting;
+            }
+            check(sweep.getCounters() == engineTotals, what + ", blocks " + blocks.name + ": counters " +
+                describe(sweep.getCounters()) + ", engines' " + describe(engineTotals));
+#endif
+        }
+        return timing;
+    }
+
+    /* -------- Detection tests -------- */
+
+    void printTimingHeader(const std::vector<Blocks>& schedules, const char* extra)
+    {
+        std::printf("%-36s %-9s %7s", "settings", "thresh", "events");
+        for (const Blocks& blocks : schedules)
+        {
+            std::printf(" %8s", blocks.name.c_str());
+        }
+        std::printf(" %8s   (ns/sample by block size)\n", extra);
+    }
+
+    void testDetection(const TestData& data, const std::vector<Blocks>& schedules)
+    {
+        const std::vector<TestCase> cases = makeTestCases();
+        std::vector<bool> variantsUsed(CrossingEngine::NUM_DETECTOR_VARIANTS - CrossingEngine::VARIANT_INACTIVE);
+        const Blocks& threadBlocks = schedules.back();
+
+        std::printf("Engine vs. reference model\n");
+        printTimingHeader(schedules, "threads");
+
+        for (const TestCase& testCase : cases)
+        {
+            for (int t = 0; t < NUM_THRESH_TYPES; ++t)
+            {
+                const ThresholdType threshType = static_cast<ThresholdType>(t);
+                std::vector<double> timing;
+                size_t numEvents = 0;
+
+                for (const Blocks& blocks : schedules)
+                {
+                    const EventStreams expected = referenceStreams(data, testCase.settings, threshType, blocks);
+                    numEvents = countEvents(expected);
+
+                    RecordingSink sink(NUM_CHANNELS);
+                    Clock::duration elapsed(0);
+                    if (threshType == THRESH_RANDOM)
+                    {
+                        // all channels of an engine draw from one generator, so use an engine per channel
+                        for (int c = 0; c < NUM_CHANNELS; ++c)
+                        {
+                            CrossingEngine engine;
+                            engine.setSettings(testCase.settings);
+                            engine.setRandomSeed(100 + c);
+                            engine.setNumChannels(c + 1);
+                            engine.reserve(blocks.maxLength);
+
+                            const Clock::time_point startTime = Clock::now();
+                            runEngine(engine, data, threshType, blocks, c, c + 1, sink, &variantsUsed);
+                            elapsed += Clock::now() - startTime;
+                        }
+                    }
+                    else
+                    {
+                        CrossingEngine engine;
+                        engine.setSettings(testCase.settings);
+                        engine.setNumChannels(NUM_CHANNELS);
+                        engine.reserve(blocks.maxLength);
+
+                        const Clock::time_point startTime = Clock::now();
+                        runEngine(engine, data, threshType, blocks, 0, NUM_CHANNELS, sink, &variantsUsed);
+                        elapsed = Clock::now() - startTime;
+                    }
+                    timing.push_back(nsPerSample(elapsed, static_cast<double>(data.numSamples) * NUM_CHANNELS));
+
+                    const std::string what = testCase.name + ", " + thresholdNames[t] + " threshold, blocks " + blocks.name;
+                    compareStreams(expected, sink.streams, what);
+
+                    if (threshType == THRESH_CONSTANT)
+                    {
+                        testTTLEvents(data, testCase, blocks, expected);
+                        testRateLimit(data, testCase, blocks, expected);
+                    }
+                }
+
+                // the same engine, with each channel processed on its own thread
+                double threadTiming = 0;
+                if (threshType != THRESH_RANDOM)
+                {
+                    CrossingEngine engine;
+                    engine.setSettings(testCase.settings);
+                    engine.setNumChannels(NUM_CHANNELS);
+                    engine.reserve(threadBlocks.maxLength);
+
+                    std::vector<RecordingSink> sinks(NUM_CHANNELS, RecordingSink(NUM_CHANNELS));
+                    std::vector<std::thread> threads;
+                    const Clock::time_point startTime = Clock::now();
+                    for (int c = 0; c < NUM_CHANNELS; ++c)
+                    {
+                        threads.push_back(std::thread([&, c]()
+                        {
+                            runEngine(engine, data, threshType, threadBlocks, c, c + 1, sinks[c]);
+                        }));
+                    }
+                    for (std::thread& thread : threads)
+                    {
+                        thread.join();
+                    }
+                    threadTiming = nsPerSample(Clock::now() - startTime, static_cast<double>(data.numSamples) * NUM_CHANNELS);
+
+                    EventStreams merged(NUM_CHANNELS);
+                    for (int c = 0; c < NUM_CHANNELS; ++c)
+                    {
+                        merged[c] = sinks[c].streams[c];
+                    }
+                    compareStreams(referenceStreams(data, testCase.settings, threshType, threadBlocks), merged,
+                        testCase.name + ", " + thresholdNames[t] + " threshold, " + std::to_string(NUM_CHANNELS) +
+                        " threads, blocks " + threadBlocks.name);
+                }
+
+                std::printf("%-36s %-9s %7zu", testCase.name.c_str(), thresholdNames[t], numEvents);
+                for (double ns : timing)
+                {
+                    std::printf(" %8.2f", ns);
+                }
+                if (threshType != THRESH_RANDOM)
+                {
+                    std::printf(" %8.2f", threadTiming);
+                }
+                std::printf("\n");
+            }
+        }
+
+        // make sure the cases reach both the block kernel and a good share of the specialized loops
+        const int numUsed = static_cast<int>(std::count(variantsUsed.begin(), variantsUsed.end(), true));
+        std::printf("Detector variants exercised: %d\n", numUsed);
+        check(variantsUsed[CrossingEngine::VARIANT_BLOCK_KERNEL - CrossingEngine::VARIANT_INACTIVE],
+            "block kernel exercised");
+        check(numUsed >= 20, "at least 20 detector variants exercised");
+
+        std::printf("\nSweeps vs. reference model (3 lanes)\n");
+        printTimingHeader(schedules, "");
+
+        for (const TestCase& testCase : cases)
+        {
+            if (!CrossingSweep::supports(testCase.settings))
+            {
+                continue;
+            }
+
+            for (int c = 0; c < NUM_CHANNELS; ++c)
+            {
+                const std::vector<float>& input = data.input[c];
+                std::vector<double> floatTiming = testSweep(testCase, input, input, data.constantThresh[c],
+                    0.1f, schedules, "float sweep, channel " + std::to_string(c));
+
+                // integer-valued samples, as in a raw recording with a resolution of 0.01, against
+                // both integer and fractional thresholds
+                std::vector<int16_t> quantized(input.size());
+                std::vector<float> quantizedAsFloat(input.size());
+                for (size_t i = 0; i < input.size(); ++i)
+                {
+                    const float scaled = std::round(input[i] * 100.0f);
+                    quantized[i] = static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, scaled)));
+                    quantizedAsFloat[i] = quantized[i];
+                }
+                const float intThreshold = std::round(data.constantThresh[c] * 100.0f) + (c % 2 ? 0.5f : 0.0f);
+                std::vector<double> int16Timing = testSweep(testCase, quantized, quantizedAsFloat, intThreshold,
+                    10.0f, schedules, "int16 sweep, channel " + std::to_string(c));
+
+                if (c == 0)
+                {
+                    std::printf("%-36s %-9s %7s", testCase.name.c_str(), "float", "");
+                    for (double ns : floatTiming)
+                    {
+                        std::printf(" %8.2f", ns);
+                    }
+                    std::printf("\n%-36s %-9s %7s", "", "int16", "");
+                    for (double ns : int16Timing)
+                    {
+                        std::printf(" %8.2f", ns);
+                    }
+                    std::printf("\n");
+                }
+            }
+        }
+    }
+
+    /* -------- Decimation -------- */
+
+    // Full-rate indices of the samples a Decimator should choose from one channel, and how many it
+    // should choose from each block.
+    void referenceDecimation(const std::vector<float>& x, Decimator::Mode mode, int factor,
+        const Blocks& blocks, std::vector<int>& chosen, std::vector<int>& decimatedLengths)
+    {
+        chosen.clear();
+        decimatedLengths.clear();
+
+        int start = 0;
+        for (int length : blocks.lengths)
+        {
+            const size_t numBefore = chosen.size();
+            if (mode == Decimator::SUBSAMPLE)
+            {
+                // every factor-th sample of the whole signal
+                for (int i = start; i < start + length; ++i)
+                {
+                    if (i % factor == 0)
+                    {
+                        chosen.push_back(i);
+                    }
+                }
+            }
+            else
+            {
+                // groups start over at each block
+                for (int groupStart = start; groupStart < start + length; groupStart += factor)
+                {
+                    const int groupEnd = std::min(start + length, groupStart + factor);
+                    const int minInd = static_cast<int>(std::min_element(x.begin() + groupStart, x.begin() + groupEnd) - x.begin());
+                    const int maxInd = static_cast<int>(std::max_element(x.begin() + groupStart, x.begin() + groupEnd) - x.begin());
+                    chosen.push_back(std::min(minInd, maxInd));
+                    if (minInd != maxInd)
+                    {
+                        chosen.push_back(std::max(minInd, maxInd));
+                    }
+                }
+            }
+            decimatedLengths.push_back(static_cast<int>(chosen.size() - numBefore));
+            start += length;
+        }
+    }
+
+    /* The engine evaluating the samples a Decimator chooses, against the model applied to the
+     * decimated signal with its crossings mapped back to the chosen samples' timestamps.
+     */
+    void testDecimation(const TestData& data, const std::vector<Blocks>& schedules)
+    {
+        struct DecimationCase
+        {
+            Decimator::Mode mode;
+            int factor;
+            const char* name;
+        };
+        const DecimationCase decimationCases[] = {
+            { Decimator::SUBSAMPLE, 4, "subsample 4" },
+            { Decimator::MIN_MAX, 3, "min/max 3" },
+            { Decimator::MIN_MAX, 8, "min/max 8" }
+        };
+
+        std::printf("\nDecimated engine vs. reference model\n");
+        std::printf("%-36s %-9s %7s\n", "case", "decimator", "events");
+
+        for (const TestCase& testCase : makeTestCases())
+        {
+            const CrossingEngine::Settings& s = testCase.settings;
+            for (const DecimationCase& decimation : decimationCases)
+            {
+                size_t numEvents = 0;
+                for (int t = THRESH_CONSTANT; t <= THRESH_CHANNEL; ++t)
+                {
+                    for (const Blocks& blocks : schedules)
+                    {
+                        EventStreams expected(NUM_CHANNELS);
+                        RecordingSink sink(NUM_CHANNELS);
+
+                        CrossingEngine engine;
+                        engine.setSettings(s);
+                        engine.setNumChannels(NUM_CHANNELS);
+                        engine.reserve(blocks.maxLength);
+
+                        for (int c = 0; c < NUM_CHANNELS; ++c)
+                        {
+                            const std::vector<float>& x = data.input[c];
+                            const std::vector<float> constant(data.numSamples, data.constantThresh[c]);
+                            const std::vector<float>& thresh = t == THRESH_CONSTANT ? constant : data.channelThresh[c];
+
+                            std::vector<int> chosen, decimatedLengths;
+                            referenceDecimation(x, decimation.mode, decimation.factor, blocks, chosen, decimatedLengths);
+
+                            std::vector<float> xDecimated, threshDecimated;
+                            for (int i : chosen)
+                            {
+                                xDecimated.push_back(x[i]);
+                                threshDecimated.push_back(thresh[i]);
+                            }
+                            const Blocks decimatedBlocks = makeBlocks(blocks.name, decimatedLengths,
+                                static_cast<int>(chosen.size()));
+
+                            for (Event e : detectReference(xDecimated, threshDecimated.data(), s, decimatedBlocks, nullptr))
+                            {
+                                const int64_t k = e.crossingPoint - START_TS;
+                                const double fraction = e.interpolatedPoint - (e.crossingPoint - 1);
+                                e.crossingPoint = START_TS + chosen[k];
+                                e.decisionPoint = START_TS + chosen[e.decisionPoint - START_TS];
+                                if (s.interpolation != CrossingEngine::INTERP_NONE)
+                                {
+                                    // same fraction of the way from the chosen sample before
+                                    const int64_t before = START_TS + chosen[k - 1];
+                                    e.interpolatedPoint = before + fraction * (e.crossingPoint - before);
+                                }
+                                expected[c].push_back(e);
+                            }
+
+                            Decimator decimator;
+                            decimator.configure(decimation.factor, decimation.mode);
+                            decimator.setHistoryLength(s.pastSpan + s.futureSpan + 2);
+                            decimator.reserve(blocks.maxLength);
+                            std::vector<float> in(blocks.maxLength), th(blocks.maxLength);
+
+                            int start = 0;
+                            for (int length : blocks.lengths)
+                            {
+                                const int numChosen = decimator.selectSamples(length, START_TS + start, x.data() + start);
+                                decimator.gather(x.data() + start, in.data());
+                                decimator.gather(thresh.data() + start, th.data());
+
+                                // (decimated timestamps are offset like the model's, so that the fractions
+                                // recovered from the interpolated points round the same way)
+                                const int64_t decimatedStart = START_TS + decimator.getDecimatedStart();
+                                Decimator::MappingSink mapping(decimator, START_TS + start, sink);
+                                if (t == THRESH_CONSTANT)
+                                {
+                                    engine.processBlock(c, in.data(), data.constantThresh[c], numChosen,
+                                        decimatedStart, mapping);
+                                }
+                                else
+                                {
+                                    engine.processBlock(c, in.data(), th.data(), numChosen, decimatedStart, mapping);
+                                }
+                                decimator.commit();
+                                start += length;
+                            }
+                        }
+
+                        if (s.interpolation == CrossingEngine::INTERP_NONE)
+                        {
+                            // (the mapped interpolated point is meaningless without interpolation)
+                            for (std::vector<Event>& stream : sink.streams)
+                            {
+                                for (Event& e : stream)
+                                {
+                                    e.interpolatedPoint = 0.0;
+                                }
+                            }
+                        }
+
+                        compareStreams(expected, sink.streams, testCase.name + ", " + decimation.name + ", " +
+                            thresholdNames[t] + " threshold, blocks " + blocks.name);
+                        numEvents = countEvents(expected);
+                    }
+                }
+                std::printf("%-36s %-9s %7zu\n", testCase.name.c_str(), decimation.name, numEvents);
+            }
+        }
+    }
+
+    /* -------- Amplitude thresholds -------- */
+
+    // RMS amplitude over the given windows, against a naive double-precision loop over the whole signal
+    void testAmplitudeAverage(const TestData& data, const std::vector<Blocks>& schedules)
+    {
+        struct AverageCase
+        {
+            AmplitudeAverage::Window window;
+            double length;
+            const char* name;
+        };
+        const AverageCase averageCases[] = {
+            { AmplitudeAverage::WINDOW_EXPONENTIAL, 1, "exponential 1" },
+            { AmplitudeAverage::WINDOW_EXPONENTIAL, 300.5, "exponential 300.5" },
+            { AmplitudeAverage::WINDOW_EXPONENTIAL, 30000, "exponential 30000" },
+            { AmplitudeAverage::WINDOW_BOXCAR, 1, "boxcar 1" },
+            { AmplitudeAverage::WINDOW_BOXCAR, 250.3, "boxcar 250.3" },
+            { AmplitudeAverage::WINDOW_BOXCAR, 2000, "boxcar 2000" }
+        };
+        const float multiplier = 2.5f;
+
+        std::printf("\nRMS amplitude vs. naive average\n");
+
+        for (const AverageCase& averageCase : averageCases)
+        {
+            double worstError = 0;
+            for (int c = 0; c < NUM_CHANNELS; ++c)
+            {
+                const std::vector<float>& x = data.input[c];
+                std::vector<double> expected(data.numSamples);
+                if (averageCase.window == AmplitudeAverage::WINDOW_EXPONENTIAL)
+                {
+                    const double w = 1.0 / averageCase.length;
+                    double y = static_cast<double>(x[0]) * x[0];
+                    for (int i = 0; i < data.numSamples; ++i)
+                    {
+                        y = (1 - w) * y + w * (static_cast<double>(x[i]) * x[i]);
+                        expected[i] = y;
+                    }
+                }
+                else
+                {
+                    const int width = static_cast<int>(std::ceil(averageCase.length));
+                    for (int i = 0; i < data.numSamples; ++i)
+                    {
+                        const int first = std::max(0, i - width + 1);
+                        double sum = 0;
+                        for (int j = first; j <= i; ++j)
+                        {
+                            sum += static_cast<double>(x[j]) * x[j];
+                        }
+                        expected[i] = sum / (i - first + 1);
+                    }
+                }
+
+                for (const Blocks& blocks : schedules)
+                {
+                    AmplitudeAverage average;
+                    average.configure(averageCase.window, averageCase.length);
+                    average.reserve(blocks.maxLength);
+
+                    std::vector<float> rms(data.numSamples);
+                    int start = 0;
+                    for (int length : blocks.lengths)
+                    {
+                        average.process(x.data() + start, length, multiplier, rms.data() + start);
+                        start += length;
+                    }
+
+                    // (the square root is taken in single precision)
+                    int firstWrong = -1;
+                    for (int i = 0; i < data.numSamples; ++i)
+                    {
+                        const double exact = multiplier * std::sqrt(expected[i]);
+                        const double error = std::fabs(rms[i] - exact) / std::max(exact, 1e-30);
+                        worstError = std::max(worstError, error);
+                        if (error > 1e-6 && firstWrong < 0)
+                        {
+                            firstWrong = i;
+                        }
+                    }
+
+                    const std::string what = std::string(averageCase.name) + ", channel " + std::to_string(c) +
+                        ", blocks " + blocks.name;
+                    check(firstWrong < 0, what + ": RMS at sample " + std::to_string(firstWrong));
+                    const double finalMeanSquare = expected.back();
+                    check(std::fabs(average.getMeanSquare() - finalMeanSquare) <= 1e-12 * finalMeanSquare,
+                        what + ": final mean square");
+                }
+            }
+            std::printf("%-20s worst relative error %.3g\n", averageCase.name, worstError);
+        }
+    }
+
+    /* The percentile of the amplitude over a window, against the same point of a sorted copy of
+     * the window. The estimate only has to be in the same histogram bin as the exact value. Halfway
+     * through, the percentile changes (without restarting), so the tracked bin moves both ways.
+     */
+    void testAmplitudePercentile(const TestData& data, const std::vector<Blocks>& schedules)
+    {
+        struct PercentileCase
+        {
+            double percentile;
+            double laterPercentile;
+            double windowSamples;
+            const char* name;
+        };
+        const PercentileCase percentileCases[] = {
+            { 50, 90, 2000, "median, then 90th, window 2000" },
+            { 95, 5, 20000, "95th, then 5th, window 20000" },
+            { 100, 0, 100000, "max, then min, window 100000" }
+        };
+        const float multiplier = 2.0f;
+        const double binWidth = 1.0 / AmplitudePercentile::BINS_PER_OCTAVE; // in octaves
+        const double minAmplitude = std::ldexp(1.0, AmplitudePercentile::MIN_EXPONENT);
+
+        std::printf("\nAmplitude percentile vs. sorted window\n");
+
+        for (const PercentileCase& percentileCase : percentileCases)
+        {
+            double worstError = 0;
+            for (int c = 0; c < NUM_CHANNELS; ++c)
+            {
+                const std::vector<float>& x = data.input[c];
+                for (const Blocks& blocks : schedules)
+                {
+                    AmplitudePercentile percentile;
+                    percentile.configure(percentileCase.percentile, percentileCase.windowSamples);
+                    const int decimation = percentile.getDecimation();
+                    const int windowPoints = std::min(AmplitudePercentile::MAX_POINTS,
+                        static_cast<int>(std::round(percentileCase.windowSamples / decimation)));
+
+                    // the percentile in effect at each sample
+                    std::vector<double> percentileAt(data.numSamples, percentileCase.percentile);
+                    std::vector<float> out(data.numSamples);
+                    int start = 0;
+                    for (int length : blocks.lengths)
+                    {
+                        if (start >= data.numSamples / 2 && percentileAt[start] == percentileCase.percentile)
+                        {
+                            percentile.configure(percentileCase.laterPercentile, percentileCase.windowSamples);
+                            std::fill(percentileAt.begin() + start, percentileAt.end(), percentileCase.laterPercentile);
+                        }
+                        percentile.process(x.data() + start, length, multiplier, out.data() + start);
+                        start += length;
+                    }
+
+                    const std::string what = std::string(percentileCase.name) + ", channel " + std::to_string(c) +
+                        ", blocks " + blocks.name;
+
+                    // between points, the estimate holds
+                    int firstWrong = -1;
+                    for (int i = 0; i < data.numSamples && firstWrong < 0; ++i)
+                    {
+                        const int lastPoint = i - i % decimation;
+                        const bool changed = percentileAt[i] != percentileAt[lastPoint];
+                        if (!changed && out[i] != out[lastPoint])
+                        {
+                            firstWrong = i;
+                        }
+                    }
+                    check(firstWrong < 0, what + ": estimate changed between points at sample " + std::to_string(firstWrong));
+
+                    // at every 37th point (and the last), against the sorted window
+                    const int numPoints = (data.numSamples + decimation - 1) / decimation;
+                    std::vector<float> window;
+                    firstWrong = -1;
+                    for (int p = 0; p < numPoints && firstWrong < 0; ++p)
+                    {
+                        if (p % 37 != 0 && p != numPoints - 1)
+                        {
+                            continue;
+                        }
+
+                        window.clear();
+                        for (int q = std::max(0, p - windowPoints + 1); q <= p; ++q)
+                        {
+                            window.push_back(std::fabs(x[q * decimation]));
+                        }
+                        const int i = p * decimation;
+                        const int rank = static_cast<int>(std::floor(percentileAt[i] / 100 * (window.size() - 1) + 0.5));
+                        std::nth_element(window.begin(), window.begin() + rank, window.end());
+                        const double exact = window[rank];
+                        const double estimate = out[i] / multiplier;
+
+                        if (exact < minAmplitude)
+                        {
+                            if (estimate != 0)
+                            {
+                                firstWrong = i;
+                            }
+                            continue;
+                        }
+
+                        const double error = std::fabs(std::log2(estimate / exact));
+                        worstError = std::max(worstError, error);
+                        if (!(error < binWidth + 1e-6))
+                        {
+                            firstWrong = i;
+                        }
+                    }
+                    check(firstWrong < 0, what + ": estimate outside the exact value's bin at sample " +
+                        std::to_string(firstWrong));
+                }
+            }
+            std::printf("%-32s worst error %.3g bins\n", percentileCase.name, worstError / binWidth);
+        }
+    }
+
+    /* -------- Kernels and queue -------- */
+
+    // Checks that mask holds exactly the given bits (and no bits past n).
+    bool maskEquals(const std::vector<uint64_t>& mask, const std::vector<bool>& bits)
+    {
+        const int n = static_cast<int>(bits.size());
+        for (int w = 0; w < CrossingKernels::numMaskWords(n); ++w)
+        {
+            uint64_t word = 0;
+            for (int b = 0; b < 64 && w * 64 + b < n; ++b)
+            {
+                word |= static_cast<uint64_t>(bits[w * 64 + b]) << b;
+            }
+            if (mask[w] != word)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void testKernels()
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_int_distribution<int> intDist(-40, 40);
+
+        const int numThresh = 5;
+        for (int n : { 0, 1, 5, 31, 63, 64, 65, 127, 128, 200, 1000 })
+        {
+            for (int misalign : { 0, 1, 3 })
+            {
+                const std::string what = "kernels, n = " + std::to_string(n) + ", offset " + std::to_string(misalign);
+
+                // some samples exactly at threshold, where "above" must be false
+                std::vector<float> inputStorage(n + misalign), threshStorage(n + misalign);
+                std::vector<int16_t> intInputStorage(n + misalign), intThreshStorage(n + misalign);
+                for (int i = 0; i < n + misalign; ++i)
+                {
+                    threshStorage[i] = unit(rng) * 0.5f;
+                    inputStorage[i] = i % 7 == 0 ? threshStorage[i] : unit(rng);
+                    intThreshStorage[i] = static_cast<int16_t>(intDist(rng));
+                    intInputStorage[i] = i % 7 == 0 ? intThreshStorage[i] : static_cast<int16_t>(intDist(rng));
+                }
+                const float* input = inputStorage.data() + misalign;
+                const float* thresh = threshStorage.data() + misalign;
+                const int16_t* intInput = intInputStorage.data() + misalign;
+                const int16_t* intThresh = intThreshStorage.data() + misalign;
+
+                const int numWords = std::max(1, CrossingKernels::numMaskWords(n));
+                std::vector<uint64_t> mask(numWords, ~uint64_t(0));
+                std::vector<bool> bits(n);
+
+                for (int i = 0; i < n; ++i) bits[i] = input[i] > thresh[i];
+                CrossingKernels::computeAboveMask(input, thresh, n, mask.data());
+                check(maskEquals(mask, bits), what + ": float above-mask, threshold array");
+
+                if (n > 0)
+                {
+                    for (int i = 0; i < n; ++i) bits[i] = input[i] > thresh[0];
+                    CrossingKernels::computeAboveMask(input, thresh[0], n, mask.data());
+                    check(maskEquals(mask, bits), what + ": float above-mask, constant threshold");
+
+                    for (int i = 0; i < n; ++i) bits[i] = intInput[i] > intThresh[0];
+                    CrossingKernels::computeAboveMask(intInput, intThresh[0], n, mask.data());
+                    check(maskEquals(mask, bits), what + ": int16 above-mask, constant threshold");
+                }
+
+                for (int i = 0; i < n; ++i) bits[i] = intInput[i] > intThresh[i];
+                CrossingKernels::computeAboveMask(intInput, intThresh, n, mask.data());
+                check(maskEquals(mask, bits), what + ": int16 above-mask, threshold array");
+
+                // several constant thresholds in one pass
+                const int stride = numWords + 1;
+                std::vector<uint64_t> masks(stride * numThresh);
+                CrossingKernels::computeAboveMasks(input, thresh, numThresh, n, masks.data(), stride);
+                std::vector<uint64_t> intMasks(stride * numThresh);
+                CrossingKernels::computeAboveMasks(intInput, intThresh, numThresh, n, intMasks.data(), stride);
+                for (int t = 0; t < numThresh && t < n; ++t)
+                {
+                    std::vector<uint64_t> one(masks.begin() + t * stride, masks.begin() + t * stride + numWords);
+                    for (int i = 0; i < n; ++i) bits[i] = input[i] > thresh[t];
+                    check(maskEquals(one, bits), what + ": float above-masks, threshold " + std::to_string(t));
+
+                    std::vector<uint64_t> intOne(intMasks.begin() + t * stride, intMasks.begin() + t * stride + numWords);
+                    for (int i = 0; i < n; ++i) bits[i] = intInput[i] > intThresh[t];
+                    check(maskEquals(intOne, bits), what + ": int16 above-masks, threshold " + std::to_string(t));
+                }
+
+                // popcounts over ranges
+                for (int i = 0; i < n; ++i) bits[i] = input[i] > thresh[i];
+                CrossingKernels::computeAboveMask(input, thresh, n, mask.data());
+                for (int from = 0; from <= n; from += std::max(1, n / 13))
+                {
+                    for (int to = from - 1; to <= n; to += std::max(1, n / 11))
+                    {
+                        const int expected = to > from ? static_cast<int>(std::count(bits.begin() + from, bits.begin() + to, true)) : 0;
+                        check(CrossingKernels::countSetBits(mask.data(), from, to) == expected,
+                            what + ": countSetBits(" + std::to_string(from) + ", " + std::to_string(to) + ")");
+                    }
+                }
+
+                if (n == 0)
+                {
+                    continue;
+                }
+
+                // crossing masks for each combination of directions, then scans over them
+                const std::vector<uint64_t> above = mask;
+                for (int directions = 0; directions < 4; ++directions)
+                {
+                    for (bool prevAbove : { false, true })
+                    {
+                        const bool rising = (directions & 1) != 0;
+                        const bool falling = (directions & 2) != 0;
+                        std::vector<uint64_t> crossings = above;
+                        const bool lastAbove = CrossingKernels::aboveToCrossings(crossings.data(), n, prevAbove,
+                            rising, falling);
+
+                        std::vector<bool> crossingBits(n);
+                        for (int i = 0; i < n; ++i)
+                        {
+                            const bool prev = i > 0 ? bits[i - 1] : prevAbove;
+                            crossingBits[i] = prev != bits[i] && (bits[i] ? rising : falling);
+                        }
+                        const std::string dirWhat = what + ", directions " + std::to_string(directions) +
+                            (prevAbove ? ", previous above" : "");
+                        check(maskEquals(crossings, crossingBits), dirWhat + ": aboveToCrossings");
+                        check(lastAbove == bits[n - 1], dirWhat + ": aboveToCrossings return value");
+
+                        for (int from = -1; from <= n + 1; ++from)
+                        {
+                            int expected = -1;
+                            for (int i = std::max(0, from); i < n && expected < 0; ++i)
+                            {
+                                expected = crossingBits[i] ? i : -1;
+                            }
+                            if (!check(CrossingKernels::findNextSet(crossings.data(), n, from) == expected,
+                                dirWhat + ": findNextSet from " + std::to_string(from)))
+                            {
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void testPendingEventQueue()
+    {
+        struct Item
+        {
+            int64_t timestamp;
+            int id;
+        };
+
+        const int capacity = 100;
+        PendingEventQueue<Item> queue;
+        queue.setCapacity(capacity);
+
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<int> tsDist(0, 50);
+        for (int i = 0; i < capacity; ++i)
+        {
+            check(queue.push({ tsDist(rng), i }), "queue: push within capacity");
+        }
+        check(queue.isFull() && !queue.push({ 0, capacity }), "queue: push fails when full");
+
+        queue.removeIf([](const Item& item) { return item.id % 3 == 0; });
+        const int expectedSize = capacity - (capacity + 2) / 3;
+        check(queue.size() == expectedSize, "queue: removeIf removes matching elements");
+
+        int64_t last = std::numeric_limits<int64_t>::min();
+        int numPopped = 0;
+        bool ordered = true;
+        while (!queue.isEmpty())
+        {
+            ordered = ordered && queue.top().timestamp >= last && queue.top().id % 3 != 0;
+            last = queue.top().timestamp;
+            queue.pop();
+            ++numPopped;
+        }
+        check(ordered, "queue: pops in timestamp order");
+        check(numPopped == expectedSize, "queue: pops every element");
+    }
+
+    void printUsage()
+    {
+        std::printf("Usage: CrossingTests [--seconds <s>] [--file <path>]\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = 1.0;
+    std::string filePath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc)
+        {
+            seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--file" && i + 1 < argc)
+        {
+            filePath = argv[++i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<float> recorded;
+    if (!filePath.empty() && !loadSignal(filePath, recorded))
+    {
+        std::fprintf(stderr, "Could not read samples from %s\n", filePath.c_str());
+        return 1;
+    }
+
+    const int numSamples = std::max(4096, static_cast<int>(seconds * SAMPLE_RATE));
+    const TestData data = makeTestData(numSamples, recorded);
+    const std::vector<Blocks> schedules = makeSchedules(numSamples);
+
+#if CROSSING_KERNELS_AVX
+    std::printf("Kernels: AVX\n");
+#elif CROSSING_KERNELS_SSE2
+    std::printf("Kernels: SSE2\n");
+#elif CROSSING_KERNELS_NEON
+    std::printf("Kernels: NEON\n");
+#else
+    std::printf("Kernels: scalar\n");
+#endif
+
+    testKernels();
+    testPendingEventQueue();
+    testDetection(data, schedules);
+    testDecimation(data, schedules);
+    testAmplitudeAverage(data, schedules);
+    testAmplitudePercentile(data, schedules);
+
+    if (numFailures > 0)
+    {
+        std::printf("\n%d check(s) failed\n", numFailures);
+        return 1;
+    }
+
+    std::printf("\nAll checks passed\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory, MGH
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TEST_SIGNALS_H_INCLUDED
+#define TEST_SIGNALS_H_INCLUDED
+
+/*
+Input signals shared by the tests (Test/CrossingTests.cpp) and the benchmark
+(Benchmark/CrossingBenchmark.cpp): synthetic signals, and recordings read from raw float32 files.
+
+All signals are on a unit scale, so that the same detector settings make sense for all of them.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace TestSignals
+{
+    const double SAMPLE_RATE = 30000.0;
+    const double PI = 3.14159265358979323846;
+
+    enum SignalType { SIGNAL_SINE, SIGNAL_NOISE, SIGNAL_SPIKES, SIGNAL_PHASE, NUM_SIGNAL_TYPES };
+    const char* const signalNames[] = { "sine", "noise", "spikes", "phase" };
+
+    inline std::vector<float> makeSignal(SignalType type, int numSamples, unsigned int seed)
+    {
+        std::vector<float> signal(numSamples);
+        std::mt19937 rng(seed);
+
+        switch (type)
+        {
+        case SIGNAL_SINE:
+        {
+            // 40 Hz oscillation with enough noise for some jittery crossings
+            std::normal_distribution<float> noise(0.0f, 0.2f);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                signal[i] = static_cast<float>(std::sin(2 * PI * 40.0 * i / SAMPLE_RATE)) + noise(rng);
+            }
+            break;
+        }
+
+        case SIGNAL_NOISE:
+        {
+            // crossings nearly every other sample (worst case for the event rate)
+            std::normal_distribution<float> noise(0.0f, 1.0f);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                signal[i] = noise(rng);
+            }
+            break;
+        }
+
+        case SIGNAL_SPIKES:
+        {
+            // slow oscillation with single-sample artifacts, for the jump limit
+            std::normal_distribution<float> noise(0.0f, 0.1f);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                signal[i] = 0.5f * static_cast<float>(std::sin(2 * PI * 5.0 * i / SAMPLE_RATE)) + noise(rng);
+                const float u = unit(rng);
+                if (u < 0.003f)
+                {
+                    signal[i] += u < 0.0015f ? 3.0f : -3.0f;
+                }
+            }
+            break;
+        }
+
+        case SIGNAL_PHASE:
+        {
+            // wrapped phase in [-1, 1) (i.e. in units of 180 degrees) with slowly wandering
+            // frequency, like the Phase Calculator's output
+            std::normal_distribution<double> drift(0.0, 0.002);
+            double phase = 0, freq = 8.0;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                freq = std::min(12.0, std::max(4.0, freq + drift(rng)));
+                phase = std::fmod(phase + 2.0 * freq / SAMPLE_RATE, 2.0);
+                signal[i] = static_cast<float>(phase >= 1.0 ? phase - 2.0 : phase);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        return signal;
+    }
+
+    /** Reads raw little-endian float32 samples and normalizes them to zero mean and unit
+     *  variance. Returns false if the file can't be read or is empty.
+     */
+    inline bool loadSignal(const std::string& path, std::vector<float>& signal)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            return false;
+        }
+
+        std::streamoff numBytes = file.tellg();
+        signal.resize(static_cast<size_t>(numBytes / sizeof(float)));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(signal.data()), signal.size() * sizeof(float));
+        if (signal.empty())
+        {
+            return false;
+        }
+
+        double sum = 0, sumSquares = 0;
+        for (float x : signal)
+        {
+            sum += x;
+            sumSquares += static_cast<double>(x) * x;
+        }
+        const double mean = sum / signal.size();
+        const double sd = std::sqrt(std::max(0.0, sumSquares / signal.size() - mean * mean));
+        for (float& x : signal)
+        {
+            x = static_cast<float>((x - mean) / (sd > 0 ? sd : 1.0));
+        }
+        return true;
+    }
+
+    /** numSamples of a loaded recording, starting part / numParts of the way through it (and
+     *  wrapping around), so that channels reading the same recording don't cross at the same time.
+     */
+    inline std::vector<float> excerpt(const std::vector<float>& recorded, int numSamples, int part, int numParts)
+    {
+        std::vector<float> signal(numSamples);
+        const size_t offset = (recorded.size() / numParts) * part;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            signal[i] = recorded[(offset + i) % recorded.size()];
+        }
+        return signal;
+    }
+}
+
+#endif // TEST_SIGNALS_H_INCLUDED